@@ -0,0 +1,27 @@
+#!/bin/bash
+
+set -e
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+# Build and run pathtracer_bench, writing bench-<commit>.json in the repo root.
+# Extra arguments are passed through, e.g. ./scripts/bench.sh --scene procedural:1M
+
+REVISION=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if ! git diff --quiet HEAD 2>/dev/null; then
+    REVISION="${REVISION}-dirty"
+fi
+OUTPUT="$(pwd)/bench-${REVISION}.json"
+
+echo -e "${YELLOW}Building pathtracer_bench...${NC}"
+cmake -S . -B build > /dev/null
+cmake --build build --target pathtracer_bench
+
+echo -e "${BLUE}Benchmarking ${REVISION}...${NC}"
+cd build
+./pathtracer_bench --label "${REVISION}" --output "${OUTPUT}" "$@"
+
+echo -e "${GREEN}Results: ${OUTPUT}${NC}"
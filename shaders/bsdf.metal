@@ -20,9 +20,9 @@ inline float fresnelSchlick(float cosTheta, float F0) {
     return F0 + (1.0 - F0) * pow(1 - cosTheta, 5);
 }
 
-// cosine-weighted hemisphere
-inline float3 randomHemisphere(float3 N, thread uint &st) {
-    float u = rand01(st), v = rand01(st);
+// cosine-weighted hemisphere from a uniform 2D sample
+inline float3 randomHemisphere(float3 N, float2 uv) {
+    float u = uv.x, v = uv.y;
     float r     = sqrt(u),
           theta = 2.0f * M_PI_F * v;
     float3 s = float3(r*cos(theta), r*sin(theta), sqrt(1 - u));
@@ -30,4 +30,9 @@ inline float3 randomHemisphere(float3 N, thread uint &st) {
     float3 tangent = normalize(cross(up, N));
     float3 bitan   = cross(N, tangent);
     return normalize(s.x*tangent + s.y*bitan + s.z*N);
-}
\ No newline at end of file
+}
+// power heuristic (beta = 2) for a sample of density `pdf` against `other`
+inline float powerHeuristic(float pdf, float other) {
+    float r = other / pdf;
+    return 1.0 / (1.0 + r*r);
+}
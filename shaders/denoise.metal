@@ -0,0 +1,78 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// Edge-aware à-trous denoiser; mirrors src/Cpu/Denoiser.cpp. denoise_prepare divides
+// the accumulation by the first-hit albedo, then denoise_atrous runs once per pass
+// with its taps `step` pixels apart and multiplies the albedo back in on the last.
+
+constant float kDenoiseKernel[3]   = {3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0}; // B3 spline, by |offset|
+constant float kDenoiseGaussian[2] = {0.5, 0.25};
+
+inline float3 demodulator(float4 albedo) { return max(albedo.xyz, float3(1e-3)); }
+
+// demodulated radiance, w = variance of the pixel mean's luminance
+kernel void denoise_prepare(texture2d<float, access::read>  accum      [[texture(0)]],
+                            texture2d<float, access::read>  albedo     [[texture(1)]],
+                            texture2d<float, access::write> dst        [[texture(3)]],
+                            uint2                           gid        [[thread_position_in_grid]]) {
+    if (gid.x >= dst.get_width() || gid.y >= dst.get_height()) return;
+    float4 color = accum.read(gid);
+    float4 a     = albedo.read(gid);
+    float  mean  = luminance(color.xyz);
+    float  variance = max(a.w - mean*mean, 0.0) / color.w; // w = samples in the pixel
+    float3 d  = demodulator(a);
+    float  ld = luminance(d);
+    dst.write(float4(color.xyz / d, variance / (ld*ld)), gid);
+}
+
+kernel void denoise_atrous(texture2d<float, access::read>  src         [[texture(0)]],
+                           texture2d<float, access::read>  albedo      [[texture(1)]],
+                           texture2d<float, access::read>  normalDepth [[texture(2)]],
+                           texture2d<float, access::write> dst         [[texture(3)]],
+                           constant DenoisePass            &pass       [[buffer(0)]],
+                           uint2                           gid         [[thread_position_in_grid]]) {
+    int2 size = int2(src.get_width(), src.get_height());
+    int2 p    = int2(gid);
+    if (any(p >= size)) return;
+
+    float4 center = src.read(gid);
+    float4 guide  = normalDepth.read(gid);
+
+    // variance estimates from a few samples are noisy themselves: blur them 3x3 first
+    float variance = 0.0;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int2 q = p + int2(dx, dy);
+            if (any(q < 0) || any(q >= size)) continue;
+            variance += kDenoiseGaussian[abs(dx)] * kDenoiseGaussian[abs(dy)] * src.read(uint2(q)).w;
+        }
+    }
+    float invSigmaL = 1.0 / (pass.colorSigma * sqrt(variance) + 1e-4);
+    float invNormal = 1.0 / (pass.normalSigma * pass.normalSigma);
+    float lp = luminance(center.xyz);
+
+    float  sumW = 0.0, sumVar = 0.0;
+    float3 sum  = float3(0.0);
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+            int2 q = p + int(pass.step) * int2(dx, dy);
+            if (any(q < 0) || any(q >= size)) continue;
+            float4 c = src.read(uint2(q));
+            float4 g = normalDepth.read(uint2(q));
+            float  distance = float(pass.step) * float(max(abs(dx), abs(dy)));
+            float3 dn = guide.xyz - g.xyz;
+
+            float e = abs(lp - luminance(c.xyz)) * invSigmaL
+                    + dot(dn, dn) * invNormal
+                    + abs(guide.w - g.w) / (pass.depthSigma * max(distance, 1.0) * max(min(guide.w, g.w), 1e-6));
+            float w = kDenoiseKernel[abs(dx)] * kDenoiseKernel[abs(dy)] * exp(-e);
+            sumW   += w;
+            sum    += w * c.xyz;
+            sumVar += w * w * c.w;
+        }
+    }
+    // the centre tap always has weight
+    float4 result = float4(sum / sumW, sumVar / (sumW*sumW));
+    if (pass.last) result = float4(result.xyz * demodulator(albedo.read(gid)), 1.0);
+    dst.write(result, gid);
+}
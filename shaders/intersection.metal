@@ -2,15 +2,15 @@ struct Ray { float3 origin, dir; };
 
 
 // returns (t, normal, albedo) or t<0 if miss
-inline float intersectTriangle(SceneTriangle tri, Ray r,
+inline float intersectTriangle(float3 v0, float3 v1, float3 v2, Ray r,
                                thread float3 &outN) {
     const float EPS = 1e-6;
-    float3 e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0;
+    float3 e1 = v1 - v0, e2 = v2 - v0;
     float3 p = cross(r.dir, e2);
     float  det = dot(e1, p);
     if (fabs(det) < EPS) return -1.0;
     float inv = 1.0/det;
-    float3 tvec = r.origin - tri.v0;
+    float3 tvec = r.origin - v0;
     float u = dot(tvec,p)*inv;
     if (u<0||u>1) return -1.0;
     float3 q = cross(tvec, e1);
@@ -55,4 +55,15 @@ inline bool intersectAABB(float3 mn, float3 mx, Ray r) {
     float tnear = max(max(tmin.x, tmin.y), tmin.z);
     float tfar  = min(min(tmax.x, tmax.y), tmax.z);
     return tfar >= max(tnear, 0.0);
-}
\ No newline at end of file
+}
+
+// Where the ray enters the box (0 from inside), or INFINITY when it misses it or
+// only gets there at or beyond tMax; inv is 1 / r.dir.
+inline float aabbEntry(float3 mn, float3 mx, Ray r, float3 inv, float tMax) {
+    float3 t0  = (mn - r.origin) * inv;
+    float3 t1  = (mx - r.origin) * inv;
+    float3 tmin = min(t0, t1), tmax = max(t0, t1);
+    float tnear = max(max(max(tmin.x, tmin.y), tmin.z), 0.0);
+    float tfar  = min(min(tmax.x, tmax.y), tmax.z);
+    return tfar >= tnear && tnear < tMax ? tnear : INFINITY;
+}
@@ -1,17 +1,391 @@
 #include <metal_stdlib>
 #include "types.metal"
 #include "rng.metal"
+#include "sampler.metal"
 #include "bsdf.metal"
 #include "intersection.metal"
+#include "denoise.metal"
+#include "reproject.metal"
 
 using namespace metal;
 
-// maximum bounces per sample
+// traversal stack entries; trees are at most kMaxBvhDepth (src/Bvh/BvhBuilder.h)
+// deep, and ordered traversal keeps fewer entries than that
 #define MAX_STACK_DEPTH 32
+// maximum bounces per sample
 #define MAX_BOUNCES 20
 
+// A postponed node and where the ray enters its box.
+struct TraversalEntry {
+    uint  node;
+    float t;
+};
+
+// Hits closer than bestT against one bottom-level BVH; ray and normal in object
+// space. Children are visited near to far, only the farther one waits on the stack,
+// and entries behind bestT are dropped, as traverseBvh in src/Cpu/Integrator.h.
+// With anyHit it returns true at the first hit, leaving bestT, bestN and bestMat.
+inline bool intersectBLAS(device const BVHNode       *bvhNodes,
+                          device const SceneTriangle *triangles,
+                          device const packed_float3 *vertices,
+                          uint                        root,
+                          Ray                         ray,
+                          thread float               &bestT,
+                          thread float3              &bestN,
+                          thread uint                &bestMat,
+                          bool                        anyHit
+                          TRAVERSAL_STATS_PARAM) {
+    float3 inv = 1.0 / ray.dir;
+    TRAVERSAL_STAT(stats.nodes++; stats.aabbTests++;)
+    if (isinf(aabbEntry(bvhNodes[root].bboxMin, bvhNodes[root].bboxMax, ray, inv, bestT))) return false;
+
+    TraversalEntry stack[MAX_STACK_DEPTH];
+    int  sp = 0;
+    uint ni = root;
+    while (true) {
+        BVHNode node = bvhNodes[ni];
+        if (node.count > 0) {
+            TRAVERSAL_STAT(stats.triangleTests += node.count;)
+            uint start = node.leftFirst;
+            for (uint i=0; i<node.count; ++i) {
+                SceneTriangle tri = triangles[start+i];
+                float3 nTmp;
+                float  t = intersectTriangle(vertices[tri.v0], vertices[tri.v1], vertices[tri.v2], ray, nTmp);
+                if (t > 0.0 && t < bestT) {
+                    if (anyHit) return true;
+                    bestT   = t;
+                    bestN   = nTmp;
+                    bestMat = tri.matIndex;
+                }
+            }
+        } else {
+            TRAVERSAL_STAT(stats.aabbTests += 2;)
+            uint  first   = node.leftFirst;
+            uint  second  = node.rightFirst;
+            float tFirst  = aabbEntry(bvhNodes[first].bboxMin, bvhNodes[first].bboxMax, ray, inv, bestT);
+            float tSecond = aabbEntry(bvhNodes[second].bboxMin, bvhNodes[second].bboxMax, ray, inv, bestT);
+            if (tSecond < tFirst) {
+                uint  n = first; first = second; second = n;
+                float t = tFirst; tFirst = tSecond; tSecond = t;
+            }
+            if (!isinf(tFirst)) {
+                if (!isinf(tSecond)) {
+                    if (sp < MAX_STACK_DEPTH) {
+                        stack[sp++] = TraversalEntry{second, tSecond};
+                        TRAVERSAL_STAT(stats.stackHighWater = max(stats.stackHighWater, uint(sp));)
+                    } else {
+                        TRAVERSAL_STAT(stats.stackOverflows++;)
+                    }
+                }
+                ni = first;
+                TRAVERSAL_STAT(stats.nodes++;)
+                continue;
+            }
+        }
+        while (sp > 0 && stack[sp-1].t >= bestT) --sp;
+        if (sp == 0) return false;
+        ni = stack[--sp].node;
+        TRAVERSAL_STAT(stats.nodes++;)
+    }
+}
+
+// The scene's buffers, gathered so helpers can trace rays of their own.
+struct SceneBuffers {
+    device const SceneTriangle *triangles;
+    device const packed_float3 *vertices;
+    device const BVHNode       *bvhNodes;
+    device const SceneInstance *instances;
+    device const BVHNode       *tlasNodes;
+    uint                        tlasNodeCount;
+    device const ScenePlane    *planes;
+    uint                        planeCount;
+    device const SceneSphere   *spheres;
+    uint                        sphereCount;
+    device const Material      *materials;
+    device const SceneLight    *lights;
+    uint                        lightCount;
+    float                       lightPower; // sum of area * emitted luminance
+};
+
+// Instances hit closer than bestT, each traced in object space by intersectBLAS;
+// the TLAS is walked the same way. With anyHit, true at the first hit.
+inline bool intersectTLAS(SceneBuffers   scene,
+                          Ray            ray,
+                          thread float  &bestT,
+                          thread float3 &bestN,
+                          thread uint   &bestMat,
+                          thread bool   &hitTriangle,
+                          bool           anyHit
+                          TRAVERSAL_STATS_PARAM) {
+    if (scene.tlasNodeCount == 0) return false;
+    float3 inv = 1.0 / ray.dir;
+    TRAVERSAL_STAT(stats.nodes++; stats.aabbTests++;)
+    if (isinf(aabbEntry(scene.tlasNodes[0].bboxMin, scene.tlasNodes[0].bboxMax, ray, inv, bestT))) return false;
+
+    TraversalEntry stack[MAX_STACK_DEPTH];
+    int  sp = 0;
+    uint ni = 0; // TLAS root node
+    while (true) {
+        BVHNode node = scene.tlasNodes[ni];
+        if (node.count > 0) {
+            for (uint i=0; i<node.count; ++i) {
+                // trace the instance in object space; t is unchanged because the
+                // direction is transformed without renormalising
+                SceneInstance inst = scene.instances[node.leftFirst+i];
+                Ray objRay;
+                objRay.origin = (inst.worldToObject * float4(ray.origin, 1.0)).xyz;
+                objRay.dir    = (inst.worldToObject * float4(ray.dir, 0.0)).xyz;
+                float  prevT  = bestT;
+                float3 nObj   = float3(0.0);
+                if (intersectBLAS(scene.bvhNodes, scene.triangles, scene.vertices, inst.blasRoot, objRay, bestT, nObj,
+                                  bestMat, anyHit TRAVERSAL_STATS_ARG)) return true;
+                if (bestT < prevT) {
+                    bestN       = normalize((transpose(inst.worldToObject) * float4(nObj, 0.0)).xyz);
+                    hitTriangle = true;
+                }
+            }
+        } else {
+            TRAVERSAL_STAT(stats.aabbTests += 2;)
+            uint  first   = node.leftFirst;
+            uint  second  = node.rightFirst;
+            float tFirst  = aabbEntry(scene.tlasNodes[first].bboxMin, scene.tlasNodes[first].bboxMax, ray, inv, bestT);
+            float tSecond = aabbEntry(scene.tlasNodes[second].bboxMin, scene.tlasNodes[second].bboxMax, ray, inv, bestT);
+            if (tSecond < tFirst) {
+                uint  n = first; first = second; second = n;
+                float t = tFirst; tFirst = tSecond; tSecond = t;
+            }
+            if (!isinf(tFirst)) {
+                if (!isinf(tSecond)) {
+                    if (sp < MAX_STACK_DEPTH) {
+                        stack[sp++] = TraversalEntry{second, tSecond};
+                        TRAVERSAL_STAT(stats.stackHighWater = max(stats.stackHighWater, uint(sp));)
+                    } else {
+                        TRAVERSAL_STAT(stats.stackOverflows++;)
+                    }
+                }
+                ni = first;
+                TRAVERSAL_STAT(stats.nodes++;)
+                continue;
+            }
+        }
+        while (sp > 0 && stack[sp-1].t >= bestT) --sp;
+        if (sp == 0) return false;
+        ni = stack[--sp].node;
+        TRAVERSAL_STAT(stats.nodes++;)
+    }
+}
+
+// Closest hit in world space; returns t, or 1e20 on a miss.
+inline float intersectScene(SceneBuffers   scene,
+                            Ray            ray,
+                            thread float3 &bestN,
+                            thread uint   &bestMat,
+                            thread bool   &hitTriangle
+                            TRAVERSAL_STATS_PARAM) {
+    float bestT = 1e20;
+    bestN       = float3(0.0);
+    bestMat     = 0;
+    hitTriangle = false;
+
+    intersectTLAS(scene, ray, bestT, bestN, bestMat, hitTriangle, false TRAVERSAL_STATS_ARG);
+
+    TRAVERSAL_STAT(stats.primitiveTests += scene.planeCount + scene.sphereCount;)
+    for (uint i = 0; i < scene.planeCount; ++i) {
+        float3 nTmp;
+        float  t = intersectPlane(scene.planes[i], ray, nTmp);
+        if (t > 0.0 && t < bestT) {
+            bestT       = t;
+            bestN       = nTmp;
+            bestMat     = scene.planes[i].matIndex;
+            hitTriangle = false;
+        }
+    }
+
+    // Spheres
+    for (uint i = 0; i < scene.sphereCount; ++i) {
+        float3 nTmp;
+        float  t = intersectSphere(scene.spheres[i], ray, nTmp);
+        if (t > 0.0 && t < bestT) {
+            bestT       = t;
+            bestN       = nTmp;
+            bestMat     = scene.spheres[i].matIndex;
+            hitTriangle = false;
+        }
+    }
+    return bestT;
+}
+
+// solid-angle density of light sampling towards an emitter hit at distance t
+inline float lightPdf(SceneBuffers scene, float emitted, float t, float3 n, float3 dir) {
+    float cosL = abs(dot(n, dir));
+    return cosL > 0.0 ? emitted / scene.lightPower * t*t / cosL : INFINITY;
+}
+
+// a light sample whose shadow ray has not been traced yet
+struct LightSample {
+    Ray    shadow;
+    float  distance;
+    float3 radiance; // what arrives if nothing is in between
+};
+
+// Direct light at a diffuse vertex from one point on a light picked by power,
+// MIS-weighted against the diffuse bounce (see src/Cpu/Integrator.h). False when
+// the sample cannot contribute; otherwise its shadow ray still has to be traced.
+inline bool drawLightSample(SceneBuffers scene, float3 P, float3 n, float3 albedo, float pDiffuse,
+                            thread Sampler &sampler, thread LightSample &out) {
+    float2 u = get2D(sampler);
+    uint pick = min(uint(u.x * float(scene.lightCount)), scene.lightCount - 1);
+    if (u.y >= scene.lights[pick].prob) pick = scene.lights[pick].alias;
+    SceneLight light = scene.lights[pick];
+
+    // uniform point on the triangle
+    float2 ab = get2D(sampler);
+    float a = ab.x, b = ab.y;
+    if (a + b > 1.0) {
+        a = 1.0 - a;
+        b = 1.0 - b;
+    }
+    float3 e1 = light.e1, e2 = light.e2;
+    float3 toLight = float3(light.v0) + a*e1 + b*e2 - P;
+    float  dist    = length(toLight);
+    float3 wi      = toLight / dist;
+    float  cosS    = dot(n, wi);
+    if (cosS <= 0.0) return false;
+
+    float3 emission = scene.materials[light.matIndex].emission;
+    float  pdfLight = lightPdf(scene, luminance(emission), dist, normalize(cross(e1, e2)), wi);
+    if (isinf(pdfLight)) return false;
+
+    float pdfBsdf = pDiffuse * cosS * M_1_PI_F;
+    out.shadow.origin = P + n*0.001;
+    out.shadow.dir    = wi;
+    out.distance      = dist;
+    out.radiance      = albedo * M_1_PI_F * emission * (cosS / pdfLight * powerHeuristic(pdfLight, pdfBsdf));
+    return true;
+}
+
+// Whether anything lies along the ray in (0, tMax). Stops at the first hit found, so
+// shadow and visibility rays never look for the closest one; cheap primitives first.
+inline bool anyHitScene(SceneBuffers scene, Ray ray, float tMax TRAVERSAL_STATS_PARAM) {
+    TRAVERSAL_STAT(stats.primitiveTests += scene.planeCount + scene.sphereCount;)
+    float3 nTmp;
+    for (uint i = 0; i < scene.planeCount; ++i) {
+        float t = intersectPlane(scene.planes[i], ray, nTmp);
+        if (t > 0.0 && t < tMax) return true;
+    }
+    for (uint i = 0; i < scene.sphereCount; ++i) {
+        float t = intersectSphere(scene.spheres[i], ray, nTmp);
+        if (t > 0.0 && t < tMax) return true;
+    }
+    uint matTmp;
+    bool triTmp;
+    return intersectTLAS(scene, ray, tMax, nTmp, matTmp, triTmp, true TRAVERSAL_STATS_ARG);
+}
+
+// whether anything blocks the sample's shadow ray before the light
+inline bool occluded(SceneBuffers scene, LightSample sample TRAVERSAL_STATS_PARAM) {
+    return anyHitScene(scene, sample.shadow, sample.distance*0.999 TRAVERSAL_STATS_ARG);
+}
+
+// drawLightSample with its shadow ray traced
+inline float3 sampleLight(SceneBuffers scene, float3 P, float3 n, float3 albedo, float pDiffuse,
+                          thread Sampler &sampler TRAVERSAL_STATS_PARAM) {
+    LightSample sample;
+    if (!drawLightSample(scene, P, n, albedo, pDiffuse, sampler, sample) || occluded(scene, sample TRAVERSAL_STATS_ARG)) {
+        return float3(0.0);
+    }
+    return sample.radiance;
+}
+
+// The steps of a path vertex, shared by path_trace and the wavefront kernels in
+// wavefront.metal, as in src/Cpu/Integrator.h.
+
+inline float3 skyRadiance(float3 dir) {
+    float tt = 0.5*(normalize(dir).y + 1.0);
+    return mix(float3(0.2), float3(0.005, 0.007, 0.01), tt);
+}
+
+// denoiser features of a camera ray's hit, as PathAovs in src/Cpu/Integrator.h
+inline void firstHitAovs(Material mat, Ray ray, float t, float3 n, thread float3 &albedo, thread float4 &normalDepth) {
+    bool plain  = mat.ior <= 1.0 && mat.reflectivity < 1.0 && luminance(mat.emission) <= 0.0;
+    albedo      = plain ? mat.albedo : float3(1.0);
+    normalDepth = float4(dot(ray.dir, n) < 0.0 ? n : -n, t);
+}
+
+// MIS weight of emission found at a hit that light sampling at the previous vertex
+// (whose bounce had density bsdfPdf, 0 if it sampled no lights) could have found too
+inline float emissionWeight(SceneBuffers scene, Material mat, float t, float3 n, bool hitTriangle, float3 dir,
+                            float bsdfPdf) {
+    float emitted = luminance(mat.emission);
+    if (bsdfPdf > 0.0 && hitTriangle && emitted > 0.0) {
+        return powerHeuristic(bsdfPdf, lightPdf(scene, emitted, t, n, dir));
+    }
+    return 1.0;
+}
+
+// Russian roulette termination after 4 bounces; false ends the path
+inline bool survivesRoulette(uint bounce, thread float3 &throughput, thread Sampler &sampler) {
+    if (bounce < 4) return true;
+    // probability of survival = max RGB throughput, clamped to [0.05,1]
+    float p_rr = max(max(throughput.x, throughput.y), throughput.z);
+    p_rr = clamp(p_rr, 0.05, 1.0);
+    if (get1D(sampler) > p_rr) {
+        return false;
+    }
+    throughput /= p_rr;
+    return true;
+}
+
+// ior > 1: reflect or refract by Fresnel
+inline void scatterDielectric(Material mat, float3 bestN, float3 P, thread Ray &ray, thread Sampler &sampler) {
+    // compute cosine of incidence
+    float cosI = dot(ray.dir, bestN);
+    bool entering = cosI < 0.0;
+    float3 N = entering ? bestN : -bestN;
+
+    // decide indices
+    float eta_i = entering ? 1.0 : mat.ior;
+    float eta_t = entering ? mat.ior : 1.0;
+    float eta   = eta_i / eta_t;
+
+    // base reflectance at normal incidence
+    float F0 = pow((eta_i - eta_t)/(eta_i + eta_t), 2.0);
+    float R  = fresnelSchlick(fabs(cosI), F0);
+
+    if (get1D(sampler) < R) {
+        // reflect
+        ray.origin = P + N*0.001;
+        ray.dir    = reflectDir(ray.dir,N);
+    } else {
+        // refract
+        ray.origin = P - N*0.001;
+        ray.dir    = refractDir(ray.dir,N,eta);
+    }
+}
+
+// mirror/diffuse mix: pick a lobe by reflectivity and continue along it
+inline void scatterSurface(Material mat, float3 bestN, float3 P, bool sampledLights, thread Ray &ray,
+                           thread float3 &throughput, thread float &bsdfPdf, thread Sampler &sampler) {
+    float p_spec = mat.reflectivity;
+    float p_diff = 1.0 - p_spec;
+    float u_b    = get1D(sampler);
+
+    if (u_b < p_spec) {
+        ray.origin  = P + bestN * 0.001;
+        ray.dir     = reflectDir(ray.dir, bestN);
+        throughput *= (1.0 / p_spec);
+    } else {
+        ray.origin  = P + bestN * 0.001;
+        ray.dir     = randomHemisphere(bestN, get2D(sampler));
+        throughput *= mat.albedo / p_diff;
+        if (sampledLights) bsdfPdf = p_diff * dot(bestN, ray.dir) * M_1_PI_F;
+    }
+}
+
 kernel void path_trace(
     texture2d<float, access::read_write> outTex   [[texture(0)]],
+    texture2d<float, access::read_write> albedoTex [[texture(1)]], // first-hit albedo, w = mean of lum(L)^2
+    texture2d<float, access::read_write> normalDepthTex [[texture(2)]], // first-hit normal, w = depth
     device const SceneTriangle           *triangles [[buffer(1)]],
     constant uint                        &triCount  [[buffer(2)]],
     device const ScenePlane              *planes    [[buffer(3)]],
@@ -24,17 +398,34 @@ kernel void path_trace(
     constant Camera                      &cam        [[ buffer(10) ]],
     device const BVHNode                 *bvhNodes     [[buffer(11)]],
     constant uint                        &bvhNodeCount [[buffer(12)]],
+    device const SceneInstance           *instances    [[buffer(13)]],
+    constant uint                        &instanceCount[[buffer(14)]],
+    device const BVHNode                 *tlasNodes    [[buffer(15)]],
+    constant uint                        &tlasNodeCount[[buffer(16)]],
+    device const packed_float3           *vertices     [[buffer(17)]],
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    device RayStats                      *pixelStats   [[buffer(18)]],
+#endif
+    device const SceneLight              *lights       [[buffer(19)]],
+    constant uint                        &lightCount   [[buffer(20)]],
+    constant float                       &lightPower   [[buffer(21)]],
+    constant uint                        &samplerType  [[buffer(22)]],
+    constant uint                        &history      [[buffer(28)]], // 0: the textures hold no samples for this camera
     uint2                                gid       [[thread_position_in_grid]]
 ) {
     uint W = outTex.get_width(), H = outTex.get_height();
     if (gid.x>=W || gid.y>=H) return;
 
-// seed RNG per‐pixel+frame
-    thread uint st = gid.x + gid.y*W + frameIndex*1973;
+    SceneBuffers scene = {triangles, vertices, bvhNodes, instances, tlasNodes, tlasNodeCount,
+                          planes, planeCount, spheres, sphereCount, materials, lights, lightCount, lightPower};
+
+    // per‐pixel+frame random numbers
+    Sampler sampler = makeSampler(samplerType, gid, W, frameIndex, 0);
 
     // generate a tiny random offset in [0,1) for AA
-    float dx = rand01(st);
-    float dy = rand01(st);
+    float2 jitter = get2D(sampler);
+    float dx = jitter.x;
+    float dy = jitter.y;
 
     // initialize primary ray with jittered uv inside pixel
     float u = (float(gid.x) + dx) / float(W);
@@ -45,67 +436,25 @@ kernel void path_trace(
     ray.dir    = normalize(cam.lowerLeft + u*cam.horizontal + v*cam.vertical - cam.origin);
     float3 throughput = float3(1.0);
     float3 L = float3(0.0);
+    float bsdfPdf = 0.0; // of the last bounce if light was also sampled there, else 0
+    // first-hit features that guide the denoiser, as PathAovs in src/Cpu/Integrator.h
+    float3 aovAlbedo = float3(1.0);
+    float4 aovNormalDepth = float4(-ray.dir, MISS_DEPTH);
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    RayStats stats = {1, 0, 0, 0, 0, 0, 0, 0};
+#endif
 
     for (uint bounce = 0; bounce < MAX_BOUNCES; ++bounce) {
+        TRAVERSAL_STAT(stats.bounces++;)
+        startBounce(sampler, bounce);
         // 1) Find the nearest intersection
-        float  bestT   = 1e20;
-        float3 bestN   = float3(0.0);
-        uint   bestMat  = 0;
-
-        int stack[MAX_STACK_DEPTH];
-        int  sp = 0;
-        stack[sp++] = 0; // root node
-
-        while (sp > 0) {
-            int ni = stack[--sp];
-            BVHNode node = bvhNodes[ni];
-            if (!intersectAABB(node.bboxMin, node.bboxMax, ray)) continue;
-            if (node.count > 0) {
-                int start = node.leftFirst;
-                for (uint i=0; i<node.count; ++i) {
-                    float3 nTmp;
-                    float  t = intersectTriangle(triangles[start+i], ray, nTmp);
-                    if (t > 0.0 && t < bestT) {
-                        bestT   = t;
-                        bestN   = nTmp;
-                        bestMat = triangles[start+i].matIndex;
-                    }
-                }
-            } else {
-                int left  = node.leftFirst;
-                int right = node.rightFirst;
-                if (sp + 2 <= MAX_STACK_DEPTH) {
-                    stack[sp++] = left;
-                    stack[sp++] = right;
-                }
-            }
-        }
-
-        for (uint i = 0; i < planeCount; ++i) {
-            float3 nTmp;
-            float  t = intersectPlane(planes[i], ray, nTmp);
-            if (t > 0.0 && t < bestT) {
-                bestT   = t;
-                bestN   = nTmp;
-                bestMat = planes[i].matIndex;
-            }
-        }
-
-        // Spheres
-        for (uint i = 0; i < sphereCount; ++i) {
-            float3 nTmp;
-            float  t = intersectSphere(spheres[i], ray, nTmp);
-            if (t > 0.0 && t < bestT) {
-                bestT   = t;
-                bestN   = nTmp;
-                bestMat = spheres[i].matIndex;
-            }
-        }
+        float3 bestN;
+        uint   bestMat;
+        bool   hitTriangle;
+        float  bestT = intersectScene(scene, ray, bestN, bestMat, hitTriangle TRAVERSAL_STATS_ARG);
 
         if (bestT > 1e19) {
-            float  tt  = 0.5*(normalize(ray.dir).y + 1.0);
-            float3 sky = mix(float3(0.2), float3(0.005, 0.007, 0.01), tt);
-            L += throughput * sky;
+            L += throughput * skyRadiance(ray.dir);
             break;
         }
 
@@ -113,71 +462,58 @@ kernel void path_trace(
         float3 P = ray.origin + bestT * ray.dir;
 
         Material mat = materials[bestMat];
+        if (bounce == 0) firstHitAovs(mat, ray, bestT, bestN, aovAlbedo, aovNormalDepth);
 
-        L += throughput * mat.emission;
-
-        // Russian roulette termination after 4 bounces
-        if (bounce >= 4) {
-            // probability of survival = max RGB throughput, clamped to [0.05,1]
-            float p_rr = max(max(throughput.x, throughput.y), throughput.z);
-            p_rr = clamp(p_rr, 0.05, 1.0);
-            if (rand01(st) > p_rr) {
-                break;
-            }
-            throughput /= p_rr;
-        }
+        L += throughput * mat.emission * emissionWeight(scene, mat, bestT, bestN, hitTriangle, ray.dir, bsdfPdf);
+        bsdfPdf = 0.0;
 
-        // compute cosine of incidence
-        float cosI = dot(ray.dir, bestN);
-        bool entering = cosI < 0.0;
-        float3 N = entering ? bestN : -bestN;
+        if (!survivesRoulette(bounce, throughput, sampler)) break;
 
         // if this material has an ior > 1, treat it as dielectric:
         if (mat.ior > 1.0) {
-            // decide indices
-            float eta_i = entering ? 1.0 : mat.ior;
-            float eta_t = entering ? mat.ior : 1.0;
-            float eta   = eta_i / eta_t;
-
-            // base reflectance at normal incidence
-            float F0 = pow((eta_i - eta_t)/(eta_i + eta_t), 2.0);
-            float R  = fresnelSchlick(fabs(cosI), F0);
-
-            if (rand01(st) < R) {
-                // reflect
-                ray.origin = P + N*0.001;
-                ray.dir    = reflectDir(ray.dir,N);
-            } else {
-                // refract
-                ray.origin = P - N*0.001;
-                ray.dir    = refractDir(ray.dir,N,eta);
-            }
+            scatterDielectric(mat, bestN, P, ray, sampler);
             continue;
         }
 
-        float p_spec = mat.reflectivity;
-        float p_diff = 1.0 - p_spec;
-        float u_b    = rand01(st);
-
-        if (u_b < p_spec) {
-            ray.origin  = P + bestN * 0.001;
-            ray.dir     = reflectDir(ray.dir, bestN);
-            throughput *= (1.0 / p_spec);
-        } else {
-            ray.origin  = P + bestN * 0.001;
-            ray.dir     = randomHemisphere(bestN, st);
-            throughput *= mat.albedo / p_diff;
+        bool sampleLights = lightCount > 0 && mat.reflectivity < 1.0;
+        if (sampleLights) {
+            L += throughput * sampleLight(scene, P, bestN, mat.albedo, 1.0 - mat.reflectivity, sampler TRAVERSAL_STATS_ARG);
         }
+        scatterSurface(mat, bestN, P, sampleLights, ray, throughput, bsdfPdf, sampler);
     }
 
-    // read & accumulate frame‐to‐frame
-    float4 prev = (frameIndex>0) ? outTex.read(gid) : float4(0);
-    float4 curr = float4(L,1.0);
-    float4 accum= (prev*float(frameIndex) + curr)/float(frameIndex+1);
+    // read & accumulate frame‐to‐frame; w counts the pixel's samples, which after
+    // a reprojection differs from pixel to pixel
+    float4 prev = history ? outTex.read(gid) : float4(0);
+    float  n    = prev.w;
+    float4 accum= float4((prev.xyz*n + L)/(n+1.0), n+1.0);
 
     outTex.write(accum, gid);
+
+    // the AOVs average the same way; albedo's w keeps lum(L)^2 for the variance
+    float  l = luminance(L);
+    float4 prevAlbedo = history ? albedoTex.read(gid) : float4(0);
+    float4 prevNormalDepth = history ? normalDepthTex.read(gid) : float4(0);
+    albedoTex.write((prevAlbedo*n + float4(aovAlbedo, l*l))/(n+1.0), gid);
+    normalDepthTex.write((prevNormalDepth*n + aovNormalDepth)/(n+1.0), gid);
+
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    device RayStats &px = pixelStats[gid.y*W + gid.x];
+    if (!history) px = RayStats{0, 0, 0, 0, 0, 0, 0, 0};
+    px.paths          += stats.paths;
+    px.bounces        += stats.bounces;
+    px.nodes          += stats.nodes;
+    px.aabbTests      += stats.aabbTests;
+    px.triangleTests  += stats.triangleTests;
+    px.primitiveTests += stats.primitiveTests;
+    px.stackHighWater  = max(px.stackHighWater, stats.stackHighWater);
+    px.stackOverflows += stats.stackOverflows;
+#endif
 }
 
+// the same integrator split into stages
+#include "wavefront.metal"
+
 // Vertex→fragment struct
 struct VSOut {
     float4 position [[position]];
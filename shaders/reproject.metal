@@ -0,0 +1,76 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// Temporal reprojection. When the camera moves, path_trace starts the frame with no
+// history and this kernel then pulls the accumulation of the previous frame across:
+// each pixel's first hit is projected into the previous camera, the four history
+// pixels around it are kept only where they saw the same surface (depth and normal
+// agree), and their bilinear mix is blended in as `n` earlier samples, n capped at
+// maxHistory. Rejected pixels (disocclusions, off-screen) restart from this frame's
+// sample. Accumulation w holds each pixel's sample count.
+
+// Where `cam` sees the direction `d` from its origin, in pixels (centres at +0.5);
+// false behind the camera.
+inline bool projectToPixel(Camera cam, float3 d, float2 size, thread float2 &pixel) {
+    float3 front = cam.lowerLeft + 0.5*cam.horizontal + 0.5*cam.vertical - cam.origin;
+    float  along = dot(d, front);
+    if (along <= 0.0) return false;
+    float3 q = d * (dot(front, front) / along) - (cam.lowerLeft - cam.origin);
+    float  u = dot(q, cam.horizontal) / dot(cam.horizontal, cam.horizontal);
+    float  v = dot(q, cam.vertical) / dot(cam.vertical, cam.vertical);
+    pixel = float2(u, 1.0 - v) * size;
+    return true;
+}
+
+kernel void reproject(texture2d<float, access::read_write> outTex             [[texture(0)]],
+                      texture2d<float, access::read_write> albedoTex          [[texture(1)]],
+                      texture2d<float, access::read_write> normalDepthTex     [[texture(2)]],
+                      texture2d<float, access::read>       historyTex         [[texture(3)]],
+                      texture2d<float, access::read>       historyAlbedo      [[texture(4)]],
+                      texture2d<float, access::read>       historyNormalDepth [[texture(5)]],
+                      constant Reprojection                &r                 [[buffer(0)]],
+                      uint2                                gid                [[thread_position_in_grid]]) {
+    int2 size = int2(outTex.get_width(), outTex.get_height());
+    if (any(int2(gid) >= size)) return;
+
+    // this frame's single sample
+    float4 normalDepth = normalDepthTex.read(gid);
+    bool   miss = normalDepth.w > 0.5 * MISS_DEPTH;
+    float2 uv   = (float2(gid) + 0.5) / float2(size);
+    float3 dir  = normalize(r.current.lowerLeft + uv.x*r.current.horizontal + (1.0 - uv.y)*r.current.vertical
+                            - r.current.origin);
+    // the sky is found by direction alone, surfaces by position
+    float3 d = miss ? dir : r.current.origin + normalDepth.w*dir - r.previous.origin;
+    float  expected = length(d);
+    float2 pixel;
+    if (!projectToPixel(r.previous, d, float2(size), pixel)) return;
+
+    float2 p    = pixel - 0.5;
+    int2   base = int2(floor(p));
+    float2 f    = p - floor(p);
+    float4 color = float4(0.0), albedo = float4(0.0), guide = float4(0.0);
+    float  sumW  = 0.0;
+    for (int tap = 0; tap < 4; ++tap) {
+        int2 q = base + int2(tap & 1, tap >> 1);
+        if (any(q < 0) || any(q >= size)) continue;
+        float4 h = historyNormalDepth.read(uint2(q));
+        if (miss != (h.w > 0.5 * MISS_DEPTH)) continue;
+        if (!miss && (abs(h.w - expected) > r.depthTolerance * expected || dot(h.xyz, normalDepth.xyz) < r.normalTolerance)) {
+            continue;
+        }
+        float w = ((tap & 1) ? f.x : 1.0 - f.x) * ((tap >> 1) ? f.y : 1.0 - f.y);
+        color  += w * historyTex.read(uint2(q));
+        albedo += w * historyAlbedo.read(uint2(q));
+        // depths were measured from the previous origin
+        guide  += w * float4(h.xyz, miss ? h.w : h.w * normalDepth.w / expected);
+        sumW   += w;
+    }
+    if (sumW < 1e-3) return;
+    color /= sumW, albedo /= sumW, guide /= sumW;
+
+    float  n    = min(color.w, float(r.maxHistory));
+    float4 curr = outTex.read(gid);
+    outTex.write(float4((color.xyz*n + curr.xyz) / (n + 1.0), n + curr.w), gid);
+    albedoTex.write((albedo*n + albedoTex.read(gid)) / (n + 1.0), gid);
+    normalDepthTex.write((guide*n + normalDepth) / (n + 1.0), gid);
+}
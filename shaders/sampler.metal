@@ -0,0 +1,123 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// Random numbers for one sample of one pixel; see src/Cpu/Sampler.h, which this
+// mirrors. All but SAMPLER_LCG are counter-based, one stream per dimension.
+#define SAMPLER_LCG       0 // the original per-pixel LCG
+#define SAMPLER_PCG       1 // PCG hashes per pixel, sample and dimension
+#define SAMPLER_SOBOL     2 // Owen-scrambled Sobol, shuffled per pixel and dimension
+#define SAMPLER_BLUENOISE 3 // one Sobol sequence, shifted per pixel by an R2 dither mask
+
+// dimensions restart at a fixed offset every bounce
+#define CAMERA_DIMENSIONS 2
+#define BOUNCE_DIMENSIONS 8
+
+struct Sampler {
+    uint type;
+    uint2 pixel;
+    uint sample;
+    uint seed;
+    uint pixelSeed;
+    uint dimension;
+    uint lcgState;
+};
+
+// PCG-RXS-M-XS hash (Jarzynski & Olano)
+inline uint pcgHash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline uint hashCombine(uint seed, uint v) {
+    return seed ^ (pcgHash(v) + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+}
+
+// Laine-Karras permutation: every bit flips depending only on the bits below it
+inline uint laineKarras(uint v, uint seed) {
+    v += seed;
+    v ^= v * 0x6C50B47Cu;
+    v ^= v * 0xB82F1E52u;
+    v ^= v * 0xC7AFE638u;
+    v ^= v * 0x8D22F6E6u;
+    return v;
+}
+
+// Burley's hash-based Owen scrambling
+inline uint owenScramble(uint v, uint seed) {
+    return reverse_bits(laineKarras(reverse_bits(v), seed));
+}
+
+// Sobol dimension 1 (Pascal matrix) with reversed bits; dimension 0 reversed is the index
+inline uint sobol1Reversed(uint index) {
+    index ^= index >> 1 & 0x55555555u;
+    index ^= index >> 2 & 0x33333333u;
+    index ^= index >> 4 & 0x0F0F0F0Fu;
+    index ^= index >> 8 & 0x00FF00FFu;
+    index ^= index >> 16;
+    return index;
+}
+
+// Owen-scrambled 2D Sobol point in 32-bit fixed point
+inline uint2 scrambledSobol(uint index, uint seedX, uint seedY) {
+    return uint2(reverse_bits(laineKarras(index, seedX)),
+                 reverse_bits(laineKarras(sobol1Reversed(index), seedY)));
+}
+
+inline float toUnitFloat(uint v) {
+    return float(v >> 8) * 0x1p-24f;
+}
+
+inline Sampler makeSampler(uint type, uint2 pixel, uint width, uint sample, uint seed) {
+    Sampler s;
+    s.type      = type;
+    s.pixel     = pixel;
+    s.sample    = sample;
+    s.seed      = seed;
+    s.pixelSeed = hashCombine(hashCombine(seed, pixel.x), pixel.y);
+    s.dimension = 0;
+    s.lcgState  = pixel.x + pixel.y*width + sample*1973 + seed*0x9E3779B9u;
+    return s;
+}
+
+inline void startBounce(thread Sampler &s, uint bounce) {
+    s.dimension = CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS;
+}
+
+// 2D point of this sample in the stream of dimension d
+inline float2 samplerPoint(thread const Sampler &s, uint d) {
+    if (s.type == SAMPLER_PCG) {
+        uint h = hashCombine(hashCombine(s.pixelSeed, s.sample), d);
+        return float2(toUnitFloat(pcgHash(h)), toUnitFloat(pcgHash(h ^ 0xA511E9B3u)));
+    }
+    if (s.type == SAMPLER_SOBOL) {
+        // shuffle the sample order, then scramble each coordinate
+        uint  dimSeed = hashCombine(s.pixelSeed, d);
+        uint2 p = scrambledSobol(owenScramble(s.sample, dimSeed), dimSeed * 0x2C1B3C6Du, dimSeed * 0x297A2D39u);
+        return float2(toUnitFloat(p.x), toUnitFloat(p.y));
+    }
+    // SAMPLER_BLUENOISE: one Sobol sequence for the screen, shifted per pixel by an
+    // R2 dither mask (1/g and 1/g^2 in 32-bit fixed point)
+    const uint a1 = 0xC13FA9A9u, a2 = 0x91E10DA5u;
+    uint  dimSeed = hashCombine(s.seed, d);
+    uint  shiftX  = pcgHash(dimSeed), shiftY = pcgHash(shiftX);
+    uint2 p       = scrambledSobol(owenScramble(s.sample, dimSeed), shiftX, shiftY);
+    uint  maskX   = (s.pixel.x + (shiftX & 0xFFFFu)) * a1 + (s.pixel.y + (shiftX >> 16)) * a2;
+    uint  maskY   = (s.pixel.x + (shiftY & 0xFFFFu)) * a1 + (s.pixel.y + (shiftY >> 16)) * a2;
+    return float2(toUnitFloat(p.x + maskX), toUnitFloat(p.y + maskY));
+}
+
+inline float get1D(thread Sampler &s) {
+    if (s.type == SAMPLER_LCG) return rand01(s.lcgState);
+    return samplerPoint(s, s.dimension++).x;
+}
+
+inline float2 get2D(thread Sampler &s) {
+    if (s.type == SAMPLER_LCG) {
+        float u = rand01(s.lcgState);
+        return float2(u, rand01(s.lcgState));
+    }
+    float2 p = samplerPoint(s, s.dimension);
+    s.dimension += 2;
+    return p;
+}
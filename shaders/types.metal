@@ -12,10 +12,31 @@ struct Material {
     float  ior; // index of refraction, 1.0 for air, >1.0 for dielectric
 };
 
-struct SceneTriangle { float3 v0, v1, v2; uint matIndex; };
+// Rec. 709 luminance of a linear colour
+inline float luminance(float3 c) {
+    return 0.2126*c.x + 0.7152*c.y + 0.0722*c.z;
+}
+
+// corners index the packed_float3 vertex buffer
+struct SceneTriangle { uint v0, v1, v2; uint matIndex; };
 struct ScenePlane    { float3 normal; float  d;   uint matIndex; };
 struct SceneSphere   { float3 center; float  radius; uint matIndex; };
 
+// emissive triangle in world space, drawn from an alias table (see src/Scene.cpp)
+struct SceneLight {
+    packed_float3 v0;
+    packed_float3 e1, e2; // edges from v0
+    uint          matIndex;
+    float         prob;
+    uint          alias;
+};
+
+// one placement of a mesh; rays enter its BLAS in object space
+struct SceneInstance {
+    float4x4 worldToObject;
+    uint     blasRoot;
+};
+
 struct BVHNode {
     float3 bboxMin;
     float3 bboxMax;
@@ -23,3 +44,48 @@ struct BVHNode {
     uint rightFirst;
     uint  count;
 };
+
+// traversal counters of a path / summed per pixel, see src/TraversalStats.h
+struct RayStats {
+    uint paths;
+    uint bounces;
+    uint nodes;
+    uint aabbTests;
+    uint triangleTests;
+    uint primitiveTests;
+    uint stackHighWater;
+    uint stackOverflows;
+};
+
+// Counting compiles in only with -D PATHTRACER_TRAVERSAL_STATS; it needs a
+// `thread RayStats &stats` in scope, which the *_STATS_PARAM/ARG macros thread through.
+#ifdef PATHTRACER_TRAVERSAL_STATS
+#define TRAVERSAL_STAT(statement) statement
+#define TRAVERSAL_STATS_PARAM , thread RayStats &stats
+#define TRAVERSAL_STATS_ARG , stats
+#else
+#define TRAVERSAL_STAT(statement)
+#define TRAVERSAL_STATS_PARAM
+#define TRAVERSAL_STATS_ARG
+#endif
+
+// depth AOV of camera rays that leave the scene, kMissDepth in src/Cpu/Integrator.h
+#define MISS_DEPTH 1e10
+
+// one denoise_atrous pass, see DenoisePass in src/Cpu/Denoiser.h
+struct DenoisePass {
+    uint  step;
+    float colorSigma;
+    float normalSigma;
+    float depthSigma;
+    uint  last;
+};
+
+// arguments of the reproject kernel, see Reprojection in src/Renderer.h
+struct Reprojection {
+    Camera current;
+    Camera previous;
+    uint   maxHistory;      // samples a pixel may carry over
+    float  depthTolerance;  // relative
+    float  normalTolerance; // minimum cosine
+};
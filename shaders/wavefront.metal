@@ -0,0 +1,302 @@
+// Wavefront path tracing: the work of path_trace split into one kernel per stage,
+// linked by compacted queues of path indices, so each dispatch runs threads that
+// all do the same thing (see src/Cpu/Wavefront.h for the CPU pipeline). Per frame:
+//
+//   wavefront_generate                          camera ray of every pixel
+//   per bounce:
+//     wavefront_extend                          closest hit of each queued ray
+//     wavefront_classify                        misses, emission, roulette; queue by material
+//     wavefront_shade_dielectric/_surface       scatter, draw light samples
+//     wavefront_connect                         trace the shadow rays
+//   wavefront_accumulate                        blend into the textures like path_trace
+//
+// wavefront_queue_args turns the queue lengths into threadgroup counts for the
+// indirect dispatches in between. Needs the helpers of kernel.metal.
+
+// Path state, field-major: field f of path i is paths[f*pathCount + i], so that
+// neighbouring threads read neighbouring float4s.
+#define WF_ORIGIN          0 // w = bsdfPdf, as in path_trace
+#define WF_DIR             1
+#define WF_THROUGHPUT      2
+#define WF_RADIANCE        3
+#define WF_ALBEDO          4 // first-hit AOVs
+#define WF_NORMAL_DEPTH    5
+#define WF_HIT             6 // normal, w = t
+#define WF_STATE           7 // as uints: material, hit a triangle, sampler dimension, LCG state
+#define WF_SHADOW_ORIGIN   8 // w = distance to the light
+#define WF_SHADOW_DIR      9
+#define WF_SHADOW_RADIANCE 10 // throughput already applied
+#define WF_FIELDS          11
+
+// Queue q holds up to pathCount indices at queues[q*pathCount].
+#define WF_QUEUE_EXTEND     0 // 0 and 1 alternate: this bounce's rays and the next one's
+#define WF_QUEUE_DIELECTRIC 2
+#define WF_QUEUE_SURFACE    3
+#define WF_QUEUE_SHADOW     4
+#define WF_QUEUES           5
+
+#define WF_GROUP_SIZE 64 // threads per threadgroup of the queue kernels
+
+// matches WavefrontControl in src/Renderer.h
+struct WavefrontControl {
+    atomic_uint count[WF_QUEUES];
+    uint        args[WF_QUEUES][3]; // MTLDispatchThreadgroupsIndirectArguments per queue
+};
+
+// the scene buffers as path_trace binds them
+#define WF_SCENE_PARAMS \
+    device const SceneTriangle *triangles     [[buffer(1)]], \
+    device const ScenePlane    *planes        [[buffer(3)]], \
+    constant uint              &planeCount    [[buffer(4)]], \
+    device const SceneSphere   *spheres       [[buffer(5)]], \
+    constant uint              &sphereCount   [[buffer(6)]], \
+    device const Material      *materials     [[buffer(8)]], \
+    device const BVHNode       *bvhNodes      [[buffer(11)]], \
+    device const SceneInstance *instances     [[buffer(13)]], \
+    device const BVHNode       *tlasNodes     [[buffer(15)]], \
+    constant uint              &tlasNodeCount [[buffer(16)]], \
+    device const packed_float3 *vertices      [[buffer(17)]], \
+    device const SceneLight    *lights        [[buffer(19)]], \
+    constant uint              &lightCount    [[buffer(20)]], \
+    constant float             &lightPower    [[buffer(21)]]
+#define WF_SCENE \
+    SceneBuffers{triangles, vertices, bvhNodes, instances, tlasNodes, tlasNodeCount, \
+                 planes, planeCount, spheres, sphereCount, materials, lights, lightCount, lightPower}
+
+// the wavefront's own buffers
+#define WF_PARAMS \
+    device float4           *paths       [[buffer(23)]], \
+    device uint             *queues      [[buffer(24)]], \
+    device WavefrontControl &control     [[buffer(25)]], \
+    constant uint           &bounce      [[buffer(26)]], \
+    constant uint2          &size        [[buffer(27)]], \
+    constant uint           &frameIndex  [[buffer(7)]], \
+    constant uint           &samplerType [[buffer(22)]]
+
+inline void pushQueue(device uint *queues, device WavefrontControl &control, uint queue, uint pathCount, uint path) {
+    uint slot = atomic_fetch_add_explicit(&control.count[queue], 1, memory_order_relaxed);
+    queues[queue*pathCount + slot] = path;
+}
+
+// The sampler of path i, resumed where the last stage left it.
+inline Sampler loadSampler(uint samplerType, uint i, uint2 size, uint frameIndex, uint4 state) {
+    Sampler s   = makeSampler(samplerType, uint2(i % size.x, i / size.x), size.x, frameIndex, 0);
+    s.dimension = state.z;
+    s.lcgState  = state.w;
+    return s;
+}
+
+inline void storeSampler(device float4 *paths, uint pathCount, uint i, Sampler s) {
+    uint4 state = as_type<uint4>(paths[WF_STATE*pathCount + i]);
+    state.zw    = uint2(s.dimension, s.lcgState);
+    paths[WF_STATE*pathCount + i] = as_type<float4>(state);
+}
+
+kernel void wavefront_generate(WF_PARAMS,
+                               constant Camera &cam [[buffer(10)]],
+                               uint2           gid  [[thread_position_in_grid]]) {
+    if (gid.x >= size.x || gid.y >= size.y) return;
+    uint pathCount = size.x * size.y;
+    uint i = gid.y*size.x + gid.x;
+
+    // per‐pixel+frame random numbers, exactly as path_trace draws them
+    Sampler sampler = makeSampler(samplerType, gid, size.x, frameIndex, 0);
+    float2 jitter = get2D(sampler);
+    float u = (float(gid.x) + jitter.x) / float(size.x);
+    float v = 1.0 - (float(gid.y) + jitter.y) / float(size.y);
+    float3 dir = normalize(cam.lowerLeft + u*cam.horizontal + v*cam.vertical - cam.origin);
+
+    paths[WF_ORIGIN*pathCount + i]       = float4(cam.origin, 0.0);
+    paths[WF_DIR*pathCount + i]          = float4(dir, 0.0);
+    paths[WF_THROUGHPUT*pathCount + i]   = float4(1.0);
+    paths[WF_RADIANCE*pathCount + i]     = float4(0.0);
+    paths[WF_ALBEDO*pathCount + i]       = float4(1.0);
+    paths[WF_NORMAL_DEPTH*pathCount + i] = float4(-dir, MISS_DEPTH);
+    paths[WF_STATE*pathCount + i]        = as_type<float4>(uint4(0, 0, sampler.dimension, sampler.lcgState));
+
+    // every path starts out queued, in pixel order
+    queues[WF_QUEUE_EXTEND*pathCount + i] = i;
+    if (i == 0) {
+        atomic_store_explicit(&control.count[WF_QUEUE_EXTEND], pathCount, memory_order_relaxed);
+        for (uint q = 1; q < WF_QUEUES; ++q) atomic_store_explicit(&control.count[q], 0, memory_order_relaxed);
+    }
+}
+
+// threadgroups for every queue's current length; one thread
+kernel void wavefront_queue_args(device WavefrontControl &control [[buffer(25)]]) {
+    for (uint q = 0; q < WF_QUEUES; ++q) {
+        uint n = atomic_load_explicit(&control.count[q], memory_order_relaxed);
+        control.args[q][0] = (n + WF_GROUP_SIZE - 1) / WF_GROUP_SIZE;
+        control.args[q][1] = 1;
+        control.args[q][2] = 1;
+    }
+}
+
+// after a bounce: this bounce's queues are spent, the next extend queue stays
+kernel void wavefront_next_bounce(device WavefrontControl &control [[buffer(25)]],
+                                  constant uint           &bounce  [[buffer(26)]]) {
+    atomic_store_explicit(&control.count[WF_QUEUE_EXTEND + bounce % 2], 0, memory_order_relaxed);
+    atomic_store_explicit(&control.count[WF_QUEUE_DIELECTRIC], 0, memory_order_relaxed);
+    atomic_store_explicit(&control.count[WF_QUEUE_SURFACE], 0, memory_order_relaxed);
+    atomic_store_explicit(&control.count[WF_QUEUE_SHADOW], 0, memory_order_relaxed);
+}
+
+kernel void wavefront_extend(WF_SCENE_PARAMS, WF_PARAMS, uint tid [[thread_position_in_grid]]) {
+    uint queue = WF_QUEUE_EXTEND + bounce % 2;
+    if (tid >= atomic_load_explicit(&control.count[queue], memory_order_relaxed)) return;
+    uint pathCount = size.x * size.y;
+    uint i = queues[queue*pathCount + tid];
+    TRAVERSAL_STAT(RayStats stats = {};)
+
+    Ray ray;
+    ray.origin = paths[WF_ORIGIN*pathCount + i].xyz;
+    ray.dir    = paths[WF_DIR*pathCount + i].xyz;
+    float3 bestN;
+    uint   bestMat;
+    bool   hitTriangle;
+    float  bestT = intersectScene(WF_SCENE, ray, bestN, bestMat, hitTriangle TRAVERSAL_STATS_ARG);
+
+    paths[WF_HIT*pathCount + i] = float4(bestN, bestT);
+    uint4 state = as_type<uint4>(paths[WF_STATE*pathCount + i]);
+    state.xy = uint2(bestMat, hitTriangle ? 1 : 0);
+    state.z  = CAMERA_DIMENSIONS + bounce * BOUNCE_DIMENSIONS; // startBounce
+    paths[WF_STATE*pathCount + i] = as_type<float4>(state);
+}
+
+kernel void wavefront_classify(WF_SCENE_PARAMS, WF_PARAMS, uint tid [[thread_position_in_grid]]) {
+    uint queue = WF_QUEUE_EXTEND + bounce % 2;
+    if (tid >= atomic_load_explicit(&control.count[queue], memory_order_relaxed)) return;
+    uint pathCount = size.x * size.y;
+    uint i = queues[queue*pathCount + tid];
+
+    Ray ray;
+    float4 origin = paths[WF_ORIGIN*pathCount + i];
+    ray.origin = origin.xyz;
+    ray.dir    = paths[WF_DIR*pathCount + i].xyz;
+    float4 hit   = paths[WF_HIT*pathCount + i];
+    uint4  state = as_type<uint4>(paths[WF_STATE*pathCount + i]);
+    float3 throughput = paths[WF_THROUGHPUT*pathCount + i].xyz;
+    float3 L = paths[WF_RADIANCE*pathCount + i].xyz;
+
+    if (hit.w > 1e19) {
+        paths[WF_RADIANCE*pathCount + i] = float4(L + throughput * skyRadiance(ray.dir), 0.0);
+        return;
+    }
+    Material mat = materials[state.x];
+    if (bounce == 0) {
+        float3 albedo;
+        float4 normalDepth;
+        firstHitAovs(mat, ray, hit.w, hit.xyz, albedo, normalDepth);
+        paths[WF_ALBEDO*pathCount + i]       = float4(albedo, 0.0);
+        paths[WF_NORMAL_DEPTH*pathCount + i] = normalDepth;
+    }
+
+    L += throughput * mat.emission * emissionWeight(WF_SCENE, mat, hit.w, hit.xyz, state.y != 0, ray.dir, origin.w);
+    paths[WF_RADIANCE*pathCount + i] = float4(L, 0.0);
+    paths[WF_ORIGIN*pathCount + i].w = 0.0; // bsdfPdf
+
+    Sampler sampler = loadSampler(samplerType, i, size, frameIndex, state);
+    bool survives = survivesRoulette(bounce, throughput, sampler);
+    storeSampler(paths, pathCount, i, sampler);
+    if (!survives) return;
+    paths[WF_THROUGHPUT*pathCount + i] = float4(throughput, 0.0);
+    pushQueue(queues, control, mat.ior > 1.0 ? WF_QUEUE_DIELECTRIC : WF_QUEUE_SURFACE, pathCount, i);
+}
+
+kernel void wavefront_shade_dielectric(device const Material *materials [[buffer(8)]], WF_PARAMS,
+                                       uint tid [[thread_position_in_grid]]) {
+    if (tid >= atomic_load_explicit(&control.count[WF_QUEUE_DIELECTRIC], memory_order_relaxed)) return;
+    uint pathCount = size.x * size.y;
+    uint i = queues[WF_QUEUE_DIELECTRIC*pathCount + tid];
+
+    Ray ray;
+    ray.origin = paths[WF_ORIGIN*pathCount + i].xyz;
+    ray.dir    = paths[WF_DIR*pathCount + i].xyz;
+    float4 hit   = paths[WF_HIT*pathCount + i];
+    uint4  state = as_type<uint4>(paths[WF_STATE*pathCount + i]);
+    Sampler sampler = loadSampler(samplerType, i, size, frameIndex, state);
+
+    float3 P = ray.origin + hit.w * ray.dir;
+    scatterDielectric(materials[state.x], hit.xyz, P, ray, sampler);
+
+    paths[WF_ORIGIN*pathCount + i] = float4(ray.origin, 0.0);
+    paths[WF_DIR*pathCount + i]    = float4(ray.dir, 0.0);
+    storeSampler(paths, pathCount, i, sampler);
+    pushQueue(queues, control, WF_QUEUE_EXTEND + (bounce + 1) % 2, pathCount, i);
+}
+
+kernel void wavefront_shade_surface(WF_SCENE_PARAMS, WF_PARAMS, uint tid [[thread_position_in_grid]]) {
+    if (tid >= atomic_load_explicit(&control.count[WF_QUEUE_SURFACE], memory_order_relaxed)) return;
+    uint pathCount = size.x * size.y;
+    uint i = queues[WF_QUEUE_SURFACE*pathCount + tid];
+
+    Ray ray;
+    ray.origin = paths[WF_ORIGIN*pathCount + i].xyz;
+    ray.dir    = paths[WF_DIR*pathCount + i].xyz;
+    float4 hit   = paths[WF_HIT*pathCount + i];
+    uint4  state = as_type<uint4>(paths[WF_STATE*pathCount + i]);
+    float3 throughput = paths[WF_THROUGHPUT*pathCount + i].xyz;
+    Sampler  sampler = loadSampler(samplerType, i, size, frameIndex, state);
+    Material mat     = materials[state.x];
+    float3   P       = ray.origin + hit.w * ray.dir;
+
+    bool sampleLights = lightCount > 0 && mat.reflectivity < 1.0;
+    if (sampleLights) {
+        LightSample sample;
+        if (drawLightSample(WF_SCENE, P, hit.xyz, mat.albedo, 1.0 - mat.reflectivity, sampler, sample)) {
+            paths[WF_SHADOW_ORIGIN*pathCount + i]   = float4(sample.shadow.origin, sample.distance);
+            paths[WF_SHADOW_DIR*pathCount + i]      = float4(sample.shadow.dir, 0.0);
+            paths[WF_SHADOW_RADIANCE*pathCount + i] = float4(throughput * sample.radiance, 0.0);
+            pushQueue(queues, control, WF_QUEUE_SHADOW, pathCount, i);
+        }
+    }
+    float bsdfPdf = 0.0;
+    scatterSurface(mat, hit.xyz, P, sampleLights, ray, throughput, bsdfPdf, sampler);
+
+    paths[WF_ORIGIN*pathCount + i]     = float4(ray.origin, bsdfPdf);
+    paths[WF_DIR*pathCount + i]        = float4(ray.dir, 0.0);
+    paths[WF_THROUGHPUT*pathCount + i] = float4(throughput, 0.0);
+    storeSampler(paths, pathCount, i, sampler);
+    pushQueue(queues, control, WF_QUEUE_EXTEND + (bounce + 1) % 2, pathCount, i);
+}
+
+kernel void wavefront_connect(WF_SCENE_PARAMS, WF_PARAMS, uint tid [[thread_position_in_grid]]) {
+    if (tid >= atomic_load_explicit(&control.count[WF_QUEUE_SHADOW], memory_order_relaxed)) return;
+    uint pathCount = size.x * size.y;
+    uint i = queues[WF_QUEUE_SHADOW*pathCount + tid];
+    TRAVERSAL_STAT(RayStats stats = {};)
+
+    float4 origin = paths[WF_SHADOW_ORIGIN*pathCount + i];
+    LightSample sample;
+    sample.shadow.origin = origin.xyz;
+    sample.shadow.dir    = paths[WF_SHADOW_DIR*pathCount + i].xyz;
+    sample.distance      = origin.w;
+    if (occluded(WF_SCENE, sample TRAVERSAL_STATS_ARG)) return;
+    paths[WF_RADIANCE*pathCount + i] += paths[WF_SHADOW_RADIANCE*pathCount + i];
+}
+
+// fold the finished paths into the accumulation, as the end of path_trace does
+kernel void wavefront_accumulate(texture2d<float, access::read_write> outTex         [[texture(0)]],
+                                 texture2d<float, access::read_write> albedoTex      [[texture(1)]],
+                                 texture2d<float, access::read_write> normalDepthTex [[texture(2)]],
+                                 device const float4 *paths      [[buffer(23)]],
+                                 constant uint2      &size       [[buffer(27)]],
+                                 constant uint       &history    [[buffer(28)]],
+                                 uint2               gid         [[thread_position_in_grid]]) {
+    if (gid.x >= size.x || gid.y >= size.y) return;
+    uint pathCount = size.x * size.y;
+    uint i = gid.y*size.x + gid.x;
+
+    float3 L = paths[WF_RADIANCE*pathCount + i].xyz;
+    float  l = luminance(L);
+    float4 prev[3] = {float4(0), float4(0), float4(0)};
+    if (history) {
+        prev[0] = outTex.read(gid);
+        prev[1] = albedoTex.read(gid);
+        prev[2] = normalDepthTex.read(gid);
+    }
+    float n = prev[0].w; // samples so far
+    outTex.write(float4((prev[0].xyz*n + L)/(n+1.0), n+1.0), gid);
+    albedoTex.write((prev[1]*n + float4(paths[WF_ALBEDO*pathCount + i].xyz, l*l))/(n+1.0), gid);
+    normalDepthTex.write((prev[2]*n + paths[WF_NORMAL_DEPTH*pathCount + i])/(n+1.0), gid);
+}
@@ -0,0 +1,126 @@
+#ifndef BENCH_JSON_H
+#define BENCH_JSON_H
+
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Minimal streaming JSON writer, two-space indented so results diff line by line.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream &out) : _out(out) {
+    }
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(std::string_view name) {
+        separate();
+        string(name);
+        _out << ": ";
+        _afterKey = true;
+    }
+
+    void value(std::string_view s) {
+        separate();
+        string(s);
+    }
+
+    void value(const char *s) { value(std::string_view(s)); }
+
+    void value(bool v) {
+        separate();
+        _out << (v ? "true" : "false");
+    }
+
+    void value(double v) {
+        separate();
+        if (!std::isfinite(v)) {
+            _out << "null";
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.6g", v);
+        _out << buf;
+    }
+
+    void value(float v) { value(static_cast<double>(v)); }
+
+    // every integer width, so size_t and uint64_t resolve on both libc++ and libstdc++
+    void value(int v) { integer(v); }
+    void value(unsigned v) { integer(v); }
+    void value(unsigned long v) { integer(v); }
+    void value(unsigned long long v) { integer(v); }
+
+    template<typename T>
+    void field(std::string_view name, const T &v) {
+        key(name);
+        value(v);
+    }
+
+private:
+    template<typename T>
+    void integer(T v) {
+        separate();
+        _out << v;
+    }
+
+    void open(char c) {
+        separate();
+        _out << c;
+        _first.push_back(true);
+    }
+
+    void close(char c) {
+        const bool empty = _first.back();
+        _first.pop_back();
+        if (!empty) newline();
+        _out << c;
+        if (_first.empty()) _out << '\n';
+    }
+
+    // comma and line break before every element except a key's value
+    void separate() {
+        if (_afterKey) {
+            _afterKey = false;
+            return;
+        }
+        if (_first.empty()) return;
+        if (!_first.back()) _out << ',';
+        _first.back() = false;
+        newline();
+    }
+
+    void newline() {
+        _out << '\n';
+        for (size_t i = 0; i < _first.size(); ++i) _out << "  ";
+    }
+
+    void string(std::string_view s) {
+        _out << '"';
+        for (const char c: s) {
+            if (c == '"' || c == '\\') {
+                _out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                _out << buf;
+            } else {
+                _out << c;
+            }
+        }
+        _out << '"';
+    }
+
+    std::ostream &_out;
+    std::vector<bool> _first; // per open container: nothing written into it yet
+    bool _afterKey = false;
+};
+
+
+#endif //BENCH_JSON_H
@@ -0,0 +1,124 @@
+#ifndef BENCH_PROCEDURALSCENE_H
+#define BENCH_PROCEDURALSCENE_H
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+#include "../Object.h"
+#include "../Bvh/Aabb.h"
+#include "../Cpu/Rng.h"
+
+// Reproducible synthetic geometry for benchmarks: a pile of lumpy, overlapping
+// "rocks" of very different sizes, which gives a BVH builder the uneven triangle
+// density of real scenes instead of a uniform soup. The same (triangle count, seed)
+// always yields the same mesh.
+struct ProceduralScene {
+    static constexpr uint32_t kStacks = 16;
+    static constexpr uint32_t kSlices = 32;
+    // two pole fans plus the quads between the inner rings
+    static constexpr uint32_t kRockTriangles = 2 * kSlices + 2 * kSlices * (kStacks - 2);
+
+    // Append at least `triangleCount` triangles (whole rocks) inside `bounds` to the
+    // global `vertices`/`triangles`, as one Object with `materialIndex`.
+    static void generate(uint32_t triangleCount, uint32_t seed, const AABB &bounds, uint32_t materialIndex) {
+        const uint32_t rocks = (triangleCount + kRockTriangles - 1) / kRockTriangles;
+        const simd::float3 extent = bounds.extent();
+        // keep the rocks' combined volume roughly constant as their count grows
+        const float baseRadius = 0.4f * std::cbrt(extent.x * extent.y * extent.z / static_cast<float>(rocks));
+
+        Object obj;
+        obj.firstTriangle = static_cast<uint32_t>(triangles.size());
+        obj.triCount = rocks * kRockTriangles;
+        obj.materialIndex = materialIndex;
+        obj.source = "procedural";
+        vertices.reserve(vertices.size() + static_cast<size_t>(rocks) * (2 + (kStacks - 1) * kSlices));
+        triangles.reserve(triangles.size() + obj.triCount);
+
+        uint32_t st = seed * 747796405u + 2891336453u;
+        for (uint32_t r = 0; r < rocks; ++r) {
+            const simd::float3 center = bounds.bmin + simd::float3{rand01(st), rand01(st), rand01(st)} * extent;
+            // a few large boulders among many pebbles
+            const float u = rand01(st);
+            const float radius = baseRadius * (0.25f + 1.75f * u * u * u);
+            addRock(center, radius, st, materialIndex);
+        }
+        objects.push_back(obj);
+    }
+
+    // Like generate, but long thin planks (two triangles each) at random angles, each
+    // spanning much of `bounds`: the case where object splits leave every box
+    // overlapping its sibling, and spatial splits (BvhBuildMode::Sbvh) pay off.
+    static void generateSplinters(uint32_t triangleCount, uint32_t seed, const AABB &bounds, uint32_t materialIndex) {
+        const uint32_t planks = (triangleCount + 1) / 2;
+        const simd::float3 extent = bounds.extent();
+        const float size = simd::reduce_min(extent);
+
+        Object obj;
+        obj.firstTriangle = static_cast<uint32_t>(triangles.size());
+        obj.triCount = 2 * planks;
+        obj.materialIndex = materialIndex;
+        obj.source = "splinters";
+        vertices.reserve(vertices.size() + 4 * static_cast<size_t>(planks));
+        triangles.reserve(triangles.size() + obj.triCount);
+
+        uint32_t st = seed * 747796405u + 2891336453u;
+        const auto direction = [&] {
+            const float z = 2.0f * rand01(st) - 1.0f, phi = 2.0f * std::numbers::pi_v<float> * rand01(st);
+            const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+            return simd::float3{r * std::cos(phi), z, r * std::sin(phi)};
+        };
+        for (uint32_t p = 0; p < planks; ++p) {
+            const simd::float3 center = bounds.bmin + simd::float3{rand01(st), rand01(st), rand01(st)} * extent;
+            const simd::float3 along = direction() * (size * (0.2f + 0.3f * rand01(st)));
+            const simd::float3 across = simd::normalize(simd::cross(along, direction())) * (size * 0.004f);
+            const simd::float3 lo = simd::max(simd::min(center - along, bounds.bmax), bounds.bmin);
+            const simd::float3 hi = simd::max(simd::min(center + along, bounds.bmax), bounds.bmin);
+            const uint32_t base = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(lo - across);
+            vertices.push_back(lo + across);
+            vertices.push_back(hi + across);
+            vertices.push_back(hi - across);
+            triangles.push_back({base, base + 1, base + 2, materialIndex});
+            triangles.push_back({base, base + 2, base + 3, materialIndex});
+        }
+        objects.push_back(obj);
+    }
+
+private:
+    static void addRock(const simd::float3 &center, float radius, uint32_t &st, uint32_t materialIndex) {
+        constexpr float pi = std::numbers::pi_v<float>;
+        const uint32_t base = static_cast<uint32_t>(vertices.size());
+        const auto lumpy = [&](simd::float3 dir) { return center + dir * (radius * (0.85f + 0.3f * rand01(st))); };
+
+        vertices.push_back(lumpy({0, 1, 0}));
+        for (uint32_t i = 1; i < kStacks; ++i) {
+            const float theta = pi * static_cast<float>(i) / kStacks;
+            for (uint32_t j = 0; j < kSlices; ++j) {
+                const float phi = 2.0f * pi * static_cast<float>(j) / kSlices;
+                vertices.push_back(lumpy({std::sin(theta) * std::cos(phi), std::cos(theta),
+                                          std::sin(theta) * std::sin(phi)}));
+            }
+        }
+        vertices.push_back(lumpy({0, -1, 0}));
+
+        // ring i (1-based) starts at base + 1 + (i - 1) * kSlices
+        const auto ring = [&](uint32_t i, uint32_t j) { return base + 1 + (i - 1) * kSlices + j % kSlices; };
+        const uint32_t bottom = base + 1 + (kStacks - 1) * kSlices;
+        for (uint32_t j = 0; j < kSlices; ++j) {
+            triangles.push_back({base, ring(1, j + 1), ring(1, j), materialIndex});
+            triangles.push_back({bottom, ring(kStacks - 1, j), ring(kStacks - 1, j + 1), materialIndex});
+        }
+        for (uint32_t i = 1; i + 1 < kStacks; ++i) {
+            for (uint32_t j = 0; j < kSlices; ++j) {
+                triangles.push_back({ring(i, j), ring(i, j + 1), ring(i + 1, j + 1), materialIndex});
+                triangles.push_back({ring(i + 1, j + 1), ring(i + 1, j), ring(i, j), materialIndex});
+            }
+        }
+    }
+};
+
+
+#endif //BENCH_PROCEDURALSCENE_H
@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Json.h"
+#include "ProceduralScene.h"
+#include "../Camera.h"
+#include "../Config.h"
+#include "../Object.h"
+#include "../Scene.h"
+#include "../ThreadPool.h"
+#include "../Cpu/CpuRenderer.h"
+#include "../Cpu/Integrator.h"
+
+// Reproducible performance numbers for the CPU backend, written as JSON so runs on
+// different commits can be compared by a script:
+//
+//   * per BVH builder: build time, node count, depth and SAH cost of the largest mesh;
+//     with --optimize, also for each builder followed by BvhOptimizer
+//   * per builder and BVH width: single-ray throughput for primary, diffuse-bounce
+//     and shadow rays (any-hit, and closest-hit for comparison), and full
+//     path_trace samples per second
+//   * per --bounces cap: samples and rays per second of the megakernel and the
+//     wavefront pipeline (SAH, BVH4); both trace the same rays
+//   * with --rmse-target: time for uniform and adaptive sampling, for uniform
+//     sampling without light sampling, and samples per pixel for each of --samplers,
+//     to get within that RMSE of a --reference-spp render
+//
+//   pathtracer_bench [--scene teapot|cube|<file.obj>|procedural:<triangles>|splinters:<triangles>]...
+//                    [--builders median,sah,lbvh,sbvh] [--optimize ms] [--widths 2,4,8] [--res 800x600]
+//                    [--spp N] [--repeat N] [--seed N] [--threads N] [--label text]
+//                    [--rmse-target 0.02] [--reference-spp 256] [--samplers lcg,pcg,sobol,bluenoise]
+//                    [--bounces 1,2,4,8,20]
+//                    [--output bench.json]
+//
+// Procedural sizes take k/M suffixes (procedural:250k, procedural:10M); splinters
+// are long thin triangles at random angles (see ProceduralScene). Progress
+// goes to stderr; the JSON goes to stdout unless --output is given.
+
+namespace {
+    using clock = std::chrono::high_resolution_clock;
+
+    struct Options {
+        std::vector<std::string> scenes;
+        std::vector<BvhBuildMode> builders = {
+            BvhBuildMode::Median, BvhBuildMode::BinnedSah, BvhBuildMode::Lbvh, BvhBuildMode::Sbvh
+        };
+        std::vector<int> widths = {2, 4, 8};
+        uint32_t width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+        uint32_t spp = 2;
+        uint32_t repeat = 3;
+        uint32_t seed = 1;
+        float rmseTarget = 0.0f; // off
+        uint32_t referenceSpp = 256;
+        float optimizeMs = -1.0f; // off; 0 optimises until converged
+        std::vector<SamplerType> samplers = {SamplerType::Lcg, SamplerType::Pcg, SamplerType::Sobol, SamplerType::BlueNoise};
+        std::vector<uint32_t> bounces = {1, 2, 4, 8, MAX_BOUNCES};
+        unsigned threads = std::thread::hardware_concurrency();
+        std::string label;
+        std::string output;
+    };
+
+    struct RaySet {
+        std::vector<Ray> primary, diffuse, shadow;
+        std::vector<float> shadowDistance; // to the point on the emitter
+    };
+
+    double seconds(clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    std::vector<std::string> split(const std::string &s) {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= s.size()) {
+            const size_t end = std::min(s.find(',', start), s.size());
+            if (end > start) parts.push_back(s.substr(start, end - start));
+            start = end + 1;
+        }
+        return parts;
+    }
+
+    // "250k" -> 250000, "10M" -> 10000000; 0 if malformed
+    uint32_t parseCount(const std::string &s) {
+        char *end = nullptr;
+        const double v = std::strtod(s.c_str(), &end);
+        double scale = 1.0;
+        if (*end == 'k' || *end == 'K') scale = 1e3, ++end;
+        else if (*end == 'm' || *end == 'M') scale = 1e6, ++end;
+        if (*end != '\0' || v <= 0.0) return 0;
+        return static_cast<uint32_t>(v * scale);
+    }
+
+    bool setupScene(Scene &scene, const std::string &name, uint32_t seed) {
+        if (name == "teapot") {
+            scene.setupDefault();
+            return true;
+        }
+        if (name.rfind("procedural:", 0) == 0) {
+            const uint32_t count = parseCount(name.substr(11));
+            if (count == 0) return false;
+            scene.setupRoom();
+            ProceduralScene::generate(count, seed, Scene::kSubjectBounds, 1);
+            scene.buildAccel();
+            return true;
+        }
+        if (name.rfind("splinters:", 0) == 0) {
+            const uint32_t count = parseCount(name.substr(10));
+            if (count == 0) return false;
+            scene.setupRoom();
+            ProceduralScene::generateSplinters(count, seed, Scene::kSubjectBounds, 1);
+            scene.buildAccel();
+            return true;
+        }
+        return scene.setupObj(name == "cube" ? "assets/cube.obj" : name, 1);
+    }
+
+    // The mesh the build statistics are taken on: the one with the most triangles.
+    std::vector<Triangle> largestMesh() {
+        const Object *largest = nullptr;
+        for (const Object &o: objects) {
+            if (!largest || o.triCount > largest->triCount) largest = &o;
+        }
+        std::vector<Triangle> tris;
+        if (!largest) return tris;
+        tris.reserve(largest->triCount);
+        for (uint32_t i = 0; i < largest->triCount; ++i) {
+            const SceneTriangle &T = triangles[largest->firstTriangle + i];
+            tris.push_back({vertices[T.v0], vertices[T.v1], vertices[T.v2], T.matIndex});
+        }
+        return tris;
+    }
+
+    // Camera rays as CpuRenderer generates them, then from each primary hit one
+    // cosine-weighted bounce and one ray toward a random point on an emitter.
+    RaySet makeRays(const Scene &scene, const Camera &cam, const Options &opt, ThreadPool &pool) {
+        std::vector<const SceneTriangle *> emitters;
+        for (const SceneTriangle &T: triangles) {
+            if (simd::reduce_max(scene.materials[T.matIndex].emission) > 0.0f) emitters.push_back(&T);
+        }
+
+        const size_t pixels = static_cast<size_t>(opt.width) * opt.height;
+        RaySet rays;
+        rays.primary.resize(pixels);
+        std::vector<Ray> diffuse(pixels), shadow(pixels);
+        std::vector<float> shadowDistance(pixels);
+        std::vector<uint8_t> hit(pixels, 0);
+        const BinaryBlas blas{scene};
+        pool.parallelFor(opt.height, [&](size_t y) {
+            for (uint32_t x = 0; x < opt.width; ++x) {
+                const size_t i = y * opt.width + x;
+                uint32_t st = static_cast<uint32_t>(i) + opt.seed * 1973;
+                const float u = (static_cast<float>(x) + rand01(st)) / static_cast<float>(opt.width);
+                const float v = 1.0f - (static_cast<float>(y) + rand01(st)) / static_cast<float>(opt.height);
+                Ray &ray = rays.primary[i];
+                ray.origin = cam.origin;
+                ray.dir = simd::normalize(cam.lowerLeft + u * cam.horizontal + v * cam.vertical - cam.origin);
+
+                const Hit h = intersectScene(scene, blas, ray);
+                if (h.t > 1e19f) continue;
+                const simd::float3 P = ray.origin + h.t * ray.dir;
+                const simd::float3 N = simd::dot(ray.dir, h.normal) < 0.0f ? h.normal : -h.normal;
+                const simd::float3 origin = P + N * 0.001f;
+                diffuse[i] = {origin, randomHemisphere(N, {rand01(st), rand01(st)})};
+                if (!emitters.empty()) {
+                    const SceneTriangle &L = *emitters[std::min(static_cast<size_t>(rand01(st) * emitters.size()),
+                                                                emitters.size() - 1)];
+                    float a = rand01(st), b = rand01(st);
+                    if (a + b > 1.0f) a = 1.0f - a, b = 1.0f - b;
+                    const simd::float3 target = vertices[L.v0] + a * (vertices[L.v1] - vertices[L.v0]) +
+                                                b * (vertices[L.v2] - vertices[L.v0]);
+                    shadow[i] = {origin, simd::normalize(target - origin)};
+                    shadowDistance[i] = simd::length(target - origin);
+                }
+                hit[i] = emitters.empty() ? 1 : 2;
+            }
+        });
+        for (size_t i = 0; i < pixels; ++i) {
+            if (hit[i] >= 1) rays.diffuse.push_back(diffuse[i]);
+            if (hit[i] >= 2) {
+                rays.shadow.push_back(shadow[i]);
+                rays.shadowDistance.push_back(shadowDistance[i]);
+            }
+        }
+        return rays;
+    }
+
+    // Best-of-`repeat` throughput in Mrays/s of `trace(i, ray)` over `rays`.
+    template<typename Trace>
+    double rayRate(const std::vector<Ray> &rays, uint32_t repeat, ThreadPool &pool, Trace &&trace) {
+        if (rays.empty()) return 0.0;
+        constexpr size_t kChunk = 1024;
+        const size_t chunks = (rays.size() + kChunk - 1) / kChunk;
+        double best = 1e30;
+        for (uint32_t r = 0; r < repeat; ++r) {
+            const auto t0 = clock::now();
+            pool.parallelFor(chunks, [&](size_t c) {
+                const size_t end = std::min(rays.size(), (c + 1) * kChunk);
+                for (size_t i = c * kChunk; i < end; ++i) trace(i, rays[i]);
+            });
+            best = std::min(best, seconds(clock::now() - t0));
+        }
+        return static_cast<double>(rays.size()) / best * 1e-6;
+    }
+
+    // Closest-hit throughput.
+    template<typename Blas>
+    double traceRate(const Scene &scene, const Blas &blas, const std::vector<Ray> &rays, uint32_t repeat,
+                     ThreadPool &pool) {
+        std::vector<float> t(rays.size());
+        return rayRate(rays, repeat, pool, [&](size_t i, const Ray &ray) { t[i] = intersectScene(scene, blas, ray).t; });
+    }
+
+    template<typename Blas>
+    void traversalStats(JsonWriter &json, const Scene &scene, const Blas &blas, const RaySet &rays,
+                        const Options &opt, ThreadPool &pool) {
+        json.field("primary_mrays_s", traceRate(scene, blas, rays.primary, opt.repeat, pool));
+        json.field("diffuse_mrays_s", traceRate(scene, blas, rays.diffuse, opt.repeat, pool));
+        // shadow rays as path_trace traces them, as any-hit queries up to the emitter, and
+        // for comparison as closest-hit queries
+        std::vector<uint8_t> blocked(rays.shadow.size());
+        json.field("shadow_mrays_s", rayRate(rays.shadow, opt.repeat, pool, [&](size_t i, const Ray &ray) {
+            blocked[i] = anyHitScene(scene, blas, ray, rays.shadowDistance[i] * 0.999f);
+        }));
+        json.field("shadow_closest_mrays_s", traceRate(scene, blas, rays.shadow, opt.repeat, pool));
+    }
+
+    // RMSE of two images after the display's sqrt tone curve.
+    double toneMappedRmse(const std::vector<simd::float4> &a, const std::vector<simd::float4> &b) {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (int c = 0; c < 3; ++c) {
+                const float x = std::sqrt(std::clamp(a[i][c], 0.0f, 1.0f));
+                const float y = std::sqrt(std::clamp(b[i][c], 0.0f, 1.0f));
+                sum += static_cast<double>((x - y) * (x - y));
+            }
+        }
+        return std::sqrt(sum / static_cast<double>(a.size() * 3));
+    }
+
+    // Render until the image is within opt.rmseTarget of `reference`, sampling every
+    // pixel every frame (threshold 0) or adaptively.
+    void convergenceRun(JsonWriter &json, const Scene &scene, const Camera &cam, const std::vector<simd::float4> &reference,
+                        float threshold, bool nextEvent, SamplerType sampler, const Options &opt, ThreadPool &pool) {
+        CpuRenderer renderer(scene, opt.width, opt.height, pool);
+        renderer.setBvhWidth(4);
+        renderer.setSeed(opt.seed);
+        renderer.setAdaptive(threshold);
+        renderer.setNextEventEstimation(nextEvent);
+        renderer.setSampler(sampler);
+
+        double renderSeconds = 0.0, rmse = 1.0;
+        while (renderer.frameIndex() < opt.referenceSpp && !renderer.converged() && rmse > opt.rmseTarget) {
+            const auto r0 = clock::now();
+            renderer.render(cam);
+            renderSeconds += seconds(clock::now() - r0);
+            rmse = toneMappedRmse(renderer.accumulation(), reference);
+        }
+        json.beginObject();
+        if (threshold > 0.0f) json.field("threshold", threshold);
+        json.field("seconds", renderSeconds);
+        json.field("frames", renderer.frameIndex());
+        json.field("mean_spp", static_cast<double>(renderer.samplesTaken()) / (static_cast<double>(opt.width) * opt.height));
+        json.field("rmse", rmse);
+        json.field("reached", rmse <= opt.rmseTarget);
+        json.endObject();
+    }
+
+    void convergence(JsonWriter &json, Scene &scene, const Camera &cam, const Options &opt, ThreadPool &pool) {
+        std::cerr << "-- convergence to RMSE " << opt.rmseTarget << "\n";
+        scene.bvhMode = BvhBuildMode::BinnedSah;
+        scene.buildAccel();
+
+        // an independent sample stream, so the reference's own noise is not shared
+        CpuRenderer reference(scene, opt.width, opt.height, pool);
+        reference.setBvhWidth(4);
+        reference.setSeed(opt.seed + 1);
+        for (uint32_t f = 0; f < std::max(opt.referenceSpp, 2u); ++f) reference.render(cam);
+
+        // The measured RMSE includes the reference's own noise, in quadrature; aim the
+        // adaptive sampler at the error that leaves room for it.
+        const float referenceError = reference.estimatedError();
+        const float threshold = std::sqrt(std::max(opt.rmseTarget * opt.rmseTarget - referenceError * referenceError,
+                                                   0.25f * opt.rmseTarget * opt.rmseTarget));
+
+        json.key("convergence");
+        json.beginObject();
+        json.field("target_rmse", opt.rmseTarget);
+        json.field("reference_spp", opt.referenceSpp);
+        json.field("reference_error", referenceError);
+        json.key("uniform");
+        convergenceRun(json, scene, cam, reference.accumulation(), 0.0f, true, SamplerType::Sobol, opt, pool);
+        json.key("adaptive");
+        convergenceRun(json, scene, cam, reference.accumulation(), threshold, true, SamplerType::Sobol, opt, pool);
+        json.key("no_nee");
+        convergenceRun(json, scene, cam, reference.accumulation(), 0.0f, false, SamplerType::Sobol, opt, pool);
+        // uniform sampling per sampler: compare "frames", the spp to reach the target
+        json.key("samplers");
+        json.beginObject();
+        for (const SamplerType sampler: opt.samplers) {
+            std::cerr << "   sampler " << samplerName(sampler) << "\n";
+            json.key(samplerName(sampler));
+            convergenceRun(json, scene, cam, reference.accumulation(), 0.0f, true, sampler, opt, pool);
+        }
+        json.endObject();
+        json.endObject();
+    }
+
+    // Megakernel against wavefront as paths get longer. Rays per second counts
+    // extension and shadow rays; the wavefront counts them, and as both pipelines
+    // trace the same paths the megakernel's rate uses the same count.
+    void pipelines(JsonWriter &json, Scene &scene, const Camera &cam, const Options &opt, ThreadPool &pool) {
+        std::cerr << "-- pipelines\n";
+        scene.bvhMode = BvhBuildMode::BinnedSah;
+        scene.buildAccel();
+        CpuRenderer renderer(scene, opt.width, opt.height, pool);
+        renderer.setBvhWidth(4);
+        const double samples = static_cast<double>(opt.width) * opt.height * opt.spp;
+
+        // best of `repeat` seconds for opt.spp frames
+        const auto time = [&](PathPipeline pipeline) {
+            renderer.setPipeline(pipeline);
+            double best = 1e30;
+            for (uint32_t r = 0; r < opt.repeat; ++r) {
+                renderer.clearAccumulation();
+                const auto t0 = clock::now();
+                for (uint32_t f = 0; f < opt.spp; ++f) renderer.render(cam);
+                best = std::min(best, seconds(clock::now() - t0));
+            }
+            return best;
+        };
+
+        json.key("pipelines");
+        json.beginArray();
+        for (const uint32_t bounces: opt.bounces) {
+            std::cerr << "   bounces " << bounces << "\n";
+            renderer.setMaxBounces(bounces);
+            const double megakernel = time(PathPipeline::Megakernel);
+            const double wavefront = time(PathPipeline::Wavefront);
+            const WavefrontCounters &c = renderer.wavefrontCounters(); // of the last repeat
+            const auto rays = static_cast<double>(c.extensionRays + c.shadowRays);
+
+            json.beginObject();
+            json.field("bounces", bounces);
+            json.field("rays_per_sample", rays / samples);
+            json.field("megakernel_msamples_s", samples / megakernel * 1e-6);
+            json.field("megakernel_mrays_s", rays / megakernel * 1e-6);
+            json.field("wavefront_msamples_s", samples / wavefront * 1e-6);
+            json.field("wavefront_mrays_s", rays / wavefront * 1e-6);
+            json.key("wavefront_stage_ms");
+            json.beginObject();
+            json.field("extend", c.extendSeconds * 1e3);
+            json.field("shade", c.shadeSeconds * 1e3);
+            json.field("connect", c.connectSeconds * 1e3);
+            json.endObject();
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void benchScene(JsonWriter &json, const std::string &name, const Options &opt, ThreadPool &pool) {
+        std::cerr << "== " << name << "\n";
+        const auto t0 = clock::now();
+        Scene scene;
+        scene.pool = &pool;
+        if (!setupScene(scene, name, opt.seed)) {
+            std::cerr << "Could not set up scene " << name << ", skipping\n";
+            return;
+        }
+        const double setupMs = seconds(clock::now() - t0) * 1e3;
+
+        // same starting pose as MovementHandler
+        const float aspect = static_cast<float>(opt.width) / static_cast<float>(opt.height);
+        const Camera cam = makeCamera({-2, 3, 6}, std::numbers::pi_v<float> * 11 / 12,
+                                      -std::numbers::pi_v<float> * 1 / 12, 45.0f, aspect);
+        const RaySet rays = makeRays(scene, cam, opt, pool);
+        const std::vector<Triangle> subject = largestMesh();
+
+        json.beginObject();
+        json.field("name", name);
+        json.field("triangles", scene.triangles.size());
+        json.field("vertices", scene.vertices.size());
+        json.field("setup_ms", setupMs);
+        json.key("rays");
+        json.beginObject();
+        json.field("primary", rays.primary.size());
+        json.field("diffuse", rays.diffuse.size());
+        json.field("shadow", rays.shadow.size());
+        json.endObject();
+
+        json.key("builders");
+        json.beginArray();
+        std::vector<std::pair<BvhBuildMode, bool>> variants; // builder, optimised
+        for (BvhBuildMode mode: opt.builders) {
+            variants.emplace_back(mode, false);
+            if (opt.optimizeMs >= 0.0f) variants.emplace_back(mode, true);
+        }
+        for (const auto &[mode, optimized]: variants) {
+            const std::string builder = std::string(bvhBuildModeName(mode)) + (optimized ? "+opt" : "");
+            std::cerr << "-- " << builder << "\n";
+            BvhOptimizeSettings optimize;
+            optimize.enabled = optimized;
+            optimize.timeBudgetMs = std::max(opt.optimizeMs, 0.0f);
+            double buildSeconds = 1e30, optimizeSeconds = 1e30;
+            BvhOptimizeStats stats;
+            std::vector<BVHNode> nodes;
+            std::vector<int> triIndices;
+            for (uint32_t r = 0; r < opt.repeat; ++r) {
+                const auto b0 = clock::now();
+                BvhBuilder::build(mode, subject, nodes, triIndices, &pool);
+                buildSeconds = std::min(buildSeconds, seconds(clock::now() - b0));
+                if (!optimized) continue;
+                const auto o0 = clock::now();
+                stats = BvhOptimizer::optimize(nodes, triIndices, optimize, &pool);
+                optimizeSeconds = std::min(optimizeSeconds, seconds(clock::now() - o0));
+            }
+
+            json.beginObject();
+            json.field("builder", builder);
+            json.field("mesh_triangles", subject.size());
+            json.field("build_ms", buildSeconds * 1e3);
+            json.field("nodes", nodes.size());
+            json.field("references", triIndices.size()); // more than mesh_triangles after spatial splits
+            json.field("depth", nodes.empty() ? 0 : BvhBuilder::depth(nodes));
+            json.field("sah_cost", nodes.empty() ? 0.0f : BvhBuilder::sahCost(nodes));
+            if (optimized) {
+                json.field("optimize_ms", optimizeSeconds * 1e3);
+                json.field("optimize_passes", stats.passes);
+                json.field("built_sah_cost", stats.costBefore);
+            }
+
+            scene.bvhMode = mode;
+            scene.bvhOptimize = optimize;
+            scene.buildAccel();
+            json.key("widths");
+            json.beginArray();
+            for (int width: opt.widths) {
+                json.beginObject();
+                json.field("width", width);
+                std::vector<uint32_t> roots;
+                for (const SceneMesh &mesh: scene.meshes) {
+                    if (mesh.nodeCount > 0) roots.push_back(mesh.rootNode);
+                }
+                if (width == 4) {
+                    WideBvh<4> wide;
+                    const auto w0 = clock::now();
+                    wide.build(scene.bvhNodes, scene.triangles, scene.vertices, roots);
+                    json.field("collapse_ms", seconds(clock::now() - w0) * 1e3);
+                    traversalStats(json, scene, WideBlas<4>{wide}, rays, opt, pool);
+                } else if (width == 8) {
+                    WideBvh<8> wide;
+                    const auto w0 = clock::now();
+                    wide.build(scene.bvhNodes, scene.triangles, scene.vertices, roots);
+                    json.field("collapse_ms", seconds(clock::now() - w0) * 1e3);
+                    traversalStats(json, scene, WideBlas<8>{wide}, rays, opt, pool);
+                } else {
+                    traversalStats(json, scene, BinaryBlas{scene}, rays, opt, pool);
+                }
+
+                CpuRenderer renderer(scene, opt.width, opt.height, pool);
+                renderer.setBvhWidth(width);
+                const auto r0 = clock::now();
+                for (uint32_t f = 0; f < opt.spp; ++f) renderer.render(cam);
+                const double renderSeconds = seconds(clock::now() - r0);
+                json.field("msamples_s", static_cast<double>(opt.width) * opt.height * opt.spp / renderSeconds * 1e-6);
+                json.endObject();
+            }
+            json.endArray();
+            json.endObject();
+        }
+        json.endArray();
+        scene.bvhOptimize = {};
+        if (!opt.bounces.empty()) pipelines(json, scene, cam, opt, pool);
+        if (opt.rmseTarget > 0.0f) convergence(json, scene, cam, opt, pool);
+        json.endObject();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--scene" && hasValue) {
+            opt.scenes.push_back(argv[++i]);
+        } else if (arg == "--builders" && hasValue) {
+            opt.builders.clear();
+            for (const std::string &b: split(argv[++i])) {
+                if (b == "median") opt.builders.push_back(BvhBuildMode::Median);
+                else if (b == "sah") opt.builders.push_back(BvhBuildMode::BinnedSah);
+                else if (b == "lbvh") opt.builders.push_back(BvhBuildMode::Lbvh);
+                else if (b == "sbvh") opt.builders.push_back(BvhBuildMode::Sbvh);
+                else {
+                    std::cerr << "Unknown BVH builder: " << b << "\n";
+                    return 1;
+                }
+            }
+        } else if (arg == "--optimize" && hasValue) {
+            opt.optimizeMs = std::max(std::strtof(argv[++i], nullptr), 0.0f);
+        } else if (arg == "--widths" && hasValue) {
+            opt.widths.clear();
+            for (const std::string &w: split(argv[++i])) {
+                const int width = std::atoi(w.c_str());
+                if (width != 2 && width != 4 && width != 8) {
+                    std::cerr << "BVH width must be 2, 4 or 8\n";
+                    return 1;
+                }
+                opt.widths.push_back(width);
+            }
+        } else if (arg == "--res" && hasValue) {
+            const std::string res = argv[++i];
+            const size_t x = res.find('x');
+            opt.width = static_cast<uint32_t>(std::strtoul(res.c_str(), nullptr, 10));
+            opt.height = x == std::string::npos ? 0 : static_cast<uint32_t>(std::strtoul(res.c_str() + x + 1, nullptr, 10));
+            if (opt.width == 0 || opt.height == 0) {
+                std::cerr << "Resolution must look like 800x600\n";
+                return 1;
+            }
+        } else if (arg == "--spp" && hasValue) {
+            opt.spp = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--repeat" && hasValue) {
+            opt.repeat = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--seed" && hasValue) {
+            opt.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--threads" && hasValue) {
+            opt.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rmse-target" && hasValue) {
+            opt.rmseTarget = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--reference-spp" && hasValue) {
+            opt.referenceSpp = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--samplers" && hasValue) {
+            opt.samplers.clear();
+            for (const std::string &name: split(argv[++i])) {
+                const std::optional<SamplerType> type = parseSamplerType(name);
+                if (!type) {
+                    std::cerr << "Unknown sampler: " << name << "\n";
+                    return 1;
+                }
+                opt.samplers.push_back(*type);
+            }
+        } else if (arg == "--bounces" && hasValue) {
+            opt.bounces.clear();
+            for (const std::string &b: split(argv[++i])) {
+                const auto bounces = static_cast<uint32_t>(std::strtoul(b.c_str(), nullptr, 10));
+                if (bounces == 0) {
+                    std::cerr << "Bounce counts must be positive\n";
+                    return 1;
+                }
+                opt.bounces.push_back(bounces);
+            }
+        } else if (arg == "--label" && hasValue) {
+            opt.label = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            opt.output = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (opt.scenes.empty()) opt.scenes = {"teapot", "cube", "procedural:100k"};
+
+    // the scene and BVH code log to std::cout; keep stdout for the JSON
+    std::streambuf *stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+    std::ofstream file;
+    if (!opt.output.empty()) {
+        file.open(opt.output);
+        if (!file) {
+            std::cerr << "Failed to open " << opt.output << "\n";
+            return 1;
+        }
+    }
+    std::ostream out(opt.output.empty() ? stdoutBuf : file.rdbuf());
+
+    ThreadPool pool(opt.threads);
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("label", opt.label);
+    json.field("threads", pool.size());
+    json.key("resolution");
+    json.beginArray();
+    json.value(opt.width);
+    json.value(opt.height);
+    json.endArray();
+    json.field("spp", opt.spp);
+    json.field("repeat", opt.repeat);
+    json.field("seed", opt.seed);
+    json.key("scenes");
+    json.beginArray();
+    for (const std::string &name: opt.scenes) benchScene(json, name, opt, pool);
+    json.endArray();
+    json.endObject();
+
+    out.flush();
+    std::cout.rdbuf(stdoutBuf);
+    if (!opt.output.empty()) std::cerr << "Wrote " << opt.output << "\n";
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef AABB_H
+#define AABB_H
+#include <cmath>
+
+#include "../Math/Simd.h"
+#include "../Math/Transform.h"
+#include "../Primitives/Primitives.h"
+
+struct AABB {
+    simd::float3 bmin = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
+    simd::float3 bmax = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+
+    void grow(const simd::float3 &p) {
+        bmin = simd::min(bmin, p);
+        bmax = simd::max(bmax, p);
+    }
+
+    void grow(const AABB &b) {
+        bmin = simd::min(bmin, b.bmin);
+        bmax = simd::max(bmax, b.bmax);
+    }
+
+    bool empty() const { return bmin.x > bmax.x; }
+
+    simd::float3 extent() const { return bmax - bmin; }
+
+    simd::float3 center() const { return (bmin + bmax) * 0.5f; }
+
+    // Surface area; 0 for an empty box so it never contributes to a SAH sum.
+    float area() const {
+        if (empty()) return 0.0f;
+        simd::float3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Bounds of this box after an affine transform (of all eight corners).
+    AABB transformed(const simd::float4x4 &m) const {
+        AABB b;
+        if (empty()) return b;
+        for (int i = 0; i < 8; ++i) {
+            b.grow(transformPoint(m, {
+                                      (i & 1) ? bmax.x : bmin.x,
+                                      (i & 2) ? bmax.y : bmin.y,
+                                      (i & 4) ? bmax.z : bmin.z
+                                  }));
+        }
+        return b;
+    }
+
+    static AABB of(const Triangle &T) {
+        AABB b;
+        b.grow(T.v0);
+        b.grow(T.v1);
+        b.grow(T.v2);
+        return b;
+    }
+};
+
+#endif //AABB_H
@@ -0,0 +1,71 @@
+#ifndef BUILDUTIL_H
+#define BUILDUTIL_H
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "BvhNode.h"
+#include "../ThreadPool.h"
+
+// Helpers shared by the BVH builders.
+namespace BuildUtil {
+    // ranges at least this large are processed in parallel chunks
+    static constexpr int kParallelPassSize = 65536;
+    static constexpr int kChunkSize = 16384;
+
+    inline int chunkCount(ThreadPool *pool, int count) {
+        if (!pool || pool->size() == 1 || count < kParallelPassSize) return 1;
+        return (count + kChunkSize - 1) / kChunkSize;
+    }
+
+    // Run fn(chunk, begin, end) over [start,end), in parallel when the range is large.
+    template<typename Fn>
+    void forEachChunk(ThreadPool *pool, int start, int end, Fn &&fn) {
+        const int chunks = chunkCount(pool, end - start);
+        if (chunks == 1) {
+            fn(0, start, end);
+            return;
+        }
+        pool->parallelFor(chunks, [&](size_t c) {
+            const int begin = start + static_cast<int>(c) * kChunkSize;
+            fn(static_cast<int>(c), begin, std::min(begin + kChunkSize, end));
+        });
+    }
+
+    // Builders that run subtrees concurrently give a node over n primitives the
+    // slots [i, i + 2n - 1) of a scratch array (a binary subtree never needs more),
+    // placing the left child at i + 1 and the right child at i + 2 * leftCount.
+    // This copies the reachable nodes into `nodes` in depth-first order (node, left
+    // subtree, right subtree) and renumbers the child links.
+    inline void compactDepthFirst(const std::vector<BVHNode> &sparse, std::vector<BVHNode> &nodes) {
+        nodes.clear();
+        nodes.reserve(sparse.size());
+
+        struct Item {
+            uint32_t src;
+            int parent;
+            bool isRight;
+        };
+        std::vector<Item> stack;
+        stack.push_back({0, -1, false});
+        while (!stack.empty()) {
+            const Item item = stack.back();
+            stack.pop_back();
+
+            const auto newIndex = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(sparse[item.src]);
+            if (item.parent >= 0) {
+                if (item.isRight) nodes[item.parent].rightFirst = newIndex;
+                else nodes[item.parent].leftFirst = newIndex;
+            }
+
+            const BVHNode &n = sparse[item.src];
+            if (n.count == 0) {
+                stack.push_back({n.rightFirst, static_cast<int>(newIndex), true});
+                stack.push_back({n.leftFirst, static_cast<int>(newIndex), false});
+            }
+        }
+    }
+}
+
+#endif //BUILDUTIL_H
@@ -2,18 +2,152 @@
 #ifndef BVHBUILDER_H
 #define BVHBUILDER_H
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <fstream>
+#include <string>
+#include <utility>
 #include <vector>
-#include <simd/common.h>
 
+#include "../Math/Simd.h"
+
+#include "Aabb.h"
 #include "BvhNode.h"
+#include "BvhOptimizer.h"
+#include "BvhRefit.h"
+#include "LbvhBuilder.h"
+#include "SahBuilder.h"
+#include "SbvhBuilder.h"
+#include "../ThreadPool.h"
 #include "../Primitives/Primitives.h"
 
 static constexpr int kMaxBVHNodes = 1000000; // tune to your GPU budget
 static constexpr size_t kMaxTriangles = 500000; // likewise
+// levels, root included, of every traversed tree; the traversal stacks
+// (MAX_STACK_DEPTH in Integrator.h and kernel.metal) are sized so this never overflows them
+static constexpr int kMaxBvhDepth = 32;
+
+enum class BvhBuildMode {
+    Median, // longest axis, split at the median triangle, 4 tris per leaf
+    BinnedSah, // binned surface area heuristic, leaf size chosen by cost
+    Lbvh, // Morton-ordered linear BVH, fastest to build
+    Sbvh, // binned SAH plus spatial splits, for long or large triangles; slowest to build
+};
+
+inline const char *bvhBuildModeName(BvhBuildMode mode) {
+    switch (mode) {
+        case BvhBuildMode::Median: return "median";
+        case BvhBuildMode::BinnedSah: return "sah";
+        case BvhBuildMode::Lbvh: return "lbvh";
+        case BvhBuildMode::Sbvh: return "sbvh";
+    }
+    return "?";
+}
 
 struct BvhBuilder {
+    // Build a BVH over all of `tris` with the chosen builder. `triIndices` is
+    // (re)initialised to the identity and comes back in leaf order; with Sbvh it may
+    // list a triangle more than once and so be longer than `tris`. Builders that
+    // support it run on `pool` when one is given.
+    static void build(
+        BvhBuildMode mode,
+        const std::vector<Triangle> &tris,
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        ThreadPool *pool = nullptr,
+        const SbvhSettings &sbvh = {}
+    ) {
+        nodes.clear();
+        triIndices.resize(tris.size());
+        for (size_t i = 0; i < tris.size(); ++i) triIndices[i] = static_cast<int>(i);
+        if (tris.empty()) return;
+
+        switch (mode) {
+            case BvhBuildMode::Median:
+                buildBVH(0, static_cast<int>(tris.size()), tris, nodes, triIndices);
+                break;
+            case BvhBuildMode::BinnedSah:
+                SahBuilder::build(tris, nodes, triIndices, {}, pool);
+                break;
+            case BvhBuildMode::Lbvh:
+                LbvhBuilder::build(tris, nodes, triIndices, pool);
+                break;
+            case BvhBuildMode::Sbvh:
+                SbvhBuilder::build(tris, nodes, triIndices, sbvh);
+                break;
+        }
+    }
+
+    // Expected cost of a random ray against the tree under `root`, relative to the
+    // root box: sum of Ct * A(inner)/A(root) + Ci * count * A(leaf)/A(root).
+    // Lower is better.
+    static float sahCost(
+        const std::vector<BVHNode> &nodes,
+        uint32_t root = 0,
+        float traversalCost = 1.0f,
+        float intersectionCost = 1.0f
+    ) {
+        if (nodes.empty()) return 0.0f;
+        auto area = [](const BVHNode &n) {
+            AABB b{n.bboxMin, n.bboxMax};
+            return b.area();
+        };
+        const float rootArea = area(nodes[root]);
+        if (rootArea <= 0.0f) return 0.0f;
+
+        double cost = 0.0;
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const BVHNode &n = nodes[stack.back()];
+            stack.pop_back();
+            const double rel = area(n) / rootArea;
+            if (n.count > 0) {
+                cost += intersectionCost * n.count * rel;
+            } else {
+                cost += traversalCost * rel;
+                stack.push_back(n.leftFirst);
+                stack.push_back(n.rightFirst);
+            }
+        }
+        return static_cast<float>(cost);
+    }
+
+    // Collapse every inner node `maxDepth` levels down (the root is level 1) into a
+    // leaf over its whole subtree, so no path gets longer. A subtree's primitives
+    // are one contiguous range (see BvhRefit::subtreeExtent), so the leaf can index
+    // them as they are. Returns the number of subtrees collapsed.
+    static int limitDepth(std::vector<BVHNode> &nodes, int maxDepth) {
+        if (nodes.empty()) return 0;
+        std::vector<BVHNode> sparse = nodes;
+        int collapsed = 0;
+        std::vector<std::pair<uint32_t, int>> stack = {{0, 1}};
+        while (!stack.empty()) {
+            const auto [ni, level] = stack.back();
+            stack.pop_back();
+            const BVHNode &n = nodes[ni];
+            if (n.count > 0) continue;
+            if (level < maxDepth) {
+                stack.emplace_back(n.leftFirst, level + 1);
+                stack.emplace_back(n.rightFirst, level + 1);
+                continue;
+            }
+            uint32_t first, count, span;
+            BvhRefit::subtreeExtent(nodes, ni, first, count, span);
+            sparse[ni] = {n.bboxMin, n.bboxMax, first, 0, count};
+            ++collapsed;
+        }
+        if (collapsed > 0) BuildUtil::compactDepthFirst(sparse, nodes);
+        return collapsed;
+    }
+
+    // Longest root-to-leaf path, counting the root as depth 1.
+    static int depth(const std::vector<BVHNode> &nodes, int nodeIndex = 0) {
+        if (nodes.empty()) return 0;
+        const BVHNode &n = nodes[nodeIndex];
+        if (n.count > 0) return 1;
+        return 1 + std::max(depth(nodes, static_cast<int>(n.leftFirst)), depth(nodes, static_cast<int>(n.rightFirst)));
+    }
+
     static int buildBVH(
         int start,
         int end,
@@ -1,7 +1,7 @@
 #ifndef BVHNODE_H
 #define BVHNODE_H
 #include <cstdint>
-#include <simd/vector_types.h>
+#include "../Math/Simd.h"
 
 struct BVHNode {
     simd::float3 bboxMin;
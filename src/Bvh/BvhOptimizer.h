@@ -0,0 +1,278 @@
+#ifndef BVHOPTIMIZER_H
+#define BVHOPTIMIZER_H
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Aabb.h"
+#include "BuildUtil.h"
+#include "BvhNode.h"
+#include "../ThreadPool.h"
+
+struct BvhOptimizeSettings {
+    bool enabled = false;
+    int treeletLeaves = 7; // 3 to 8; the search per node grows as 3^n
+    float traversalCost = 1.0f; // as in SahSettings
+    float intersectionCost = 1.0f;
+    // stop after a pass that lowers the SAH cost by less than this fraction...
+    float minImprovement = 0.01f;
+    // ...or once this much time has passed (0: no limit), keeping the work done
+    float timeBudgetMs = 0.0f;
+    int maxPasses = 16;
+};
+
+struct BvhOptimizeStats {
+    int passes = 0;
+    float costBefore = 0.0f, costAfter = 0.0f; // SAH cost, as BvhBuilder::sahCost
+    double ms = 0.0;
+};
+
+// Post-build optimisation by treelet restructuring (Karras and Aila 2013). Bottom-up,
+// every inner node grows a treelet of up to treeletLeaves subtrees, always opening
+// the largest one, and gets the topology above those subtrees with the lowest SAH
+// cost, found exactly by dynamic programming over subsets. Leaves keep their
+// triangles, so this mostly helps trees that were fast to build but poor (median,
+// LBVH); passes repeat until one gains less than minImprovement or time runs out.
+//
+// Disjoint subtrees are restructured in parallel, then the nodes above them. The
+// node count never changes; the result is re-laid out by reorderDepthFirst.
+struct BvhOptimizer {
+    static constexpr int kMaxTreeletLeaves = 8;
+    // subtrees up to this many nodes are restructured as one task
+    static constexpr uint32_t kTaskNodes = 8192;
+
+    static BvhOptimizeStats optimize(
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        const BvhOptimizeSettings &settings,
+        ThreadPool *pool = nullptr
+    ) {
+        BvhOptimizeStats stats;
+        if (nodes.empty()) return stats;
+        const auto start = std::chrono::steady_clock::now();
+        const float rootArea = area(nodes[0]);
+
+        std::vector<float> costs(nodes.size(), 0.0f);
+        const Pass pass{
+            nodes, costs, settings, std::clamp(settings.treeletLeaves, 3, kMaxTreeletLeaves),
+            settings.timeBudgetMs > 0.0f
+                ? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double, std::milli>(settings.timeBudgetMs))
+                : std::chrono::steady_clock::time_point::max()
+        };
+        float cost = rootArea > 0.0f ? subtreeCost(pass, 0) / rootArea : 0.0f;
+        stats.costBefore = cost;
+        while (stats.passes < settings.maxPasses && std::chrono::steady_clock::now() < pass.deadline) {
+            run(pass, pool);
+            ++stats.passes;
+            const float next = rootArea > 0.0f ? costs[0] / rootArea : 0.0f;
+            const bool enough = next < cost * (1.0f - settings.minImprovement);
+            cost = next;
+            if (!enough) break;
+        }
+        stats.costAfter = cost;
+
+        reorderDepthFirst(nodes, triIndices);
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    // Lay the nodes out depth-first (node, left subtree, right subtree) as the
+    // builders do, with the larger child on the left so the one rays enter most
+    // often sits right after its parent, and `triIndices` in leaf order. Every
+    // subtree then covers contiguous node and index ranges again, which refitting
+    // and partial rebuilds rely on (see BvhRefit::subtreeExtent).
+    static void reorderDepthFirst(std::vector<BVHNode> &nodes, std::vector<int> &triIndices) {
+        if (nodes.empty()) return;
+        std::vector<BVHNode> sparse = nodes;
+        for (BVHNode &n: sparse) {
+            if (n.count == 0 && area(sparse[n.rightFirst]) > area(sparse[n.leftFirst])) {
+                std::swap(n.leftFirst, n.rightFirst);
+            }
+        }
+        BuildUtil::compactDepthFirst(sparse, nodes);
+
+        std::vector<int> order;
+        order.reserve(triIndices.size());
+        for (BVHNode &n: nodes) {
+            if (n.count == 0) continue;
+            const uint32_t first = static_cast<uint32_t>(order.size());
+            order.insert(order.end(), triIndices.begin() + n.leftFirst, triIndices.begin() + n.leftFirst + n.count);
+            n.leftFirst = first;
+        }
+        triIndices = std::move(order);
+    }
+
+private:
+    struct Pass {
+        std::vector<BVHNode> &nodes;
+        std::vector<float> &costs; // unnormalised SAH cost of every subtree
+        const BvhOptimizeSettings &settings;
+        int treeletLeaves;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    static float area(const BVHNode &n) { return AABB{n.bboxMin, n.bboxMax}.area(); }
+
+    static float subtreeCost(const Pass &pass, uint32_t root) {
+        float cost = 0.0f;
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const BVHNode &n = pass.nodes[stack.back()];
+            stack.pop_back();
+            if (n.count > 0) {
+                cost += pass.settings.intersectionCost * static_cast<float>(n.count) * area(n);
+            } else {
+                cost += pass.settings.traversalCost * area(n);
+                stack.push_back(n.leftFirst);
+                stack.push_back(n.rightFirst);
+            }
+        }
+        return cost;
+    }
+
+    // One bottom-up pass over the whole tree.
+    static void run(const Pass &pass, ThreadPool *pool) {
+        std::vector<uint32_t> tasks, top;
+        if (!pool || pool->size() == 1) {
+            tasks.push_back(0);
+        } else {
+            std::vector<uint32_t> sizes(pass.nodes.size(), 1);
+            const std::vector<uint32_t> order = preorder(pass.nodes, 0);
+            for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                const BVHNode &n = pass.nodes[*it];
+                if (n.count == 0) sizes[*it] = 1 + sizes[n.leftFirst] + sizes[n.rightFirst];
+            }
+            std::vector<uint32_t> stack = {0};
+            while (!stack.empty()) {
+                const uint32_t ni = stack.back();
+                stack.pop_back();
+                const BVHNode &n = pass.nodes[ni];
+                if (n.count > 0 || sizes[ni] <= kTaskNodes) {
+                    tasks.push_back(ni);
+                } else {
+                    top.push_back(ni);
+                    stack.push_back(n.rightFirst);
+                    stack.push_back(n.leftFirst);
+                }
+            }
+        }
+
+        // a treelet only ever rearranges nodes of its own subtree, so tasks never meet
+        const auto subtree = [&](uint32_t root) {
+            const std::vector<uint32_t> order = preorder(pass.nodes, root);
+            for (auto it = order.rbegin(); it != order.rend(); ++it) restructure(pass, *it);
+        };
+        if (tasks.size() == 1) subtree(tasks[0]);
+        else pool->parallelFor(tasks.size(), [&](size_t t) { subtree(tasks[t]); });
+        // reverse preorder visits children first
+        for (auto it = top.rbegin(); it != top.rend(); ++it) restructure(pass, *it);
+    }
+
+    static std::vector<uint32_t> preorder(const std::vector<BVHNode> &nodes, uint32_t root) {
+        std::vector<uint32_t> order, stack = {root};
+        while (!stack.empty()) {
+            const uint32_t ni = stack.back();
+            stack.pop_back();
+            order.push_back(ni);
+            if (nodes[ni].count == 0) {
+                stack.push_back(nodes[ni].rightFirst);
+                stack.push_back(nodes[ni].leftFirst);
+            }
+        }
+        return order;
+    }
+
+    // Update the cost of `ni` from its children, then rebuild the treelet under it
+    // if a better topology exists. Its descendants must be done already.
+    static void restructure(const Pass &pass, uint32_t ni) {
+        std::vector<BVHNode> &nodes = pass.nodes;
+        std::vector<float> &costs = pass.costs;
+        const BVHNode &node = nodes[ni];
+        if (node.count > 0) {
+            costs[ni] = pass.settings.intersectionCost * static_cast<float>(node.count) * area(node);
+            return;
+        }
+        costs[ni] = pass.settings.traversalCost * area(node) + costs[node.leftFirst] + costs[node.rightFirst];
+        if (std::chrono::steady_clock::now() >= pass.deadline) return;
+
+        // grow the treelet by opening its largest inner leaf
+        std::array<uint32_t, kMaxTreeletLeaves> leaves{node.leftFirst, node.rightFirst};
+        std::array<uint32_t, kMaxTreeletLeaves> inner{}; // opened nodes, reused for the new topology
+        int leafCount = 2, innerCount = 0;
+        while (leafCount < pass.treeletLeaves) {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (int i = 0; i < leafCount; ++i) {
+                const BVHNode &n = nodes[leaves[i]];
+                if (n.count == 0 && area(n) > largestArea) {
+                    largest = i;
+                    largestArea = area(n);
+                }
+            }
+            if (largest < 0) break;
+            const BVHNode &opened = nodes[leaves[largest]];
+            inner[innerCount++] = leaves[largest];
+            leaves[largest] = opened.leftFirst;
+            leaves[leafCount++] = opened.rightFirst;
+        }
+        if (leafCount < 3) return; // two subtrees have only one arrangement
+
+        // cheapest topology of every subset of the treelet's leaves, smaller subsets first
+        constexpr int kSubsets = 1 << kMaxTreeletLeaves;
+        std::array<AABB, kSubsets> boxes;
+        std::array<float, kSubsets> best;
+        std::array<uint8_t, kSubsets> split;
+        const uint32_t full = (1u << leafCount) - 1;
+        for (uint32_t s = 1; s <= full; ++s) {
+            const uint32_t low = s & (0u - s);
+            if (s == low) {
+                const BVHNode &leaf = nodes[leaves[std::countr_zero(s)]];
+                boxes[s] = AABB{leaf.bboxMin, leaf.bboxMax};
+                best[s] = costs[leaves[std::countr_zero(s)]];
+                continue;
+            }
+            boxes[s] = boxes[s ^ low];
+            boxes[s].grow(boxes[low]);
+            // every partition once: p is the side holding the lowest leaf
+            float cheapest = HUGE_VALF;
+            uint32_t choice = low;
+            for (uint32_t p = (s - 1) & s; p != 0; p = (p - 1) & s) {
+                if (!(p & low)) continue;
+                const float c = best[p] + best[s ^ p];
+                if (c < cheapest) {
+                    cheapest = c;
+                    choice = p;
+                }
+            }
+            best[s] = pass.settings.traversalCost * boxes[s].area() + cheapest;
+            split[s] = static_cast<uint8_t>(choice);
+        }
+        if (!(best[full] < costs[ni] * (1.0f - 1e-6f))) return; // no real gain, keep it stable
+
+        int nextInner = 0;
+        const auto emit = [&](const auto &self, uint32_t s, uint32_t index) -> void {
+            uint32_t child[2];
+            for (int side = 0; side < 2; ++side) {
+                const uint32_t sub = side == 0 ? split[s] : s ^ split[s];
+                if (std::has_single_bit(sub)) {
+                    child[side] = leaves[std::countr_zero(sub)];
+                } else {
+                    child[side] = inner[nextInner++];
+                    self(self, sub, child[side]);
+                }
+            }
+            nodes[index] = {boxes[s].bmin, boxes[s].bmax, child[0], child[1], 0};
+            costs[index] = best[s];
+        };
+        emit(emit, full, ni);
+    }
+};
+
+
+#endif //BVHOPTIMIZER_H
@@ -0,0 +1,131 @@
+#ifndef BVHREFIT_H
+#define BVHREFIT_H
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Aabb.h"
+#include "BvhNode.h"
+#include "../Primitives/Primitives.h"
+
+// Bottom-up refitting of an existing BVH after its triangles moved. The topology is
+// kept; only the boxes of the leaves that hold changed triangles and of their
+// ancestors are recomputed.
+struct BvhRefit {
+    // Parent of every node reachable from `root` (-1 for the root itself).
+    // Entries of unreachable nodes are left untouched.
+    static void computeParents(const std::vector<BVHNode> &nodes, uint32_t root, std::vector<int> &parents) {
+        if (parents.size() < nodes.size()) parents.resize(nodes.size(), -1);
+        parents[root] = -1;
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const uint32_t ni = stack.back();
+            stack.pop_back();
+            const BVHNode &n = nodes[ni];
+            if (n.count > 0) continue;
+            parents[n.leftFirst] = static_cast<int>(ni);
+            parents[n.rightFirst] = static_cast<int>(ni);
+            stack.push_back(n.leftFirst);
+            stack.push_back(n.rightFirst);
+        }
+    }
+
+    // Leaf that holds each triangle slot, for the subtree under `root`.
+    static void computeTriangleLeaves(const std::vector<BVHNode> &nodes, uint32_t root,
+                                      std::vector<uint32_t> &triangleLeaf) {
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const uint32_t ni = stack.back();
+            stack.pop_back();
+            const BVHNode &n = nodes[ni];
+            if (n.count > 0) {
+                if (triangleLeaf.size() < n.leftFirst + n.count) triangleLeaf.resize(n.leftFirst + n.count);
+                for (uint32_t i = 0; i < n.count; ++i) triangleLeaf[n.leftFirst + i] = ni;
+            } else {
+                stack.push_back(n.leftFirst);
+                stack.push_back(n.rightFirst);
+            }
+        }
+    }
+
+    // Mark `dirtyLeaves` and all their ancestors, returning the marked nodes
+    // children-first (descending index, valid because children follow parents in
+    // the depth-first layout).
+    static std::vector<uint32_t> collectDirty(const std::vector<int> &parents,
+                                              const std::vector<uint32_t> &dirtyLeaves,
+                                              std::vector<uint8_t> &marked) {
+        if (marked.size() < parents.size()) marked.resize(parents.size(), 0);
+        std::vector<uint32_t> dirty;
+        for (uint32_t leaf: dirtyLeaves) {
+            // climb until we meet a path that is already marked
+            for (int ni = static_cast<int>(leaf); ni >= 0 && !marked[ni]; ni = parents[ni]) {
+                marked[ni] = 1;
+                dirty.push_back(static_cast<uint32_t>(ni));
+            }
+        }
+        std::sort(dirty.begin(), dirty.end(), std::greater<>());
+        return dirty;
+    }
+
+    // Recompute the boxes of `dirty` (children-first order, see collectDirty).
+    static void refit(std::vector<BVHNode> &nodes, const std::vector<SceneTriangle> &tris,
+                      const std::vector<SceneVertex> &verts, const std::vector<uint32_t> &dirty) {
+        for (uint32_t ni: dirty) {
+            BVHNode &n = nodes[ni];
+            AABB b;
+            if (n.count > 0) {
+                for (uint32_t i = 0; i < n.count; ++i) {
+                    const SceneTriangle &T = tris[n.leftFirst + i];
+                    b.grow(verts[T.v0].position());
+                    b.grow(verts[T.v1].position());
+                    b.grow(verts[T.v2].position());
+                }
+            } else {
+                b.grow(AABB{nodes[n.leftFirst].bboxMin, nodes[n.leftFirst].bboxMax});
+                b.grow(AABB{nodes[n.rightFirst].bboxMin, nodes[n.rightFirst].bboxMax});
+            }
+            n.bboxMin = b.bmin;
+            n.bboxMax = b.bmax;
+        }
+    }
+
+    // Deepest marked node whose subtree contains every marked leaf: walk down from
+    // `root` while exactly one child is marked.
+    static uint32_t dirtyRoot(const std::vector<BVHNode> &nodes, const std::vector<uint8_t> &marked, uint32_t root) {
+        uint32_t ni = root;
+        while (nodes[ni].count == 0) {
+            const bool l = marked[nodes[ni].leftFirst];
+            const bool r = marked[nodes[ni].rightFirst];
+            if (l == r) break;
+            ni = l ? nodes[ni].leftFirst : nodes[ni].rightFirst;
+        }
+        return ni;
+    }
+
+    // Triangle range [first, first + count) and node span [root, root + span) of a
+    // subtree. Both are contiguous in the depth-first layout.
+    static void subtreeExtent(const std::vector<BVHNode> &nodes, uint32_t root,
+                              uint32_t &first, uint32_t &count, uint32_t &span) {
+        first = UINT32_MAX;
+        count = 0;
+        uint32_t last = root;
+        std::vector<uint32_t> stack = {root};
+        while (!stack.empty()) {
+            const uint32_t ni = stack.back();
+            stack.pop_back();
+            last = std::max(last, ni);
+            const BVHNode &n = nodes[ni];
+            if (n.count > 0) {
+                first = std::min(first, n.leftFirst);
+                count += n.count;
+            } else {
+                stack.push_back(n.leftFirst);
+                stack.push_back(n.rightFirst);
+            }
+        }
+        span = last - root + 1;
+    }
+};
+
+
+#endif //BVHREFIT_H
@@ -0,0 +1,257 @@
+#ifndef LBVHBUILDER_H
+#define LBVHBUILDER_H
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "Aabb.h"
+#include "BuildUtil.h"
+#include "BvhNode.h"
+#include "SahBuilder.h"
+#include "../ThreadPool.h"
+#include "../Primitives/Primitives.h"
+
+// Linear BVH (Karras 2012): sort triangles along a 63-bit Morton curve of their
+// centroids, then derive the hierarchy directly from the sorted keys. Every step is
+// O(n) per pass and parallel, so it rebuilds far faster than the top-down builders
+// at the price of a worse tree. Output uses the usual BVHNode layout.
+struct LbvhBuilder {
+    static constexpr int kMaxLeafSize = 4;
+    static constexpr int kParallelSubtreeSize = 4096;
+
+    static int build(
+        const std::vector<Triangle> &tris,
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        ThreadPool *pool = nullptr
+    ) {
+        const int n = static_cast<int>(tris.size());
+        if (n == 0) return 0;
+
+        const std::vector<SahBuilder::PrimRef> refs = SahBuilder::makePrimRefs(tris, pool);
+
+        // 1) Morton codes of the centroids, quantised to 21 bits per axis
+        const int chunks = BuildUtil::chunkCount(pool, n);
+        std::vector<AABB> partial(chunks);
+        BuildUtil::forEachChunk(pool, 0, n, [&](int c, int begin, int end) {
+            for (int i = begin; i < end; ++i) partial[c].grow(refs[i].centroid);
+        });
+        AABB centroidBounds;
+        for (const auto &b: partial) centroidBounds.grow(b);
+
+        const simd::float3 cMin = centroidBounds.bmin;
+        const simd::float3 cExtent = centroidBounds.extent();
+        simd::float3 scale;
+        for (int axis = 0; axis < 3; ++axis) {
+            scale[axis] = cExtent[axis] > 0.0f ? static_cast<float>(kMortonMax) / cExtent[axis] : 0.0f;
+        }
+
+        std::vector<uint64_t> keys(n);
+        triIndices.resize(n);
+        BuildUtil::forEachChunk(pool, 0, n, [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const simd::float3 q = (refs[i].centroid - cMin) * scale;
+                keys[i] = morton3(quantise(q.x), quantise(q.y), quantise(q.z));
+                triIndices[i] = i;
+            }
+        });
+
+        // 2) sort (key, triangle) pairs
+        radixSort(keys, triIndices, pool);
+
+        // 3) Karras hierarchy: internal node i splits a contiguous key range
+        std::vector<InternalNode> internal(n > 1 ? n - 1 : 0);
+        BuildUtil::forEachChunk(pool, 0, n - 1, [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) internal[i] = buildInternal(keys, i);
+        });
+
+        // 4) emit BVHNodes depth-first with bounds, collapsing small ranges into leaves
+        std::vector<BVHNode> sparse(2 * static_cast<size_t>(n) - 1);
+        const Context ctx{refs, triIndices, internal, sparse, pool};
+        emit(ctx, n > 1 ? ChildRef{0, false} : ChildRef{0, true}, 0);
+
+        BuildUtil::compactDepthFirst(sparse, nodes);
+        return 0;
+    }
+
+private:
+    static constexpr uint32_t kMortonMax = (1u << 21) - 1;
+
+    struct ChildRef {
+        uint32_t index;
+        bool leaf; // `index` is a sorted primitive, otherwise an internal node
+    };
+
+    struct InternalNode {
+        uint32_t first, last; // covered range of sorted primitives, inclusive
+        ChildRef left, right;
+    };
+
+    struct Context {
+        const std::vector<SahBuilder::PrimRef> &refs;
+        const std::vector<int> &triIndices;
+        const std::vector<InternalNode> &internal;
+        std::vector<BVHNode> &nodes;
+        ThreadPool *pool;
+    };
+
+    static uint32_t quantise(float v) {
+        return static_cast<uint32_t>(std::clamp(v, 0.0f, static_cast<float>(kMortonMax)));
+    }
+
+    // Spread the low 21 bits of v so they occupy every third bit.
+    static uint64_t expandBits(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    static uint64_t morton3(uint32_t x, uint32_t y, uint32_t z) {
+        return expandBits(x) << 2 | expandBits(y) << 1 | expandBits(z);
+    }
+
+    // LSD radix sort on 8-bit digits. Each pass histograms chunks in parallel,
+    // prefix-sums per (digit, chunk) and scatters stably. Passes where every key
+    // shares the digit are skipped.
+    static void radixSort(std::vector<uint64_t> &keys, std::vector<int> &values, ThreadPool *pool) {
+        const int n = static_cast<int>(keys.size());
+        std::vector<uint64_t> keysTmp(n);
+        std::vector<int> valuesTmp(n);
+        const int chunks = BuildUtil::chunkCount(pool, n);
+        std::vector<std::array<uint32_t, 256> > hist(chunks);
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            BuildUtil::forEachChunk(pool, 0, n, [&](int c, int begin, int end) {
+                hist[c].fill(0);
+                for (int i = begin; i < end; ++i) hist[c][(keys[i] >> shift) & 0xff]++;
+            });
+
+            std::array<uint32_t, 256> total{};
+            for (int c = 0; c < chunks; ++c) {
+                for (int d = 0; d < 256; ++d) total[d] += hist[c][d];
+            }
+            if (std::ranges::any_of(total, [&](uint32_t t) { return t == static_cast<uint32_t>(n); })) continue;
+
+            // hist[c][d] becomes the output offset of chunk c's first key with digit d
+            uint32_t offset = 0;
+            for (int d = 0; d < 256; ++d) {
+                for (int c = 0; c < chunks; ++c) {
+                    const uint32_t count = hist[c][d];
+                    hist[c][d] = offset;
+                    offset += count;
+                }
+            }
+
+            BuildUtil::forEachChunk(pool, 0, n, [&](int c, int begin, int end) {
+                auto &out = hist[c];
+                for (int i = begin; i < end; ++i) {
+                    const uint32_t dst = out[(keys[i] >> shift) & 0xff]++;
+                    keysTmp[dst] = keys[i];
+                    valuesTmp[dst] = values[i];
+                }
+            });
+            keys.swap(keysTmp);
+            values.swap(valuesTmp);
+        }
+    }
+
+    // Length of the common prefix of keys i and j; duplicate keys fall back to their
+    // indices so every key is unique. -1 when j is out of range.
+    static int delta(const std::vector<uint64_t> &keys, int i, int j) {
+        const int n = static_cast<int>(keys.size());
+        if (j < 0 || j >= n) return -1;
+        const uint64_t a = keys[i], b = keys[j];
+        if (a == b) return 64 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+        return std::countl_zero(a ^ b);
+    }
+
+    static InternalNode buildInternal(const std::vector<uint64_t> &keys, int i) {
+        // direction of the range
+        const int d = delta(keys, i, i + 1) - delta(keys, i, i - 1) > 0 ? 1 : -1;
+
+        // upper bound for the range length, then binary search the other end
+        const int deltaMin = delta(keys, i, i - d);
+        int lMax = 2;
+        while (delta(keys, i, i + lMax * d) > deltaMin) lMax *= 2;
+        int l = 0;
+        for (int t = lMax / 2; t >= 1; t /= 2) {
+            if (delta(keys, i, i + (l + t) * d) > deltaMin) l += t;
+        }
+        const int j = i + l * d;
+
+        // binary search the split position
+        const int deltaNode = delta(keys, i, j);
+        int s = 0;
+        for (int t = (l + 1) / 2;; t = (t + 1) / 2) {
+            if (delta(keys, i, i + (s + t) * d) > deltaNode) s += t;
+            if (t == 1) break;
+        }
+        const int gamma = i + s * d + std::min(d, 0);
+
+        InternalNode node{};
+        node.first = static_cast<uint32_t>(std::min(i, j));
+        node.last = static_cast<uint32_t>(std::max(i, j));
+        node.left = {static_cast<uint32_t>(gamma), std::min(i, j) == gamma};
+        node.right = {static_cast<uint32_t>(gamma + 1), std::max(i, j) == gamma + 1};
+        return node;
+    }
+
+    static void range(const Context &ctx, ChildRef ref, uint32_t &first, uint32_t &last) {
+        if (ref.leaf) {
+            first = last = ref.index;
+        } else {
+            first = ctx.internal[ref.index].first;
+            last = ctx.internal[ref.index].last;
+        }
+    }
+
+    // Write the subtree under `ref` starting at `slot` and return its bounds.
+    static AABB emit(const Context &ctx, ChildRef ref, uint32_t slot) {
+        uint32_t first, last;
+        range(ctx, ref, first, last);
+        const uint32_t count = last - first + 1;
+        BVHNode &node = ctx.nodes[slot];
+
+        AABB bounds;
+        if (count <= static_cast<uint32_t>(kMaxLeafSize)) {
+            for (uint32_t i = first; i <= last; ++i) bounds.grow(ctx.refs[ctx.triIndices[i]].bounds);
+            node.leftFirst = first;
+            node.rightFirst = 0;
+            node.count = count;
+        } else {
+            const InternalNode &in = ctx.internal[ref.index];
+            uint32_t leftFirst, leftLast;
+            range(ctx, in.left, leftFirst, leftLast);
+            const uint32_t leftSlot = slot + 1;
+            const uint32_t rightSlot = slot + 2 * (leftLast - leftFirst + 1);
+
+            AABB leftBounds, rightBounds;
+            if (ctx.pool && ctx.pool->size() > 1 && count >= static_cast<uint32_t>(kParallelSubtreeSize)) {
+                ThreadPool::TaskGroup group(*ctx.pool);
+                group.run([&] { leftBounds = emit(ctx, in.left, leftSlot); });
+                rightBounds = emit(ctx, in.right, rightSlot);
+                group.wait();
+            } else {
+                leftBounds = emit(ctx, in.left, leftSlot);
+                rightBounds = emit(ctx, in.right, rightSlot);
+            }
+            bounds = leftBounds;
+            bounds.grow(rightBounds);
+            node.leftFirst = leftSlot;
+            node.rightFirst = rightSlot;
+            node.count = 0;
+        }
+        node.bboxMin = bounds.bmin;
+        node.bboxMax = bounds.bmax;
+        return bounds;
+    }
+};
+
+
+#endif //LBVHBUILDER_H
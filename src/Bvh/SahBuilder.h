@@ -0,0 +1,307 @@
+#ifndef SAHBUILDER_H
+#define SAHBUILDER_H
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "Aabb.h"
+#include "BuildUtil.h"
+#include "BvhNode.h"
+#include "../ThreadPool.h"
+#include "../Primitives/Primitives.h"
+
+struct SahSettings {
+    int binCount = 16; // candidate planes per axis = binCount - 1
+    float traversalCost = 1.0f; // cost of one AABB test, relative to...
+    float intersectionCost = 1.0f; // ...one triangle test
+    int maxLeafSize = 16; // leaves never get larger than this
+};
+
+// Binned Surface Area Heuristic builder. Produces the same node layout as
+// BvhBuilder::buildBVH (depth-first, leaves index contiguous ranges of triIndices),
+// but picks split planes and leaf sizes by estimated traversal cost.
+//
+// With a ThreadPool, large subtrees are built as separate tasks and the bounds,
+// binning and partition passes over large ranges are split into chunks. Subtrees
+// get disjoint node ranges (see BuildUtil::compactDepthFirst), so concurrent
+// builds never share an allocation.
+struct SahBuilder {
+    static constexpr int kMaxBins = 32;
+    // ranges at least this large are built as their own task
+    static constexpr int kParallelSubtreeSize = 4096;
+
+    using Settings = SahSettings;
+
+    // Per-triangle data the split search needs, computed once up front.
+    struct PrimRef {
+        AABB bounds;
+        simd::float3 centroid;
+    };
+
+    static std::vector<PrimRef> makePrimRefs(const std::vector<Triangle> &tris, ThreadPool *pool = nullptr) {
+        std::vector<PrimRef> refs(tris.size());
+        BuildUtil::forEachChunk(pool, 0, static_cast<int>(tris.size()), [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                refs[i].bounds = AABB::of(tris[i]);
+                refs[i].centroid = (tris[i].v0 + tris[i].v1 + tris[i].v2) / 3.0f;
+            }
+        });
+        return refs;
+    }
+
+    static int build(
+        const std::vector<Triangle> &tris,
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        const Settings &settings = {},
+        ThreadPool *pool = nullptr
+    ) {
+        return build(makePrimRefs(tris, pool), nodes, triIndices, settings, pool);
+    }
+
+    // Same, over arbitrary boxes (e.g. object instances) instead of triangles.
+    static int build(
+        const std::vector<PrimRef> &refs,
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        const Settings &settings = {},
+        ThreadPool *pool = nullptr
+    ) {
+        const int count = static_cast<int>(triIndices.size());
+        if (count == 0) return 0;
+
+        std::vector<BVHNode> sparse(2 * static_cast<size_t>(count) - 1);
+        std::vector<int> scratch(pool ? count : 0);
+
+        Context ctx{refs, triIndices, sparse, scratch, settings, pool};
+        buildNode(ctx, 0, 0, count);
+
+        BuildUtil::compactDepthFirst(sparse, nodes);
+        return 0;
+    }
+
+private:
+    // A chosen split: `axis < 0` means "make a leaf".
+    struct Split {
+        int axis = -1;
+        int bin = 0; // primitives in bins [0, bin) go left
+        float cost = 0.0f;
+    };
+
+    struct Context {
+        const std::vector<PrimRef> &refs;
+        std::vector<int> &triIndices;
+        std::vector<BVHNode> &nodes;
+        std::vector<int> &scratch; // partition buffer for the parallel passes
+        const Settings &settings;
+        ThreadPool *pool;
+    };
+
+    struct Bins {
+        std::array<std::array<AABB, kMaxBins>, 3> bounds{};
+        std::array<std::array<int, kMaxBins>, 3> counts{};
+    };
+
+    struct BinMapping {
+        simd::float3 cMin;
+        simd::float3 scale; // 0 on axes where all centroids coincide
+        int binCount;
+
+        int binOf(const simd::float3 &centroid, int axis) const {
+            return std::clamp(static_cast<int>((centroid[axis] - cMin[axis]) * scale[axis]), 0, binCount - 1);
+        }
+    };
+
+    static void computeBounds(const Context &ctx, int start, int end, AABB &bounds, AABB &centroidBounds) {
+        const int chunks = BuildUtil::chunkCount(ctx.pool, end - start);
+        std::vector<AABB> b(chunks), cb(chunks);
+        BuildUtil::forEachChunk(ctx.pool, start, end, [&](int c, int begin, int stop) {
+            for (int i = begin; i < stop; ++i) {
+                const PrimRef &ref = ctx.refs[ctx.triIndices[i]];
+                b[c].grow(ref.bounds);
+                cb[c].grow(ref.centroid);
+            }
+        });
+        for (int c = 0; c < chunks; ++c) {
+            bounds.grow(b[c]);
+            centroidBounds.grow(cb[c]);
+        }
+    }
+
+    // Evaluate binned SAH over [start,end) and return the cheapest split, or a leaf
+    // if nothing beats intersecting every triangle directly.
+    static Split findSplit(const Context &ctx, int start, int end, const AABB &bounds, const BinMapping &map) {
+        const int count = end - start;
+        const int binCount = map.binCount;
+        const float rootArea = bounds.area();
+        const Settings &settings = ctx.settings;
+
+        const int chunks = BuildUtil::chunkCount(ctx.pool, count);
+        std::vector<Bins> partial(chunks);
+        BuildUtil::forEachChunk(ctx.pool, start, end, [&](int c, int begin, int stop) {
+            Bins &bins = partial[c];
+            for (int i = begin; i < stop; ++i) {
+                const PrimRef &ref = ctx.refs[ctx.triIndices[i]];
+                for (int axis = 0; axis < 3; ++axis) {
+                    int b = map.binOf(ref.centroid, axis);
+                    bins.counts[axis][b]++;
+                    bins.bounds[axis][b].grow(ref.bounds);
+                }
+            }
+        });
+        Bins &bins = partial[0];
+        for (int c = 1; c < chunks; ++c) {
+            for (int axis = 0; axis < 3; ++axis) {
+                for (int b = 0; b < binCount; ++b) {
+                    bins.counts[axis][b] += partial[c].counts[axis][b];
+                    bins.bounds[axis][b].grow(partial[c].bounds[axis][b]);
+                }
+            }
+        }
+
+        Split best;
+        best.cost = settings.intersectionCost * static_cast<float>(count); // leaf cost
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (map.scale[axis] <= 0.0f) continue;
+            const auto &binBounds = bins.bounds[axis];
+            const auto &binCounts = bins.counts[axis];
+
+            // sweep right-to-left for the suffix areas, then left-to-right for the cost
+            std::array<float, kMaxBins> rightArea{};
+            std::array<int, kMaxBins> rightCount{};
+            AABB acc;
+            int n = 0;
+            for (int b = binCount - 1; b > 0; --b) {
+                acc.grow(binBounds[b]);
+                n += binCounts[b];
+                rightArea[b] = acc.area();
+                rightCount[b] = n;
+            }
+
+            acc = AABB{};
+            n = 0;
+            for (int b = 1; b < binCount; ++b) {
+                acc.grow(binBounds[b - 1]);
+                n += binCounts[b - 1];
+                if (n == 0 || rightCount[b] == 0) continue;
+                float cost = settings.traversalCost + settings.intersectionCost *
+                             (acc.area() * static_cast<float>(n) + rightArea[b] * static_cast<float>(rightCount[b])) /
+                             rootArea;
+                if (cost < best.cost) {
+                    best.axis = axis;
+                    best.bin = b;
+                    best.cost = cost;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Move the primitives of bins [0, split.bin) to the front of [start,end).
+    static int partition(const Context &ctx, int start, int end, const BinMapping &map, const Split &split) {
+        auto goesLeft = [&](int t) { return map.binOf(ctx.refs[t].centroid, split.axis) < split.bin; };
+
+        const int chunks = BuildUtil::chunkCount(ctx.pool, end - start);
+        if (chunks == 1) {
+            auto it = std::partition(ctx.triIndices.begin() + start, ctx.triIndices.begin() + end, goesLeft);
+            return static_cast<int>(it - ctx.triIndices.begin());
+        }
+
+        // count per chunk, prefix-sum the offsets, then scatter through the scratch buffer
+        std::vector<int> leftCounts(chunks, 0);
+        BuildUtil::forEachChunk(ctx.pool, start, end, [&](int c, int begin, int stop) {
+            int n = 0;
+            for (int i = begin; i < stop; ++i) n += goesLeft(ctx.triIndices[i]);
+            leftCounts[c] = n;
+        });
+        std::vector<int> leftOffset(chunks), rightOffset(chunks);
+        int totalLeft = 0;
+        for (int c = 0; c < chunks; ++c) {
+            leftOffset[c] = start + totalLeft;
+            totalLeft += leftCounts[c];
+        }
+        int rightBase = start + totalLeft;
+        for (int c = 0; c < chunks; ++c) {
+            rightOffset[c] = rightBase;
+            const int chunkSize = std::min(BuildUtil::kChunkSize, end - (start + c * BuildUtil::kChunkSize));
+            rightBase += chunkSize - leftCounts[c];
+        }
+        BuildUtil::forEachChunk(ctx.pool, start, end, [&](int c, int begin, int stop) {
+            int l = leftOffset[c], r = rightOffset[c];
+            for (int i = begin; i < stop; ++i) {
+                const int t = ctx.triIndices[i];
+                ctx.scratch[goesLeft(t) ? l++ : r++] = t;
+            }
+        });
+        BuildUtil::forEachChunk(ctx.pool, start, end, [&](int, int begin, int stop) {
+            std::copy(ctx.scratch.begin() + begin, ctx.scratch.begin() + stop, ctx.triIndices.begin() + begin);
+        });
+        return start + totalLeft;
+    }
+
+    static void buildNode(const Context &ctx, int nodeIndex, int start, int end) {
+        AABB bounds, centroidBounds;
+        computeBounds(ctx, start, end, bounds, centroidBounds);
+        BVHNode &node = ctx.nodes[nodeIndex];
+        node.bboxMin = bounds.bmin;
+        node.bboxMax = bounds.bmax;
+
+        const int count = end - start;
+        BinMapping map{};
+        map.binCount = std::clamp(ctx.settings.binCount, 2, kMaxBins);
+        map.cMin = centroidBounds.bmin;
+        const simd::float3 cExtent = centroidBounds.extent();
+        for (int axis = 0; axis < 3; ++axis) {
+            map.scale[axis] = cExtent[axis] > 0.0f ? static_cast<float>(map.binCount) / cExtent[axis] : 0.0f;
+        }
+
+        Split split;
+        if (count > 1) {
+            split = findSplit(ctx, start, end, bounds, map);
+        }
+
+        int mid = start;
+        if (split.axis >= 0) {
+            mid = partition(ctx, start, end, map, split);
+        } else if (count > ctx.settings.maxLeafSize) {
+            // SAH prefers a leaf (or centroids coincide) but the leaf would be too big:
+            // fall back to a median split on the longest centroid axis.
+            int axis = (cExtent.x > cExtent.y ? (cExtent.x > cExtent.z ? 0 : 2) : (cExtent.y > cExtent.z ? 1 : 2));
+            mid = (start + end) / 2;
+            std::nth_element(
+                ctx.triIndices.begin() + start,
+                ctx.triIndices.begin() + mid,
+                ctx.triIndices.begin() + end,
+                [&](int a, int b) { return ctx.refs[a].centroid[axis] < ctx.refs[b].centroid[axis]; }
+            );
+        }
+
+        if (mid == start || mid == end) {
+            node.leftFirst = start;
+            node.count = count;
+            node.rightFirst = 0;
+            return;
+        }
+
+        // the left subtree fits in the 2*leftCount - 1 slots after this node
+        const int leftChild = nodeIndex + 1;
+        const int rightChild = nodeIndex + 2 * (mid - start);
+        node.leftFirst = leftChild;
+        node.rightFirst = rightChild;
+        node.count = 0;
+
+        if (ctx.pool && ctx.pool->size() > 1 && count >= kParallelSubtreeSize) {
+            ThreadPool::TaskGroup group(*ctx.pool);
+            group.run([&] { buildNode(ctx, leftChild, start, mid); });
+            buildNode(ctx, rightChild, mid, end);
+            group.wait();
+        } else {
+            buildNode(ctx, leftChild, start, mid);
+            buildNode(ctx, rightChild, mid, end);
+        }
+    }
+};
+
+
+#endif //SAHBUILDER_H
@@ -0,0 +1,353 @@
+#ifndef SBVHBUILDER_H
+#define SBVHBUILDER_H
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "Aabb.h"
+#include "BvhNode.h"
+#include "SahBuilder.h"
+#include "../Primitives/Primitives.h"
+
+struct SbvhSettings {
+    SahSettings sah; // object split bins, costs and leaf size
+    int spatialBinCount = 32; // candidate planes per axis = spatialBinCount - 1
+    // spatial splits are only searched where the best object split's children
+    // overlap by more than this fraction of the root's area (alpha in the paper)
+    float overlapThreshold = 1e-5f;
+    // extra leaf references allowed, as a fraction of the triangle count
+    float duplicationBudget = 0.25f;
+};
+
+// Spatial split BVH (Stich, Friedrich and Dietrich 2009). Picks between a leaf, a
+// binned SAH object split (as SahBuilder) and a spatial split: a plane that cuts
+// the triangles straddling it, sending a reference to each child with its box
+// clipped to that side. A long or large triangle then no longer stretches one
+// child's box across its sibling. Straddlers are only cut where that beats moving
+// them whole to one side ("reference unsplitting"), and never beyond the budget.
+//
+// Leaves index contiguous ranges of `triIndices` as with the other builders, but a
+// triangle may appear in several leaves, so it comes back up to
+// duplicationBudget * tris.size() entries longer than `tris`.
+//
+// Builds on one thread; spatial binning clips every straddling triangle per bin, so
+// expect several times the build time of SahBuilder.
+struct SbvhBuilder {
+    static constexpr int kMaxBins = 64;
+    // below this depth only, so a pile of identical triangles cannot recurse forever
+    static constexpr int kMaxSpatialDepth = 48;
+
+    static void build(
+        const std::vector<Triangle> &tris,
+        std::vector<BVHNode> &nodes,
+        std::vector<int> &triIndices,
+        const SbvhSettings &settings = {}
+    ) {
+        nodes.clear();
+        triIndices.clear();
+        if (tris.empty()) return;
+
+        std::vector<Reference> refs(tris.size());
+        AABB root;
+        for (size_t i = 0; i < tris.size(); ++i) {
+            refs[i] = {AABB::of(tris[i]), static_cast<int>(i)};
+            root.grow(refs[i].bounds);
+        }
+        nodes.reserve(2 * tris.size());
+        triIndices.reserve(tris.size());
+        Context ctx{
+            tris, nodes, triIndices, settings, root.area(),
+            static_cast<size_t>(std::max(settings.duplicationBudget, 0.0f) * static_cast<float>(tris.size()))
+        };
+        buildNode(ctx, refs, 0);
+    }
+
+private:
+    // One triangle, or the part of it inside `bounds`.
+    struct Reference {
+        AABB bounds;
+        int tri;
+    };
+
+    struct Context {
+        const std::vector<Triangle> &tris;
+        std::vector<BVHNode> &nodes;
+        std::vector<int> &triIndices;
+        const SbvhSettings &settings;
+        float rootArea;
+        size_t duplicatesLeft;
+    };
+
+    // Object split: references whose centroid falls in bins [0, bin) go left.
+    struct ObjectSplit {
+        int axis = -1;
+        int bin = 0;
+        float cost = HUGE_VALF;
+        AABB left, right;
+        float cMin = 0.0f, scale = 0.0f; // centroid bin mapping on `axis`
+    };
+
+    // Spatial split at axis = pos; boxes and counts as binned, before unsplitting.
+    struct SpatialSplit {
+        int axis = -1;
+        float pos = 0.0f;
+        float cost = HUGE_VALF;
+        AABB left, right;
+        int leftCount = 0, rightCount = 0;
+    };
+
+    static AABB intersection(const AABB &a, const AABB &b) {
+        AABB r{simd::max(a.bmin, b.bmin), simd::min(a.bmax, b.bmax)};
+        const simd::float3 e = r.extent();
+        return e.x < 0.0f || e.y < 0.0f || e.z < 0.0f ? AABB{} : r;
+    }
+
+    static int longestAxis(const simd::float3 &e) {
+        return e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+    }
+
+    // The parts of `ref` on either side of the plane axis = pos, each clipped to the
+    // triangle and to ref.bounds; an empty box when nothing is left on that side.
+    static void splitReference(const Context &ctx, const Reference &ref, int axis, float pos, Reference &left,
+                               Reference &right) {
+        const Triangle &T = ctx.tris[ref.tri];
+        const simd::float3 v[3] = {T.v0, T.v1, T.v2};
+        AABB l, r;
+        for (int i = 0; i < 3; ++i) {
+            const simd::float3 &p = v[i], &q = v[(i + 1) % 3];
+            const float pd = p[axis], qd = q[axis];
+            if (pd <= pos) l.grow(p);
+            if (pd >= pos) r.grow(p);
+            if ((pd < pos && qd > pos) || (pd > pos && qd < pos)) {
+                simd::float3 x = p + (q - p) * ((pos - pd) / (qd - pd));
+                x[axis] = pos;
+                l.grow(x);
+                r.grow(x);
+            }
+        }
+        left = {intersection(l, ref.bounds), ref.tri};
+        right = {intersection(r, ref.bounds), ref.tri};
+    }
+
+    static ObjectSplit findObjectSplit(const Context &ctx, const std::vector<Reference> &refs, const AABB &bounds,
+                                       const AABB &centroids) {
+        const int binCount = std::clamp(ctx.settings.sah.binCount, 2, kMaxBins);
+        const SahSettings &sah = ctx.settings.sah;
+        const float area = bounds.area();
+        const simd::float3 extent = centroids.extent();
+
+        ObjectSplit best;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 0.0f) continue;
+            const float scale = static_cast<float>(binCount) / extent[axis];
+            std::array<AABB, kMaxBins> binBounds{};
+            std::array<int, kMaxBins> binCounts{};
+            for (const Reference &ref: refs) {
+                const int b = std::clamp(static_cast<int>((ref.bounds.center()[axis] - centroids.bmin[axis]) * scale),
+                                         0, binCount - 1);
+                binBounds[b].grow(ref.bounds);
+                binCounts[b]++;
+            }
+
+            std::array<AABB, kMaxBins> rightBounds{};
+            std::array<int, kMaxBins> rightCount{};
+            AABB acc;
+            int n = 0;
+            for (int b = binCount - 1; b > 0; --b) {
+                acc.grow(binBounds[b]);
+                n += binCounts[b];
+                rightBounds[b] = acc;
+                rightCount[b] = n;
+            }
+            acc = AABB{};
+            n = 0;
+            for (int b = 1; b < binCount; ++b) {
+                acc.grow(binBounds[b - 1]);
+                n += binCounts[b - 1];
+                if (n == 0 || rightCount[b] == 0) continue;
+                const float cost = sah.traversalCost + sah.intersectionCost *
+                                   (acc.area() * static_cast<float>(n) +
+                                    rightBounds[b].area() * static_cast<float>(rightCount[b])) / area;
+                if (cost < best.cost) {
+                    best = {axis, b, cost, acc, rightBounds[b], centroids.bmin[axis], scale};
+                }
+            }
+        }
+        return best;
+    }
+
+    static SpatialSplit findSpatialSplit(const Context &ctx, const std::vector<Reference> &refs, const AABB &bounds) {
+        const int binCount = std::clamp(ctx.settings.spatialBinCount, 2, kMaxBins);
+        const SahSettings &sah = ctx.settings.sah;
+        const float area = bounds.area();
+        const simd::float3 extent = bounds.extent();
+
+        SpatialSplit best;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 0.0f) continue;
+            const float origin = bounds.bmin[axis];
+            const float width = extent[axis] / static_cast<float>(binCount);
+            const auto binOf = [&](float x) {
+                return std::clamp(static_cast<int>((x - origin) / width), 0, binCount - 1);
+            };
+            std::array<AABB, kMaxBins> binBounds{};
+            std::array<int, kMaxBins> entries{}, exits{};
+            for (const Reference &ref: refs) {
+                const int first = binOf(ref.bounds.bmin[axis]), last = binOf(ref.bounds.bmax[axis]);
+                entries[first]++;
+                exits[last]++;
+                // clip the reference into every bin it passes through
+                Reference rest = ref;
+                for (int b = first; b < last; ++b) {
+                    Reference part, next;
+                    splitReference(ctx, rest, axis, origin + width * static_cast<float>(b + 1), part, next);
+                    binBounds[b].grow(part.bounds);
+                    rest = next;
+                }
+                binBounds[last].grow(rest.bounds);
+            }
+
+            std::array<AABB, kMaxBins> rightBounds{};
+            std::array<int, kMaxBins> rightCount{};
+            AABB acc;
+            int n = 0;
+            for (int b = binCount - 1; b > 0; --b) {
+                acc.grow(binBounds[b]);
+                n += exits[b];
+                rightBounds[b] = acc;
+                rightCount[b] = n;
+            }
+            acc = AABB{};
+            n = 0;
+            for (int b = 1; b < binCount; ++b) {
+                acc.grow(binBounds[b - 1]);
+                n += entries[b - 1];
+                if (n == 0 || rightCount[b] == 0) continue;
+                const float cost = sah.traversalCost + sah.intersectionCost *
+                                   (acc.area() * static_cast<float>(n) +
+                                    rightBounds[b].area() * static_cast<float>(rightCount[b])) / area;
+                if (cost < best.cost) {
+                    best = {axis, origin + width * static_cast<float>(b), cost, acc, rightBounds[b], n, rightCount[b]};
+                }
+            }
+        }
+        return best;
+    }
+
+    // Distribute `refs` over the split plane. A straddler goes whole to one side
+    // when that is cheaper than the duplicate, measured on the binned boxes.
+    static void partitionSpatial(const Context &ctx, const std::vector<Reference> &refs, const SpatialSplit &split,
+                                 std::vector<Reference> &left, std::vector<Reference> &right) {
+        AABB leftBounds = split.left, rightBounds = split.right;
+        auto leftCount = static_cast<float>(split.leftCount), rightCount = static_cast<float>(split.rightCount);
+        for (const Reference &ref: refs) {
+            if (ref.bounds.bmax[split.axis] <= split.pos) {
+                left.push_back(ref);
+            } else if (ref.bounds.bmin[split.axis] >= split.pos) {
+                right.push_back(ref);
+            } else {
+                AABB toLeft = leftBounds, toRight = rightBounds;
+                toLeft.grow(ref.bounds);
+                toRight.grow(ref.bounds);
+                const float both = leftBounds.area() * leftCount + rightBounds.area() * rightCount;
+                const float onlyLeft = toLeft.area() * leftCount + rightBounds.area() * (rightCount - 1.0f);
+                const float onlyRight = leftBounds.area() * (leftCount - 1.0f) + toRight.area() * rightCount;
+                if (onlyLeft < both && onlyLeft <= onlyRight) {
+                    left.push_back(ref);
+                    leftBounds = toLeft;
+                    rightCount -= 1.0f;
+                } else if (onlyRight < both) {
+                    right.push_back(ref);
+                    rightBounds = toRight;
+                    leftCount -= 1.0f;
+                } else {
+                    Reference l, r;
+                    splitReference(ctx, ref, split.axis, split.pos, l, r);
+                    // rounding can leave a sliver on one side only
+                    if (!l.bounds.empty()) left.push_back(l);
+                    if (!r.bounds.empty() || l.bounds.empty()) right.push_back(r.bounds.empty() ? ref : r);
+                }
+            }
+        }
+    }
+
+    static void buildNode(Context &ctx, std::vector<Reference> &refs, int depth) {
+        const auto nodeIndex = static_cast<uint32_t>(ctx.nodes.size());
+        ctx.nodes.emplace_back();
+        AABB bounds, centroids;
+        for (const Reference &ref: refs) {
+            bounds.grow(ref.bounds);
+            centroids.grow(ref.bounds.center());
+        }
+        ctx.nodes[nodeIndex].bboxMin = bounds.bmin;
+        ctx.nodes[nodeIndex].bboxMax = bounds.bmax;
+
+        const int count = static_cast<int>(refs.size());
+        const SahSettings &sah = ctx.settings.sah;
+        const float leafCost = sah.intersectionCost * static_cast<float>(count);
+        ObjectSplit object;
+        SpatialSplit spatial;
+        if (count > 1) {
+            object = findObjectSplit(ctx, refs, bounds, centroids);
+            const float overlap = object.axis >= 0 ? intersection(object.left, object.right).area() : HUGE_VALF;
+            if (depth < kMaxSpatialDepth && ctx.duplicatesLeft > 0 &&
+                overlap > ctx.settings.overlapThreshold * ctx.rootArea) {
+                spatial = findSpatialSplit(ctx, refs, bounds);
+                if (static_cast<size_t>(spatial.leftCount + spatial.rightCount - count) > ctx.duplicatesLeft) {
+                    spatial.axis = -1;
+                }
+            }
+        }
+
+        std::vector<Reference> left, right;
+        const float splitCost = std::min(object.cost, spatial.axis >= 0 ? spatial.cost : HUGE_VALF);
+        if (count > sah.maxLeafSize || splitCost < leafCost) {
+            if (spatial.axis >= 0 && spatial.cost < object.cost) {
+                partitionSpatial(ctx, refs, spatial, left, right);
+                if (left.empty() || right.empty()) {
+                    left.clear();
+                    right.clear();
+                } else {
+                    const size_t added = left.size() + right.size() - refs.size();
+                    ctx.duplicatesLeft -= std::min(added, ctx.duplicatesLeft);
+                }
+            }
+            if (left.empty() && object.axis >= 0) {
+                for (const Reference &ref: refs) {
+                    const int b = static_cast<int>((ref.bounds.center()[object.axis] - object.cMin) * object.scale);
+                    (b < object.bin ? left : right).push_back(ref);
+                }
+            } else if (left.empty() && count > sah.maxLeafSize) {
+                // centroids coincide: halve by count along the longest axis
+                const int axis = longestAxis(centroids.extent());
+                const auto mid = refs.begin() + count / 2;
+                std::nth_element(refs.begin(), mid, refs.end(), [&](const Reference &a, const Reference &b) {
+                    return a.bounds.center()[axis] < b.bounds.center()[axis];
+                });
+                left.assign(refs.begin(), mid);
+                right.assign(mid, refs.end());
+            }
+        }
+
+        BVHNode &node = ctx.nodes[nodeIndex];
+        if (left.empty() || right.empty()) {
+            node.leftFirst = static_cast<uint32_t>(ctx.triIndices.size());
+            node.count = static_cast<uint32_t>(count);
+            node.rightFirst = 0;
+            for (const Reference &ref: refs) ctx.triIndices.push_back(ref.tri);
+            return;
+        }
+        node.count = 0;
+        std::vector<Reference>().swap(refs); // the children hold them now
+
+        buildNode(ctx, left, depth + 1);
+        ctx.nodes[nodeIndex].leftFirst = nodeIndex + 1;
+        ctx.nodes[nodeIndex].rightFirst = static_cast<uint32_t>(ctx.nodes.size());
+        buildNode(ctx, right, depth + 1);
+    }
+};
+
+
+#endif //SBVHBUILDER_H
@@ -0,0 +1,146 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Aabb.h"
+#include "BvhNode.h"
+#include "../Primitives/Primitives.h"
+
+// W-ary node with its children's boxes stored SoA, so one vector instruction per
+// slab tests a ray against all W children. Lanes [0, childCount) are in use.
+template<int W>
+struct alignas(W * sizeof(float)) WideNode {
+    float bminX[W], bminY[W], bminZ[W];
+    float bmaxX[W], bmaxY[W], bmaxZ[W];
+    uint32_t child[W]; // inner: WideNode index; leaf: first TriPacket
+    uint32_t count[W]; // leaf: number of TriPackets; inner: 0
+    uint32_t childCount;
+};
+
+// W triangles SoA with precomputed edges (e1 = v1 - v0, e2 = v2 - v0, exactly as
+// intersectTriangle computes them). Unused lanes are degenerate and never hit.
+template<int W>
+struct alignas(W * sizeof(float)) TriPacket {
+    float v0x[W], v0y[W], v0z[W];
+    float e1x[W], e1y[W], e1z[W];
+    float e2x[W], e2y[W], e2z[W];
+    uint32_t matIndex[W];
+};
+
+// BVH4/BVH8 collapsed from the binary BLAS in Scene::bvhNodes. Every inner node
+// absorbs grandchildren (largest surface area first) until it has W children, and
+// every binary leaf is repacked into ceil(count / W) TriPackets in leaf order.
+template<int W>
+struct WideBvh {
+    static_assert(W == 4 || W == 8, "WideBvh supports 4 and 8 lanes");
+
+    std::vector<WideNode<W> > nodes;
+    std::vector<TriPacket<W> > packets;
+    std::vector<std::pair<uint32_t, uint32_t> > roots; // (binary BLAS root, wide root), sorted
+
+    void build(const std::vector<BVHNode> &bvhNodes, const std::vector<SceneTriangle> &tris,
+               const std::vector<SceneVertex> &verts, std::vector<uint32_t> blasRoots) {
+        nodes.clear();
+        packets.clear();
+        roots.clear();
+        std::sort(blasRoots.begin(), blasRoots.end());
+        blasRoots.erase(std::unique(blasRoots.begin(), blasRoots.end()), blasRoots.end());
+        for (uint32_t r: blasRoots) {
+            const uint32_t wide = bvhNodes[r].count > 0
+                                      ? collapse(bvhNodes, tris, verts, {r})
+                                      : collapse(bvhNodes, tris, verts, {bvhNodes[r].leftFirst, bvhNodes[r].rightFirst});
+            roots.emplace_back(r, wide);
+        }
+    }
+
+    // Wide root of the BLAS whose binary root is `blasRoot` (SceneInstance::blasRoot).
+    uint32_t root(uint32_t blasRoot) const {
+        const auto it = std::lower_bound(roots.begin(), roots.end(), std::make_pair(blasRoot, 0u));
+        return it->second;
+    }
+
+private:
+    static float area(const BVHNode &n) { return AABB{n.bboxMin, n.bboxMax}.area(); }
+
+    // Emit a wide node over the binary subtrees `children`, then its own children
+    // depth-first. Returns its index.
+    uint32_t collapse(const std::vector<BVHNode> &bvhNodes, const std::vector<SceneTriangle> &tris,
+                      const std::vector<SceneVertex> &verts, std::vector<uint32_t> children) {
+        // open the largest inner child until all W lanes are used
+        while (children.size() < W) {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (size_t i = 0; i < children.size(); ++i) {
+                const BVHNode &c = bvhNodes[children[i]];
+                if (c.count == 0 && area(c) > bestArea) {
+                    best = static_cast<int>(i);
+                    bestArea = area(c);
+                }
+            }
+            if (best < 0) break;
+            const BVHNode &c = bvhNodes[children[best]];
+            children[best] = c.leftFirst;
+            children.insert(children.begin() + best + 1, c.rightFirst);
+        }
+
+        const uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        WideNode<W> node{};
+        node.childCount = static_cast<uint32_t>(children.size());
+        for (int lane = 0; lane < W; ++lane) {
+            if (lane >= static_cast<int>(children.size())) {
+                node.bminX[lane] = node.bminY[lane] = node.bminZ[lane] = HUGE_VALF;
+                node.bmaxX[lane] = node.bmaxY[lane] = node.bmaxZ[lane] = -HUGE_VALF;
+                continue;
+            }
+            const BVHNode &c = bvhNodes[children[lane]];
+            node.bminX[lane] = c.bboxMin.x;
+            node.bminY[lane] = c.bboxMin.y;
+            node.bminZ[lane] = c.bboxMin.z;
+            node.bmaxX[lane] = c.bboxMax.x;
+            node.bmaxY[lane] = c.bboxMax.y;
+            node.bmaxZ[lane] = c.bboxMax.z;
+            if (c.count > 0) {
+                node.child[lane] = pack(tris, verts, c.leftFirst, c.count);
+                node.count[lane] = (c.count + W - 1) / W;
+            } else {
+                node.child[lane] = collapse(bvhNodes, tris, verts, {c.leftFirst, c.rightFirst});
+                node.count[lane] = 0;
+            }
+        }
+        nodes[index] = node;
+        return index;
+    }
+
+    uint32_t pack(const std::vector<SceneTriangle> &tris, const std::vector<SceneVertex> &verts,
+                  uint32_t first, uint32_t count) {
+        const uint32_t start = static_cast<uint32_t>(packets.size());
+        for (uint32_t base = 0; base < count; base += W) {
+            TriPacket<W> p{}; // zero edges: det == 0, never hit
+            for (int lane = 0; lane < W && base + lane < count; ++lane) {
+                const SceneTriangle &T = tris[first + base + lane];
+                const simd::float3 v0 = verts[T.v0].position();
+                const simd::float3 e1 = verts[T.v1].position() - v0, e2 = verts[T.v2].position() - v0;
+                p.v0x[lane] = v0.x;
+                p.v0y[lane] = v0.y;
+                p.v0z[lane] = v0.z;
+                p.e1x[lane] = e1.x;
+                p.e1y[lane] = e1.y;
+                p.e1z[lane] = e1.z;
+                p.e2x[lane] = e2.x;
+                p.e2y[lane] = e2.y;
+                p.e2z[lane] = e2.z;
+                p.matIndex[lane] = T.matIndex;
+            }
+            packets.push_back(p);
+        }
+        return start;
+    }
+};
+
+
+#endif //WIDEBVH_H
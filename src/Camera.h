@@ -1,6 +1,9 @@
 #ifndef CAMERA_H
 #define CAMERA_H
-#include <simd/vector_types.h>
+#include <cmath>
+#include <numbers>
+
+#include "Math/Simd.h"
 
 struct Camera {
     simd::float3 origin;
@@ -9,5 +12,28 @@ struct Camera {
     simd::float3 vertical;
 };
 
+// Build the pinhole basis path_trace expects from a yaw/pitch pose (fov in degrees).
+inline Camera makeCamera(simd::float3 pos, float yaw, float pitch, float fov, float aspect) {
+    const float theta = fov * (std::numbers::pi_v<float> / 180.0f);
+    float halfH = std::tan(theta * 0.5f);
+    float halfW = aspect * halfH;
+
+    simd::float3 front = {
+        std::cos(pitch) * std::sin(yaw),
+        std::sin(pitch),
+        std::cos(pitch) * std::cos(yaw)
+    };
+    const simd::float3 worldUp = simd_make_float3(0.0f, 1.0f, 0.0f);
+    simd::float3 right = simd::normalize(simd::cross(front, worldUp));
+    simd::float3 up = simd::cross(right, front);
+
+    Camera cam{};
+    cam.origin = pos;
+    cam.lowerLeft = pos + front - right * halfW - up * halfH;
+    cam.horizontal = 2 * halfW * right;
+    cam.vertical = 2 * halfH * up;
+    return cam;
+}
+
 
 #endif //CAMERA_H
@@ -0,0 +1,50 @@
+#ifndef CPU_BSDF_H
+#define CPU_BSDF_H
+
+#pragma once
+#include <cmath>
+#include <numbers>
+
+#include "../Math/Simd.h"
+
+// CPU mirror of shaders/bsdf.metal
+
+// reflect
+inline simd::float3 reflectDir(simd::float3 I, simd::float3 N) {
+    return I - 2.0f * simd::dot(I, N) * N;
+}
+
+// refract (η = η₁/η₂)
+inline simd::float3 refractDir(simd::float3 I, simd::float3 N, float eta) {
+    float cosI = simd::dot(-I, N);
+    float sin2T = eta * eta * (1.0f - cosI * cosI);
+    if (sin2T > 1.0f) return simd::float3{0, 0, 0}; // TIR
+    float cosT = std::sqrt(1.0f - sin2T);
+    return eta * I + (eta * cosI - cosT) * N;
+}
+
+// Schlick’s Fresnel
+inline float fresnelSchlick(float cosTheta, float F0) {
+    return F0 + (1.0f - F0) * std::pow(1.0f - cosTheta, 5.0f);
+}
+
+// cosine-weighted hemisphere from a uniform 2D sample
+inline simd::float3 randomHemisphere(simd::float3 N, simd::float2 uv) {
+    float u = uv.x, v = uv.y;
+    float r = std::sqrt(u),
+          theta = 2.0f * std::numbers::pi_v<float> * v;
+    simd::float3 s = {r * std::cos(theta), r * std::sin(theta), std::sqrt(1 - u)};
+    simd::float3 up = std::fabs(N.z) < .9f ? simd::float3{0, 0, 1} : simd::float3{1, 0, 0};
+    simd::float3 tangent = simd::normalize(simd::cross(up, N));
+    simd::float3 bitan = simd::cross(N, tangent);
+    return simd::normalize(s.x * tangent + s.y * bitan + s.z * N);
+}
+
+// MIS weight of a sample drawn with density `pdf` against another strategy with
+// density `other` (power heuristic, beta = 2).
+inline float powerHeuristic(float pdf, float other) {
+    const float r = other / pdf; // as a ratio, so huge densities cannot overflow
+    return 1.0f / (1.0f + r * r);
+}
+
+#endif //CPU_BSDF_H
@@ -0,0 +1,298 @@
+#include "CpuRenderer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "Integrator.h"
+#include "Packet.h"
+#include "../Profiler.h"
+
+namespace {
+    // the display's tone curve, as in writePPM
+    float toneMap(float linear) { return std::sqrt(std::clamp(linear, 0.0f, 1.0f)); }
+}
+
+CpuRenderer::CpuRenderer(const Scene &scene, uint32_t width, uint32_t height, ThreadPool &pool)
+    : _scene(scene),
+      _pool(pool),
+      _width(width),
+      _height(height),
+      _tilesX((width + kTileSize - 1) / kTileSize),
+      _tilesY((height + kTileSize - 1) / kTileSize),
+      _accum(static_cast<size_t>(width) * height, simd::float4{0, 0, 0, 0}),
+      _accumOdd(_accum.size(), simd::float4{0, 0, 0, 0}),
+      _albedo(_accum.size(), simd::float4{0, 0, 0, 0}),
+      _normalDepth(_accum.size(), simd::float4{0, 0, 0, 0}) {
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    _stats.assign(_accum.size(), RayStats{});
+#endif
+    clearAccumulation();
+}
+
+void CpuRenderer::setAdaptive(float threshold, uint32_t minSamples) {
+    _adaptiveThreshold = threshold;
+    _adaptiveMinSamples = std::max(minSamples, 2u);
+}
+
+uint64_t CpuRenderer::samplesTaken() const {
+    uint64_t total = 0;
+    for (uint32_t tile = 0; tile < _tileSamples.size(); ++tile) {
+        const uint32_t x0 = (tile % _tilesX) * kTileSize, y0 = (tile / _tilesX) * kTileSize;
+        const uint64_t pixels = static_cast<uint64_t>(std::min(kTileSize, _width - x0)) * std::min(kTileSize, _height - y0);
+        total += pixels * _tileSamples[tile];
+    }
+    return total;
+}
+
+void CpuRenderer::setBvhWidth(int width) {
+    std::vector<uint32_t> roots;
+    for (const SceneMesh &mesh: _scene.meshes) {
+        if (mesh.nodeCount > 0) roots.push_back(mesh.rootNode);
+    }
+    _bvhWidth = width;
+    if (width == 4) _wide4.build(_scene.bvhNodes, _scene.triangles, _scene.vertices, roots);
+    else if (width == 8) _wide8.build(_scene.bvhNodes, _scene.triangles, _scene.vertices, roots);
+    else _bvhWidth = 2;
+}
+
+void CpuRenderer::render(const Camera &cam) {
+    PROFILE_SCOPE("Frame");
+    const BinaryBlas binary{_scene};
+    const WideBlas<4> wide4{_wide4};
+    const WideBlas<8> wide8{_wide8};
+    if (_pipeline == PathPipeline::Wavefront) {
+        switch (_bvhWidth) {
+            case 4: renderWavefront(cam, wide4);
+                break;
+            case 8: renderWavefront(cam, wide8);
+                break;
+            default: renderWavefront(cam, binary);
+        }
+    } else {
+        _pool.parallelFor(_activeTiles.size(), [&](size_t i) {
+            const uint32_t tile = _activeTiles[i];
+            switch (_bvhWidth) {
+                case 4: renderTile(tile, cam, wide4);
+                    break;
+                case 8: renderTile(tile, cam, wide8);
+                    break;
+                default: renderTile(tile, cam, binary);
+            }
+        });
+    }
+    _frameIndex++;
+
+    if (_adaptiveThreshold > 0.0f) {
+        std::erase_if(_activeTiles, [&](uint32_t tile) {
+            return _tileSamples[tile] >= _adaptiveMinSamples && tileError(tile) < _adaptiveThreshold;
+        });
+    }
+}
+
+float CpuRenderer::estimatedError() const {
+    double sum = 0.0;
+    for (uint32_t tile = 0; tile < _tileSamples.size(); ++tile) {
+        const uint32_t x0 = (tile % _tilesX) * kTileSize, y0 = (tile / _tilesX) * kTileSize;
+        const double pixels = static_cast<double>(std::min(kTileSize, _width - x0) * std::min(kTileSize, _height - y0));
+        const double e = tileError(tile);
+        sum += e * e * pixels;
+    }
+    return static_cast<float>(std::sqrt(sum / static_cast<double>(_accum.size())));
+}
+
+float CpuRenderer::tileError(uint32_t tile) const {
+    const uint32_t x0 = (tile % _tilesX) * kTileSize, y0 = (tile / _tilesX) * kTileSize;
+    const uint32_t x1 = std::min(x0 + kTileSize, _width), y1 = std::min(y0 + kTileSize, _height);
+    const uint32_t n = _tileSamples[tile], odd = n / 2, even = n - odd;
+
+    // The even and odd samples make two independent half-resolution estimates; half
+    // their tone-mapped difference estimates the error of the full average.
+    double sum = 0.0;
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            const size_t i = static_cast<size_t>(y) * _width + x;
+            const simd::float4 &all = _accum[i], &b = _accumOdd[i];
+            for (int c = 0; c < 3; ++c) {
+                const float a = (all[c] * static_cast<float>(n) - b[c] * static_cast<float>(odd)) / static_cast<float>(even);
+                const float d = 0.5f * (toneMap(a) - toneMap(b[c]));
+                sum += static_cast<double>(d * d);
+            }
+        }
+    }
+    return static_cast<float>(std::sqrt(sum / static_cast<double>((x1 - x0) * (y1 - y0) * 3)));
+}
+
+template<typename Blas>
+void CpuRenderer::renderTile(uint32_t tile, const Camera &cam, const Blas &blas) {
+    PROFILE_SCOPE("Tile");
+    const uint32_t W = _width, H = _height;
+    const uint32_t x0 = (tile % _tilesX) * kTileSize;
+    const uint32_t y0 = (tile / _tilesX) * kTileSize;
+    const uint32_t x1 = std::min(x0 + kTileSize, W);
+    const uint32_t y1 = std::min(y0 + kTileSize, H);
+    const uint32_t sample = _tileSamples[tile]; // drives the sampler, so results don't depend on scheduling
+
+    // 4x4 pixel blocks, one ray packet each
+    for (uint32_t by = y0; by < y1; by += kBlockSize) {
+        for (uint32_t bx = x0; bx < x1; bx += kBlockSize) {
+            Sampler samplers[RayPacket::kSize];
+            RayPacket packet;
+            for (uint32_t i = 0; i < RayPacket::kSize; ++i) {
+                const uint32_t x = bx + i % kBlockSize, y = by + i / kBlockSize;
+                if (x >= x1 || y >= y1) continue;
+
+                // per‐pixel+frame random numbers
+                Sampler &sampler = samplers[i];
+                sampler = Sampler(_sampler, x, y, W, _sampleOffset + sample, _seed);
+                packet.set(static_cast<int>(i), cameraRay(cam, x, y, sampler));
+            }
+
+            PacketHit primary;
+            if (_traversal == TraversalPolicy::Packet) {
+                packet.finalize();
+                intersectScenePacket(_scene, packet, primary);
+            }
+
+            for (uint32_t bits = packet.active; bits; bits &= bits - 1) {
+                const int i = std::countr_zero(bits);
+                const uint32_t x = bx + i % kBlockSize, y = by + i / kBlockSize;
+
+                // past the first bounce rays diverge: continue one at a time
+#ifdef PATHTRACER_TRAVERSAL_STATS
+                tRayStats = {};
+                tRayStats.paths = 1;
+#endif
+                const Hit hit = primary.hit(i);
+                PathAovs aovs;
+                const simd::float3 L = tracePath(_scene, blas, packet.ray(i), samplers[i],
+                                                 _traversal == TraversalPolicy::Packet ? &hit : nullptr,
+                                                 _path, &aovs);
+                const size_t index = static_cast<size_t>(y) * W + x;
+#ifdef PATHTRACER_TRAVERSAL_STATS
+                if (sample == 0) _stats[index] = {};
+                _stats[index].add(tRayStats);
+#endif
+                accumulate(index, sample, L, aovs);
+            }
+        }
+    }
+    _tileSamples[tile] = sample + 1;
+}
+
+template<typename Blas>
+void CpuRenderer::renderWavefront(const Camera &cam, const Blas &blas) {
+    constexpr uint32_t kTilePixels = kTileSize * kTileSize;
+    // whole tiles per batch, so every path of a tile shares one sample index; path
+    // slots go tile by tile, row-major within the tile
+    for (size_t first = 0; first < _activeTiles.size(); first += kWaveTiles) {
+        PROFILE_SCOPE("Wavefront batch");
+        const size_t tiles = std::min<size_t>(kWaveTiles, _activeTiles.size() - first);
+        const auto forEachPixel = [&](size_t t, const auto &fn) {
+            const uint32_t tile = _activeTiles[first + t];
+            const uint32_t x0 = (tile % _tilesX) * kTileSize, y0 = (tile / _tilesX) * kTileSize;
+            for (uint32_t y = y0; y < std::min(y0 + kTileSize, _height); ++y) {
+                for (uint32_t x = x0; x < std::min(x0 + kTileSize, _width); ++x) {
+                    fn(tile, x, y, t * kTilePixels + (y - y0) * kTileSize + (x - x0));
+                }
+            }
+        };
+
+        // generate
+        _wavefront.reset(tiles * kTilePixels);
+        _pool.parallelFor(tiles, [&](size_t t) {
+            forEachPixel(t, [&](uint32_t tile, uint32_t x, uint32_t y, size_t slot) {
+                Sampler sampler(_sampler, x, y, _width, _sampleOffset + _tileSamples[tile], _seed);
+                const Ray ray = cameraRay(cam, x, y, sampler);
+                _wavefront.setPath(slot, ray, sampler);
+            });
+        });
+
+        _wavefront.trace(_scene, blas, _path, _pool);
+
+        _pool.parallelFor(tiles, [&](size_t t) {
+            forEachPixel(t, [&](uint32_t tile, uint32_t x, uint32_t y, size_t slot) {
+                const size_t index = static_cast<size_t>(y) * _width + x;
+                const uint32_t sample = _tileSamples[tile];
+#ifdef PATHTRACER_TRAVERSAL_STATS
+                if (sample == 0) _stats[index] = {};
+                _stats[index].add(_wavefront.stats(slot));
+#endif
+                accumulate(index, sample, _wavefront.radiance(slot), _wavefront.aovs(slot));
+            });
+            _tileSamples[_activeTiles[first + t]]++;
+        });
+    }
+}
+
+Ray CpuRenderer::cameraRay(const Camera &cam, uint32_t x, uint32_t y, Sampler &sampler) const {
+    // generate a tiny random offset in [0,1) for AA
+    const simd::float2 jitter = sampler.get2D();
+    float dx = jitter.x;
+    float dy = jitter.y;
+
+    // initialize primary ray with jittered uv inside pixel
+    float u = (static_cast<float>(x) + dx) / static_cast<float>(_width);
+    float v = 1.0f - (static_cast<float>(y) + dy) / static_cast<float>(_height);
+
+    Ray ray;
+    ray.origin = cam.origin;
+    ray.dir = simd::normalize(cam.lowerLeft + u * cam.horizontal + v * cam.vertical - cam.origin);
+    return ray;
+}
+
+void CpuRenderer::accumulate(size_t index, uint32_t sample, const simd::float3 &L, const PathAovs &aovs) {
+    // read & accumulate frame‐to‐frame
+    const auto blend = [sample](simd::float4 &avg, const simd::float4 &curr) {
+        const simd::float4 prev = sample > 0 ? avg : simd::float4{0, 0, 0, 0};
+        avg = (prev * static_cast<float>(sample) + curr) / static_cast<float>(sample + 1);
+    };
+    simd::float4 curr = {L.x, L.y, L.z, 1.0f};
+    blend(_accum[index], curr);
+    const float l = luminance(L);
+    blend(_albedo[index], {aovs.albedo.x, aovs.albedo.y, aovs.albedo.z, l * l});
+    blend(_normalDepth[index], {aovs.normal.x, aovs.normal.y, aovs.normal.z, aovs.depth});
+
+    // odd samples also go into their own average, for the error estimate
+    if (sample % 2 == 1) {
+        const uint32_t odd = sample / 2;
+        simd::float4 &half = _accumOdd[index];
+        half = odd > 0 ? (half * static_cast<float>(odd) + curr) / static_cast<float>(odd + 1) : curr;
+    }
+}
+
+std::vector<simd::float4> CpuRenderer::denoised(const DenoiseSettings &settings) const {
+    // the filter wants the variance of each pixel's mean in w
+    std::vector<simd::float4> color(_accum.size());
+    for (uint32_t tile = 0; tile < _tileSamples.size(); ++tile) {
+        const uint32_t x0 = (tile % _tilesX) * kTileSize, y0 = (tile / _tilesX) * kTileSize;
+        const auto n = static_cast<float>(std::max(_tileSamples[tile], 1u));
+        for (uint32_t y = y0; y < std::min(y0 + kTileSize, _height); ++y) {
+            for (uint32_t x = x0; x < std::min(x0 + kTileSize, _width); ++x) {
+                const size_t i = static_cast<size_t>(y) * _width + x;
+                const float mean = luminance(simd::float3{_accum[i].x, _accum[i].y, _accum[i].z});
+                color[i] = _accum[i];
+                color[i].w = std::max(_albedo[i].w - mean * mean, 0.0f) / n;
+            }
+        }
+    }
+    return denoise(color, _albedo, _normalDepth, _width, _height, settings, _pool);
+}
+
+void CpuRenderer::setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    _regionX0 = x / kTileSize;
+    _regionY0 = y / kTileSize;
+    _regionX1 = (x + width + kTileSize - 1) / kTileSize;
+    _regionY1 = (y + height + kTileSize - 1) / kTileSize;
+}
+
+void CpuRenderer::clearAccumulation() {
+    // reset our sample counters; the next sample of every tile overwrites its pixels
+    _frameIndex = 0;
+    _wavefront.resetCounters();
+    _tileSamples.assign(static_cast<size_t>(_tilesX) * _tilesY, 0);
+    _activeTiles.clear();
+    for (uint32_t ty = _regionY0; ty < std::min(_regionY1, _tilesY); ++ty) {
+        for (uint32_t tx = _regionX0; tx < std::min(_regionX1, _tilesX); ++tx) _activeTiles.push_back(ty * _tilesX + tx);
+    }
+}
@@ -0,0 +1,178 @@
+#ifndef CPURENDERER_H
+#define CPURENDERER_H
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Denoiser.h"
+#include "Integrator.h"
+#include "Wavefront.h"
+#include "../Camera.h"
+#include "../Scene.h"
+#include "../ThreadPool.h"
+#include "../TraversalStats.h"
+#include "../Bvh/WideBvh.h"
+#include "../Math/Simd.h"
+
+// How camera rays find their first hit. Later bounces are incoherent and are always
+// traced one ray at a time.
+enum class TraversalPolicy {
+    SingleRay, // every ray walks the BVH on its own
+    Packet // each 4x4 pixel block walks the binary BVH together (see Packet.h)
+};
+
+// How paths are scheduled; both trace the same paths and render the same image.
+enum class PathPipeline {
+    Megakernel, // one task runs whole paths one after another, like path_trace
+    Wavefront // a batch of paths moves through the stages together (see Wavefront.h)
+};
+
+// Headless counterpart of Renderer: runs the path_trace integrator on the CPU,
+// one sample per pixel per frame, spread over the thread pool in screen tiles.
+//
+// With adaptive sampling on, every tile tracks its own sample count and a frame
+// only samples the tiles that have not converged yet.
+class CpuRenderer {
+public:
+    static constexpr uint32_t kTileSize = 16;
+
+    CpuRenderer(const Scene &scene, uint32_t width, uint32_t height, ThreadPool &pool);
+
+    // Trace one sample per pixel of every active tile and fold it into the running
+    // average (same blend as path_trace).
+    void render(const Camera &cam);
+
+    void clearAccumulation();
+
+    // Retire a tile once it has `minSamples` and the estimated RMS error of its
+    // pixels, after the display's sqrt tone curve, is below `threshold` (e.g. 0.01 is
+    // about 2.5 of 255 levels). 0 samples every tile every frame.
+    void setAdaptive(float threshold, uint32_t minSamples = 32);
+
+    // Every tile has been retired; further frames trace nothing.
+    bool converged() const { return _activeTiles.empty(); }
+
+    // Samples traced per pixel since the last clear, summed over the image.
+    uint64_t samplesTaken() const;
+
+    // Estimated tone-mapped RMS error of the whole image (see setAdaptive); needs at
+    // least two samples per pixel.
+    float estimatedError() const;
+
+    // Branching factor of the BLAS traversal: 2 walks Scene::bvhNodes like the
+    // kernel, 4 or 8 collapse them into a WideBvh traced with SIMD.
+    void setBvhWidth(int width);
+
+    int bvhWidth() const { return _bvhWidth; }
+
+    void setTraversalPolicy(TraversalPolicy policy) { _traversal = policy; }
+
+    TraversalPolicy traversalPolicy() const { return _traversal; }
+
+    // The wavefront pipeline traces camera rays one at a time, whatever the
+    // traversal policy.
+    void setPipeline(PathPipeline pipeline) { _pipeline = pipeline; }
+
+    PathPipeline pipeline() const { return _pipeline; }
+
+    // Rays traced and time per stage by the wavefront pipeline since the last clear.
+    const WavefrontCounters &wavefrontCounters() const { return _wavefront.counters(); }
+
+    // Path length cap, MAX_BOUNCES by default.
+    void setMaxBounces(uint32_t bounces) { _path.maxBounces = bounces; }
+
+    // Light sampling with MIS at diffuse vertices (on by default); off, paths only
+    // find light by hitting it, as before it existed.
+    void setNextEventEstimation(bool enabled) { _path.nextEvent = enabled; }
+
+    // Where jitter, light, lobe, direction and roulette decisions get their random
+    // numbers from; Sobol by default.
+    void setSampler(SamplerType type) { _sampler = type; }
+
+    // Offsets every pixel's sample streams; 0 reproduces the interactive renderer.
+    void setSeed(uint32_t seed) { _seed = seed; }
+
+    // Only render the tiles overlapping this rectangle, from the next clear on; the
+    // rest of the image keeps whatever it holds. Starts out as the whole image.
+    void setRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+    // Draw the sample streams from number `first` on instead of 0, so that several
+    // renderers can split the samples of one pixel between them. Blending still
+    // counts from the last clear.
+    void setSampleOffset(uint32_t first) { _sampleOffset = first; }
+
+    uint32_t width() const { return _width; }
+    uint32_t height() const { return _height; }
+    uint32_t frameIndex() const { return _frameIndex; }
+
+    // Linear HDR radiance, row-major from the top-left pixel.
+    const std::vector<simd::float4> &accumulation() const { return _accum; }
+
+    // Average first-hit AOVs, same layout as accumulation(): albedo in xyz (w holds
+    // the mean squared luminance of the samples), and normal in xyz with depth in w.
+    const std::vector<simd::float4> &albedoAov() const { return _albedo; }
+    const std::vector<simd::float4> &normalDepthAov() const { return _normalDepth; }
+
+    // A filtered copy of accumulation(), guided by the AOVs; the accumulation itself
+    // stays unbiased.
+    std::vector<simd::float4> denoised(const DenoiseSettings &settings = {}) const;
+
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    // Per-pixel traversal counters since the last clear, same layout as accumulation().
+    // Camera rays traced as packets are not counted.
+    const std::vector<RayStats> &traversalStats() const { return _stats; }
+#endif
+
+private:
+    template<typename Blas>
+    void renderTile(uint32_t tile, const Camera &cam, const Blas &blas);
+
+    template<typename Blas>
+    void renderWavefront(const Camera &cam, const Blas &blas);
+
+    // Camera ray through a jittered point of pixel (x, y), drawn from `sampler`.
+    Ray cameraRay(const Camera &cam, uint32_t x, uint32_t y, Sampler &sampler) const;
+
+    // Fold sample number `sample` of pixel `index` into the running averages.
+    void accumulate(size_t index, uint32_t sample, const simd::float3 &L, const PathAovs &aovs);
+
+    // Estimated tone-mapped RMS error of the tile's current average.
+    float tileError(uint32_t tile) const;
+
+    const Scene &_scene;
+    ThreadPool &_pool;
+    uint32_t _width;
+    uint32_t _height;
+    uint32_t _tilesX;
+    uint32_t _tilesY;
+    std::vector<simd::float4> _accum;
+    std::vector<simd::float4> _accumOdd; // average of the odd-numbered samples only
+    std::vector<simd::float4> _albedo;
+    std::vector<simd::float4> _normalDepth;
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    std::vector<RayStats> _stats;
+#endif
+    std::vector<uint32_t> _tileSamples; // samples per pixel of every tile
+    std::vector<uint32_t> _activeTiles; // tiles the next frame samples
+    uint32_t _frameIndex = 0;
+    float _adaptiveThreshold = 0.0f;
+    uint32_t _adaptiveMinSamples = 32;
+    int _bvhWidth = 2;
+    TraversalPolicy _traversal = TraversalPolicy::SingleRay;
+    PathPipeline _pipeline = PathPipeline::Megakernel;
+    Wavefront _wavefront;
+    PathSettings _path;
+    SamplerType _sampler = SamplerType::Sobol;
+    uint32_t _seed = 0;
+    uint32_t _sampleOffset = 0;
+    uint32_t _regionX0 = 0, _regionY0 = 0, _regionX1 = UINT32_MAX, _regionY1 = UINT32_MAX; // in tiles
+    WideBvh<4> _wide4;
+    WideBvh<8> _wide8;
+
+    static constexpr uint32_t kBlockSize = 4; // pixels per packet side
+    static constexpr uint32_t kWaveTiles = 256; // tiles per wavefront batch, 64k paths
+};
+
+
+#endif //CPURENDERER_H
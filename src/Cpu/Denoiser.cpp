@@ -0,0 +1,166 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Lanes.h"
+#include "../Material.h"
+#include "../Profiler.h"
+
+namespace {
+    using L = Lanes<4>;
+    using Float = L::Float;
+    using Mask = L::Mask;
+
+    constexpr float kKernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16}; // B3 spline
+    constexpr float kGaussian[2] = {0.5f, 0.25f};
+    constexpr float kMinAlbedo = 1e-3f;
+
+    // e^-x for x >= 0: 2^t split into an exponent and a Taylor polynomial for the
+    // fraction, good to about 0.1%, which is plenty for filter weights. Below e^-30
+    // it returns 0, so squared weights never turn into (slow) denormals.
+    Float expNeg(Float x) {
+        const Float t = L::max(x * -1.44269504f, L::splat(-64.0f));
+        Mask i = __builtin_convertvector(t, Mask); // rounds towards zero, one too high for fractions
+        i += __builtin_convertvector(i, Float) > t;
+        const Float f = t - __builtin_convertvector(i, Float);
+        const Float p = 1.0f + f * (0.6931472f + f * (0.2402265f + f * (0.0555041f + f * 0.0096181f)));
+        const Float e = (Float) ((Mask) p + (i << 23)); // add i to the exponent field
+        return x < 30.0f ? e : Float{};
+    }
+
+    // Structure-of-arrays images with a border wide enough for the widest pass, so
+    // four neighbouring pixels load as one vector and taps never leave the buffer.
+    // Border pixels have depth -1 and get no weight.
+    struct Layout {
+        uint32_t pad, stride, rows;
+
+        size_t at(uint32_t x, uint32_t y) const { return static_cast<size_t>(y + pad) * stride + x + pad; }
+    };
+
+    struct ColorPlanes {
+        std::vector<float> r, g, b, var;
+
+        explicit ColorPlanes(size_t size) : r(size, 0.0f), g(size, 0.0f), b(size, 0.0f), var(size, 0.0f) {
+        }
+    };
+
+    struct GuidePlanes {
+        std::vector<float> nx, ny, nz, z;
+
+        explicit GuidePlanes(size_t size) : nx(size, 0.0f), ny(size, 0.0f), nz(size, 0.0f), z(size, -1.0f) {
+        }
+    };
+
+    Float luminance(Float r, Float g, Float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+    // one à-trous pass over the four pixels starting at index `p`
+    void filterBlock(const Layout &layout, const GuidePlanes &guides, const ColorPlanes &in, ColorPlanes &out,
+                     size_t p, uint32_t step, const DenoiseSettings &settings) {
+        const Float zp = L::load(&guides.z[p]);
+        const Float nxp = L::load(&guides.nx[p]), nyp = L::load(&guides.ny[p]), nzp = L::load(&guides.nz[p]);
+        const Float lp = luminance(L::load(&in.r[p]), L::load(&in.g[p]), L::load(&in.b[p]));
+        // variance estimates from a few samples are noisy themselves: blur them 3x3 first
+        Float variance{};
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                const float w = kGaussian[std::abs(dx)] * kGaussian[std::abs(dy)];
+                variance += w * L::load(&in.var[p + dy * static_cast<ptrdiff_t>(layout.stride) + dx]);
+            }
+        }
+        Float invSigmaL;
+        for (int i = 0; i < 4; ++i) invSigmaL[i] = 1.0f / (settings.colorSigma * std::sqrt(std::max(variance[i], 0.0f)) + 1e-4f);
+        const float invNormal = 1.0f / (settings.normalSigma * settings.normalSigma);
+
+        Float sumW{}, sumR{}, sumG{}, sumB{}, sumVar{};
+        for (int dy = -2; dy <= 2; ++dy) {
+            for (int dx = -2; dx <= 2; ++dx) {
+                const size_t q = p + static_cast<ptrdiff_t>(step) * (dy * static_cast<ptrdiff_t>(layout.stride) + dx);
+                const Float r = L::load(&in.r[q]), g = L::load(&in.g[q]), b = L::load(&in.b[q]);
+                const Float zq = L::load(&guides.z[q]);
+                const Float dnx = nxp - L::load(&guides.nx[q]), dny = nyp - L::load(&guides.ny[q]),
+                        dnz = nzp - L::load(&guides.nz[q]);
+                const float distance = static_cast<float>(step * std::max(std::abs(dx), std::abs(dy)));
+
+                const Float colorTerm = L::abs(lp - luminance(r, g, b)) * invSigmaL;
+                const Float normalTerm = (dnx * dnx + dny * dny + dnz * dnz) * invNormal;
+                const Float depthTerm = L::abs(zp - zq)
+                        / (settings.depthSigma * std::max(distance, 1.0f) * L::max(L::min(zp, zq), L::splat(1e-6f)));
+                Float w = kKernel[dx + 2] * kKernel[dy + 2] * expNeg(colorTerm + normalTerm + depthTerm);
+                w = zq < 0.0f ? Float{} : w;
+
+                sumW += w;
+                sumR += w * r;
+                sumG += w * g;
+                sumB += w * b;
+                sumVar += w * w * L::load(&in.var[q]);
+            }
+        }
+        // border lanes have no weight at all; keep them finite for the next pass
+        const Mask valid = sumW > 0.0f;
+        const Float inv = 1.0f / (valid ? sumW : L::splat(1.0f));
+        const auto store = [&](std::vector<float> &plane, Float v) {
+            v = valid ? v : Float{};
+            std::copy_n(reinterpret_cast<const float *>(&v), 4, &plane[p]);
+        };
+        store(out.r, sumR * inv);
+        store(out.g, sumG * inv);
+        store(out.b, sumB * inv);
+        store(out.var, sumVar * inv * inv);
+    }
+}
+
+std::vector<simd::float4> denoise(const std::vector<simd::float4> &color, const std::vector<simd::float4> &albedo,
+                                  const std::vector<simd::float4> &normalDepth, uint32_t width, uint32_t height,
+                                  const DenoiseSettings &settings, ThreadPool &pool) {
+    PROFILE_SCOPE("Denoise");
+    const uint32_t pad = settings.iterations > 0 ? 2u << (settings.iterations - 1) : 0;
+    const uint32_t blocks = (width + 3) / 4;
+    const Layout layout{pad, blocks * 4 + 2 * pad, height + 2 * pad};
+    const size_t size = static_cast<size_t>(layout.stride) * layout.rows;
+
+    const auto demodulator = [&](size_t i) {
+        return simd::float3{std::max(albedo[i].x, kMinAlbedo), std::max(albedo[i].y, kMinAlbedo),
+                            std::max(albedo[i].z, kMinAlbedo)};
+    };
+
+    // demodulate into planes
+    GuidePlanes guides(size);
+    ColorPlanes ping(size), pong(size);
+    pool.parallelFor(height, [&](size_t y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const size_t i = y * width + x, p = layout.at(x, static_cast<uint32_t>(y));
+            const simd::float3 a = demodulator(i);
+            const float la = ::luminance(a);
+            ping.r[p] = color[i].x / a.x;
+            ping.g[p] = color[i].y / a.y;
+            ping.b[p] = color[i].z / a.z;
+            ping.var[p] = color[i].w / (la * la);
+            guides.nx[p] = normalDepth[i].x;
+            guides.ny[p] = normalDepth[i].y;
+            guides.nz[p] = normalDepth[i].z;
+            guides.z[p] = normalDepth[i].w;
+        }
+    });
+
+    for (uint32_t iteration = 0; iteration < settings.iterations; ++iteration) {
+        pool.parallelFor(height, [&](size_t y) {
+            for (uint32_t block = 0; block < blocks; ++block) {
+                filterBlock(layout, guides, ping, pong, layout.at(block * 4, static_cast<uint32_t>(y)), 1u << iteration,
+                            settings);
+            }
+        });
+        std::swap(ping, pong);
+    }
+
+    // and modulate back
+    std::vector<simd::float4> result(color.size());
+    pool.parallelFor(height, [&](size_t y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const size_t i = y * width + x, p = layout.at(x, static_cast<uint32_t>(y));
+            const simd::float3 a = demodulator(i);
+            result[i] = {ping.r[p] * a.x, ping.g[p] * a.y, ping.b[p] * a.z, 1.0f};
+        }
+    });
+    return result;
+}
@@ -0,0 +1,41 @@
+#ifndef CPU_DENOISER_H
+#define CPU_DENOISER_H
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "../ThreadPool.h"
+#include "../Math/Simd.h"
+
+// Edge-aware à-trous wavelet filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet
+// Transform for fast Global Illumination Filtering"), with SVGF's variance-guided
+// colour weight. Radiance is divided by the first-hit albedo before filtering and
+// multiplied back afterwards, so texture survives while lighting noise is smoothed.
+// CPU counterpart of shaders/denoise.metal.
+
+struct DenoiseSettings {
+    uint32_t iterations = 5; // the 5x5 kernel's taps are 2^i pixels apart in pass i
+    float colorSigma = 4.0f; // luminance difference, in standard deviations of the noise
+    float normalSigma = 0.2f; // distance between unit normals
+    float depthSigma = 0.1f; // relative depth difference per pixel of tap distance
+};
+
+// One filter pass as the Metal kernel takes it; matches DenoisePass in shaders/types.metal.
+struct DenoisePass {
+    uint32_t step;
+    float colorSigma;
+    float normalSigma;
+    float depthSigma;
+    uint32_t last; // multiply the albedo back in
+};
+
+// Filter an image of `width` x `height` pixels, all row-major from the top-left.
+// `color` is linear radiance with the variance of each pixel mean's luminance in w,
+// `albedo` and `normalDepth` are the first-hit AOVs (PathAovs): albedo in xyz, and
+// the normal in xyz with the depth in w. Returns the filtered radiance, w = 1.
+std::vector<simd::float4> denoise(const std::vector<simd::float4> &color, const std::vector<simd::float4> &albedo,
+                                  const std::vector<simd::float4> &normalDepth, uint32_t width, uint32_t height,
+                                  const DenoiseSettings &settings, ThreadPool &pool);
+
+#endif //CPU_DENOISER_H
@@ -0,0 +1,304 @@
+#include "Distributed.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <spawn.h>
+#include <thread>
+#include <sys/wait.h>
+
+#include "Integrator.h"
+#include "../Profiler.h"
+
+extern char **environ;
+
+namespace {
+    void writeSetup(MessageWriter &out, const RenderSetup &setup) {
+        out.putString(setup.scene).putString(setup.cachePath);
+        out.put(setup.bvhMode).put(setup.sbvh).put(setup.bvhOptimize);
+        out.put(setup.bvhWidth).put(setup.traversal).put(setup.pipeline);
+        out.put(setup.width).put(setup.height).put(setup.camera);
+        out.put(setup.maxBounces).put(setup.nextEvent).put(setup.sampler).put(setup.seed);
+    }
+
+    bool readSetup(MessageReader &in, RenderSetup &setup) {
+        return in.getString(setup.scene) && in.getString(setup.cachePath) && in.get(setup.bvhMode) &&
+               in.get(setup.sbvh) && in.get(setup.bvhOptimize) &&
+               in.get(setup.bvhWidth) && in.get(setup.traversal) && in.get(setup.pipeline) &&
+               in.get(setup.width) && in.get(setup.height) && in.get(setup.camera) && in.get(setup.maxBounces) &&
+               in.get(setup.nextEvent) && in.get(setup.sampler) && in.get(setup.seed);
+    }
+
+    bool sameJob(const RenderJob &a, const RenderJob &b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height &&
+               a.firstSample == b.firstSample && a.samples == b.samples;
+    }
+
+    // the job's rectangle of a full-image buffer, row by row
+    std::vector<simd::float4> crop(const std::vector<simd::float4> &image, uint32_t imageWidth, const RenderJob &job) {
+        std::vector<simd::float4> pixels;
+        pixels.reserve(static_cast<size_t>(job.width) * job.height);
+        for (uint32_t y = job.y; y < job.y + job.height; ++y) {
+            const auto row = image.begin() + static_cast<ptrdiff_t>(static_cast<size_t>(y) * imageWidth + job.x);
+            pixels.insert(pixels.end(), row, row + job.width);
+        }
+        return pixels;
+    }
+}
+
+std::vector<simd::float4> DistributedImage::denoised(const DenoiseSettings &settings, ThreadPool &pool) const {
+    std::vector<simd::float4> color(accumulation.size());
+    for (size_t i = 0; i < color.size(); ++i) {
+        const simd::float4 &a = accumulation[i];
+        const float mean = luminance(simd::float3{a.x, a.y, a.z});
+        color[i] = a;
+        color[i].w = std::max(albedo[i].w - mean * mean, 0.0f) / static_cast<float>(std::max(samples[i], 1u));
+    }
+    return denoise(color, albedo, normalDepth, width, height, settings, pool);
+}
+
+Coordinator::Coordinator(RenderSetup setup, uint32_t spp, uint32_t jobSize, uint32_t jobSamples)
+    : _setup(std::move(setup)) {
+    const size_t pixels = static_cast<size_t>(_setup.width) * _setup.height;
+    _image.width = _setup.width;
+    _image.height = _setup.height;
+    _image.accumulation.assign(pixels, simd::float4{0, 0, 0, 0});
+    _image.albedo.assign(pixels, simd::float4{0, 0, 0, 0});
+    _image.normalDepth.assign(pixels, simd::float4{0, 0, 0, 0});
+    _image.samples.assign(pixels, 0);
+
+    // whole tiles, so a worker renders nothing outside its job
+    constexpr uint32_t tile = CpuRenderer::kTileSize;
+    const uint32_t size = std::max((jobSize + tile - 1) / tile, 1u) * tile;
+    const uint32_t samples = jobSamples == 0 ? spp : std::min(jobSamples, spp);
+    for (uint32_t first = 0; first < spp; first += samples) {
+        for (uint32_t y = 0; y < _setup.height; y += size) {
+            for (uint32_t x = 0; x < _setup.width; x += size) {
+                _queue.push_back({x, y, std::min(size, _setup.width - x), std::min(size, _setup.height - y), first,
+                                  std::min(samples, spp - first)});
+            }
+        }
+    }
+    _jobCount = _remaining = _queue.size();
+}
+
+bool Coordinator::run(Listener &listener, std::vector<pid_t> localWorkers) {
+    const bool local = !localWorkers.empty();
+    std::vector<std::thread> threads;
+    while (true) {
+        {
+            std::lock_guard lock(_mutex);
+            if (_remaining == 0) break;
+            if (local && localWorkers.empty() && _connected == 0) {
+                std::cerr << "Every worker exited with " << _remaining << " of " << _jobCount << " jobs left\n";
+                _failed = true;
+                break;
+            }
+        }
+        Connection connection = listener.accept(100);
+        if (connection.valid()) threads.emplace_back(&Coordinator::serve, this, std::move(connection));
+        std::erase_if(localWorkers, [](pid_t pid) { return waitpid(pid, nullptr, WNOHANG) != 0; });
+    }
+    _changed.notify_all();
+    for (std::thread &thread: threads) thread.join();
+    return !_failed;
+}
+
+void Coordinator::serve(Connection connection) {
+    const std::string peer = connection.peerName();
+    uint32_t type = 0, version = 0, threads = 0;
+    std::vector<uint8_t> payload;
+    if (!connection.receive(type, payload) || type != static_cast<uint32_t>(MessageType::Hello) ||
+        !MessageReader(payload).get(version) || version != kProtocolVersion) {
+        std::lock_guard lock(_mutex);
+        std::cerr << "Rejected " << peer << ": not a worker of this version\n";
+        return;
+    }
+    MessageWriter setup;
+    writeSetup(setup, _setup);
+    if (!connection.send(static_cast<uint32_t>(MessageType::Setup), setup.bytes()) ||
+        !connection.receive(type, payload) || type != static_cast<uint32_t>(MessageType::Ready) ||
+        !MessageReader(payload).get(threads)) {
+        std::lock_guard lock(_mutex);
+        std::cerr << "Worker at " << peer << " failed to set up\n";
+        return;
+    }
+
+    uint32_t id;
+    {
+        std::lock_guard lock(_mutex);
+        id = ++_workersJoined;
+        ++_connected;
+        std::cout << "Worker " << id << " joined from " << peer << " (" << threads << " threads)\n";
+    }
+    // one track per worker, each job from handing it out to merging its result
+    Profiler::get().nameThread("Worker " + std::to_string(id) + " (" + peer + ")");
+    uint32_t jobs = 0;
+    while (const std::optional<RenderJob> job = takeJob()) {
+        PROFILE_SCOPE("Job");
+        MessageWriter request;
+        request.put(*job);
+        if (!connection.send(static_cast<uint32_t>(MessageType::Job), request.bytes()) ||
+            !connection.receive(type, payload) || type != static_cast<uint32_t>(MessageType::Result) ||
+            !merge(payload, *job)) {
+            std::lock_guard lock(_mutex);
+            _queue.push_front(*job);
+            ++_jobsRequeued;
+            --_connected;
+            std::cout << "Worker " << id << " left after " << jobs << " jobs; its job goes back in the queue\n";
+            _changed.notify_one();
+            return;
+        }
+        ++jobs;
+    }
+    connection.send(static_cast<uint32_t>(MessageType::Done));
+    std::lock_guard lock(_mutex);
+    --_connected;
+}
+
+std::optional<RenderJob> Coordinator::takeJob() {
+    std::unique_lock lock(_mutex);
+    _changed.wait(lock, [&] { return !_queue.empty() || _remaining == 0 || _failed; });
+    if (_queue.empty() || _failed) return std::nullopt;
+    const RenderJob job = _queue.front();
+    _queue.pop_front();
+    return job;
+}
+
+bool Coordinator::merge(const std::vector<uint8_t> &payload, const RenderJob &job) {
+    MessageReader in(payload);
+    RenderJob echo{};
+    std::vector<simd::float4> planes[3];
+    const size_t pixels = static_cast<size_t>(job.width) * job.height;
+    if (!in.get(echo) || !sameJob(echo, job) || !in.getArray(planes[0]) || !in.getArray(planes[1]) ||
+        !in.getArray(planes[2]) || planes[0].size() != pixels || planes[1].size() != pixels ||
+        planes[2].size() != pixels) {
+        return false;
+    }
+
+    std::lock_guard lock(_mutex);
+    std::vector<simd::float4> *targets[3] = {&_image.accumulation, &_image.albedo, &_image.normalDepth};
+    const auto m = static_cast<float>(job.samples);
+    for (uint32_t row = 0; row < job.height; ++row) {
+        for (uint32_t column = 0; column < job.width; ++column) {
+            const size_t i = static_cast<size_t>(job.y + row) * _image.width + job.x + column;
+            const size_t p = static_cast<size_t>(row) * job.width + column;
+            // averages weighted by sample count; a pixel's first job is copied exactly
+            const uint32_t n = _image.samples[i];
+            for (int plane = 0; plane < 3; ++plane) {
+                simd::float4 &avg = (*targets[plane])[i];
+                avg = n == 0 ? planes[plane][p] : (avg * static_cast<float>(n) + planes[plane][p] * m) / (static_cast<float>(n) + m);
+            }
+            _image.samples[i] = n + job.samples;
+        }
+    }
+    if (--_remaining == 0) _changed.notify_all();
+    return true;
+}
+
+int runWorker(const std::string &host, uint16_t port, unsigned threads, uint32_t maxJobs) {
+    ignoreBrokenPipes();
+    // the coordinator may still be loading the scene
+    Connection connection = Connection::open(host, port, 30.0);
+    if (!connection.valid()) {
+        std::cerr << "Could not reach a coordinator at " << host << ":" << port << "\n";
+        return 1;
+    }
+    uint32_t type = 0;
+    std::vector<uint8_t> payload;
+    RenderSetup setup;
+    if (!connection.send(static_cast<uint32_t>(MessageType::Hello), MessageWriter().put(kProtocolVersion).bytes()) ||
+        !connection.receive(type, payload) || type != static_cast<uint32_t>(MessageType::Setup)) {
+        std::cerr << "The coordinator at " << host << ":" << port << " did not send a setup\n";
+        return 1;
+    }
+    MessageReader setupReader(payload);
+    if (!readSetup(setupReader, setup)) {
+        std::cerr << "Malformed setup from the coordinator\n";
+        return 1;
+    }
+
+    ThreadPool pool(threads);
+    Scene scene;
+    scene.bvhMode = setup.bvhMode;
+    scene.sbvh = setup.sbvh;
+    scene.bvhOptimize = setup.bvhOptimize;
+    scene.pool = &pool;
+    scene.cachePath = setup.cachePath;
+    if (!loadScene(scene, setup.scene)) {
+        std::cerr << "Could not load scene: " << setup.scene << "\n";
+        return 1;
+    }
+    CpuRenderer renderer(scene, setup.width, setup.height, pool);
+    renderer.setBvhWidth(setup.bvhWidth);
+    renderer.setTraversalPolicy(setup.traversal);
+    renderer.setPipeline(setup.pipeline);
+    renderer.setMaxBounces(setup.maxBounces);
+    renderer.setNextEventEstimation(setup.nextEvent);
+    renderer.setSampler(setup.sampler);
+    renderer.setSeed(setup.seed);
+    if (!connection.send(static_cast<uint32_t>(MessageType::Ready), MessageWriter().put(pool.size()).bytes())) return 1;
+
+    for (uint32_t jobs = 0; maxJobs == 0 || jobs < maxJobs; ++jobs) {
+        RenderJob job{};
+        if (!connection.receive(type, payload)) {
+            std::cerr << "Lost the coordinator\n";
+            return 1;
+        }
+        if (type == static_cast<uint32_t>(MessageType::Done)) return 0;
+        if (type != static_cast<uint32_t>(MessageType::Job) || !MessageReader(payload).get(job) ||
+            job.x + job.width > setup.width || job.y + job.height > setup.height) {
+            std::cerr << "Malformed job from the coordinator\n";
+            return 1;
+        }
+
+        renderer.setRegion(job.x, job.y, job.width, job.height);
+        renderer.setSampleOffset(job.firstSample);
+        renderer.clearAccumulation();
+        for (uint32_t s = 0; s < job.samples; ++s) renderer.render(setup.camera);
+
+        const std::vector<simd::float4> accumulation = crop(renderer.accumulation(), setup.width, job);
+        const std::vector<simd::float4> albedo = crop(renderer.albedoAov(), setup.width, job);
+        const std::vector<simd::float4> normalDepth = crop(renderer.normalDepthAov(), setup.width, job);
+        MessageWriter result;
+        result.put(job);
+        result.putArray(accumulation.data(), accumulation.size());
+        result.putArray(albedo.data(), albedo.size());
+        result.putArray(normalDepth.data(), normalDepth.size());
+        if (!connection.send(static_cast<uint32_t>(MessageType::Result), result.bytes())) {
+            std::cerr << "Lost the coordinator\n";
+            return 1;
+        }
+    }
+    return 0; // leaving early; the coordinator hands our next job to someone else
+}
+
+std::vector<pid_t> spawnLocalWorkers(const char *self, uint16_t port, uint32_t count, unsigned threads) {
+    const std::string address = "127.0.0.1:" + std::to_string(port), threadCount = std::to_string(threads);
+    std::vector<pid_t> workers;
+    for (uint32_t i = 0; i < count; ++i) {
+        char *argv[] = {
+            const_cast<char *>(self), const_cast<char *>("--worker"), const_cast<char *>(address.c_str()),
+            const_cast<char *>("--threads"), const_cast<char *>(threadCount.c_str()), nullptr
+        };
+        pid_t pid;
+        if (posix_spawnp(&pid, self, nullptr, nullptr, argv, environ) != 0) {
+            std::cerr << "Could not start worker process " << self << "\n";
+            return {};
+        }
+        workers.push_back(pid);
+    }
+    return workers;
+}
+
+void waitForWorkers(const std::vector<pid_t> &workers) {
+    for (const pid_t pid: workers) waitpid(pid, nullptr, 0);
+}
+
+bool loadScene(Scene &scene, const std::string &name) {
+    if (name == "teapot") {
+        scene.setupDefault();
+        return true;
+    }
+    return scene.setupObj(name == "cube" ? "assets/cube.obj" : name, 1);
+}
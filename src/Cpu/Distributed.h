@@ -0,0 +1,145 @@
+#ifndef CPU_DISTRIBUTED_H
+#define CPU_DISTRIBUTED_H
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "CpuRenderer.h"
+#include "Denoiser.h"
+#include "Sampler.h"
+#include "Socket.h"
+#include "../Camera.h"
+#include "../Scene.h"
+#include "../ThreadPool.h"
+#include "../Math/Simd.h"
+
+// Rendering one image with several processes, on one machine or many. A coordinator
+// (pathtracer_cpu --serve) cuts the image into jobs: squares of whole tiles, and
+// optionally runs of samples. Workers (pathtracer_cpu --worker host:port) may connect
+// at any time. Each loads the scene named in the setup, normally from the shared
+// scene cache, and renders one job at a time with its own CpuRenderer. A result
+// carries the job's pixel averages, and the coordinator folds them in weighted by
+// the job's sample count. When a worker disconnects, crashes or leaves, its
+// unfinished job goes back to the front of the queue.
+//
+// When every job covers all samples of its pixels, the merged image is
+// bit-identical to a single-process render. Samples are numbered per pixel, and
+// every job draws exactly the ones a local render would.
+//
+// Protocol, one message per step (see MessageType):
+//   worker → Hello, coordinator → Setup, worker → Ready,
+//   then coordinator → Job, worker → Result, repeated,
+//   and finally coordinator → Done.
+
+enum class MessageType : uint32_t {
+    Hello, // kProtocolVersion
+    Setup, // RenderSetup
+    Ready, // threads the worker renders with
+    Job, // RenderJob
+    Result, // RenderJob, then accumulation, albedo and normal/depth of its pixels
+    Done
+};
+
+constexpr uint32_t kProtocolVersion = 3;
+
+// Everything a worker needs to render exactly what the coordinator would.
+struct RenderSetup {
+    std::string scene; // as --scene takes it
+    std::string cachePath;
+    BvhBuildMode bvhMode = BvhBuildMode::BinnedSah;
+    SbvhSettings sbvh; // these two are part of the cache key, so they must match the coordinator's
+    BvhOptimizeSettings bvhOptimize;
+    int bvhWidth = 4;
+    TraversalPolicy traversal = TraversalPolicy::SingleRay;
+    PathPipeline pipeline = PathPipeline::Megakernel;
+    uint32_t width = 0, height = 0;
+    Camera camera{};
+    uint32_t maxBounces = MAX_BOUNCES;
+    bool nextEvent = true;
+    SamplerType sampler = SamplerType::Sobol;
+    uint32_t seed = 0;
+};
+
+// Pixels [x, x + width) x [y, y + height), samples [firstSample, firstSample + samples).
+struct RenderJob {
+    uint32_t x, y, width, height;
+    uint32_t firstSample, samples;
+};
+
+// The merged render, in CpuRenderer's layouts, with every pixel's sample count.
+struct DistributedImage {
+    uint32_t width = 0, height = 0;
+    std::vector<simd::float4> accumulation, albedo, normalDepth;
+    std::vector<uint32_t> samples;
+
+    // As CpuRenderer::denoised.
+    std::vector<simd::float4> denoised(const DenoiseSettings &settings, ThreadPool &pool) const;
+};
+
+// Hands out the jobs of one render to every worker that connects and merges what
+// they send back.
+class Coordinator {
+public:
+    // `spp` samples for every pixel, in jobs of jobSize x jobSize pixels (rounded up
+    // to whole tiles) and `jobSamples` samples each (0: all of them).
+    Coordinator(RenderSetup setup, uint32_t spp, uint32_t jobSize, uint32_t jobSamples);
+
+    // Serve connections from `listener` until every job is merged. `localWorkers` are
+    // processes started for this render. If all of them have exited, and no other
+    // worker is connected while jobs remain, the render fails (false).
+    bool run(Listener &listener, std::vector<pid_t> localWorkers = {});
+
+    const DistributedImage &image() const { return _image; }
+
+    size_t jobCount() const { return _jobCount; }
+    uint32_t workersJoined() const { return _workersJoined; }
+    uint32_t jobsRequeued() const { return _jobsRequeued; }
+
+private:
+    // One worker's connection, on its own thread.
+    void serve(Connection connection);
+
+    // The next job, waiting while others might still be handed back; nothing once
+    // every job is merged or the render failed.
+    std::optional<RenderJob> takeJob();
+
+    // Fold a Result payload for `job` into the image; false if it does not fit the job.
+    bool merge(const std::vector<uint8_t> &payload, const RenderJob &job);
+
+    RenderSetup _setup;
+    DistributedImage _image;
+    size_t _jobCount = 0;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<RenderJob> _queue;
+    size_t _remaining = 0; // jobs not merged yet, including those being rendered
+    uint32_t _connected = 0;
+    uint32_t _workersJoined = 0;
+    uint32_t _jobsRequeued = 0;
+    bool _failed = false;
+};
+
+// Render jobs for the coordinator at host:port until it is done or, if maxJobs is
+// not 0, after that many jobs. Returns the process exit code.
+int runWorker(const std::string &host, uint16_t port, unsigned threads, uint32_t maxJobs = 0);
+
+// Start `count` processes of the executable `self` (argv[0]), each a worker for the
+// coordinator on this machine's `port` with `threads` threads. Empty on failure.
+std::vector<pid_t> spawnLocalWorkers(const char *self, uint16_t port, uint32_t count, unsigned threads);
+
+// Wait for processes from spawnLocalWorkers to exit.
+void waitForWorkers(const std::vector<pid_t> &workers);
+
+// Load `name` as --scene takes it: teapot, cube or an OBJ file placed on the floor.
+bool loadScene(Scene &scene, const std::string &name);
+
+
+#endif //CPU_DISTRIBUTED_H
@@ -0,0 +1,230 @@
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// the float and integer writers below copy host bytes straight into little-endian formats
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+    uint8_t toneMap(float linear) {
+        const float ldr = std::sqrt(std::max(linear, 0.0f));
+        return static_cast<uint8_t>(std::lround(std::clamp(ldr, 0.0f, 1.0f) * 255.0f));
+    }
+
+    template<typename T>
+    void put(std::vector<uint8_t> &buf, T v) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&v);
+        buf.insert(buf.end(), bytes, bytes + sizeof(T));
+    }
+
+    void put(std::vector<uint8_t> &buf, const char *s) {
+        buf.insert(buf.end(), s, s + std::strlen(s) + 1);
+    }
+
+    void putBigEndian(std::vector<uint8_t> &buf, uint32_t v) {
+        for (int shift = 24; shift >= 0; shift -= 8) buf.push_back(static_cast<uint8_t>(v >> shift));
+    }
+
+    uint32_t crc32(const uint8_t *data, size_t size) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        uint32_t c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    void pngChunk(std::vector<uint8_t> &png, const char type[4], const std::vector<uint8_t> &data) {
+        putBigEndian(png, static_cast<uint32_t>(data.size()));
+        const size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        putBigEndian(png, crc32(png.data() + start, png.size() - start));
+    }
+
+    // lower-case, without the dot
+    std::string extension(const std::string &path) {
+        const size_t dot = path.rfind('.');
+        std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext;
+    }
+
+    bool writeFile(const std::string &path, const std::vector<uint8_t> &bytes) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out) {
+            std::cerr << "Failed to write image: " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+}
+
+bool writePPM(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open image for writing: " << path << "\n";
+        return false;
+    }
+
+    out << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const simd::float4 &p = pixels[static_cast<size_t>(y) * width + x];
+            for (int c = 0; c < 3; ++c) {
+                row[x * 3 + c] = toneMap(p[c]);
+            }
+        }
+        out.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    return static_cast<bool>(out);
+}
+
+bool writePNG(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height) {
+    // filter type 0 (none) in front of every row
+    std::vector<uint8_t> raw;
+    raw.reserve((static_cast<size_t>(width) * 3 + 1) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        raw.push_back(0);
+        for (uint32_t x = 0; x < width; ++x) {
+            const simd::float4 &p = pixels[static_cast<size_t>(y) * width + x];
+            for (int c = 0; c < 3; ++c) raw.push_back(toneMap(p[c]));
+        }
+    }
+
+    // zlib stream of stored deflate blocks
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    constexpr size_t kMaxBlock = 65535;
+    for (size_t pos = 0; pos < raw.size() || pos == 0; pos += kMaxBlock) {
+        const auto len = static_cast<uint16_t>(std::min(kMaxBlock, raw.size() - pos));
+        zlib.push_back(pos + len == raw.size() ? 1 : 0);
+        put(zlib, len);
+        put(zlib, static_cast<uint16_t>(~len));
+        zlib.insert(zlib.end(), raw.begin() + static_cast<std::ptrdiff_t>(pos),
+                    raw.begin() + static_cast<std::ptrdiff_t>(pos + len));
+    }
+    uint32_t a = 1, b = 0;
+    for (const uint8_t byte: raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(zlib, b << 16 | a);
+
+    std::vector<uint8_t> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, no interlace
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    pngChunk(png, "IHDR", header);
+    pngChunk(png, "IDAT", zlib);
+    pngChunk(png, "IEND", {});
+    return writeFile(path, png);
+}
+
+bool writePFM(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height) {
+    // a negative scale marks little-endian data; rows run bottom to top
+    const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    std::vector<uint8_t> bytes(header.begin(), header.end());
+    bytes.reserve(bytes.size() + static_cast<size_t>(width) * height * 3 * sizeof(float));
+    for (uint32_t y = height; y-- > 0;) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const simd::float4 &p = pixels[static_cast<size_t>(y) * width + x];
+            for (int c = 0; c < 3; ++c) put(bytes, static_cast<float>(p[c]));
+        }
+    }
+    return writeFile(path, bytes);
+}
+
+bool writeEXR(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height) {
+    constexpr int32_t kFloat = 2;
+    const auto xMax = static_cast<int32_t>(width) - 1, yMax = static_cast<int32_t>(height) - 1;
+
+    std::vector<uint8_t> bytes;
+    put(bytes, 20000630); // magic
+    put(bytes, 2); // version 2, single-part scanline
+
+    // channels are listed, and stored per scanline, in alphabetical order
+    put(bytes, "channels");
+    put(bytes, "chlist");
+    put(bytes, 3 * 18 + 1);
+    for (const char *name: {"B", "G", "R"}) {
+        put(bytes, name);
+        put(bytes, kFloat);
+        put(bytes, 0); // pLinear and reserved
+        put(bytes, 1); // x sampling
+        put(bytes, 1); // y sampling
+    }
+    bytes.push_back(0);
+    put(bytes, "compression");
+    put(bytes, "compression");
+    put(bytes, 1);
+    bytes.push_back(0); // none
+    for (const char *window: {"dataWindow", "displayWindow"}) {
+        put(bytes, window);
+        put(bytes, "box2i");
+        put(bytes, 16);
+        for (const int32_t v: {0, 0, xMax, yMax}) put(bytes, v);
+    }
+    put(bytes, "lineOrder");
+    put(bytes, "lineOrder");
+    put(bytes, 1);
+    bytes.push_back(0); // increasing y
+    put(bytes, "pixelAspectRatio");
+    put(bytes, "float");
+    put(bytes, 4);
+    put(bytes, 1.0f);
+    put(bytes, "screenWindowCenter");
+    put(bytes, "v2f");
+    put(bytes, 8);
+    put(bytes, 0.0f);
+    put(bytes, 0.0f);
+    put(bytes, "screenWindowWidth");
+    put(bytes, "float");
+    put(bytes, 4);
+    put(bytes, 1.0f);
+    bytes.push_back(0); // end of header
+
+    // one uncompressed scanline per chunk: y, byte count, then B, G and R rows
+    const uint32_t lineBytes = width * 3 * sizeof(float);
+    const uint64_t firstChunk = bytes.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; ++y) put(bytes, firstChunk + static_cast<uint64_t>(y) * (8 + lineBytes));
+    for (uint32_t y = 0; y < height; ++y) {
+        put(bytes, static_cast<int32_t>(y));
+        put(bytes, lineBytes);
+        for (int c = 2; c >= 0; --c) {
+            for (uint32_t x = 0; x < width; ++x) put(bytes, static_cast<float>(pixels[static_cast<size_t>(y) * width + x][c]));
+        }
+    }
+    return writeFile(path, bytes);
+}
+
+bool isImageFormat(const std::string &path) {
+    const std::string ext = extension(path);
+    return ext == "ppm" || ext == "png" || ext == "pfm" || ext == "exr";
+}
+
+bool writeImage(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height) {
+    const std::string ext = extension(path);
+    if (ext == "png") return writePNG(path, pixels, width, height);
+    if (ext == "pfm") return writePFM(path, pixels, width, height);
+    if (ext == "exr") return writeEXR(path, pixels, width, height);
+    if (ext == "ppm") return writePPM(path, pixels, width, height);
+    std::cerr << "Unknown image format (use .ppm, .png, .pfm or .exr): " << path << "\n";
+    return false;
+}
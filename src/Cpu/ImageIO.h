@@ -0,0 +1,33 @@
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../Math/Simd.h"
+
+// All writers take linear HDR pixels, row-major from the top-left, and report
+// failures on stderr.
+
+// 8-bit binary PPM, using the same sqrt tone curve as quad_frag.
+bool writePPM(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height);
+
+// 8-bit RGB PNG with the same tone curve as writePPM. The image data is stored
+// uncompressed, which keeps the writer free of a zlib dependency.
+bool writePNG(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height);
+
+// Linear 32-bit float RGB Portable Float Map.
+bool writePFM(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height);
+
+// Linear 32-bit float RGB OpenEXR, scanline, uncompressed.
+bool writeEXR(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height);
+
+// Whether writeImage knows the extension of `path`.
+bool isImageFormat(const std::string &path);
+
+// Pick the writer from the extension of `path`: .ppm, .png, .pfm or .exr.
+bool writeImage(const std::string &path, const std::vector<simd::float4> &pixels, uint32_t width, uint32_t height);
+
+#endif //IMAGEIO_H
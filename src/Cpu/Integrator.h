@@ -0,0 +1,572 @@
+#ifndef CPU_INTEGRATOR_H
+#define CPU_INTEGRATOR_H
+
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <utility>
+
+#include "Bsdf.h"
+#include "Intersection.h"
+#include "Lanes.h"
+#include "Sampler.h"
+#include "../Material.h"
+#include "../Scene.h"
+#include "../TraversalStats.h"
+#include "../Bvh/WideBvh.h"
+#include "../Math/Transform.h"
+
+// CPU port of the path_trace kernel in shaders/kernel.metal. Keep the two in sync:
+// the same scene data, traversal and material logic, so both backends converge to
+// the same image.
+
+// traversal stack entries; one per level of a tree at most kMaxBvhDepth deep (two for packets)
+constexpr int MAX_STACK_DEPTH = 32;
+static_assert(kMaxBvhDepth <= MAX_STACK_DEPTH);
+// maximum bounces per sample
+constexpr uint32_t MAX_BOUNCES = 20;
+
+struct Hit {
+    float t = 1e20f;
+    simd::float3 normal = {0, 0, 0};
+    uint32_t matIndex = 0;
+    bool triangle = false; // from a mesh, so an emissive hit is in Scene::lights
+};
+
+// Depth AOV of camera rays that leave the scene.
+constexpr float kMissDepth = 1e10f;
+
+// First-hit features of a path, the guides of the denoiser (see Denoiser.h).
+struct PathAovs {
+    simd::float3 albedo = {1.0f, 1.0f, 1.0f}; // 1 where radiance has no texture to remove: sky, lights, glass, mirrors
+    simd::float3 normal = {0.0f, 0.0f, 0.0f}; // facing the camera
+    float depth = kMissDepth; // distance along the camera ray
+};
+
+// Integrator options beyond the scene itself.
+struct PathSettings {
+    uint32_t maxBounces = MAX_BOUNCES;
+    // sample Scene::lights at every diffuse vertex and combine with the bounce by MIS;
+    // off, light is only found by hitting it
+    bool nextEvent = true;
+};
+
+// A postponed node and the distance at which the ray enters its box.
+struct TraversalEntry {
+    uint32_t node;
+    float t;
+};
+
+// Walk of a binary BVH for one ray, nearer child first. `leaf(node)` gets every leaf
+// whose box the ray enters before `tMax`; it may lower `tMax` as it finds hits, which
+// culls the boxes behind them, and returns true to end the walk (any-hit queries).
+// Only the farther child waits on the stack, at most one per level, so a tree within
+// kMaxBvhDepth cannot overflow it.
+template<typename Leaf>
+void traverseBvh(const BVHNode *bvhNodes, uint32_t root, const Ray &ray, const float &tMax, Leaf &&leaf) {
+    const simd::float3 inv = 1.0f / ray.dir;
+    TRAVERSAL_STAT(nodes++);
+    TRAVERSAL_STAT(aabbTests++);
+    if (aabbEntry(bvhNodes[root].bboxMin, bvhNodes[root].bboxMax, ray, inv, tMax) == HUGE_VALF) return;
+
+    TraversalEntry stack[MAX_STACK_DEPTH];
+    int sp = 0;
+    uint32_t ni = root;
+    while (true) {
+        const BVHNode &node = bvhNodes[ni];
+        if (node.count > 0) {
+            if (leaf(node)) return;
+        } else {
+            TRAVERSAL_STAT(aabbTests += 2);
+            uint32_t first = node.leftFirst, second = node.rightFirst;
+            float tFirst = aabbEntry(bvhNodes[first].bboxMin, bvhNodes[first].bboxMax, ray, inv, tMax);
+            float tSecond = aabbEntry(bvhNodes[second].bboxMin, bvhNodes[second].bboxMax, ray, inv, tMax);
+            if (tSecond < tFirst) {
+                std::swap(first, second);
+                std::swap(tFirst, tSecond);
+            }
+            if (tFirst != HUGE_VALF) {
+                if (tSecond != HUGE_VALF) {
+                    if (sp < MAX_STACK_DEPTH) {
+                        stack[sp++] = {second, tSecond};
+                        TRAVERSAL_STAT(noteStack(sp));
+                    } else {
+                        TRAVERSAL_STAT(stackOverflows++); // only a tree deeper than kMaxBvhDepth gets here
+                    }
+                }
+                ni = first;
+                TRAVERSAL_STAT(nodes++);
+                continue;
+            }
+        }
+        // back to the last postponed box, unless a hit has been found in front of it
+        while (sp > 0 && stack[sp - 1].t >= tMax) --sp;
+        if (sp == 0) return;
+        ni = stack[--sp].node;
+        TRAVERSAL_STAT(nodes++);
+    }
+}
+
+// Closest hit against one bottom-level BVH. `ray` is in the mesh's object space;
+// the normal is left in object space too.
+inline void intersectBlas(const Scene &scene, uint32_t root, const Ray &ray, Hit &hit) {
+    const SceneTriangle *triangles = scene.triangles.data();
+    const SceneVertex *vertices = scene.vertices.data();
+    traverseBvh(scene.bvhNodes.data(), root, ray, hit.t, [&](const BVHNode &node) {
+        TRAVERSAL_STAT(triangleTests += node.count);
+        for (uint32_t i = 0; i < node.count; ++i) {
+            const SceneTriangle &tri = triangles[node.leftFirst + i];
+            simd::float3 nTmp;
+            float t = intersectTriangle(vertices[tri.v0].position(), vertices[tri.v1].position(),
+                                        vertices[tri.v2].position(), ray, nTmp);
+            if (t > 0.0f && t < hit.t) {
+                hit.t = t;
+                hit.normal = nTmp;
+                hit.matIndex = tri.matIndex;
+            }
+        }
+        return false;
+    });
+}
+
+// Whether anything in one bottom-level BVH is hit closer than `tMax`; stops at the
+// first such triangle.
+inline bool anyHitBlas(const Scene &scene, uint32_t root, const Ray &ray, float tMax) {
+    const SceneTriangle *triangles = scene.triangles.data();
+    const SceneVertex *vertices = scene.vertices.data();
+    bool found = false;
+    traverseBvh(scene.bvhNodes.data(), root, ray, tMax, [&](const BVHNode &node) {
+        for (uint32_t i = 0; i < node.count; ++i) {
+            TRAVERSAL_STAT(triangleTests++);
+            const SceneTriangle &tri = triangles[node.leftFirst + i];
+            simd::float3 nTmp;
+            float t = intersectTriangle(vertices[tri.v0].position(), vertices[tri.v1].position(),
+                                        vertices[tri.v2].position(), ray, nTmp);
+            if (t > 0.0f && t < tMax) return found = true;
+        }
+        return false;
+    });
+    return found;
+}
+
+// One BLAS of a WideBvh: each step tests all W child boxes, culls those entered
+// behind `hit.t` and postpones the others nearest-last, and each leaf intersects W
+// triangles at once. Lane for lane the arithmetic is the same as
+// intersectAABB/intersectTriangle, so hits match the binary traversal. With AnyHit
+// the walk ends at the first triangle closer than `hit.t`, returning true, and
+// leaves `hit` alone.
+template<int W, bool AnyHit>
+bool traverseBlasWide(const WideBvh<W> &bvh, uint32_t root, const Ray &ray, Hit &hit) {
+    using L = Lanes<W>;
+    using F = typename L::Float;
+    constexpr float EPS = 1e-6f;
+
+    const F ox = L::splat(ray.origin.x), oy = L::splat(ray.origin.y), oz = L::splat(ray.origin.z);
+    const F dx = L::splat(ray.dir.x), dy = L::splat(ray.dir.y), dz = L::splat(ray.dir.z);
+    const simd::float3 inv = 1.0f / ray.dir;
+    const F ix = L::splat(inv.x), iy = L::splat(inv.y), iz = L::splat(inv.z);
+
+    // a node postpones at most W - 1 children per level
+    TraversalEntry stack[MAX_STACK_DEPTH * W];
+    int sp = 0;
+    stack[sp++] = {root, 0.0f};
+
+    while (sp > 0) {
+        const TraversalEntry entry = stack[--sp];
+        if (entry.t >= hit.t) continue; // a hit in front of it was found since
+        const WideNode<W> &node = bvh.nodes[entry.node];
+        TRAVERSAL_STAT(nodes++);
+        TRAVERSAL_STAT(aabbTests += node.childCount);
+
+        const F t0x = (L::load(node.bminX) - ox) * ix, t1x = (L::load(node.bmaxX) - ox) * ix;
+        const F t0y = (L::load(node.bminY) - oy) * iy, t1y = (L::load(node.bmaxY) - oy) * iy;
+        const F t0z = (L::load(node.bminZ) - oz) * iz, t1z = (L::load(node.bmaxZ) - oz) * iz;
+        const F tnear = L::max(L::max(L::max(L::min(t0x, t1x), L::min(t0y, t1y)), L::min(t0z, t1z)),
+                               L::splat(0.0f));
+        const F tfar = L::min(L::min(L::max(t0x, t1x), L::max(t0y, t1y)), L::max(t0z, t1z));
+        uint32_t mask = L::bits((tfar >= tnear) & (tnear < L::splat(hit.t))) & ((1u << node.childCount) - 1);
+
+        // inner children hit, farthest first, so the nearest is popped next
+        TraversalEntry inner[W];
+        int innerCount = 0;
+        for (; mask; mask &= mask - 1) {
+            const int lane = std::countr_zero(mask);
+            if (node.count[lane] == 0) {
+                int k = innerCount++;
+                for (; k > 0 && inner[k - 1].t < tnear[lane]; --k) inner[k] = inner[k - 1];
+                inner[k] = {node.child[lane], tnear[lane]};
+                continue;
+            }
+            TRAVERSAL_STAT(triangleTests += node.count[lane] * W);
+            for (uint32_t pi = node.child[lane]; pi < node.child[lane] + node.count[lane]; ++pi) {
+                const TriPacket<W> &P = bvh.packets[pi];
+                const F e1x = L::load(P.e1x), e1y = L::load(P.e1y), e1z = L::load(P.e1z);
+                const F e2x = L::load(P.e2x), e2y = L::load(P.e2y), e2z = L::load(P.e2z);
+                const F px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+                const F det = e1x * px + e1y * py + e1z * pz;
+                const F invDet = 1.0f / det;
+                const F tx = ox - L::load(P.v0x), ty = oy - L::load(P.v0y), tz = oz - L::load(P.v0z);
+                const F u = (tx * px + ty * py + tz * pz) * invDet;
+                const F qx = ty * e1z - tz * e1y, qy = tz * e1x - tx * e1z, qz = tx * e1y - ty * e1x;
+                const F v = (dx * qx + dy * qy + dz * qz) * invDet;
+                const F t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+                uint32_t hits = L::bits(~(L::abs(det) < EPS) & ~(u < 0.0f | u > 1.0f) &
+                                        ~(v < 0.0f | u + v > 1.0f) & ~(t < EPS) &
+                                        (t > 0.0f) & (t < hit.t));
+                if constexpr (AnyHit) {
+                    if (hits) return true;
+                    continue;
+                }
+                for (; hits; hits &= hits - 1) {
+                    const int i = std::countr_zero(hits);
+                    if (t[i] < hit.t) {
+                        hit.t = t[i];
+                        hit.normal = simd::normalize(simd::cross(simd::float3{P.e1x[i], P.e1y[i], P.e1z[i]},
+                                                                 simd::float3{P.e2x[i], P.e2y[i], P.e2z[i]}));
+                        hit.matIndex = P.matIndex[i];
+                    }
+                }
+            }
+        }
+        for (int k = 0; k < innerCount; ++k) {
+            if (sp < MAX_STACK_DEPTH * W) {
+                stack[sp++] = inner[k];
+                TRAVERSAL_STAT(noteStack(sp));
+            } else {
+                TRAVERSAL_STAT(stackOverflows++); // only a tree deeper than kMaxBvhDepth gets here
+            }
+        }
+    }
+    return false;
+}
+
+// Closest hit against one BLAS of a WideBvh.
+template<int W>
+void intersectBlasWide(const WideBvh<W> &bvh, uint32_t root, const Ray &ray, Hit &hit) {
+    traverseBlasWide<W, false>(bvh, root, ray, hit);
+}
+
+// How intersectScene and anyHitScene traverse a BLAS: the binary Scene::bvhNodes
+// (as the kernel does) or a WideBvh collapsed from them.
+struct BinaryBlas {
+    const Scene &scene;
+
+    void intersect(uint32_t blasRoot, const Ray &ray, Hit &hit) const { intersectBlas(scene, blasRoot, ray, hit); }
+
+    bool anyHit(uint32_t blasRoot, const Ray &ray, float tMax) const {
+        return anyHitBlas(scene, blasRoot, ray, tMax);
+    }
+};
+
+template<int W>
+struct WideBlas {
+    const WideBvh<W> &bvh;
+
+    void intersect(uint32_t blasRoot, const Ray &ray, Hit &hit) const {
+        intersectBlasWide(bvh, bvh.root(blasRoot), ray, hit);
+    }
+
+    bool anyHit(uint32_t blasRoot, const Ray &ray, float tMax) const {
+        Hit bound;
+        bound.t = tMax;
+        return traverseBlasWide<W, true>(bvh, bvh.root(blasRoot), ray, bound);
+    }
+};
+
+// 1) Find the nearest intersection
+template<typename Blas>
+Hit intersectScene(const Scene &scene, const Blas &blas, const Ray &ray) {
+    Hit hit;
+
+    const SceneInstance *instances = scene.instances.data();
+
+    if (!scene.tlasNodes.empty()) {
+        traverseBvh(scene.tlasNodes.data(), 0, ray, hit.t, [&](const BVHNode &node) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                // trace the instance in object space; t is unchanged because the
+                // direction is transformed without renormalising
+                const SceneInstance &inst = instances[node.leftFirst + i];
+                Ray objRay;
+                objRay.origin = transformPoint(inst.worldToObject, ray.origin);
+                objRay.dir = transformDirection(inst.worldToObject, ray.dir);
+                const float prevT = hit.t;
+                blas.intersect(inst.blasRoot, objRay, hit);
+                if (hit.t < prevT) {
+                    hit.normal = simd::normalize(transformNormal(inst.worldToObject, hit.normal));
+                    hit.triangle = true;
+                }
+            }
+            return false;
+        });
+    }
+
+    TRAVERSAL_STAT(primitiveTests += static_cast<uint32_t>(scene.planes.size() + scene.spheres.size()));
+    for (const auto &plane: scene.planes) {
+        simd::float3 nTmp;
+        float t = intersectPlane(plane, ray, nTmp);
+        if (t > 0.0f && t < hit.t) {
+            hit.t = t;
+            hit.normal = nTmp;
+            hit.matIndex = plane.matIndex;
+            hit.triangle = false;
+        }
+    }
+
+    // Spheres
+    for (const auto &sphere: scene.spheres) {
+        simd::float3 nTmp;
+        float t = intersectSphere(sphere, ray, nTmp);
+        if (t > 0.0f && t < hit.t) {
+            hit.t = t;
+            hit.normal = nTmp;
+            hit.matIndex = sphere.matIndex;
+            hit.triangle = false;
+        }
+    }
+
+    return hit;
+}
+
+// Whether anything is hit in (0, tMax): the shadow and visibility query. It stops at
+// the first hit found instead of searching for the closest.
+template<typename Blas>
+bool anyHitScene(const Scene &scene, const Blas &blas, const Ray &ray, float tMax) {
+    TRAVERSAL_STAT(primitiveTests += static_cast<uint32_t>(scene.planes.size() + scene.spheres.size()));
+    for (const auto &plane: scene.planes) {
+        simd::float3 nTmp;
+        float t = intersectPlane(plane, ray, nTmp);
+        if (t > 0.0f && t < tMax) return true;
+    }
+    for (const auto &sphere: scene.spheres) {
+        simd::float3 nTmp;
+        float t = intersectSphere(sphere, ray, nTmp);
+        if (t > 0.0f && t < tMax) return true;
+    }
+
+    bool found = false;
+    if (!scene.tlasNodes.empty()) {
+        traverseBvh(scene.tlasNodes.data(), 0, ray, tMax, [&](const BVHNode &node) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                const SceneInstance &inst = scene.instances[node.leftFirst + i];
+                Ray objRay;
+                objRay.origin = transformPoint(inst.worldToObject, ray.origin);
+                objRay.dir = transformDirection(inst.worldToObject, ray.dir);
+                if (blas.anyHit(inst.blasRoot, objRay, tMax)) return found = true;
+            }
+            return false;
+        });
+    }
+    return found;
+}
+
+// Solid-angle density of sampling direction `ray.dir` towards a light hit at distance
+// `t` with geometric normal `n`, for a light of emitted luminance `emitted`.
+inline float lightPdf(const Scene &scene, float emitted, float t, const simd::float3 &n, const simd::float3 &dir) {
+    const float cosL = std::fabs(simd::dot(n, dir));
+    return cosL > 0.0f ? emitted / scene.lightPower * t * t / cosL : HUGE_VALF;
+}
+
+// A light sample whose shadow ray has not been traced yet.
+struct LightSample {
+    Ray shadow;
+    float distance = 0.0f; // to the point on the light
+    simd::float3 radiance = {0.0f, 0.0f, 0.0f}; // what arrives if nothing is in between
+};
+
+// Direct light at a diffuse vertex (position `P`, normal `n`) from one point on one
+// light, drawn by power from the alias table and MIS-weighted against the diffuse
+// bounce, taken with probability `pDiffuse`, that could have found it too. False
+// when the sample cannot contribute; otherwise its shadow ray still has to be traced.
+inline bool drawLightSample(const Scene &scene, const simd::float3 &P, const simd::float3 &n,
+                            const simd::float3 &albedo, float pDiffuse, Sampler &sampler, LightSample &out) {
+    const auto count = static_cast<uint32_t>(scene.lights.size());
+    const simd::float2 u = sampler.get2D();
+    uint32_t pick = std::min(static_cast<uint32_t>(u.x * static_cast<float>(count)), count - 1);
+    if (u.y >= scene.lights[pick].prob) pick = scene.lights[pick].alias;
+    const SceneLight &light = scene.lights[pick];
+
+    // uniform point on the triangle
+    const simd::float2 ab = sampler.get2D();
+    float a = ab.x, b = ab.y;
+    if (a + b > 1.0f) {
+        a = 1.0f - a;
+        b = 1.0f - b;
+    }
+    const simd::float3 e1 = light.e1.position(), e2 = light.e2.position();
+    const simd::float3 toLight = light.v0.position() + a * e1 + b * e2 - P;
+    const float dist = simd::length(toLight);
+    const simd::float3 wi = toLight / dist;
+    const float cosS = simd::dot(n, wi);
+    if (cosS <= 0.0f) return false;
+
+    const simd::float3 emission = scene.materials[light.matIndex].emission;
+    const float pdfLight = lightPdf(scene, luminance(emission), dist, simd::normalize(simd::cross(e1, e2)), wi);
+    if (std::isinf(pdfLight)) return false;
+
+    constexpr float invPi = std::numbers::inv_pi_v<float>;
+    const float pdfBsdf = pDiffuse * cosS * invPi;
+    out.shadow.origin = P + n * 0.001f;
+    out.shadow.dir = wi;
+    out.distance = dist;
+    out.radiance = albedo * invPi * emission * (cosS / pdfLight * powerHeuristic(pdfLight, pdfBsdf));
+    return true;
+}
+
+// Whether anything blocks `sample`'s shadow ray before the light.
+template<typename Blas>
+bool occluded(const Scene &scene, const Blas &blas, const LightSample &sample) {
+    return anyHitScene(scene, blas, sample.shadow, sample.distance * 0.999f);
+}
+
+// drawLightSample with its shadow ray traced: the direct light itself.
+template<typename Blas>
+simd::float3 sampleLight(const Scene &scene, const Blas &blas, const simd::float3 &P, const simd::float3 &n,
+                         const simd::float3 &albedo, float pDiffuse, Sampler &sampler) {
+    LightSample sample;
+    if (!drawLightSample(scene, P, n, albedo, pDiffuse, sampler, sample) || occluded(scene, blas, sample)) {
+        return {0.0f, 0.0f, 0.0f};
+    }
+    return sample.radiance;
+}
+
+// The steps of a path vertex, shared by tracePath and the wavefront stages
+// (Wavefront.h) so both trace exactly the same paths.
+
+// Radiance of a ray that leaves the scene.
+inline simd::float3 skyRadiance(const simd::float3 &dir) {
+    float tt = 0.5f * (simd::normalize(dir).y + 1.0f);
+    return simd::mix(simd::float3{0.2f, 0.2f, 0.2f}, simd::float3{0.005f, 0.007f, 0.01f}, tt);
+}
+
+// Denoiser features of a camera ray's hit.
+inline PathAovs firstHitAovs(const Material &mat, const Ray &ray, const Hit &hit) {
+    const bool plain = mat.ior <= 1.0f && mat.reflectivity < 1.0f && luminance(mat.emission) <= 0.0f;
+    return {plain ? mat.albedo : simd::float3{1.0f, 1.0f, 1.0f},
+            simd::dot(ray.dir, hit.normal) < 0.0f ? hit.normal : -hit.normal, hit.t};
+}
+
+// MIS weight of the emission found at `hit`: below 1 if light sampling at the
+// previous vertex (whose bounce had density `bsdfPdf`, 0 if it did not sample
+// lights) could have found this emitter too.
+inline float emissionWeight(const Scene &scene, const Material &mat, const Hit &hit, const Ray &ray, float bsdfPdf) {
+    const float emitted = luminance(mat.emission);
+    if (bsdfPdf > 0.0f && hit.triangle && emitted > 0.0f) {
+        return powerHeuristic(bsdfPdf, lightPdf(scene, emitted, hit.t, hit.normal, ray.dir));
+    }
+    return 1.0f;
+}
+
+// Russian roulette from the fifth vertex on; false ends the path, otherwise the
+// throughput is boosted to compensate.
+inline bool survivesRoulette(uint32_t bounce, simd::float3 &throughput, Sampler &sampler) {
+    if (bounce < 4) return true;
+    // probability of survival = max RGB throughput, clamped to [0.05,1]
+    float p_rr = std::max(std::max(throughput.x, throughput.y), throughput.z);
+    p_rr = std::clamp(p_rr, 0.05f, 1.0f);
+    if (sampler.get1D() > p_rr) {
+        return false;
+    }
+    throughput /= p_rr;
+    return true;
+}
+
+// Dielectric (ior > 1): reflect or refract `ray` at P by Fresnel.
+inline void scatterDielectric(const Material &mat, const Hit &hit, const simd::float3 &P, Ray &ray,
+                              Sampler &sampler) {
+    // compute cosine of incidence
+    float cosI = simd::dot(ray.dir, hit.normal);
+    bool entering = cosI < 0.0f;
+    simd::float3 N = entering ? hit.normal : -hit.normal;
+
+    // decide indices
+    float eta_i = entering ? 1.0f : mat.ior;
+    float eta_t = entering ? mat.ior : 1.0f;
+    float eta = eta_i / eta_t;
+
+    // base reflectance at normal incidence
+    float F0 = std::pow((eta_i - eta_t) / (eta_i + eta_t), 2.0f);
+    float R = fresnelSchlick(std::fabs(cosI), F0);
+
+    if (sampler.get1D() < R) {
+        // reflect
+        ray.origin = P + N * 0.001f;
+        ray.dir = reflectDir(ray.dir, N);
+    } else {
+        // refract
+        ray.origin = P - N * 0.001f;
+        ray.dir = refractDir(ray.dir, N, eta);
+    }
+}
+
+// Mirror/diffuse mix: pick a lobe by reflectivity and continue `ray` along it.
+// `bsdfPdf` gets the diffuse bounce's density when lights were sampled here.
+inline void scatterSurface(const Material &mat, const Hit &hit, const simd::float3 &P, bool sampledLights,
+                           Ray &ray, simd::float3 &throughput, float &bsdfPdf, Sampler &sampler) {
+    float p_spec = mat.reflectivity;
+    float p_diff = 1.0f - p_spec;
+    float u_b = sampler.get1D();
+
+    if (u_b < p_spec) {
+        ray.origin = P + hit.normal * 0.001f;
+        ray.dir = reflectDir(ray.dir, hit.normal);
+        throughput *= (1.0f / p_spec);
+    } else {
+        ray.origin = P + hit.normal * 0.001f;
+        ray.dir = randomHemisphere(hit.normal, sampler.get2D());
+        throughput *= mat.albedo / p_diff;
+        if (sampledLights) bsdfPdf = p_diff * simd::dot(hit.normal, ray.dir) * std::numbers::inv_pi_v<float>;
+    }
+}
+
+// Radiance along one camera path; `sampler` has already drawn the camera ray.
+// `primary`, when given, is the already traced hit of the camera ray (e.g. from a
+// packet). `aovs`, when given, receives the features of the first hit.
+template<typename Blas>
+simd::float3 tracePath(const Scene &scene, const Blas &blas, Ray ray, Sampler &sampler, const Hit *primary = nullptr,
+                       const PathSettings &settings = {}, PathAovs *aovs = nullptr) {
+    simd::float3 throughput = {1.0f, 1.0f, 1.0f};
+    simd::float3 L = {0.0f, 0.0f, 0.0f};
+    const bool nextEvent = settings.nextEvent && !scene.lights.empty();
+    float bsdfPdf = 0.0f; // of the last bounce if light was also sampled there, else 0
+
+    for (uint32_t bounce = 0; bounce < settings.maxBounces; ++bounce) {
+        TRAVERSAL_STAT(bounces++);
+        sampler.startBounce(bounce);
+        const Hit hit = bounce == 0 && primary ? *primary : intersectScene(scene, blas, ray);
+
+        if (hit.t > 1e19f) {
+            if (bounce == 0 && aovs) *aovs = {{1.0f, 1.0f, 1.0f}, -ray.dir, kMissDepth};
+            L += throughput * skyRadiance(ray.dir);
+            break;
+        }
+
+        // compute hit‐point
+        simd::float3 P = ray.origin + hit.t * ray.dir;
+
+        const Material &mat = scene.materials[hit.matIndex];
+        if (bounce == 0 && aovs) *aovs = firstHitAovs(mat, ray, hit);
+
+        L += throughput * mat.emission * emissionWeight(scene, mat, hit, ray, bsdfPdf);
+        bsdfPdf = 0.0f;
+
+        if (!survivesRoulette(bounce, throughput, sampler)) break;
+
+        if (mat.ior > 1.0f) {
+            scatterDielectric(mat, hit, P, ray, sampler);
+            continue;
+        }
+
+        const bool sampleLights = nextEvent && mat.reflectivity < 1.0f;
+        if (sampleLights) {
+            L += throughput * sampleLight(scene, blas, P, hit.normal, mat.albedo, 1.0f - mat.reflectivity, sampler);
+        }
+        scatterSurface(mat, hit, P, sampleLights, ray, throughput, bsdfPdf, sampler);
+    }
+
+    return L;
+}
+
+#endif //CPU_INTEGRATOR_H
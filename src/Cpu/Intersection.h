@@ -0,0 +1,83 @@
+#ifndef CPU_INTERSECTION_H
+#define CPU_INTERSECTION_H
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#include "../Math/Simd.h"
+#include "../Primitives/Primitives.h"
+
+// CPU mirror of shaders/intersection.metal
+
+struct Ray {
+    simd::float3 origin, dir;
+};
+
+// returns t, or t<0 if miss
+inline float intersectTriangle(const simd::float3 &v0, const simd::float3 &v1, const simd::float3 &v2,
+                               const Ray &r, simd::float3 &outN) {
+    constexpr float EPS = 1e-6f;
+    simd::float3 e1 = v1 - v0, e2 = v2 - v0;
+    simd::float3 p = simd::cross(r.dir, e2);
+    float det = simd::dot(e1, p);
+    if (std::fabs(det) < EPS) return -1.0f;
+    float inv = 1.0f / det;
+    simd::float3 tvec = r.origin - v0;
+    float u = simd::dot(tvec, p) * inv;
+    if (u < 0 || u > 1) return -1.0f;
+    simd::float3 q = simd::cross(tvec, e1);
+    float v = simd::dot(r.dir, q) * inv;
+    if (v < 0 || u + v > 1) return -1.0f;
+    float t = simd::dot(e2, q) * inv;
+    if (t < EPS) return -1.0f;
+    outN = simd::normalize(simd::cross(e1, e2));
+    return t;
+}
+
+inline float intersectPlane(const ScenePlane &pl, const Ray &r, simd::float3 &outN) {
+    float denom = simd::dot(pl.normal, r.dir);
+    if (std::fabs(denom) < 1e-6f) return -1.0f;
+    float t = -(simd::dot(pl.normal, r.origin) + pl.d) / denom;
+    if (t <= 0.0f) return -1.0f;
+    outN = pl.normal;
+    return t;
+}
+
+inline float intersectSphere(const SceneSphere &sp, const Ray &r, simd::float3 &outN) {
+    simd::float3 oc = r.origin - sp.center;
+    float a = simd::dot(r.dir, r.dir),
+          b = simd::dot(oc, r.dir),
+          c = simd::dot(oc, oc) - sp.radius * sp.radius;
+    float disc = b * b - a * c;
+    if (disc < 0.0f) return -1.0f;
+    float t = (-b - std::sqrt(disc)) / a;
+    if (t < 1e-6f) return -1.0f;
+    simd::float3 P = r.origin + t * r.dir;
+    outN = simd::normalize(P - sp.center);
+    return t;
+}
+
+inline bool intersectAABB(const simd::float3 &mn, const simd::float3 &mx, const Ray &r) {
+    simd::float3 inv = 1.0f / r.dir;
+    simd::float3 t0 = (mn - r.origin) * inv;
+    simd::float3 t1 = (mx - r.origin) * inv;
+    simd::float3 tmin = simd::min(t0, t1), tmax = simd::max(t0, t1);
+    float tnear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    return tfar >= std::max(tnear, 0.0f);
+}
+
+// As intersectAABB, but the distance at which `r` enters the box (0 from inside), or
+// HUGE_VALF when it misses or only gets there at or beyond `tMax`. `inv` is 1 / r.dir.
+inline float aabbEntry(const simd::float3 &mn, const simd::float3 &mx, const Ray &r, const simd::float3 &inv,
+                       float tMax) {
+    simd::float3 t0 = (mn - r.origin) * inv;
+    simd::float3 t1 = (mx - r.origin) * inv;
+    simd::float3 tmin = simd::min(t0, t1), tmax = simd::max(t0, t1);
+    float tnear = std::max(std::max(std::max(tmin.x, tmin.y), tmin.z), 0.0f);
+    float tfar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    return tfar >= tnear && tnear < tMax ? tnear : HUGE_VALF;
+}
+
+#endif //CPU_INTERSECTION_H
@@ -0,0 +1,53 @@
+#ifndef CPU_LANES_H
+#define CPU_LANES_H
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// W-wide float/mask vectors on the GCC/Clang vector extension. The compiler lowers
+// them to SSE/AVX (or NEON) for whatever the target supports, so the same code runs
+// one instruction per operation on 4 or 8 lanes without per-ISA intrinsics.
+template<int W>
+struct LaneTypes;
+
+// spelled out per width: GCC drops a dependent vector_size inside a class template
+template<>
+struct LaneTypes<4> {
+    typedef float Float __attribute__((vector_size(16)));
+    typedef int Mask __attribute__((vector_size(16))); // lanes are 0 or -1
+};
+
+template<>
+struct LaneTypes<8> {
+    typedef float Float __attribute__((vector_size(32)));
+    typedef int Mask __attribute__((vector_size(32)));
+};
+
+template<int W>
+struct Lanes {
+    using Float = typename LaneTypes<W>::Float;
+    using Mask = typename LaneTypes<W>::Mask;
+
+    static Float load(const float *p) {
+        Float v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static Float splat(float s) { return Float{} + s; }
+
+    // same operand order as std::min/std::max, so NaNs propagate the same way
+    static Float min(Float a, Float b) { return b < a ? b : a; }
+    static Float max(Float a, Float b) { return a < b ? b : a; }
+    static Float abs(Float a) { return a < 0.0f ? -a : a; }
+
+    // One bit per lane, lane 0 in bit 0.
+    static uint32_t bits(Mask m) {
+        uint32_t r = 0;
+        for (int i = 0; i < W; ++i) r |= static_cast<uint32_t>(m[i] != 0) << i;
+        return r;
+    }
+};
+
+#endif //CPU_LANES_H
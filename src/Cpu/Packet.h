@@ -0,0 +1,264 @@
+#ifndef CPU_PACKET_H
+#define CPU_PACKET_H
+
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include "Integrator.h"
+#include "Lanes.h"
+#include "../Scene.h"
+#include "../Math/Transform.h"
+
+// Packet traversal for coherent rays (camera rays of one pixel block): the rays walk
+// the binary TLAS/BLAS together with one shared stack. A node is first tested
+// against the packet as a whole with interval arithmetic over the rays' origins and
+// inverse directions; only if that cannot rule it out are the rays tested one per
+// SIMD lane. Per ray the arithmetic matches intersectAABB/intersectTriangle, so the
+// hits are the ones single-ray traversal finds.
+
+struct RayPacket {
+    static constexpr int kSize = 16; // a 4x4 pixel block
+#if defined(__AVX__)
+    static constexpr int kLanes = 8;
+#else
+    static constexpr int kLanes = 4; // 8-wide vectors would be split and spilled without AVX
+#endif
+    static constexpr uint32_t kLaneMask = (1u << kLanes) - 1;
+
+    alignas(32) float ox[kSize], oy[kSize], oz[kSize];
+    alignas(32) float dx[kSize], dy[kSize], dz[kSize];
+    alignas(32) float ix[kSize], iy[kSize], iz[kSize];
+    uint32_t active = 0; // one bit per ray in use
+
+    // Packet-wide ranges for the interval test; `coherent` is false when the rays'
+    // direction signs differ on some axis, which leaves nothing to cull with.
+    simd::float3 oMin, oMax, iMin, iMax;
+    bool coherent = false;
+
+    void set(int i, const Ray &ray) {
+        const simd::float3 inv = 1.0f / ray.dir;
+        ox[i] = ray.origin.x;
+        oy[i] = ray.origin.y;
+        oz[i] = ray.origin.z;
+        dx[i] = ray.dir.x;
+        dy[i] = ray.dir.y;
+        dz[i] = ray.dir.z;
+        ix[i] = inv.x;
+        iy[i] = inv.y;
+        iz[i] = inv.z;
+        active |= 1u << i;
+    }
+
+    Ray ray(int i) const { return {{ox[i], oy[i], oz[i]}, {dx[i], dy[i], dz[i]}}; }
+
+    // Call once all rays are set.
+    void finalize() {
+        oMin = iMin = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
+        oMax = iMax = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+        for (uint32_t m = active; m; m &= m - 1) {
+            const int i = std::countr_zero(m);
+            oMin = simd::min(oMin, simd::float3{ox[i], oy[i], oz[i]});
+            oMax = simd::max(oMax, simd::float3{ox[i], oy[i], oz[i]});
+            iMin = simd::min(iMin, simd::float3{ix[i], iy[i], iz[i]});
+            iMax = simd::max(iMax, simd::float3{ix[i], iy[i], iz[i]});
+        }
+        coherent = active != 0;
+        for (int a = 0; a < 3; ++a) {
+            const bool sameSign = iMin[a] > 0.0f || iMax[a] < 0.0f;
+            coherent = coherent && sameSign && std::isfinite(iMin[a]) && std::isfinite(iMax[a]);
+        }
+    }
+
+    // The same rays in the space of `m` (directions are not renormalised).
+    RayPacket transformed(const simd::float4x4 &m) const {
+        RayPacket p;
+        for (uint32_t bits = active; bits; bits &= bits - 1) {
+            const int i = std::countr_zero(bits);
+            const Ray r = ray(i);
+            p.set(i, {transformPoint(m, r.origin), transformDirection(m, r.dir)});
+        }
+        p.finalize();
+        return p;
+    }
+};
+
+// Closest hit of every ray in a packet, SoA so `t` can be compared in SIMD.
+struct PacketHit {
+    alignas(32) float t[RayPacket::kSize];
+    simd::float3 normal[RayPacket::kSize];
+    uint32_t matIndex[RayPacket::kSize];
+
+    PacketHit() {
+        std::fill(std::begin(t), std::end(t), 1e20f);
+        std::fill(std::begin(normal), std::end(normal), simd::float3{0, 0, 0});
+        std::fill(std::begin(matIndex), std::end(matIndex), 0u);
+    }
+
+    Hit hit(int i) const { return {t[i], normal[i], matIndex[i]}; }
+};
+
+// True when no ray of the packet can hit the box (conservative).
+inline bool packetMissesBox(const RayPacket &p, const simd::float3 &bmin, const simd::float3 &bmax) {
+    if (!p.coherent) return false;
+    float entry = 0.0f, exit = HUGE_VALF;
+    for (int a = 0; a < 3; ++a) {
+        const bool positive = p.iMin[a] > 0.0f;
+        const float nearPlane = positive ? bmin[a] : bmax[a];
+        const float farPlane = positive ? bmax[a] : bmin[a];
+        // (plane - [oMin, oMax]) * [iMin, iMax], lower bound for entry, upper for exit
+        const float n0 = (nearPlane - p.oMax[a]) * p.iMin[a], n1 = (nearPlane - p.oMax[a]) * p.iMax[a];
+        const float n2 = (nearPlane - p.oMin[a]) * p.iMin[a], n3 = (nearPlane - p.oMin[a]) * p.iMax[a];
+        const float f0 = (farPlane - p.oMax[a]) * p.iMin[a], f1 = (farPlane - p.oMax[a]) * p.iMax[a];
+        const float f2 = (farPlane - p.oMin[a]) * p.iMin[a], f3 = (farPlane - p.oMin[a]) * p.iMax[a];
+        entry = std::max(entry, std::min(std::min(n0, n1), std::min(n2, n3)));
+        exit = std::min(exit, std::max(std::max(f0, f1), std::max(f2, f3)));
+    }
+    return exit < entry;
+}
+
+// Rays of `mask` whose slab test (as aabbEntry) hits the box before their `tMax`.
+inline uint32_t packetHitsBox(const RayPacket &p, uint32_t mask, const simd::float3 &bmin,
+                              const simd::float3 &bmax, const float *tMax) {
+    using L = Lanes<RayPacket::kLanes>;
+    uint32_t result = 0;
+    for (int g = 0; g < RayPacket::kSize; g += RayPacket::kLanes) {
+        if (((mask >> g) & RayPacket::kLaneMask) == 0) continue;
+        const L::Float ox = L::load(p.ox + g), oy = L::load(p.oy + g), oz = L::load(p.oz + g);
+        const L::Float ix = L::load(p.ix + g), iy = L::load(p.iy + g), iz = L::load(p.iz + g);
+        const L::Float t0x = (bmin.x - ox) * ix, t1x = (bmax.x - ox) * ix;
+        const L::Float t0y = (bmin.y - oy) * iy, t1y = (bmax.y - oy) * iy;
+        const L::Float t0z = (bmin.z - oz) * iz, t1z = (bmax.z - oz) * iz;
+        const L::Float tnear = L::max(L::max(L::max(L::min(t0x, t1x), L::min(t0y, t1y)), L::min(t0z, t1z)),
+                                      L::splat(0.0f));
+        const L::Float tfar = L::min(L::min(L::max(t0x, t1x), L::max(t0y, t1y)), L::max(t0z, t1z));
+        result |= L::bits((tfar >= tnear) & (tnear < L::load(tMax + g))) << g;
+    }
+    return result & mask;
+}
+
+// One triangle against the rays of `mask` (as intersectTriangle), updating `hit`.
+inline void packetIntersectTriangle(const RayPacket &p, uint32_t mask, const SceneTriangle &tri,
+                                    const SceneVertex *vertices, PacketHit &hit) {
+    using L = Lanes<RayPacket::kLanes>;
+    constexpr float EPS = 1e-6f;
+    const simd::float3 v0 = vertices[tri.v0].position();
+    const simd::float3 e1 = vertices[tri.v1].position() - v0, e2 = vertices[tri.v2].position() - v0;
+    uint32_t accepted = 0;
+    for (int g = 0; g < RayPacket::kSize; g += RayPacket::kLanes) {
+        const uint32_t groupMask = (mask >> g) & RayPacket::kLaneMask;
+        if (groupMask == 0) continue;
+        const L::Float dx = L::load(p.dx + g), dy = L::load(p.dy + g), dz = L::load(p.dz + g);
+        const L::Float px = dy * e2.z - dz * e2.y, py = dz * e2.x - dx * e2.z, pz = dx * e2.y - dy * e2.x;
+        const L::Float det = e1.x * px + e1.y * py + e1.z * pz;
+        const L::Float inv = 1.0f / det;
+        const L::Float tx = L::load(p.ox + g) - v0.x;
+        const L::Float ty = L::load(p.oy + g) - v0.y;
+        const L::Float tz = L::load(p.oz + g) - v0.z;
+        const L::Float u = (tx * px + ty * py + tz * pz) * inv;
+        const L::Float qx = ty * e1.z - tz * e1.y, qy = tz * e1.x - tx * e1.z, qz = tx * e1.y - ty * e1.x;
+        const L::Float v = (dx * qx + dy * qy + dz * qz) * inv;
+        const L::Float t = (e2.x * qx + e2.y * qy + e2.z * qz) * inv;
+        uint32_t hits = groupMask & L::bits(~(L::abs(det) < EPS) & ~(u < 0.0f | u > 1.0f) &
+                                            ~(v < 0.0f | u + v > 1.0f) & ~(t < EPS) &
+                                            (t > 0.0f) & (t < L::load(hit.t + g)));
+        accepted |= hits << g;
+        for (; hits; hits &= hits - 1) {
+            const int i = std::countr_zero(hits);
+            hit.t[g + i] = t[i];
+        }
+    }
+    if (accepted == 0) return;
+    const simd::float3 n = simd::normalize(simd::cross(e1, e2));
+    for (; accepted; accepted &= accepted - 1) {
+        const int i = std::countr_zero(accepted);
+        hit.normal[i] = n;
+        hit.matIndex[i] = tri.matIndex;
+    }
+}
+
+// Shared traversal of a binary BVH: `leaf` handles (node, rays that reached it).
+// Boxes are culled per ray against `tMax`, which the leaves may lower, and the child
+// nearer along the first ray's direction is visited first. Both children are pushed,
+// so a tree within kMaxBvhDepth needs at most that many entries.
+template<typename Leaf>
+void packetTraverse(const BVHNode *nodes, uint32_t root, const RayPacket &p, const float *tMax, Leaf &&leaf) {
+    struct Entry {
+        uint32_t node, mask;
+    };
+    Entry stack[MAX_STACK_DEPTH];
+    int sp = 0;
+    stack[sp++] = {root, p.active};
+
+    while (sp > 0) {
+        const Entry e = stack[--sp];
+        const BVHNode &node = nodes[e.node];
+        if (packetMissesBox(p, node.bboxMin, node.bboxMax)) continue;
+        const uint32_t mask = packetHitsBox(p, e.mask, node.bboxMin, node.bboxMax, tMax);
+        if (mask == 0) continue;
+        if (node.count > 0) {
+            leaf(node, mask);
+        } else if (sp + 2 <= MAX_STACK_DEPTH) {
+            const int r = std::countr_zero(mask);
+            const BVHNode &left = nodes[node.leftFirst], &right = nodes[node.rightFirst];
+            const simd::float3 toRight = right.bboxMin + right.bboxMax - left.bboxMin - left.bboxMax;
+            const bool leftNearer = toRight.x * p.dx[r] + toRight.y * p.dy[r] + toRight.z * p.dz[r] >= 0.0f;
+            stack[sp++] = {leftNearer ? node.rightFirst : node.leftFirst, mask};
+            stack[sp++] = {leftNearer ? node.leftFirst : node.rightFirst, mask};
+        }
+    }
+}
+
+// Packet counterpart of intersectScene: nearest hit of every active ray.
+inline void intersectScenePacket(const Scene &scene, const RayPacket &packet, PacketHit &hit) {
+    if (!scene.tlasNodes.empty()) {
+        packetTraverse(scene.tlasNodes.data(), 0, packet, hit.t, [&](const BVHNode &node, uint32_t mask) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                const SceneInstance &inst = scene.instances[node.leftFirst + i];
+                RayPacket objPacket = packet.transformed(inst.worldToObject);
+                objPacket.active = mask;
+                PacketHit prev = hit;
+                packetTraverse(scene.bvhNodes.data(), inst.blasRoot, objPacket, hit.t,
+                               [&](const BVHNode &leaf, uint32_t m) {
+                    for (uint32_t k = 0; k < leaf.count; ++k) {
+                        packetIntersectTriangle(objPacket, m, scene.triangles[leaf.leftFirst + k],
+                                                scene.vertices.data(), hit);
+                    }
+                });
+                for (uint32_t bits = mask; bits; bits &= bits - 1) {
+                    const int r = std::countr_zero(bits);
+                    if (hit.t[r] < prev.t[r]) {
+                        hit.normal[r] = simd::normalize(transformNormal(inst.worldToObject, hit.normal[r]));
+                    }
+                }
+            }
+        });
+    }
+
+    for (uint32_t bits = packet.active; bits; bits &= bits - 1) {
+        const int r = std::countr_zero(bits);
+        const Ray ray = packet.ray(r);
+        for (const auto &plane: scene.planes) {
+            simd::float3 nTmp;
+            float t = intersectPlane(plane, ray, nTmp);
+            if (t > 0.0f && t < hit.t[r]) {
+                hit.t[r] = t;
+                hit.normal[r] = nTmp;
+                hit.matIndex[r] = plane.matIndex;
+            }
+        }
+        for (const auto &sphere: scene.spheres) {
+            simd::float3 nTmp;
+            float t = intersectSphere(sphere, ray, nTmp);
+            if (t > 0.0f && t < hit.t[r]) {
+                hit.t[r] = t;
+                hit.normal[r] = nTmp;
+                hit.matIndex[r] = sphere.matIndex;
+            }
+        }
+    }
+}
+
+#endif //CPU_PACKET_H
@@ -0,0 +1,19 @@
+#ifndef CPU_RNG_H
+#define CPU_RNG_H
+
+#pragma once
+#include <cstdint>
+
+// CPU mirror of shaders/rng.metal
+
+// simple LCG → [0,1)
+inline uint32_t lcg(uint32_t &st) {
+    st = st * 1664525u + 1013904223u;
+    return st;
+}
+
+inline float rand01(uint32_t &st) {
+    return static_cast<float>(lcg(st) & 0x00FFFFFF) / static_cast<float>(0x01000000);
+}
+
+#endif //CPU_RNG_H
@@ -0,0 +1,175 @@
+#ifndef CPU_SAMPLER_H
+#define CPU_SAMPLER_H
+
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "Rng.h"
+#include "../Math/Simd.h"
+
+// CPU mirror of shaders/sampler.metal
+
+// Where a path's random numbers come from. All but Lcg are counter-based: sample
+// `sample` of dimension `d` in a pixel is a pure function of the four, so every
+// dimension is its own stream and no state carries over between them.
+enum class SamplerType : uint32_t {
+    Lcg, // the original per-pixel LCG, one sequential stream
+    Pcg, // independent PCG hashes per pixel, sample and dimension
+    Sobol, // Owen-scrambled Sobol (0,2)-sequence, shuffled per pixel and dimension
+    BlueNoise, // one Owen-scrambled Sobol sequence, shifted per pixel by an R2 dither mask
+};
+
+inline const char *samplerName(SamplerType type) {
+    switch (type) {
+        case SamplerType::Lcg: return "lcg";
+        case SamplerType::Pcg: return "pcg";
+        case SamplerType::Sobol: return "sobol";
+        case SamplerType::BlueNoise: return "bluenoise";
+    }
+    return "?";
+}
+
+inline std::optional<SamplerType> parseSamplerType(const std::string &name) {
+    for (const SamplerType type: {SamplerType::Lcg, SamplerType::Pcg, SamplerType::Sobol, SamplerType::BlueNoise}) {
+        if (name == samplerName(type)) return type;
+    }
+    return std::nullopt;
+}
+
+// Dimensions are handed out in order, restarting at a fixed offset every bounce so
+// the same decision at the same depth always reads the same dimension.
+constexpr uint32_t kCameraDimensions = 2; // pixel jitter
+constexpr uint32_t kBounceDimensions = 8; // roulette, light pick, light point, lobe, direction
+
+// PCG-RXS-M-XS hash (Jarzynski & Olano, "Hash Functions for GPU Rendering")
+inline uint32_t pcgHash(uint32_t v) {
+    const uint32_t state = v * 747796405u + 2891336453u;
+    const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t v) {
+    return seed ^ (pcgHash(v) + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+}
+
+inline uint32_t reverseBits(uint32_t v) {
+    v = (v >> 1 & 0x55555555u) | (v & 0x55555555u) << 1;
+    v = (v >> 2 & 0x33333333u) | (v & 0x33333333u) << 2;
+    v = (v >> 4 & 0x0F0F0F0Fu) | (v & 0x0F0F0F0Fu) << 4;
+    v = (v >> 8 & 0x00FF00FFu) | (v & 0x00FF00FFu) << 8;
+    return v >> 16 | v << 16;
+}
+
+// Laine-Karras permutation: every bit is flipped depending only on the bits below it.
+inline uint32_t laineKarras(uint32_t v, uint32_t seed) {
+    v += seed;
+    v ^= v * 0x6C50B47Cu;
+    v ^= v * 0xB82F1E52u;
+    v ^= v * 0xC7AFE638u;
+    v ^= v * 0x8D22F6E6u;
+    return v;
+}
+
+// Owen scrambling of a 32-bit fixed-point value (Burley, "Practical Hash-based
+// Owen Scrambling"): Laine-Karras on the bit-reversed value.
+inline uint32_t owenScramble(uint32_t v, uint32_t seed) {
+    return reverseBits(laineKarras(reverseBits(v), seed));
+}
+
+// The first two Sobol dimensions with their bits reversed, so the most significant
+// fraction bit is bit 0: dimension 0 (van der Corput) is just `index`; dimension 1,
+// from the polynomial x + 1, has the Pascal matrix mod 2 as its generator, so output
+// bit r is the parity of the index bits c that have r as a subset.
+inline uint32_t sobol1Reversed(uint32_t index) {
+    index ^= index >> 1 & 0x55555555u;
+    index ^= index >> 2 & 0x33333333u;
+    index ^= index >> 4 & 0x0F0F0F0Fu;
+    index ^= index >> 8 & 0x00FF00FFu;
+    index ^= index >> 16;
+    return index;
+}
+
+// Owen-scrambled 2D Sobol point `index`, in 32-bit fixed point. Scrambling works on
+// reversed bits, which is how sobol1Reversed already delivers them.
+inline void scrambledSobol(uint32_t index, uint32_t seedX, uint32_t seedY, uint32_t &x, uint32_t &y) {
+    x = reverseBits(laineKarras(index, seedX));
+    y = reverseBits(laineKarras(sobol1Reversed(index), seedY));
+}
+
+inline float toUnitFloat(uint32_t v) {
+    return static_cast<float>(v >> 8) * 0x1p-24f;
+}
+
+// Random numbers for one sample of one pixel.
+struct Sampler {
+    SamplerType type = SamplerType::Lcg;
+    uint32_t x = 0, y = 0; // pixel
+    uint32_t sample = 0;
+    uint32_t seed = 0;
+    uint32_t pixelSeed = 0; // hash of pixel and seed
+    uint32_t dimension = 0;
+    uint32_t lcgState = 0; // Lcg only
+
+    Sampler() = default;
+
+    Sampler(SamplerType type, uint32_t x, uint32_t y, uint32_t width, uint32_t sample, uint32_t seed)
+        : type(type), x(x), y(y), sample(sample), seed(seed),
+          pixelSeed(hashCombine(hashCombine(seed, x), y)),
+          lcgState(x + y * width + sample * 1973 + seed * 0x9E3779B9u) {
+    }
+
+    // Jump to the dimensions of bounce `bounce`. The Lcg stream just runs on.
+    void startBounce(uint32_t bounce) { dimension = kCameraDimensions + bounce * kBounceDimensions; }
+
+    float get1D() {
+        if (type == SamplerType::Lcg) return rand01(lcgState);
+        return point(dimension++).x;
+    }
+
+    simd::float2 get2D() {
+        if (type == SamplerType::Lcg) {
+            const float u = rand01(lcgState);
+            return {u, rand01(lcgState)};
+        }
+        const simd::float2 p = point(dimension);
+        dimension += 2;
+        return p;
+    }
+
+private:
+    // 2D point of this sample in the stream of dimension `d`
+    simd::float2 point(uint32_t d) const {
+        switch (type) {
+            case SamplerType::Pcg: {
+                const uint32_t h = hashCombine(hashCombine(pixelSeed, sample), d);
+                return {toUnitFloat(pcgHash(h)), toUnitFloat(pcgHash(h ^ 0xA511E9B3u))};
+            }
+            case SamplerType::Sobol: {
+                // shuffle the sample order, then scramble each coordinate
+                const uint32_t dimSeed = hashCombine(pixelSeed, d);
+                uint32_t u, v;
+                scrambledSobol(owenScramble(sample, dimSeed), dimSeed * 0x2C1B3C6Du, dimSeed * 0x297A2D39u, u, v);
+                return {toUnitFloat(u), toUnitFloat(v)};
+            }
+            case SamplerType::BlueNoise: {
+                // one Sobol sequence for the whole screen, toroidally shifted per pixel
+                // by an R2 dither mask (Georgiev & Fajardo's blue-noise dithered
+                // sampling, with Roberts' R2 lattice in place of a blue-noise texture)
+                constexpr uint32_t a1 = 0xC13FA9A9u, a2 = 0x91E10DA5u; // 1/g, 1/g^2 in 32-bit fixed point
+                const uint32_t dimSeed = hashCombine(seed, d);
+                const uint32_t shiftX = pcgHash(dimSeed), shiftY = pcgHash(shiftX);
+                uint32_t u, v;
+                scrambledSobol(owenScramble(sample, dimSeed), shiftX, shiftY, u, v);
+                const uint32_t maskX = (x + (shiftX & 0xFFFFu)) * a1 + (y + (shiftX >> 16)) * a2;
+                const uint32_t maskY = (x + (shiftY & 0xFFFFu)) * a1 + (y + (shiftY >> 16)) * a2;
+                return {toUnitFloat(u + maskX), toUnitFloat(v + maskY)};
+            }
+            default:
+                return {0.0f, 0.0f};
+        }
+    }
+};
+
+#endif //CPU_SAMPLER_H
@@ -0,0 +1,150 @@
+#include "Socket.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint32_t kMaxPayload = 1u << 30; // anything larger is a corrupt header
+}
+
+Connection::~Connection() {
+    if (_fd >= 0) close(_fd);
+}
+
+Connection &Connection::operator=(Connection &&other) noexcept {
+    if (this != &other) {
+        if (_fd >= 0) close(_fd);
+        _fd = other._fd;
+        other._fd = -1;
+    }
+    return *this;
+}
+
+Connection Connection::open(const std::string &host, uint16_t port, double retrySeconds) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) return Connection();
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(retrySeconds);
+    int fd = -1;
+    while (fd < 0) {
+        for (const addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        if (fd >= 0 || std::chrono::steady_clock::now() >= deadline) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) {
+        // jobs and results are single messages; don't hold them back for more data
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return Connection(fd);
+}
+
+bool Connection::send(uint32_t type, const std::vector<uint8_t> &payload) {
+    const uint32_t header[2] = {type, static_cast<uint32_t>(payload.size())};
+    return sendAll(header, sizeof(header)) && sendAll(payload.data(), payload.size());
+}
+
+bool Connection::receive(uint32_t &type, std::vector<uint8_t> &payload) {
+    uint32_t header[2];
+    if (!receiveAll(header, sizeof(header)) || header[1] > kMaxPayload) return false;
+    type = header[0];
+    payload.resize(header[1]);
+    return receiveAll(payload.data(), payload.size());
+}
+
+std::string Connection::peerName() const {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    if (getpeername(_fd, reinterpret_cast<sockaddr *>(&address), &length) != 0 ||
+        getnameinfo(reinterpret_cast<sockaddr *>(&address), length, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        return "?";
+    }
+    return std::string(host) + ":" + port;
+}
+
+bool Connection::sendAll(const void *data, size_t size) {
+    const auto *p = static_cast<const char *>(data);
+    while (size > 0 && _fd >= 0) {
+        const ssize_t n = ::send(_fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return size == 0 && _fd >= 0;
+}
+
+bool Connection::receiveAll(void *data, size_t size) {
+    auto *p = static_cast<char *>(data);
+    while (size > 0 && _fd >= 0) {
+        const ssize_t n = recv(_fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // 0: closed by the peer
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return size == 0 && _fd >= 0;
+}
+
+Listener::Listener(uint16_t port) {
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_fd < 0) return;
+    const int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(_fd, 64) != 0 ||
+        getsockname(_fd, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        close(_fd);
+        _fd = -1;
+        return;
+    }
+    _port = ntohs(address.sin_port);
+}
+
+Listener::~Listener() {
+    if (_fd >= 0) close(_fd);
+}
+
+Connection Listener::accept(int timeoutMs) {
+    pollfd p{_fd, POLLIN, 0};
+    if (poll(&p, 1, timeoutMs) <= 0) return Connection();
+    const int fd = ::accept(_fd, nullptr, nullptr);
+    if (fd >= 0) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        // notice workers whose machine vanished without closing the connection
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    }
+    return Connection(fd);
+}
+
+void ignoreBrokenPipes() {
+    std::signal(SIGPIPE, SIG_IGN);
+}
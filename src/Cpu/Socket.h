@@ -0,0 +1,153 @@
+#ifndef CPU_SOCKET_H
+#define CPU_SOCKET_H
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Blocking TCP (POSIX sockets) carrying framed messages: a 32-bit type and a 32-bit
+// payload size, then the payload. Both ends are the same build on the same kind of
+// machine, so payloads are raw native-endian structs.
+
+// Payload builder: trivially copyable values, byte copies of vectors and strings.
+class MessageWriter {
+public:
+    template<typename T>
+    MessageWriter &put(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        append(&value, sizeof(T));
+        return *this;
+    }
+
+    template<typename T>
+    MessageWriter &putArray(const T *values, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put(static_cast<uint64_t>(count));
+        append(values, count * sizeof(T));
+        return *this;
+    }
+
+    MessageWriter &putString(const std::string &s) { return putArray(s.data(), s.size()); }
+
+    const std::vector<uint8_t> &bytes() const { return _bytes; }
+
+private:
+    void append(const void *data, size_t size) {
+        const size_t offset = _bytes.size();
+        _bytes.resize(offset + size);
+        if (size > 0) std::memcpy(_bytes.data() + offset, data, size);
+    }
+
+    std::vector<uint8_t> _bytes;
+};
+
+// Reads back what MessageWriter wrote; every get fails (returns false) once the
+// payload runs out, so a truncated message is caught by checking the last one.
+class MessageReader {
+public:
+    explicit MessageReader(const std::vector<uint8_t> &bytes) : _bytes(bytes) {
+    }
+
+    template<typename T>
+    bool get(T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (_bytes.size() - _offset < sizeof(T)) return fail();
+        std::memcpy(&value, _bytes.data() + _offset, sizeof(T));
+        _offset += sizeof(T);
+        return _ok;
+    }
+
+    template<typename T>
+    bool getArray(std::vector<T> &values) {
+        uint64_t count = 0;
+        if (!get(count) || count > (_bytes.size() - _offset) / sizeof(T)) return fail();
+        values.resize(count);
+        if (count > 0) std::memcpy(values.data(), _bytes.data() + _offset, count * sizeof(T));
+        _offset += count * sizeof(T);
+        return _ok;
+    }
+
+    bool getString(std::string &s) {
+        std::vector<char> chars;
+        if (!getArray(chars)) return false;
+        s.assign(chars.begin(), chars.end());
+        return true;
+    }
+
+private:
+    bool fail() { return _ok = false; }
+
+    const std::vector<uint8_t> &_bytes;
+    size_t _offset = 0;
+    bool _ok = true;
+};
+
+// One connected socket. Every call blocks; false means the peer is gone (or sent
+// garbage) and the connection is useless from then on.
+class Connection {
+public:
+    explicit Connection(int fd = -1) : _fd(fd) {
+    }
+
+    ~Connection();
+
+    Connection(Connection &&other) noexcept : _fd(other._fd) { other._fd = -1; }
+
+    Connection &operator=(Connection &&other) noexcept;
+
+    Connection(const Connection &) = delete;
+
+    Connection &operator=(const Connection &) = delete;
+
+    // Connect to `host:port`, retrying for up to `retrySeconds` while nobody listens.
+    static Connection open(const std::string &host, uint16_t port, double retrySeconds = 0.0);
+
+    bool valid() const { return _fd >= 0; }
+
+    bool send(uint32_t type, const std::vector<uint8_t> &payload = {});
+
+    bool receive(uint32_t &type, std::vector<uint8_t> &payload);
+
+    // "address:port" of the other end, for logging.
+    std::string peerName() const;
+
+private:
+    bool sendAll(const void *data, size_t size);
+
+    bool receiveAll(void *data, size_t size);
+
+    int _fd;
+};
+
+// A listening socket on every interface.
+class Listener {
+public:
+    // Port 0 picks a free one; see port().
+    explicit Listener(uint16_t port);
+
+    ~Listener();
+
+    Listener(const Listener &) = delete;
+
+    Listener &operator=(const Listener &) = delete;
+
+    bool valid() const { return _fd >= 0; }
+
+    uint16_t port() const { return _port; }
+
+    // The next incoming connection, or an invalid one after `timeoutMs` without any.
+    Connection accept(int timeoutMs);
+
+private:
+    int _fd = -1;
+    uint16_t _port = 0;
+};
+
+// Writing to a socket the peer has closed must fail the call, not kill the process.
+void ignoreBrokenPipes();
+
+
+#endif //CPU_SOCKET_H
@@ -0,0 +1,251 @@
+#ifndef CPU_WAVEFRONT_H
+#define CPU_WAVEFRONT_H
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Integrator.h"
+#include "../Profiler.h"
+#include "../Scene.h"
+#include "../ThreadPool.h"
+#include "../TraversalStats.h"
+
+// Wavefront path tracing (Laine, Karras & Aila, "Megakernels Considered Harmful for
+// Wavefront Path Tracers"). Instead of one thread running each path to the end as
+// tracePath does, a whole batch of paths advances one stage at a time:
+//
+//   extend   closest hit of every live ray
+//   classify misses and emission, Russian roulette, then queue each path by material
+//   shade    one queue per material kind: dielectrics, then the mirror/diffuse mix,
+//            which also draws a light sample and queues its shadow ray
+//   connect  trace the queued shadow rays and add the light they let through
+//
+// Queues are compacted lists of path indices, kept in path order so neighbouring
+// pixels stay together. Path state is structure-of-arrays and every stage streams
+// over its queue on the thread pool. The stages share tracePath's vertex helpers
+// and draw the same random numbers, so the image is the one tracePath renders.
+
+// Work done since the last resetCounters().
+struct WavefrontCounters {
+    uint64_t extensionRays = 0;
+    uint64_t shadowRays = 0;
+    double extendSeconds = 0.0;
+    double shadeSeconds = 0.0; // classify and shade
+    double connectSeconds = 0.0;
+};
+
+class Wavefront {
+public:
+    // Start a batch of `count` path slots, all empty until setPath.
+    void reset(size_t count) {
+        _live.assign(count, 0);
+        _ox.resize(count), _oy.resize(count), _oz.resize(count);
+        _dx.resize(count), _dy.resize(count), _dz.resize(count);
+        _tr.assign(count, 1.0f), _tg.assign(count, 1.0f), _tb.assign(count, 1.0f);
+        _lr.assign(count, 0.0f), _lg.assign(count, 0.0f), _lb.assign(count, 0.0f);
+        _bsdfPdf.assign(count, 0.0f);
+        _samplers.resize(count);
+        _hits.resize(count);
+        _lightSamples.resize(count);
+        _aovs.assign(count, PathAovs{});
+#ifdef PATHTRACER_TRAVERSAL_STATS
+        _stats.assign(count, RayStats{});
+#endif
+    }
+
+    // The generate stage: slot `i` starts a path along camera ray `ray`, with the
+    // sampler that drew it. Safe to call for different slots concurrently.
+    void setPath(size_t i, const Ray &ray, const Sampler &sampler) {
+        setRay(i, ray);
+        _samplers[i] = sampler;
+        _live[i] = 1;
+#ifdef PATHTRACER_TRAVERSAL_STATS
+        _stats[i].paths = 1;
+#endif
+    }
+
+    // Run every path of the batch to its end.
+    template<typename Blas>
+    void trace(const Scene &scene, const Blas &blas, const PathSettings &settings, ThreadPool &pool);
+
+    simd::float3 radiance(size_t i) const { return {_lr[i], _lg[i], _lb[i]}; }
+    const PathAovs &aovs(size_t i) const { return _aovs[i]; }
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    const RayStats &stats(size_t i) const { return _stats[i]; }
+#endif
+
+    const WavefrontCounters &counters() const { return _counters; }
+    void resetCounters() { _counters = {}; }
+
+private:
+    // what classify decided for a path
+    enum Route : uint8_t { kEnded, kDielectric, kSurface };
+
+    static constexpr size_t kChunk = 256; // paths per pool task
+
+    Ray ray(size_t i) const {
+        Ray r;
+        r.origin = {_ox[i], _oy[i], _oz[i]};
+        r.dir = {_dx[i], _dy[i], _dz[i]};
+        return r;
+    }
+
+    void setRay(size_t i, const Ray &r) {
+        _ox[i] = r.origin.x, _oy[i] = r.origin.y, _oz[i] = r.origin.z;
+        _dx[i] = r.dir.x, _dy[i] = r.dir.y, _dz[i] = r.dir.z;
+    }
+
+    simd::float3 throughput(size_t i) const { return {_tr[i], _tg[i], _tb[i]}; }
+
+    void setThroughput(size_t i, const simd::float3 &t) { _tr[i] = t.x, _tg[i] = t.y, _tb[i] = t.z; }
+
+    void addRadiance(size_t i, const simd::float3 &l) { _lr[i] += l.x, _lg[i] += l.y, _lb[i] += l.z; }
+
+    // fn(path) for every path in `queue`, in chunks on the pool
+    template<typename Fn>
+    static void forEach(ThreadPool &pool, const std::vector<uint32_t> &queue, const Fn &fn) {
+        pool.parallelFor((queue.size() + kChunk - 1) / kChunk, [&](size_t chunk) {
+            const size_t end = std::min(queue.size(), (chunk + 1) * kChunk);
+            for (size_t q = chunk * kChunk; q < end; ++q) fn(queue[q]);
+        });
+    }
+
+    // ray
+    std::vector<float> _ox, _oy, _oz, _dx, _dy, _dz;
+    // throughput and radiance gathered so far
+    std::vector<float> _tr, _tg, _tb, _lr, _lg, _lb;
+    std::vector<float> _bsdfPdf; // as in tracePath
+    std::vector<uint8_t> _live; // set by setPath
+    std::vector<uint8_t> _routes;
+    std::vector<uint8_t> _shadowed; // drew a light sample this bounce
+    std::vector<Sampler> _samplers;
+    std::vector<Hit> _hits;
+    std::vector<LightSample> _lightSamples; // radiance already includes the throughput
+    std::vector<PathAovs> _aovs;
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    std::vector<RayStats> _stats;
+#endif
+    // the queues
+    std::vector<uint32_t> _active, _dielectric, _surface, _shadow;
+    WavefrontCounters _counters;
+};
+
+template<typename Blas>
+void Wavefront::trace(const Scene &scene, const Blas &blas, const PathSettings &settings, ThreadPool &pool) {
+    const auto seconds = [](uint64_t ns) { return static_cast<double>(ns) * 1e-9; };
+    const bool nextEvent = settings.nextEvent && !scene.lights.empty();
+
+    const size_t count = _live.size();
+    _routes.assign(count, kEnded);
+    _shadowed.assign(count, 0);
+    _active.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (_live[i]) _active.push_back(i);
+    }
+
+    for (uint32_t bounce = 0; bounce < settings.maxBounces && !_active.empty(); ++bounce) {
+        // extend
+        const uint64_t t0 = Profiler::now();
+        forEach(pool, _active, [&](uint32_t i) {
+#ifdef PATHTRACER_TRAVERSAL_STATS
+            tRayStats = _stats[i];
+            tRayStats.bounces++;
+#endif
+            _samplers[i].startBounce(bounce);
+            _hits[i] = intersectScene(scene, blas, ray(i));
+#ifdef PATHTRACER_TRAVERSAL_STATS
+            _stats[i] = tRayStats;
+#endif
+        });
+        _counters.extensionRays += _active.size();
+
+        // classify
+        const uint64_t t1 = Profiler::now();
+        forEach(pool, _active, [&](uint32_t i) {
+            const Hit &hit = _hits[i];
+            const Ray r = ray(i);
+            _routes[i] = kEnded;
+            if (hit.t > 1e19f) {
+                if (bounce == 0) _aovs[i] = {{1.0f, 1.0f, 1.0f}, -r.dir, kMissDepth};
+                addRadiance(i, throughput(i) * skyRadiance(r.dir));
+                return;
+            }
+            const Material &mat = scene.materials[hit.matIndex];
+            if (bounce == 0) _aovs[i] = firstHitAovs(mat, r, hit);
+
+            simd::float3 t = throughput(i);
+            addRadiance(i, t * mat.emission * emissionWeight(scene, mat, hit, r, _bsdfPdf[i]));
+            _bsdfPdf[i] = 0.0f;
+            if (!survivesRoulette(bounce, t, _samplers[i])) return;
+            setThroughput(i, t);
+            _routes[i] = mat.ior > 1.0f ? kDielectric : kSurface;
+        });
+        _dielectric.clear();
+        _surface.clear();
+        for (const uint32_t i: _active) {
+            if (_routes[i] == kDielectric) _dielectric.push_back(i);
+            else if (_routes[i] == kSurface) _surface.push_back(i);
+        }
+
+        // shade
+        forEach(pool, _dielectric, [&](uint32_t i) {
+            const Hit &hit = _hits[i];
+            Ray r = ray(i);
+            const simd::float3 P = r.origin + hit.t * r.dir;
+            scatterDielectric(scene.materials[hit.matIndex], hit, P, r, _samplers[i]);
+            setRay(i, r);
+        });
+        forEach(pool, _surface, [&](uint32_t i) {
+            const Hit &hit = _hits[i];
+            const Material &mat = scene.materials[hit.matIndex];
+            Ray r = ray(i);
+            simd::float3 t = throughput(i);
+            const simd::float3 P = r.origin + hit.t * r.dir;
+            const bool sampleLights = nextEvent && mat.reflectivity < 1.0f;
+            _shadowed[i] = 0;
+            if (sampleLights) {
+                LightSample &sample = _lightSamples[i];
+                if (drawLightSample(scene, P, hit.normal, mat.albedo, 1.0f - mat.reflectivity, _samplers[i],
+                                    sample)) {
+                    sample.radiance = t * sample.radiance;
+                    _shadowed[i] = 1;
+                }
+            }
+            scatterSurface(mat, hit, P, sampleLights, r, t, _bsdfPdf[i], _samplers[i]);
+            setRay(i, r);
+            setThroughput(i, t);
+        });
+        _shadow.clear();
+        for (const uint32_t i: _surface) {
+            if (_shadowed[i]) _shadow.push_back(i);
+        }
+
+        // connect
+        const uint64_t t2 = Profiler::now();
+        forEach(pool, _shadow, [&](uint32_t i) {
+#ifdef PATHTRACER_TRAVERSAL_STATS
+            tRayStats = _stats[i];
+#endif
+            if (!occluded(scene, blas, _lightSamples[i])) addRadiance(i, _lightSamples[i].radiance);
+#ifdef PATHTRACER_TRAVERSAL_STATS
+            _stats[i] = tRayStats;
+#endif
+        });
+        _counters.shadowRays += _shadow.size();
+
+        // survivors, still in path order
+        std::erase_if(_active, [&](uint32_t i) { return _routes[i] == kEnded; });
+        const uint64_t t3 = Profiler::now();
+        Profiler &profiler = Profiler::get();
+        profiler.record("Extend", t0, t1);
+        profiler.record("Classify and shade", t1, t2);
+        profiler.record("Connect", t2, t3);
+        _counters.extendSeconds += seconds(t1 - t0);
+        _counters.shadeSeconds += seconds(t2 - t1);
+        _counters.connectSeconds += seconds(t3 - t2);
+    }
+}
+
+#endif //CPU_WAVEFRONT_H
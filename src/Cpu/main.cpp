@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <numbers>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CpuRenderer.h"
+#include "Distributed.h"
+#include "ImageIO.h"
+#include "Integrator.h"
+#include "../Camera.h"
+#include "../Config.h"
+#include "../Profiler.h"
+#include "../Scene.h"
+#include "../ThreadPool.h"
+
+namespace {
+    // <name>.albedo.<ext>, <name>.normal.<ext> and <name>.depth.<ext> next to `output`;
+    // normals map [-1, 1] to [0, 1] and depth is inverted so near is bright.
+    bool writeAovImages(const std::string &output, const std::vector<simd::float4> &albedo,
+                        const std::vector<simd::float4> &normalDepth, uint32_t width, uint32_t height) {
+        const size_t dot = output.rfind('.');
+        const std::string stem = output.substr(0, dot), ext = output.substr(dot);
+        std::vector<simd::float4> normal(albedo.size()), depth(albedo.size());
+        for (size_t i = 0; i < albedo.size(); ++i) {
+            const simd::float4 &nd = normalDepth[i];
+            normal[i] = {nd.x * 0.5f + 0.5f, nd.y * 0.5f + 0.5f, nd.z * 0.5f + 0.5f, 1.0f};
+            const float d = nd.w < kMissDepth ? 1.0f / (1.0f + nd.w) : 0.0f;
+            depth[i] = {d, d, d, 1.0f};
+        }
+        const std::pair<std::string, const std::vector<simd::float4> *> images[] = {
+            {".albedo", &albedo}, {".normal", &normal}, {".depth", &depth}};
+        for (const auto &[suffix, pixels]: images) {
+            if (!writeImage(stem + suffix + ext, *pixels, width, height)) return false;
+            std::cout << "Wrote " << stem + suffix + ext << "\n";
+        }
+        return true;
+    }
+}
+
+// Headless entry point: renders a scene on the CPU without a window and writes the
+// result to disk, for unattended and scripted renders.
+//
+//   pathtracer_cpu [--scene teapot|cube|<file.obj>] [--res 800x600] [--spp N] [--time seconds]
+//                  [--adaptive threshold] [--min-spp N] [--bounces N] [--no-nee]
+//                  [--sampler sobol|pcg|bluenoise|lcg] [--seed N] [--pos x,y,z] [--yaw degrees] [--pitch degrees]
+//                  [--output image.ppm|png|pfm|exr]... [--bvh median|sah|lbvh|sbvh] [--width 2|4|8]
+//                  [--traversal single|packet] [--pipeline megakernel|wavefront] [--cache scene.cache]
+//                  [--sbvh-budget fraction] [--bvh-optimize ms] [--threads N] [--denoise] [--aovs] [--trace trace.json] [spp] [output]
+//                  [--serve port [--workers N] [--job-size pixels] [--job-spp N]]
+//   pathtracer_cpu --worker host:port [--threads N] [--max-jobs N]
+//
+// Rendering stops at --spp samples per pixel (64 by default) or once --time seconds
+// have passed, whichever comes first; with only --time the sample count is unbounded.
+// --adaptive stops sampling tiles whose noise is below the threshold (see
+// CpuRenderer::setAdaptive), so --spp becomes the per-pixel maximum and the render
+// also ends once every tile has converged. --no-nee turns off light sampling, for
+// comparison with the plain path tracer. --sampler picks the random number source
+// (see SamplerType); lcg with --no-nee reproduces renders from before either existed.
+// --pipeline wavefront traces the same paths stage by stage (see Wavefront.h) and
+// also reports rays per second. --bvh sbvh adds spatial splits for long, thin
+// triangles; --sbvh-budget caps the references it may duplicate, as a fraction of
+// the triangle count (0.25 by default). --bvh-optimize restructures every built
+// BVH for a lower SAH cost (see BvhOptimizer) until it stops improving or the given
+// milliseconds run out (0: no limit).
+// The camera defaults to MovementHandler's starting pose. Every --output is written
+// from the same render, in the format its extension names; --denoise filters them
+// (see Denoiser.h) and --aovs writes the albedo, normal and depth that guide the
+// filter next to each one.
+// --serve renders the same image with worker processes instead (see Distributed.h):
+// it waits on `port` (0 picks one) for workers started with --worker, and --workers
+// also starts N of them on this machine, splitting --threads between them. Jobs are
+// --job-size pixels square and, with --job-spp, that many samples each; by default
+// each covers all samples, which gives the local render bit for bit. --max-jobs
+// makes a worker leave after that many jobs.
+// --trace writes what the profiler timed (scene load, BVH build, frames, tiles,
+// wavefront stages, coordinator jobs, ...) as a Chrome trace; see Profiler.h.
+int main(int argc, char *argv[]) {
+    std::string sceneName = "teapot";
+    uint32_t width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    uint32_t spp = 64;
+    bool sppGiven = false;
+    double timeBudget = 0.0;
+    float adaptiveThreshold = 0.0f;
+    uint32_t minSpp = 32;
+    uint32_t maxBounces = MAX_BOUNCES;
+    uint32_t seed = 0;
+    bool nextEvent = true;
+    bool denoiseOutput = false;
+    bool writeAovs = false;
+    SamplerType sampler = SamplerType::Sobol;
+    // same starting pose as MovementHandler
+    simd::float3 position = {-2, 3, 6};
+    float yaw = std::numbers::pi_v<float> * 11 / 12;
+    float pitch = -std::numbers::pi_v<float> * 1 / 12;
+    std::vector<std::string> outputs;
+    BvhBuildMode bvhMode = BvhBuildMode::BinnedSah;
+    SbvhSettings sbvh;
+    BvhOptimizeSettings bvhOptimize;
+    unsigned threads = std::thread::hardware_concurrency();
+    int bvhWidth = 4;
+    TraversalPolicy traversal = TraversalPolicy::SingleRay;
+    PathPipeline pipeline = PathPipeline::Megakernel;
+    std::string cachePath;
+    bool serve = false;
+    uint16_t servePort = 0;
+    uint32_t localWorkers = 0;
+    uint32_t jobSize = 64;
+    uint32_t jobSpp = 0;
+    std::string coordinator;
+    uint32_t maxJobs = 0;
+    std::string tracePath;
+
+    constexpr float degrees = std::numbers::pi_v<float> / 180.0f;
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--scene" && hasValue) {
+            sceneName = argv[++i];
+        } else if (arg == "--res" && hasValue) {
+            const std::string res = argv[++i];
+            const size_t x = res.find('x');
+            width = static_cast<uint32_t>(std::strtoul(res.c_str(), nullptr, 10));
+            height = x == std::string::npos ? 0 : static_cast<uint32_t>(std::strtoul(res.c_str() + x + 1, nullptr, 10));
+            if (width == 0 || height == 0) {
+                std::cerr << "Resolution must look like 800x600\n";
+                return 1;
+            }
+        } else if (arg == "--spp" && hasValue) {
+            spp = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            sppGiven = true;
+        } else if (arg == "--time" && hasValue) {
+            timeBudget = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--adaptive" && hasValue) {
+            adaptiveThreshold = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--min-spp" && hasValue) {
+            minSpp = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--bounces" && hasValue) {
+            maxBounces = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--no-nee") {
+            nextEvent = false;
+        } else if (arg == "--denoise") {
+            denoiseOutput = true;
+        } else if (arg == "--aovs") {
+            writeAovs = true;
+        } else if (arg == "--seed" && hasValue) {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--pos" && hasValue) {
+            if (std::sscanf(argv[++i], "%f,%f,%f", &position.x, &position.y, &position.z) != 3) {
+                std::cerr << "Position must look like -2,3,6\n";
+                return 1;
+            }
+        } else if (arg == "--yaw" && hasValue) {
+            yaw = std::strtof(argv[++i], nullptr) * degrees;
+        } else if (arg == "--pitch" && hasValue) {
+            pitch = std::strtof(argv[++i], nullptr) * degrees;
+        } else if (arg == "--output" && hasValue) {
+            outputs.emplace_back(argv[++i]);
+        } else if (arg == "--bvh" && hasValue) {
+            const std::string mode = argv[++i];
+            if (mode == "median") bvhMode = BvhBuildMode::Median;
+            else if (mode == "sah") bvhMode = BvhBuildMode::BinnedSah;
+            else if (mode == "lbvh") bvhMode = BvhBuildMode::Lbvh;
+            else if (mode == "sbvh") bvhMode = BvhBuildMode::Sbvh;
+            else {
+                std::cerr << "Unknown BVH builder: " << mode << "\n";
+                return 1;
+            }
+        } else if (arg == "--sbvh-budget" && hasValue) {
+            sbvh.duplicationBudget = std::max(std::strtof(argv[++i], nullptr), 0.0f);
+        } else if (arg == "--bvh-optimize" && hasValue) {
+            bvhOptimize.enabled = true;
+            bvhOptimize.timeBudgetMs = std::max(std::strtof(argv[++i], nullptr), 0.0f);
+        } else if (arg == "--width" && hasValue) {
+            bvhWidth = std::atoi(argv[++i]);
+            if (bvhWidth != 2 && bvhWidth != 4 && bvhWidth != 8) {
+                std::cerr << "BVH width must be 2, 4 or 8\n";
+                return 1;
+            }
+        } else if (arg == "--traversal" && hasValue) {
+            const std::string policy = argv[++i];
+            if (policy == "single") traversal = TraversalPolicy::SingleRay;
+            else if (policy == "packet") traversal = TraversalPolicy::Packet;
+            else {
+                std::cerr << "Unknown traversal policy: " << policy << "\n";
+                return 1;
+            }
+        } else if (arg == "--pipeline" && hasValue) {
+            const std::string name = argv[++i];
+            if (name == "megakernel") pipeline = PathPipeline::Megakernel;
+            else if (name == "wavefront") pipeline = PathPipeline::Wavefront;
+            else {
+                std::cerr << "Unknown pipeline (use megakernel or wavefront): " << name << "\n";
+                return 1;
+            }
+        } else if (arg == "--sampler" && hasValue) {
+            const std::string name = argv[++i];
+            const std::optional<SamplerType> type = parseSamplerType(name);
+            if (!type) {
+                std::cerr << "Unknown sampler: " << name << "\n";
+                return 1;
+            }
+            sampler = *type;
+        } else if (arg == "--cache" && hasValue) {
+            cachePath = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--serve" && hasValue) {
+            serve = true;
+            servePort = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--workers" && hasValue) {
+            localWorkers = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--job-size" && hasValue) {
+            jobSize = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--job-spp" && hasValue) {
+            jobSpp = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--worker" && hasValue) {
+            coordinator = argv[++i];
+        } else if (arg == "--max-jobs" && hasValue) {
+            maxJobs = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = argv[++i];
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        } else if (positional == 0) {
+            spp = static_cast<uint32_t>(std::strtoul(arg.c_str(), nullptr, 10));
+            sppGiven = true;
+            ++positional;
+        } else {
+            outputs.push_back(arg);
+            ++positional;
+        }
+    }
+    if (!coordinator.empty()) {
+        // everything else comes from the coordinator
+        const size_t colon = coordinator.rfind(':');
+        const unsigned long port = colon == std::string::npos ? 0 : std::strtoul(coordinator.c_str() + colon + 1, nullptr, 10);
+        if (port == 0 || port > UINT16_MAX) {
+            std::cerr << "Coordinator must look like host:port\n";
+            return 1;
+        }
+        return runWorker(coordinator.substr(0, colon), static_cast<uint16_t>(port), threads, maxJobs);
+    }
+    if (serve && (timeBudget > 0.0 || adaptiveThreshold > 0.0f)) {
+        std::cerr << "--time and --adaptive need a local render\n";
+        return 1;
+    }
+    if ((timeBudget > 0.0 || adaptiveThreshold > 0.0f) && !sppGiven) spp = UINT32_MAX;
+    if (outputs.empty()) outputs.emplace_back("render.ppm");
+    for (const std::string &output: outputs) {
+        if (!isImageFormat(output)) {
+            std::cerr << "Unknown image format (use .ppm, .png, .pfm or .exr): " << output << "\n";
+            return 1;
+        }
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    Profiler::get().nameThread("Main");
+    ThreadPool pool(threads);
+    const auto writeTrace = [&] {
+        if (tracePath.empty()) return true;
+        if (!Profiler::get().writeChromeTrace(tracePath)) {
+            std::cerr << "Could not write " << tracePath << "\n";
+            return false;
+        }
+        std::cout << "Wrote " << tracePath << "\n";
+        return true;
+    };
+
+    auto t0 = clock::now();
+    Scene scene;
+    scene.bvhMode = bvhMode;
+    scene.sbvh = sbvh;
+    scene.bvhOptimize = bvhOptimize;
+    scene.pool = &pool;
+    // workers load the scene from the cache the coordinator writes
+    scene.cachePath = serve && cachePath.empty() ? "scene.cache" : cachePath;
+    if (!loadScene(scene, sceneName)) {
+        std::cerr << "Could not load scene: " << sceneName << "\n";
+        return 1;
+    }
+    auto t1 = clock::now();
+    std::cout << "Scene: " << scene.triangles.size() << " triangles, " << scene.vertices.size() << " vertices, "
+            << scene.bvhNodes.size() << " BVH nodes (" << ms(t1 - t0) << " ms)\n";
+
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    const Camera cam = makeCamera(position, yaw, pitch, 45.0f, aspect);
+
+    // every --output from the same render, and with --aovs the guides next to each
+    const auto writeOutputs = [&](const std::vector<simd::float4> &image, const std::vector<simd::float4> &albedo,
+                                  const std::vector<simd::float4> &normalDepth) {
+        PROFILE_SCOPE("Write images");
+        for (const std::string &output: outputs) {
+            if (!writeImage(output, image, width, height)) return false;
+            std::cout << "Wrote " << output << "\n";
+            if (writeAovs && !writeAovImages(output, albedo, normalDepth, width, height)) return false;
+        }
+        return true;
+    };
+
+    if (serve) {
+        // the coordinator only splits and merges; loading the scene filled the cache
+        ignoreBrokenPipes();
+        Listener listener(servePort);
+        if (!listener.valid()) {
+            std::cerr << "Could not listen on port " << servePort << "\n";
+            return 1;
+        }
+        const RenderSetup setup{
+            sceneName, scene.cachePath, bvhMode, sbvh, bvhOptimize, bvhWidth, traversal, pipeline, width, height, cam, maxBounces,
+            nextEvent, sampler, seed
+        };
+        Coordinator coordinator(setup, spp, jobSize, jobSpp);
+        std::cout << "Serving " << coordinator.jobCount() << " jobs on port " << listener.port() << "\n";
+        std::vector<pid_t> workers;
+        if (localWorkers > 0) {
+            workers = spawnLocalWorkers(argv[0], listener.port(), localWorkers, std::max(threads / localWorkers, 1u));
+            if (workers.empty()) return 1;
+        }
+        auto t2 = clock::now();
+        const bool finished = coordinator.run(listener, workers);
+        waitForWorkers(workers);
+        auto t3 = clock::now();
+        if (!finished) return 1;
+
+        const double seconds = std::chrono::duration<double>(t3 - t2).count();
+        std::cout << "Rendered " << spp << " spp with " << coordinator.workersJoined() << " workers ("
+                << coordinator.jobCount() << " jobs, " << coordinator.jobsRequeued() << " requeued) in " << seconds
+                << " s (" << static_cast<double>(width) * height * spp / seconds * 1e-6 << " Msamples/s)\n";
+
+        const DistributedImage &merged = coordinator.image();
+        std::vector<simd::float4> filtered;
+        if (denoiseOutput) filtered = merged.denoised({}, pool);
+        auto t4 = clock::now();
+        if (!writeOutputs(denoiseOutput ? filtered : merged.accumulation, merged.albedo, merged.normalDepth)) {
+            return 1;
+        }
+        auto t5 = clock::now();
+        std::cout << "Timings: load " << ms(t1 - t0) << " ms, render " << ms(t3 - t2) << " ms, ";
+        if (denoiseOutput) std::cout << "denoise " << ms(t4 - t3) << " ms, ";
+        std::cout << "write " << ms(t5 - t4) << " ms\n";
+        return writeTrace() ? 0 : 1;
+    }
+
+    CpuRenderer renderer(scene, width, height, pool);
+    renderer.setBvhWidth(bvhWidth);
+    renderer.setTraversalPolicy(traversal);
+    renderer.setPipeline(pipeline);
+    renderer.setMaxBounces(maxBounces);
+    renderer.setNextEventEstimation(nextEvent);
+    renderer.setSampler(sampler);
+    renderer.setSeed(seed);
+    renderer.setAdaptive(adaptiveThreshold, minSpp);
+    auto t2 = clock::now();
+
+    uint32_t frames = 0;
+    RollingStats frameTimes(1024);
+    while (frames < spp && !renderer.converged() && (timeBudget <= 0.0 || std::chrono::duration<double>(clock::now() - t2).count() < timeBudget)) {
+        const auto start = clock::now();
+        renderer.render(cam);
+        frameTimes.add(static_cast<float>(ms(clock::now() - start)));
+        ++frames;
+    }
+    auto t3 = clock::now();
+
+    const double seconds = std::chrono::duration<double>(t3 - t2).count();
+    const auto samples = static_cast<double>(renderer.samplesTaken());
+    std::cout << "Rendered " << frames << " spp";
+    if (adaptiveThreshold > 0.0f) {
+        std::cout << " max, " << samples / (static_cast<double>(width) * height) << " mean"
+                << (renderer.converged() ? ", converged" : "");
+    }
+    std::cout << " (BVH" << renderer.bvhWidth()
+            << (traversal == TraversalPolicy::Packet ? ", packets" : "") << ") on " << pool.size()
+            << " threads in " << seconds << " s ("
+            << samples / seconds * 1e-6 << " Msamples/s)\n";
+    if (pipeline == PathPipeline::Wavefront) {
+        const WavefrontCounters &c = renderer.wavefrontCounters();
+        const auto rays = static_cast<double>(c.extensionRays + c.shadowRays);
+        std::cout << "Wavefront: " << c.extensionRays << " extension + " << c.shadowRays << " shadow rays, "
+                << rays / seconds * 1e-6 << " Mrays/s; extend " << c.extendSeconds << " s, shade "
+                << c.shadeSeconds << " s, connect " << c.connectSeconds << " s\n";
+    }
+    std::cout << "Frame time (last " << frameTimes.size() << "): p50 " << frameTimes.percentile(0.5f) << " ms, p95 "
+            << frameTimes.percentile(0.95f) << " ms, p99 " << frameTimes.percentile(0.99f) << " ms\n";
+
+    std::vector<simd::float4> filtered;
+    if (denoiseOutput) filtered = renderer.denoised();
+    auto t4 = clock::now();
+
+    if (!writeOutputs(denoiseOutput ? filtered : renderer.accumulation(), renderer.albedoAov(),
+                      renderer.normalDepthAov())) {
+        return 1;
+    }
+    auto t5 = clock::now();
+
+    // a cache hit skips buildAccel, so everything before the renderer counts as loading
+    const double buildMs = scene.buildMs + ms(t2 - t1);
+    std::cout << "Timings: load " << ms(t1 - t0) - scene.buildMs << " ms, BVH build " << buildMs
+            << " ms, render " << ms(t3 - t2) << " ms, ";
+    if (denoiseOutput) std::cout << "denoise " << ms(t4 - t3) << " ms, ";
+    std::cout << "write " << ms(t5 - t4) << " ms\n";
+
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    const std::vector<RayStats> &stats = renderer.traversalStats();
+    const uint32_t stackCapacity = MAX_STACK_DEPTH * (renderer.bvhWidth() == 2 ? 1 : renderer.bvhWidth());
+    printTraversalHistograms(stats.data(), stats.size(), stackCapacity);
+    const std::string &output = outputs.front();
+    if (!writeTraversalHeatmaps(output.substr(0, output.rfind('.')), stats.data(), renderer.width(),
+                                renderer.height())) {
+        return 1;
+    }
+#endif
+    return writeTrace() ? 0 : 1;
+}
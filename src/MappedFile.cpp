@@ -0,0 +1,32 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st{};
+    if (fstat(fd, &st) == 0) {
+        _size = static_cast<size_t>(st.st_size);
+        if (_size == 0) {
+            _valid = true; // nothing to map
+        } else {
+            void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, _size, MADV_SEQUENTIAL);
+                _data = p;
+                _valid = true;
+            }
+        }
+    }
+    // the mapping keeps its own reference to the file
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (_data) munmap(_data, _size);
+}
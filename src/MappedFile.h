@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file (POSIX mmap). The contents stay valid
+// for the lifetime of the object; check valid() after construction.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool valid() const { return _valid; }
+    const char *data() const { return static_cast<const char *>(_data); }
+    size_t size() const { return _size; }
+
+private:
+    void *_data = nullptr;
+    size_t _size = 0;
+    bool _valid = false;
+};
+
+
+#endif //MAPPEDFILE_H
@@ -1,5 +1,6 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
+#include "Math/Simd.h"
 
 struct Material {
     simd::float3 albedo; // diffuse color
@@ -8,4 +9,9 @@ struct Material {
     float ior; // >1 means dielectric
 };
 
+// Rec. 709 luminance of a linear RGB colour.
+inline float luminance(const simd::float3 &c) {
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
 #endif //MATERIAL_H
@@ -0,0 +1,174 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#pragma once
+
+// Portable stand-in for Apple's <simd/simd.h>.
+// On Apple platforms this simply forwards to the system header. Everywhere else it
+// provides the small subset of the simd API the scene/BVH code uses, with the same
+// memory layout (float3 is 16 bytes, 16-byte aligned) so structs shared with the
+// Metal shaders keep their size and offsets on every platform.
+
+#if defined(__APPLE__)
+#include <simd/simd.h>
+#else
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace simd {
+    struct alignas(8) float2 {
+        float x, y;
+
+        float2() = default;
+
+        constexpr float2(float x_, float y_) : x(x_), y(y_) {
+        }
+
+        constexpr float &operator[](int i) { return (&x)[i]; }
+        constexpr float operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct alignas(16) float3 {
+        float x, y, z;
+
+        float3() = default;
+
+        constexpr float3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {
+        }
+
+        constexpr float &operator[](int i) { return (&x)[i]; }
+        constexpr float operator[](int i) const { return (&x)[i]; }
+
+        constexpr float3 &operator+=(const float3 &o) { x += o.x; y += o.y; z += o.z; return *this; }
+        constexpr float3 &operator-=(const float3 &o) { x -= o.x; y -= o.y; z -= o.z; return *this; }
+        constexpr float3 &operator*=(const float3 &o) { x *= o.x; y *= o.y; z *= o.z; return *this; }
+        constexpr float3 &operator/=(const float3 &o) { x /= o.x; y /= o.y; z /= o.z; return *this; }
+        constexpr float3 &operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+        constexpr float3 &operator/=(float s) { x /= s; y /= s; z /= s; return *this; }
+
+    private:
+        float _pad{};
+    };
+
+    struct alignas(16) float4 {
+        float x, y, z, w;
+
+        float4() = default;
+
+        constexpr float4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {
+        }
+
+        constexpr float &operator[](int i) { return (&x)[i]; }
+        constexpr float operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct float4x4 {
+        float4 columns[4];
+    };
+
+    constexpr float3 operator+(float3 a, const float3 &b) { return a += b; }
+    constexpr float3 operator-(float3 a, const float3 &b) { return a -= b; }
+    constexpr float3 operator*(float3 a, const float3 &b) { return a *= b; }
+    constexpr float3 operator/(float3 a, const float3 &b) { return a /= b; }
+    constexpr float3 operator*(float3 a, float s) { return a *= s; }
+    constexpr float3 operator*(float s, float3 a) { return a *= s; }
+    constexpr float3 operator/(float3 a, float s) { return a /= s; }
+    constexpr float3 operator/(float s, const float3 &a) { return {s / a.x, s / a.y, s / a.z}; }
+    constexpr float3 operator-(const float3 &a) { return {-a.x, -a.y, -a.z}; }
+
+    constexpr float4 operator+(const float4 &a, const float4 &b) {
+        return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w};
+    }
+
+    constexpr float4 operator*(const float4 &a, float s) { return {a.x * s, a.y * s, a.z * s, a.w * s}; }
+    constexpr float4 operator*(float s, const float4 &a) { return a * s; }
+    constexpr float4 operator/(const float4 &a, float s) { return {a.x / s, a.y / s, a.z / s, a.w / s}; }
+
+    inline float3 min(const float3 &a, const float3 &b) {
+        return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+    }
+
+    inline float3 max(const float3 &a, const float3 &b) {
+        return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+    }
+
+    inline float3 abs(const float3 &a) { return {std::fabs(a.x), std::fabs(a.y), std::fabs(a.z)}; }
+
+    inline float3 clamp(const float3 &v, const float3 &lo, const float3 &hi) { return min(max(v, lo), hi); }
+
+    inline float3 mix(const float3 &a, const float3 &b, float t) { return a + (b - a) * t; }
+
+    inline float reduce_min(const float3 &a) { return std::min(a.x, std::min(a.y, a.z)); }
+    inline float reduce_max(const float3 &a) { return std::max(a.x, std::max(a.y, a.z)); }
+
+    inline float dot(const float3 &a, const float3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    inline float3 cross(const float3 &a, const float3 &b) {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    inline float length_squared(const float3 &a) { return dot(a, a); }
+    inline float length(const float3 &a) { return std::sqrt(dot(a, a)); }
+    inline float3 normalize(const float3 &a) { return a * (1.0f / length(a)); }
+} // namespace simd
+
+using simd_float2 = simd::float2;
+using simd_float3 = simd::float3;
+using simd_float4 = simd::float4;
+using simd_float4x4 = simd::float4x4;
+
+inline constexpr simd::float4x4 matrix_identity_float4x4 = {
+    {
+        {1, 0, 0, 0},
+        {0, 1, 0, 0},
+        {0, 0, 1, 0},
+        {0, 0, 0, 1},
+    }
+};
+
+constexpr simd::float3 simd_make_float3(float x, float y, float z) { return {x, y, z}; }
+constexpr simd::float4 simd_make_float4(float x, float y, float z, float w) { return {x, y, z, w}; }
+
+constexpr simd::float4 simd_mul(const simd::float4x4 &m, const simd::float4 &v) {
+    return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z + m.columns[3] * v.w;
+}
+
+constexpr simd::float4x4 simd_mul(const simd::float4x4 &a, const simd::float4x4 &b) {
+    return {{simd_mul(a, b.columns[0]), simd_mul(a, b.columns[1]), simd_mul(a, b.columns[2]), simd_mul(a, b.columns[3])}};
+}
+
+// General 4x4 inverse by cofactor expansion (the matrix is assumed invertible).
+inline simd::float4x4 simd_inverse(const simd::float4x4 &m) {
+    float a[16], inv[16];
+    for (int c = 0; c < 4; ++c) {
+        for (int r = 0; r < 4; ++r) a[c * 4 + r] = m.columns[c][r];
+    }
+
+    inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+    inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+    inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+    inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+    inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+    inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+    inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+    inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+    const float invDet = 1.0f / (a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12]);
+    simd::float4x4 r;
+    for (int c = 0; c < 4; ++c) {
+        for (int row = 0; row < 4; ++row) r.columns[c][row] = inv[c * 4 + row] * invDet;
+    }
+    return r;
+}
+#endif
+
+#endif //SIMD_H
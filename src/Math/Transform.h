@@ -0,0 +1,42 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#pragma once
+#include "Simd.h"
+
+// Affine helpers on simd::float4x4 (column-major, column vectors).
+
+inline simd::float4x4 makeTranslation(const simd::float3 &t) {
+    simd::float4x4 m = matrix_identity_float4x4;
+    m.columns[3] = simd_make_float4(t.x, t.y, t.z, 1.0f);
+    return m;
+}
+
+inline simd::float4x4 makeScale(float s) {
+    simd::float4x4 m = matrix_identity_float4x4;
+    m.columns[0].x = m.columns[1].y = m.columns[2].z = s;
+    return m;
+}
+
+inline simd::float3 transformPoint(const simd::float4x4 &m, const simd::float3 &p) {
+    const simd::float4 r = simd_mul(m, simd_make_float4(p.x, p.y, p.z, 1.0f));
+    return simd_make_float3(r.x, r.y, r.z);
+}
+
+inline simd::float3 transformDirection(const simd::float4x4 &m, const simd::float3 &d) {
+    const simd::float4 r = simd_mul(m, simd_make_float4(d.x, d.y, d.z, 0.0f));
+    return simd_make_float3(r.x, r.y, r.z);
+}
+
+// Object-space normal to world space, given the world-to-object matrix:
+// multiplies by its transpose, i.e. the inverse transpose of object-to-world.
+inline simd::float3 transformNormal(const simd::float4x4 &worldToObject, const simd::float3 &n) {
+    const simd::float4 *c = worldToObject.columns;
+    return simd_make_float3(
+        c[0].x * n.x + c[0].y * n.y + c[0].z * n.z,
+        c[1].x * n.x + c[1].y * n.y + c[1].z * n.z,
+        c[2].x * n.x + c[2].y * n.y + c[2].z * n.z
+    );
+}
+
+#endif //TRANSFORM_H
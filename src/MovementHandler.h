@@ -4,7 +4,7 @@
 #pragma once
 
 #include <chrono>
-#include <simd/simd.h>
+#include "Math/Simd.h"
 #include <unordered_map>
 #include <mutex>
 
@@ -1,90 +1,317 @@
 #include "ObjLoader.h"
 
-#include <simd/simd.h>
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <vector>
+
+#include "MappedFile.h"
 #include "Object.h"
+#include "Profiler.h"
 #include "Primitives/Primitives.h"
 
-bool ObjLoader::loadObj(const std::string &filename, uint32_t materialIndex) {
-    std::ifstream in{filename};
-    if (!in) {
-        std::cerr << "Failed to open OBJ: " << filename << "\n";
-        return false;
+namespace {
+    // below this a chunk is not worth a task
+    constexpr size_t kMinChunkBytes = 1 << 20;
+
+    // A newline-aligned slice of the file, parsed independently of the others.
+    struct Chunk {
+        const char *begin, *end;
+        // pass 1: attribute counts, then their global offsets
+        uint32_t positions = 0, texcoords = 0, normals = 0;
+        uint32_t positionBase = 0, texcoordBase = 0, normalBase = 0;
+        // pass 2: triangle corners, 0-based global indices
+        std::vector<uint32_t> vIdx, vtIdx, vnIdx;
+        bool hasTexcoords = false, hasNormals = false; // vtIdx/vnIdx are in use
+        bool bad = false;
+    };
+
+    enum class Record { Position, Texcoord, Normal, Face, Other };
+
+    bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    const char *skipBlanks(const char *p, const char *end) {
+        while (p < end && isBlank(*p)) ++p;
+        return p;
     }
 
-    // temporary storage for vertex positions
-    std::vector<simd::float3> positions;
-    positions.reserve(1024);
-
-    uint32_t startIdx = static_cast<uint32_t>(triangles.size());
-    uint32_t triCount = 0;
-
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        std::istringstream iss{line};
-
-        std::string tag;
-        iss >> tag;
-        if (tag == "v") {
-            // vertex position
-            float x, y, z;
-            iss >> x >> y >> z;
-            simd::float3 pos = {x, y, z};
-            positions.push_back(pos);
-        } else if (tag == "f") {
-            // parse *all* indices in this face
-            std::vector<int> idxList;
-            std::string tok;
-            while (iss >> tok) {
-                // strip off anything after the first '/'
-                size_t slash = tok.find('/');
-                std::string vStr = (slash == std::string::npos ? tok : tok.substr(0, slash));
-
-                // OBJ allows negative (relative) indices
-                int i = std::stoi(vStr);
-                if (i < 0) {
-                    i = int(positions.size()) + i; // relative to end
-                } else {
-                    i = i - 1; // 1-based → 0-based
-                }
-                idxList.push_back(i);
+    const char *nextLine(const char *p, const char *end) {
+        const void *nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        return nl ? static_cast<const char *>(nl) + 1 : end;
+    }
+
+    // Classify the line at `p` and move `p` past its tag.
+    Record record(const char *&p, const char *end) {
+        p = skipBlanks(p, end);
+        if (end - p < 2) return Record::Other;
+        if (p[0] == 'f' && isBlank(p[1])) {
+            p += 1;
+            return Record::Face;
+        }
+        if (p[0] != 'v') return Record::Other;
+        if (isBlank(p[1])) {
+            p += 1;
+            return Record::Position;
+        }
+        if (end - p < 3 || !isBlank(p[2])) return Record::Other;
+        if (p[1] == 't') {
+            p += 2;
+            return Record::Texcoord;
+        }
+        if (p[1] == 'n') {
+            p += 2;
+            return Record::Normal;
+        }
+        return Record::Other;
+    }
+
+    // Missing or malformed numbers read as 0, like the old stream-based loader.
+    float parseFloat(const char *&p, const char *end) {
+        p = skipBlanks(p, end);
+        if (p < end && *p == '+') ++p;
+        float v = 0.0f;
+        const auto [ptr, ec] = std::from_chars(p, end, v);
+        if (ec == std::errc()) p = ptr;
+        return v;
+    }
+
+    // 0-based index of a face reference: positive indices are 1-based, negative ones
+    // count back from the last attribute defined before this line. kNoIndex if
+    // invalid.
+    uint32_t resolve(long long i, uint32_t definedBefore, uint32_t total) {
+        const long long r = i < 0 ? definedBefore + i : i - 1;
+        return i == 0 || r < 0 || r >= total ? ObjData::kNoIndex : static_cast<uint32_t>(r);
+    }
+
+    void forEachChunk(ThreadPool *pool, std::vector<Chunk> &chunks, const auto &fn) {
+        if (pool && chunks.size() > 1) {
+            pool->parallelFor(chunks.size(), [&](size_t c) { fn(chunks[c]); });
+        } else {
+            for (Chunk &c: chunks) fn(c);
+        }
+    }
+
+    // Pass 1: how many of each attribute the chunk defines.
+    void countAttributes(Chunk &c) {
+        for (const char *line = c.begin; line < c.end; line = nextLine(line, c.end)) {
+            const char *p = line;
+            switch (record(p, c.end)) {
+                case Record::Position: ++c.positions;
+                    break;
+                case Record::Texcoord: ++c.texcoords;
+                    break;
+                case Record::Normal: ++c.normals;
+                    break;
+                default: break;
             }
+        }
+    }
 
-            // need at least 3 verts to form triangles
-            if (idxList.size() < 3) continue;
+    struct Corner {
+        uint32_t v, vt, vn;
+    };
 
-            // fan-triangulate: (0,i,i+1)
-            for (size_t j = 1; j + 1 < idxList.size(); ++j) {
-                Triangle T;
-                T.v0 = positions[idxList[0]];
-                T.v1 = positions[idxList[j]];
-                T.v2 = positions[idxList[j + 1]];
-                T.matIndex = materialIndex;
+    // Pass 2: attributes straight into their global slots, faces fan-triangulated.
+    void parseChunk(Chunk &c, ObjData &out) {
+        const uint32_t totalV = static_cast<uint32_t>(out.positions.size());
+        const uint32_t totalVt = static_cast<uint32_t>(out.texcoords.size());
+        const uint32_t totalVn = static_cast<uint32_t>(out.normals.size());
+        uint32_t v = c.positionBase, vt = c.texcoordBase, vn = c.normalBase;
+        std::vector<Corner> corners; // reused for every face
 
-                // you can compute a flat normal here if you want:
-                // simd::float3 e1 = T.v1 - T.v0;
-                // simd::float3 e2 = T.v2 - T.v0;
-                // T.normal = simd::normalize(simd::cross(e1, e2));
+        for (const char *line = c.begin; line < c.end; line = nextLine(line, c.end)) {
+            const char *p = line;
+            const char *end = c.end;
+            switch (record(p, end)) {
+                case Record::Position: {
+                    const float x = parseFloat(p, end), y = parseFloat(p, end), z = parseFloat(p, end);
+                    out.positions[v++] = {x, y, z};
+                    break;
+                }
+                case Record::Texcoord: {
+                    const float s = parseFloat(p, end), t = parseFloat(p, end);
+                    out.texcoords[vt++] = {s, t};
+                    break;
+                }
+                case Record::Normal: {
+                    const float x = parseFloat(p, end), y = parseFloat(p, end), z = parseFloat(p, end);
+                    out.normals[vn++] = {x, y, z};
+                    break;
+                }
+                case Record::Face: {
+                    // v, v/vt, v//vn or v/vt/vn per corner
+                    corners.clear();
+                    bool hasVt = false, hasVn = false;
+                    while (true) {
+                        p = skipBlanks(p, end);
+                        long long i = 0;
+                        const auto [ptr, ec] = std::from_chars(p, end, i);
+                        if (ec != std::errc()) break;
+                        p = ptr;
+                        Corner k{resolve(i, v, totalV), ObjData::kNoIndex, ObjData::kNoIndex};
+                        if (k.v == ObjData::kNoIndex) c.bad = true;
+                        if (p < end && *p == '/') {
+                            ++p;
+                            if (p < end && *p != '/') {
+                                const auto [ptrT, ecT] = std::from_chars(p, end, i);
+                                if (ecT == std::errc()) {
+                                    p = ptrT;
+                                    k.vt = resolve(i, vt, totalVt);
+                                    c.bad |= k.vt == ObjData::kNoIndex;
+                                    hasVt = true;
+                                }
+                            }
+                            if (p < end && *p == '/') {
+                                ++p;
+                                const auto [ptrN, ecN] = std::from_chars(p, end, i);
+                                if (ecN == std::errc()) {
+                                    p = ptrN;
+                                    k.vn = resolve(i, vn, totalVn);
+                                    c.bad |= k.vn == ObjData::kNoIndex;
+                                    hasVn = true;
+                                }
+                            }
+                        }
+                        corners.push_back(k);
+                    }
+                    // need at least 3 verts to form triangles
+                    if (corners.size() < 3) break;
 
-                triangles.push_back(T);
-                ++triCount;
+                    // the texcoord/normal arrays only exist once some face uses them
+                    if (hasVt && !c.hasTexcoords) {
+                        c.vtIdx.assign(c.vIdx.size(), ObjData::kNoIndex);
+                        c.hasTexcoords = true;
+                    }
+                    if (hasVn && !c.hasNormals) {
+                        c.vnIdx.assign(c.vIdx.size(), ObjData::kNoIndex);
+                        c.hasNormals = true;
+                    }
+
+                    // fan-triangulate: (0,i,i+1)
+                    for (size_t j = 1; j + 1 < corners.size(); ++j) {
+                        for (const Corner &k: {corners[0], corners[j], corners[j + 1]}) {
+                            c.vIdx.push_back(k.v);
+                            if (c.hasTexcoords) c.vtIdx.push_back(k.vt);
+                            if (c.hasNormals) c.vnIdx.push_back(k.vn);
+                        }
+                    }
+                    break;
+                }
+                case Record::Other: break;
             }
         }
     }
 
+    // Concatenate one per-chunk index array, keeping the array empty if every
+    // chunk's is.
+    void mergeIndices(ThreadPool *pool, std::vector<Chunk> &chunks, std::vector<uint32_t> Chunk::*member,
+                      const std::vector<size_t> &offsets, std::vector<uint32_t> &dst) {
+        const bool any = std::ranges::any_of(chunks, [&](const Chunk &c) { return !(c.*member).empty(); });
+        if (!any) return;
+        dst.assign(offsets.back(), ObjData::kNoIndex);
+        forEachChunk(pool, chunks, [&](Chunk &c) {
+            const std::vector<uint32_t> &src = c.*member;
+            std::copy(src.begin(), src.end(), dst.begin() + static_cast<ptrdiff_t>(offsets[&c - chunks.data()]));
+        });
+    }
+}
+
+bool ObjLoader::parseObj(const std::string &filename, ObjData &out, ThreadPool *pool) {
+    PROFILE_SCOPE("OBJ parse");
+    out = ObjData{};
+    const MappedFile file(filename);
+    if (!file.valid()) {
+        std::cerr << "Failed to open OBJ: " << filename << "\n";
+        return false;
+    }
+    const char *data = file.data();
+    const char *end = data + file.size();
+
+    // split at line boundaries, a few chunks per thread for balance
+    const size_t threads = pool ? pool->size() : 1;
+    const size_t target = std::max(kMinChunkBytes, file.size() / (threads * 4) + 1);
+    std::vector<Chunk> chunks;
+    for (const char *p = data; p < end;) {
+        const char *chunkEnd = static_cast<size_t>(end - p) <= target ? end : nextLine(p + target, end);
+        chunks.push_back({p, chunkEnd});
+        p = chunkEnd;
+    }
+
+    forEachChunk(pool, chunks, countAttributes);
+
+    uint32_t positions = 0, texcoords = 0, normals = 0;
+    for (Chunk &c: chunks) {
+        c.positionBase = positions;
+        c.texcoordBase = texcoords;
+        c.normalBase = normals;
+        positions += c.positions;
+        texcoords += c.texcoords;
+        normals += c.normals;
+    }
+    out.positions.resize(positions);
+    out.texcoords.resize(texcoords);
+    out.normals.resize(normals);
+
+    forEachChunk(pool, chunks, [&](Chunk &c) { parseChunk(c, out); });
+
+    if (std::ranges::any_of(chunks, [](const Chunk &c) { return c.bad; })) {
+        std::cerr << "Invalid face index in OBJ: " << filename << "\n";
+        return false;
+    }
+
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); ++i) offsets[i + 1] = offsets[i] + chunks[i].vIdx.size();
+    mergeIndices(pool, chunks, &Chunk::vIdx, offsets, out.positionIndices);
+    mergeIndices(pool, chunks, &Chunk::vtIdx, offsets, out.texcoordIndices);
+    mergeIndices(pool, chunks, &Chunk::vnIdx, offsets, out.normalIndices);
+    return true;
+}
+
+bool ObjLoader::loadObj(const std::string &filename, uint32_t materialIndex, const simd::float4x4 &transform,
+                        ThreadPool *pool) {
+    for (const Object &loaded: objects) {
+        if (loaded.source == filename && loaded.materialIndex == materialIndex) {
+            Object obj = loaded;
+            obj.transform = transform;
+            objects.push_back(obj);
+            std::cout << "Instanced OBJ: " << filename
+                    << " (triangles: " << obj.triCount << ")\n";
+            return true;
+        }
+    }
+
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    ObjData data;
+    if (!parseObj(filename, data, pool)) return false;
+
+    // the file's vertices are shared by its faces, as in the OBJ itself
+    const uint32_t startIdx = static_cast<uint32_t>(triangles.size());
+    const uint32_t triCount = static_cast<uint32_t>(data.triangleCount());
+    const uint32_t vertexBase = static_cast<uint32_t>(vertices.size());
+    vertices.insert(vertices.end(), data.positions.begin(), data.positions.end());
+    triangles.resize(startIdx + triCount);
+    for (uint32_t t = 0; t < triCount; ++t) {
+        SceneTriangle &T = triangles[startIdx + t];
+        T.v0 = vertexBase + data.positionIndices[3 * t];
+        T.v1 = vertexBase + data.positionIndices[3 * t + 1];
+        T.v2 = vertexBase + data.positionIndices[3 * t + 2];
+        T.matIndex = materialIndex;
+    }
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
     // record the new object
     Object obj;
     obj.firstTriangle = startIdx;
     obj.triCount = triCount;
     obj.materialIndex = materialIndex;
-    obj.transform = matrix_identity_float4x4;
+    obj.transform = transform;
+    obj.source = filename;
     objects.push_back(obj);
 
     std::cout << "Loaded OBJ: " << filename
-            << " (triangles: " << triCount << ")\n";
+            << " (triangles: " << triCount << ") in "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
     return true;
 }
@@ -2,14 +2,43 @@
 #define OBJLOADER_H
 
 #pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Math/Simd.h"
+
+// Raw contents of an OBJ file: vertex attributes and fan-triangulated faces as
+// 0-based indices (relative indices already resolved). The texcoord/normal index
+// arrays are empty when no face references that attribute, otherwise they hold
+// 3 entries per triangle with kNoIndex for corners that leave it out.
+struct ObjData {
+    static constexpr uint32_t kNoIndex = UINT32_MAX;
+
+    std::vector<simd::float3> positions;
+    std::vector<simd::float2> texcoords;
+    std::vector<simd::float3> normals;
+    std::vector<uint32_t> positionIndices;
+    std::vector<uint32_t> texcoordIndices;
+    std::vector<uint32_t> normalIndices;
+
+    size_t triangleCount() const { return positionIndices.size() / 3; }
+};
 
 class ObjLoader {
 public:
-    // Simple Wavefront OBJ loader: parses positions and triangular faces only.
-    // Appends parsed Triangles into the global `triangles` vector,
-    // and records an Object entry in `objects`.
-    static bool loadObj(const std::string &filename, uint32_t materialIndex);
+    // Memory-map `filename` and parse it, in parallel chunks on `pool` when given.
+    // Understands v, vt, vn and polygonal f records; everything else is skipped.
+    static bool parseObj(const std::string &filename, ObjData &out, ThreadPool *pool = nullptr);
+
+    // Wavefront OBJ loader: appends the file's positions to the global `vertices`
+    // and its faces, indexing them, to `triangles`, and records an Object entry in
+    // `objects`. Loading a file that is already loaded with the same material only
+    // adds another Object over its triangles.
+    static bool loadObj(const std::string &filename, uint32_t materialIndex,
+                        const simd::float4x4 &transform = matrix_identity_float4x4,
+                        ThreadPool *pool = nullptr);
 };
 
 
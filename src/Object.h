@@ -1,19 +1,24 @@
 #ifndef OBJECT_H
 #define OBJECT_H
+#include <string>
 #include <vector>
-#include <simd/matrix_types.h>
+#include "Math/Simd.h"
 
 #include "Primitives/Primitives.h"
 
+// An instance of a triangle range. Objects that share a range share one
+// bottom-level BVH; `transform` places the range in the world.
 struct Object {
     uint32_t firstTriangle{}; // index into your big triangle array
     uint32_t triCount{};
     uint32_t materialIndex{}; // or per‐triangle if you want
-    simd::float4x4 transform;
+    simd::float4x4 transform = matrix_identity_float4x4; // object → world
+    std::string source; // file the triangles came from, if any
 };
 
 // TODO: define these in a logical spot
 inline std::vector<Object> objects;
-inline std::vector<Triangle> triangles;
+inline std::vector<simd::float3> vertices; // in load order
+inline std::vector<SceneTriangle> triangles; // in load order, corners index `vertices`
 
 #endif //OBJECT_H
@@ -2,7 +2,11 @@
 #define SCENEPRIMITIVES_H
 
 #pragma once
+#include <cstdint>
 
+#include "../Math/Simd.h"
+
+// Triangle with its corners by value: the input format of the BVH builders.
 struct Triangle {
     simd::float3 v0;
     simd::float3 v1;
@@ -22,4 +26,42 @@ struct Sphere {
     uint32_t matIndex;
 };
 
+// GPU/CPU-side layouts, matching shaders/types.metal
+
+// Vertex position without simd padding (packed_float3 in Metal): 12 bytes.
+struct SceneVertex {
+    float x, y, z;
+
+    simd::float3 position() const { return {x, y, z}; }
+
+    static SceneVertex of(const simd::float3 &p) { return {p.x, p.y, p.z}; }
+};
+
+// Indexed triangle: corners are indices into a vertex array shared by the mesh.
+struct SceneTriangle {
+    uint32_t v0, v1, v2;
+    uint32_t matIndex;
+};
+
+// An emissive triangle in world space, for next-event estimation. Lights are drawn
+// from an alias table in proportion to area times emitted luminance: pick an entry
+// uniformly, keep it with probability `prob`, otherwise take `alias`.
+struct SceneLight {
+    SceneVertex v0; // corner
+    SceneVertex e1, e2; // edges from v0
+    uint32_t matIndex;
+    float prob;
+    uint32_t alias;
+};
+
+using ScenePlane = Plane;
+using SceneSphere = Sphere;
+
+// One placement of a mesh: rays are taken into object space with `worldToObject`
+// and traced against the mesh's bottom-level BVH rooted at `blasRoot`.
+struct SceneInstance {
+    simd::float4x4 worldToObject;
+    uint32_t blasRoot;
+};
+
 #endif //SCENEPRIMITIVES_H
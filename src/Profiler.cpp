@@ -0,0 +1,155 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+    // JSON string body; names are code literals, but stay valid whatever they hold.
+    std::string escaped(const std::string &s) {
+        std::string out;
+        for (const char c: s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", c);
+                out += code;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+}
+
+Profiler &Profiler::get() {
+    // never destroyed: pool threads and GPU completion handlers may record during exit
+    static Profiler *profiler = new Profiler();
+    return *profiler;
+}
+
+uint32_t Profiler::addTrack(const std::string &name) {
+    std::lock_guard lock(_mutex);
+    _trackNames.push_back(name);
+    return static_cast<uint32_t>(_trackNames.size() - 1);
+}
+
+void Profiler::nameThread(const std::string &name) {
+    const uint32_t track = threadRing().track;
+    std::lock_guard lock(_mutex);
+    _trackNames[track] = name;
+}
+
+Profiler::Ring &Profiler::threadRing() {
+    if (!_threadRing) {
+        std::lock_guard lock(_mutex);
+        auto ring = std::make_unique<Ring>();
+        ring->track = static_cast<uint32_t>(_trackNames.size());
+        _trackNames.push_back("Thread " + std::to_string(_rings.size()));
+        _threadRing = ring.get();
+        _rings.push_back(std::move(ring));
+    }
+    return *_threadRing;
+}
+
+void Profiler::record(const char *name, uint64_t start, uint64_t end, uint32_t track) {
+    Ring &ring = threadRing();
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    // readers that see any of the new fields also see the claim, and drop the slot
+    ring.claimed.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Ring::Slot &slot = ring.slots[head & (kRingSize - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(end > start ? end - start : 0, std::memory_order_relaxed);
+    slot.track.store(track == kThreadTrack ? ring.track : track, std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+    std::vector<const Ring *> rings;
+    {
+        std::lock_guard lock(_mutex);
+        for (const auto &ring: _rings) rings.push_back(ring.get());
+    }
+
+    std::vector<ProfileEvent> out;
+    for (const Ring *ring: rings) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first = head > kRingSize ? head - kRingSize : 0;
+        const size_t base = out.size();
+        for (uint64_t i = first; i < head; ++i) {
+            const Ring::Slot &slot = ring->slots[i & (kRingSize - 1)];
+            out.push_back({
+                slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                slot.duration.load(std::memory_order_relaxed), slot.track.load(std::memory_order_relaxed)
+            });
+        }
+        // whatever the owner wrote meanwhile overwrote the oldest slots we copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t after = ring->claimed.load(std::memory_order_relaxed);
+        if (after > kRingSize && after - kRingSize > first) {
+            const size_t stale = static_cast<size_t>(std::min(after - kRingSize, head) - first);
+            out.erase(out.begin() + static_cast<std::ptrdiff_t>(base),
+                      out.begin() + static_cast<std::ptrdiff_t>(base + stale));
+        }
+    }
+    return out;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) const {
+    const std::vector<ProfileEvent> all = events();
+    std::vector<std::string> trackNames;
+    {
+        std::lock_guard lock(_mutex);
+        trackNames = _trackNames;
+    }
+
+    std::ofstream file(path);
+    if (!file) return false;
+    uint64_t origin = ~0ull;
+    for (const ProfileEvent &e: all) origin = std::min(origin, e.start);
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"pathtracer\"}}";
+    for (size_t track = 0; track < trackNames.size(); ++track) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track
+                << ",\"args\":{\"name\":\"" << escaped(trackNames[track]) << "\"}}";
+    }
+    char times[64];
+    for (const ProfileEvent &e: all) {
+        // microseconds, as the format wants
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", static_cast<double>(e.start - origin) * 1e-3,
+                      static_cast<double>(e.duration) * 1e-3);
+        file << ",\n{\"name\":\"" << escaped(e.name ? e.name : "?") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.track
+                << "," << times << "}";
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+void RollingStats::add(float value) {
+    if (_values.empty()) return;
+    _values[_next] = value;
+    _next = (_next + 1) % _values.size();
+    _count = std::min(_count + 1, _values.size());
+}
+
+float RollingStats::percentile(float q) const {
+    if (_count == 0) return 0.0f;
+    std::vector<float> sorted(_values.begin(), _values.begin() + static_cast<std::ptrdiff_t>(_count));
+    const size_t rank = std::min(static_cast<size_t>(std::ceil(std::clamp(q, 0.0f, 1.0f) * static_cast<float>(_count))),
+                                 _count) - (q > 0.0f ? 1 : 0);
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(rank), sorted.end());
+    return sorted[rank];
+}
+
+float RollingStats::mean() const {
+    if (_count == 0) return 0.0f;
+    double sum = 0.0;
+    for (size_t i = 0; i < _count; ++i) sum += _values[i];
+    return static_cast<float>(sum / static_cast<double>(_count));
+}
@@ -0,0 +1,127 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timed intervals on named tracks, kept for export as a Chrome trace (load the file
+// in chrome://tracing or ui.perfetto.dev). Every thread writes into its own ring
+// buffer without locks; a full ring overwrites its oldest intervals, so only the
+// recent history survives a long session. Each thread gets a track of its own, and
+// intervals measured elsewhere (GPU command buffers) can name a track explicitly.
+//
+// Names must outlive the profiler: string literals.
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t start; // ns on Profiler::now()'s clock
+    uint64_t duration; // ns
+    uint32_t track;
+};
+
+class Profiler {
+public:
+    static constexpr uint32_t kThreadTrack = ~0u; // the recording thread's own track
+
+    // The process-wide profiler.
+    static Profiler &get();
+
+    // Nanoseconds on a monotonic clock, the time base of every event.
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // A track that is not a thread's, e.g. a GPU queue.
+    uint32_t addTrack(const std::string &name);
+
+    // Rename the calling thread's track (default "Thread <n>").
+    void nameThread(const std::string &name);
+
+    void record(const char *name, uint64_t start, uint64_t end, uint32_t track = kThreadTrack);
+
+    // Every interval still held, oldest first per thread. Safe while others record.
+    std::vector<ProfileEvent> events() const;
+
+    // The held intervals as Chrome trace_event JSON; false if the file can't be written.
+    bool writeChromeTrace(const std::string &path) const;
+
+private:
+    static constexpr size_t kRingSize = 1 << 15; // intervals per thread, a power of two
+
+    // One thread's intervals. Only the owner writes; fields are atomics so readers
+    // copying a slot that is being overwritten stay well-defined (and discard it).
+    struct Ring {
+        struct Slot {
+            std::atomic<const char *> name{nullptr};
+            std::atomic<uint64_t> start{0}, duration{0};
+            std::atomic<uint32_t> track{0};
+        };
+
+        uint32_t track = 0;
+        std::atomic<uint64_t> claimed{0}; // intervals started, announced before the slot is overwritten
+        std::atomic<uint64_t> head{0}; // intervals completely written
+        std::unique_ptr<Slot[]> slots{new Slot[kRingSize]};
+    };
+
+    Profiler() = default;
+
+    Ring &threadRing();
+
+    static inline thread_local Ring *_threadRing = nullptr; // set on the thread's first record
+
+    mutable std::mutex _mutex; // guards registration, never recording
+    std::vector<std::unique_ptr<Ring>> _rings;
+    std::vector<std::string> _trackNames;
+};
+
+// Records the enclosing scope on the calling thread's track.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name) : _name(name), _start(Profiler::now()) {
+    }
+
+    ~ProfileScope() { Profiler::get().record(_name, _start, Profiler::now()); }
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *_name;
+    uint64_t _start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) const ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+// Percentiles of the last `window` values added, e.g. frame times.
+class RollingStats {
+public:
+    explicit RollingStats(size_t window = 240) : _values(window) {
+    }
+
+    void add(float value);
+
+    size_t size() const { return _count; }
+
+    // q in [0, 1], nearest rank; 0 when empty.
+    float percentile(float q) const;
+
+    float mean() const;
+
+private:
+    std::vector<float> _values;
+    size_t _next = 0, _count = 0;
+};
+
+
+#endif //PROFILER_H
@@ -2,28 +2,45 @@
 #include "Primitives/Primitives.h"
 
 #include <iostream>
+#include <mach/mach_time.h>
 #include "Config.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
 #include <vector>
-#include <numbers>
-#include <numeric>
 
 #include "Camera.h"
 #include "Material.h"
+#include "Object.h"
+#include "Scene.h"
 
 #include "imgui.h"
 #include "imgui_impl_metal.h"
-#include "Object.h"
-#include "ObjLoader.h"
-#include "Bvh/BvhBuilder.h"
 #include "Bvh/BvhNode.h"
 
 // Forward declaration for window helper function
 extern "C" bool isImGuiWindowVisible();
 
+namespace {
+    // Profiler::now() at a Metal host time: seconds on mach_absolute_time's clock, as
+    // GPUStartTime() reports them. Both clocks are read together, so their offset holds.
+    uint64_t profilerTime(double hostSeconds) {
+        static const double nsPerTick = [] {
+            mach_timebase_info_data_t info;
+            mach_timebase_info(&info);
+            return static_cast<double>(info.numer) / info.denom;
+        }();
+        const double offset = static_cast<double>(Profiler::now()) - static_cast<double>(mach_absolute_time()) * nsPerTick;
+        return static_cast<uint64_t>(std::max(hostSeconds * 1e9 + offset, 0.0));
+    }
+}
+
 Renderer::Renderer(MTL::Device *device) : _device(device) {
     _cmdQueue = _device->newCommandQueue();
     _lastFpsTime = std::chrono::high_resolution_clock::now();
     _lastUpdate = std::chrono::high_resolution_clock::now();
+    Profiler::get().nameThread("Render thread");
+    _gpuTrack = Profiler::get().addTrack("GPU");
     setupPipeline();
     setupImgui();
     setupOutputTexture();
@@ -43,11 +60,28 @@ void Renderer::setupImgui() const {
 }
 
 void Renderer::setupPipeline() {
+    PROFILE_SCOPE("Pipeline setup");
     const auto lib = _device->newDefaultLibrary();
     // compute pipeline
     const auto comp = lib->newFunction(NS::String::string("path_trace", NS::UTF8StringEncoding));
     NS::Error *error = nullptr;
     _computePipeline = _device->newComputePipelineState(comp, &error);
+    const auto compute = [&](const char *name) {
+        const auto fn = lib->newFunction(NS::String::string(name, NS::UTF8StringEncoding));
+        return _device->newComputePipelineState(fn, &error);
+    };
+    _denoisePreparePipeline = compute("denoise_prepare");
+    _denoisePipeline = compute("denoise_atrous");
+    _reprojectPipeline = compute("reproject");
+    _wavefrontGenerate = compute("wavefront_generate");
+    _wavefrontQueueArgs = compute("wavefront_queue_args");
+    _wavefrontExtend = compute("wavefront_extend");
+    _wavefrontClassify = compute("wavefront_classify");
+    _wavefrontShadeDielectric = compute("wavefront_shade_dielectric");
+    _wavefrontShadeSurface = compute("wavefront_shade_surface");
+    _wavefrontConnect = compute("wavefront_connect");
+    _wavefrontNextBounce = compute("wavefront_next_bounce");
+    _wavefrontAccumulate = compute("wavefront_accumulate");
 
     // display pipeline (fullscreen quad)
     const auto vfn = lib->newFunction(NS::String::string("quad_vert", NS::UTF8StringEncoding));
@@ -73,6 +107,12 @@ void Renderer::setupOutputTexture() {
     );
     desc->setUsage(MTL::TextureUsageShaderWrite | MTL::TextureUsageShaderRead);
     _outputTexture = _device->newTexture(desc);
+    // frame 0 overwrites these, no need to clear them
+    _albedoTexture = _device->newTexture(desc);
+    _normalDepthTexture = _device->newTexture(desc);
+    _denoiseTextures[0] = _device->newTexture(desc);
+    _denoiseTextures[1] = _device->newTexture(desc);
+    for (auto &texture: _historyTextures) texture = _device->newTexture(desc);
     const auto cmdBuf = _cmdQueue->commandBuffer();
     const auto blit = cmdBuf->blitCommandEncoder();
     const MTL::Region full = MTL::Region::Make2D(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -83,10 +123,27 @@ void Renderer::setupOutputTexture() {
     blit->endEncoding();
     cmdBuf->commit();
     cmdBuf->waitUntilCompleted();
+
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    _rayStatsBuffer = _device->newBuffer(sizeof(RayStats) * WINDOW_WIDTH * WINDOW_HEIGHT,
+                                         MTL::ResourceStorageModeShared);
+#endif
 }
 
 
 void Renderer::draw(CA::MetalLayer *layer) {
+    PROFILE_SCOPE("Frame");
+    Profiler &profiler = Profiler::get();
+    const uint64_t frameStart = Profiler::now();
+    if (_lastFrameStart) _frameTimes.add(static_cast<float>(frameStart - _lastFrameStart) * 1e-6f);
+    _lastFrameStart = frameStart;
+    GpuTimes &gpu = *_gpuTimes;
+    const auto traced = static_cast<size_t>(GpuStage::PathTrace);
+    if (const uint64_t completed = gpu.completed[traced].load(std::memory_order_acquire); completed != _gpuFramesSeen) {
+        _gpuFrameTimes.add(gpu.ms[traced].load(std::memory_order_relaxed));
+        _gpuFramesSeen = completed;
+    }
+
     ImGuiIO &io = ImGui::GetIO();
 
     const auto size = layer->drawableSize();
@@ -102,19 +159,29 @@ void Renderer::draw(CA::MetalLayer *layer) {
     _yaw = _move.getYaw();
     _pitch = _move.getPitch();
 
-    // if the camera moved since last frame, reset accumulation:
+    constexpr float aspect = static_cast<float>(WINDOW_WIDTH) / WINDOW_HEIGHT;
+    const Camera cam = makeCamera(_camPos, _yaw, _pitch, _fov, aspect);
+
+    // if the camera moved since last frame, carry the samples over or start again
+    bool reprojecting = false;
     if (_move.hasMovedAndClear()) {
-        clearAccumulation();
+        reprojecting = _reproject && _history;
+        if (reprojecting) startReprojection();
+        else clearAccumulation();
     }
 
     // get a drawable for this frame
     const auto drawable = layer->nextDrawable();
     if (!drawable) return;
 
+    // path tracing, denoising and display each get a command buffer, so each is timed
+    uint64_t encodeStart = Profiler::now();
     const auto cmdBuf = _cmdQueue->commandBuffer();
     const auto encoder = cmdBuf->computeCommandEncoder();
     encoder->setComputePipelineState(_computePipeline);
     encoder->setTexture(_outputTexture, 0);
+    encoder->setTexture(_albedoTexture, 1);
+    encoder->setTexture(_normalDepthTexture, 2);
     // bind triangles
     encoder->setBuffer(_triangleBuffer, 0, 1);
     encoder->setBytes(&_triangleCount, sizeof(_triangleCount), 2);
@@ -133,47 +200,71 @@ void Renderer::draw(CA::MetalLayer *layer) {
     encoder->setBuffer(_bvhNodeBuffer, 0, 11);
     encoder->setBytes(&_bvhNodeCount, sizeof(_bvhNodeCount), 12);
 
-    constexpr float aspect = static_cast<float>(WINDOW_WIDTH) / WINDOW_HEIGHT;
-    const float theta = _fov * (std::numbers::pi_v<float> / 180.0f);
-    float halfH = tan(theta * 0.5f);
-    float halfW = aspect * halfH;
-
-    simd::float3 front = {
-        cos(_pitch) * sin(_yaw),
-        sin(_pitch),
-        cos(_pitch) * cos(_yaw)
-    };
-    const simd::float3 worldUp = simd_make_float3(0.0f, 1.0f, 0.0f);
-    simd::float3 right = simd::normalize(simd::cross(front, worldUp));
-    simd::float3 up = simd::cross(right, front);
-
-    Camera cam{};
-    cam.origin = _camPos;
-    cam.lowerLeft = _camPos + front - right * halfW - up * halfH;
-    cam.horizontal = 2 * halfW * right;
-    cam.vertical = 2 * halfH * up;
+    encoder->setBuffer(_instanceBuffer, 0, 13);
+    encoder->setBytes(&_instanceCount, sizeof(_instanceCount), 14);
+    encoder->setBuffer(_tlasNodeBuffer, 0, 15);
+    encoder->setBytes(&_tlasNodeCount, sizeof(_tlasNodeCount), 16);
+    encoder->setBuffer(_vertexBuffer, 0, 17);
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    encoder->setBuffer(_rayStatsBuffer, 0, 18);
+#endif
+    encoder->setBuffer(_lightBuffer, 0, 19);
+    encoder->setBytes(&_lightCount, sizeof(_lightCount), 20);
+    encoder->setBytes(&_scene.lightPower, sizeof(_scene.lightPower), 21);
+    encoder->setBytes(&_samplerType, sizeof(_samplerType), 22);
+    const uint32_t history = _history;
+    encoder->setBytes(&history, sizeof(history), 28);
 
     encoder->setBytes(&cam, sizeof(cam), 10);
 
-    const MTL::Size threadsPerThreadgroup(8, 8, 1);
-    const MTL::Size grid(WINDOW_WIDTH, WINDOW_HEIGHT, 1);
-    const MTL::Size threadgroups(
-        (grid.width + threadsPerThreadgroup.width - 1) / threadsPerThreadgroup.width,
-        (grid.height + threadsPerThreadgroup.height - 1) / threadsPerThreadgroup.height,
-        1
-    );
-    encoder->dispatchThreadgroups(threadgroups, threadsPerThreadgroup);
+    if (_wavefront) {
+        encodeWavefront(encoder);
+    } else {
+        const MTL::Size threadsPerThreadgroup(8, 8, 1);
+        const MTL::Size grid(WINDOW_WIDTH, WINDOW_HEIGHT, 1);
+        const MTL::Size threadgroups(
+            (grid.width + threadsPerThreadgroup.width - 1) / threadsPerThreadgroup.width,
+            (grid.height + threadsPerThreadgroup.height - 1) / threadsPerThreadgroup.height,
+            1
+        );
+        encoder->dispatchThreadgroups(threadgroups, threadsPerThreadgroup);
+    }
+    if (reprojecting) {
+        _reprojection.current = cam;
+        _reprojection.previous = _camera;
+        encoder->setComputePipelineState(_reprojectPipeline);
+        for (uint32_t i = 0; i < 3; ++i) encoder->setTexture(_historyTextures[i], 3 + i);
+        encoder->setBytes(&_reprojection, sizeof(_reprojection), 0);
+        encoder->dispatchThreadgroups(MTL::Size((WINDOW_WIDTH + 7) / 8, (WINDOW_HEIGHT + 7) / 8, 1),
+                                      MTL::Size(8, 8, 1));
+    }
     encoder->endEncoding();
+    _camera = cam;
+    timeOnGpu(cmdBuf, "Path trace", GpuStage::PathTrace);
+    cmdBuf->commit();
+    profiler.record("Compute dispatch", encodeStart, Profiler::now());
+
+    MTL::Texture *display = _outputTexture;
+    if (_denoise) {
+        encodeStart = Profiler::now();
+        const auto denoiseBuf = _cmdQueue->commandBuffer();
+        display = encodeDenoise(denoiseBuf);
+        timeOnGpu(denoiseBuf, "Denoise", GpuStage::Denoise);
+        denoiseBuf->commit();
+        profiler.record("Denoise dispatch", encodeStart, Profiler::now());
+    }
 
+    encodeStart = Profiler::now();
+    const auto displayBuf = _cmdQueue->commandBuffer();
     const auto rpd = MTL::RenderPassDescriptor::renderPassDescriptor();
     const auto att = rpd->colorAttachments()->object(0);
     att->setTexture(drawable->texture());
     att->setLoadAction(MTL::LoadActionClear);
     att->setStoreAction(MTL::StoreActionStore);
 
-    const auto re = cmdBuf->renderCommandEncoder(rpd);
+    const auto re = displayBuf->renderCommandEncoder(rpd);
     re->setRenderPipelineState(_quadPipeline);
-    re->setFragmentTexture(_outputTexture, 0);
+    re->setFragmentTexture(display, 0);
     re->setFragmentSamplerState(_quadSampler, 0);
     // draw two triangles as a strip
     re->drawPrimitives(
@@ -181,25 +272,69 @@ void Renderer::draw(CA::MetalLayer *layer) {
         static_cast<NS::UInteger>(0),
         4
     );
+    profiler.record("Display pass", encodeStart, Profiler::now());
 
-
+    const uint64_t imguiStart = Profiler::now();
     ImGui_ImplMetal_NewFrame(rpd);
     ImGui::NewFrame();
 
     // Only show ImGui windows if the global toggle is enabled
     if (isImGuiWindowVisible()) {
-        ImGui::ShowDemoWindow();
+        drawProfiler();
+        ImGui::Begin("Rendering");
+        int sampler = static_cast<int>(_samplerType);
+        const char *samplers[] = {"LCG", "PCG", "Sobol (Owen)", "Blue noise (R2)"};
+        if (ImGui::Combo("Sampler", &sampler, samplers, IM_ARRAYSIZE(samplers))) {
+            _samplerType = static_cast<SamplerType>(sampler);
+            clearAccumulation();
+        }
+        // same image either way, so switching keeps the accumulation
+        ImGui::Checkbox("Wavefront pipeline", &_wavefront);
+        ImGui::Checkbox("Reproject on camera moves", &_reproject);
+        if (_reproject) {
+            auto maxHistory = static_cast<int>(_reprojection.maxHistory);
+            if (ImGui::SliderInt("History cap", &maxHistory, 1, 256)) _reprojection.maxHistory = maxHistory;
+        }
+        // display only, so none of these restart the accumulation
+        ImGui::Checkbox("Denoise", &_denoise);
+        if (_denoise) {
+            auto iterations = static_cast<int>(_denoiseSettings.iterations);
+            if (ImGui::SliderInt("Passes", &iterations, 1, 6)) _denoiseSettings.iterations = iterations;
+            ImGui::SliderFloat("Colour sigma", &_denoiseSettings.colorSigma, 0.5f, 16.0f);
+            ImGui::SliderFloat("Normal sigma", &_denoiseSettings.normalSigma, 0.05f, 1.0f);
+            ImGui::SliderFloat("Depth sigma", &_denoiseSettings.depthSigma, 0.01f, 1.0f);
+        }
+        ImGui::End();
+#ifdef PATHTRACER_TRAVERSAL_STATS
+        ImGui::Begin("Traversal stats");
+        ImGui::Text("%u frames accumulated", _frameIndex + 1);
+        if (ImGui::Button("Save heatmaps")) _saveRayStats = true;
+        ImGui::End();
+#endif
     }
 
     ImGui::Render();
     ImDrawData *draw_data = ImGui::GetDrawData();
 
-    ImGui_ImplMetal_RenderDrawData(draw_data, cmdBuf, re);
+    ImGui_ImplMetal_RenderDrawData(draw_data, displayBuf, re);
 
     re->endEncoding();
-
-    cmdBuf->presentDrawable(drawable);
-    cmdBuf->commit();
+    profiler.record("ImGui", imguiStart, Profiler::now());
+
+    timeOnGpu(displayBuf, "Display", GpuStage::Display);
+    displayBuf->presentDrawable(drawable);
+    displayBuf->commit();
+
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    if (_saveRayStats) {
+        // this frame's counts must have landed before the buffer is read
+        cmdBuf->waitUntilCompleted();
+        const auto *stats = static_cast<const RayStats *>(_rayStatsBuffer->contents());
+        printTraversalHistograms(stats, WINDOW_WIDTH * WINDOW_HEIGHT, 32); // MAX_STACK_DEPTH in kernel.metal
+        writeTraversalHeatmaps("traversal", stats, WINDOW_WIDTH, WINDOW_HEIGHT);
+        _saveRayStats = false;
+    }
+#endif
 
     _framesSinceLastFps++;
 
@@ -213,138 +348,246 @@ void Renderer::draw(CA::MetalLayer *layer) {
         _lastFpsTime = now;
     }
 
+    // without reprojection, frames during a move keep redrawing sample 0; with it
+    // they accumulate, so each needs new random numbers
     const bool inCooldown = (now - _move.lastInteraction) < std::chrono::milliseconds(100);
-    if (!inCooldown) {
+    if (!inCooldown || _reproject) {
         _frameIndex++;
+        _history = true;
     }
 }
 
-void Renderer::setupScene() {
-    objects.clear();
-    triangles.clear();
-    //
-    //  1) MATERIALS
-    //
-    //  idx 0: emissive “light panel”
-    //  idx 1: white diffuse (walls, floor, back)
-    //  idx 2: red diffuse
-    //  idx 3: green diffuse
-    //  idx 4: mirror
-    //  idx 5: glass (ior=1.5)
-    const std::vector<Material> mats = {
-        // albedo         emission        reflectivity  ior
-        {{0, 0, 0}, {15, 15, 15}, 0.0f, 1.0f}, // 0 light
-        {{0.8f, 0.8f, 0.8f}, {0, 0, 0}, 0.0f, 1.0f}, // 1 white
-        {{0.8f, 0.2f, 0.2f}, {0, 0, 0}, 0.0f, 1.0f}, // 2 red
-        {{0.2f, 0.8f, 0.2f}, {0, 0, 0}, 0.0f, 1.0f}, // 3 green
-        {{0.9f, 0.9f, 0.9f}, {0, 0, 0}, 1.0f, 1.0f}, // 4 mirror
-        {{1.0f, 1.0f, 1.0f}, {0, 0, 0}, 0.0f, 1.5f}, // 5 glass
-        {{0.2f, 0.2f, 0.8f}, {0, 0, 0}, 0.0f, 1.0f} // 6 blue
+void Renderer::timeOnGpu(MTL::CommandBuffer *cmdBuf, const char *name, GpuStage stage) {
+    const uint32_t track = _gpuTrack;
+    const std::shared_ptr<GpuTimes> times = _gpuTimes;
+    cmdBuf->addCompletedHandler([track, times, name, stage](MTL::CommandBuffer *done) {
+        const uint64_t start = profilerTime(done->GPUStartTime()), end = profilerTime(done->GPUEndTime());
+        Profiler::get().record(name, start, end, track);
+        const auto i = static_cast<size_t>(stage);
+        times->ms[i].store(static_cast<float>(end - start) * 1e-6f, std::memory_order_relaxed);
+        times->completed[i].fetch_add(1, std::memory_order_release);
+    });
+}
+
+void Renderer::drawProfiler() {
+    ImGui::Begin("Profiler");
+    const auto percentiles = [](const char *label, const RollingStats &stats) {
+        ImGui::Text("%-10s p50 %6.2f  p95 %6.2f  p99 %6.2f ms", label, stats.percentile(0.5f),
+                    stats.percentile(0.95f), stats.percentile(0.99f));
     };
-    _materialCount = static_cast<uint32_t>(mats.size());
+    percentiles("Frame", _frameTimes);
+    percentiles("GPU trace", _gpuFrameTimes);
+    ImGui::Text("over the last %zu frames", _frameTimes.size());
+    const GpuTimes &gpu = *_gpuTimes;
+    ImGui::Text("Last GPU: path trace %.2f ms, denoise %.2f ms, display %.2f ms",
+                gpu.ms[static_cast<size_t>(GpuStage::PathTrace)].load(std::memory_order_relaxed),
+                _denoise ? gpu.ms[static_cast<size_t>(GpuStage::Denoise)].load(std::memory_order_relaxed) : 0.0f,
+                gpu.ms[static_cast<size_t>(GpuStage::Display)].load(std::memory_order_relaxed));
+    if (ImGui::Button("Save trace")) {
+        // open in chrome://tracing or ui.perfetto.dev
+        if (Profiler::get().writeChromeTrace("trace.json")) std::cout << "Wrote trace.json\n";
+        else std::cerr << "Could not write trace.json\n";
+    }
+    ImGui::End();
+}
+
+void Renderer::encodeWavefront(MTL::ComputeCommandEncoder *encoder) {
+    constexpr uint32_t pathCount = WINDOW_WIDTH * WINDOW_HEIGHT;
+    constexpr uint32_t fields = 11; // WF_FIELDS in shaders/wavefront.metal
+    constexpr uint32_t maxBounces = 20; // MAX_BOUNCES in kernel.metal
+    constexpr uint32_t dielectricQueue = 2, surfaceQueue = 3, shadowQueue = 4;
+    if (!_wavefrontPaths) {
+        _wavefrontPaths = _device->newBuffer(sizeof(simd::float4) * fields * pathCount, MTL::ResourceStorageModePrivate);
+        _wavefrontQueues = _device->newBuffer(sizeof(uint32_t) * 5 * pathCount, MTL::ResourceStorageModePrivate);
+        _wavefrontControl = _device->newBuffer(sizeof(WavefrontControl), MTL::ResourceStorageModePrivate);
+    }
+    const uint32_t size[2] = {WINDOW_WIDTH, WINDOW_HEIGHT};
+    encoder->setBuffer(_wavefrontPaths, 0, 23);
+    encoder->setBuffer(_wavefrontQueues, 0, 24);
+    encoder->setBuffer(_wavefrontControl, 0, 25);
+    encoder->setBytes(size, sizeof(size), 27);
+
+    const MTL::Size pixelGroup(8, 8, 1);
+    const MTL::Size pixelGroups((WINDOW_WIDTH + 7) / 8, (WINDOW_HEIGHT + 7) / 8, 1);
+    const MTL::Size queueGroup(64, 1, 1); // WF_GROUP_SIZE
+    const MTL::Size one(1, 1, 1);
+    // dispatches run one after another, so each stage sees the previous one's queues
+    const auto overQueue = [&](MTL::ComputePipelineState *pipeline, uint32_t queue) {
+        encoder->setComputePipelineState(pipeline);
+        encoder->dispatchThreadgroups(_wavefrontControl, offsetof(WavefrontControl, args) + queue * sizeof(uint32_t) * 3,
+                                      queueGroup);
+    };
+    const auto once = [&](MTL::ComputePipelineState *pipeline) {
+        encoder->setComputePipelineState(pipeline);
+        encoder->dispatchThreadgroups(one, one);
+    };
+
+    encoder->setComputePipelineState(_wavefrontGenerate);
+    encoder->dispatchThreadgroups(pixelGroups, pixelGroup);
+    for (uint32_t bounce = 0; bounce < maxBounces; ++bounce) {
+        encoder->setBytes(&bounce, sizeof(bounce), 26);
+        once(_wavefrontQueueArgs);
+        overQueue(_wavefrontExtend, bounce % 2);
+        overQueue(_wavefrontClassify, bounce % 2);
+        once(_wavefrontQueueArgs);
+        overQueue(_wavefrontShadeDielectric, dielectricQueue);
+        overQueue(_wavefrontShadeSurface, surfaceQueue);
+        once(_wavefrontQueueArgs);
+        overQueue(_wavefrontConnect, shadowQueue);
+        once(_wavefrontNextBounce);
+    }
+    encoder->setComputePipelineState(_wavefrontAccumulate);
+    encoder->dispatchThreadgroups(pixelGroups, pixelGroup);
+}
+
+MTL::Texture *Renderer::encodeDenoise(MTL::CommandBuffer *cmdBuf) {
+    const MTL::Size threadsPerThreadgroup(8, 8, 1);
+    const MTL::Size threadgroups((WINDOW_WIDTH + 7) / 8, (WINDOW_HEIGHT + 7) / 8, 1);
+
+    // passes run in encoding order, each reading what the previous one wrote
+    const auto encoder = cmdBuf->computeCommandEncoder();
+    encoder->setComputePipelineState(_denoisePreparePipeline);
+    encoder->setTexture(_outputTexture, 0);
+    encoder->setTexture(_albedoTexture, 1);
+    encoder->setTexture(_denoiseTextures[0], 3);
+    encoder->dispatchThreadgroups(threadgroups, threadsPerThreadgroup);
+
+    encoder->setComputePipelineState(_denoisePipeline);
+    encoder->setTexture(_normalDepthTexture, 2);
+    uint32_t src = 0;
+    for (uint32_t i = 0; i < _denoiseSettings.iterations; ++i, src ^= 1) {
+        const DenoisePass pass{
+            1u << i, _denoiseSettings.colorSigma, _denoiseSettings.normalSigma, _denoiseSettings.depthSigma,
+            i + 1 == _denoiseSettings.iterations
+        };
+        encoder->setTexture(_denoiseTextures[src], 0);
+        encoder->setTexture(_denoiseTextures[src ^ 1], 3);
+        encoder->setBytes(&pass, sizeof(pass), 0);
+        encoder->dispatchThreadgroups(threadgroups, threadsPerThreadgroup);
+    }
+    encoder->endEncoding();
+    return _denoiseTextures[src];
+}
+
+void Renderer::setupScene() {
+    _scene.pool = &_pool;
+    _scene.cachePath = "scene.cache";
+    _scene.setupDefault();
+
+    _materialCount = static_cast<uint32_t>(_scene.materials.size());
     _materialBuffer = _device->newBuffer(
-        mats.size() * sizeof(Material),
+        _scene.materials.data(),
+        _scene.materials.size() * sizeof(Material),
         MTL::ResourceStorageModeShared
     );
-    memcpy(_materialBuffer->contents(), mats.data(), mats.size() * sizeof(Material));
-
-    //
-    //  2) GEOMETRY
-    //
-    //  a) Ceiling “light panel” as two triangles (mat 0)
-    constexpr float yL = 4.99f; // just below the ceiling
-    constexpr float x0 = -2.0f;
-    constexpr float x1 = 2.0f;
-    constexpr float z0 = -2.0f;
-    constexpr float z1 = -1.0f;
-    triangles.push_back({{x0, yL, z0}, {x1, yL, z0}, {x1, yL, z1}, 0});
-    triangles.push_back({{x1, yL, z1}, {x0, yL, z1}, {x0, yL, z0}, 0});
-
-    //  b) Spheres (mat 2:red, 4:mirror, 5:glass, 3:green)
-    // using Sph = Sphere;
-    // const std::vector<Sph> sphs = {
-    //     {{-0.6f, 0.25f, -0.1f}, 0.25f, 2}, // small red
-    //     {{0.0f, 0.25f, -0.2f}, 0.25f, 4}, // mirror
-    //     {{0.6f, 0.25f, -0.3f}, 0.25f, 5}, // glass
-    //     {{0.0f, 0.9f, -0.2f}, 0.25f, 3} // green
-    // };
-    // _sphereCount = static_cast<uint32_t>(sphs.size());
-    // _sphereBuffer = _device->newBuffer(
-    //     sphs.data(),
-    //     sphs.size() * sizeof(Sph),
-    //     MTL::ResourceStorageModeShared
-    // );
-
-    // Load teapot with blue material and center it on the floor
-    size_t teapotTriStart = triangles.size();
-    ObjLoader::loadObj("assets/teapot.obj", 4);
-    const simd::float3 bbMin = {-3.0f, 0.0f, -2.0f};
-    const simd::float3 bbMax = {3.43400002f, 3.1500001f, 2.0f};
-    const simd::float3 translation = {
-        -(bbMin.x + bbMax.x) * 0.5f,
-        -bbMin.y,
-        -(bbMin.z + bbMax.z) * 0.5f
-    };
-    size_t teapotTriEnd = triangles.size();
-    for (size_t i = teapotTriStart; i < teapotTriEnd; ++i) {
-        triangles[i].v0 += translation;
-        triangles[i].v1 += translation;
-        triangles[i].v2 += translation;
-    }
-    // ObjLoader::loadObj("assets/cube.obj", 0);
-
-    //  c) Walls & floor & back (infinite planes, mat 1)
-    using Pln = Plane;
-    const std::vector<Pln> plns = {
-        // normal         d        matIndex
-        {{0, 1, 0}, 0.0f, 2}, // floor y=0
-        {{0, -1, 0}, 5.0f, 1}, // ceiling y=2
-        {{1, 0, 0}, 5.0f, 1}, // left  x=-2
-        {{-1, 0, 0}, 5.0f, 1}, // right x= 2
-        {{0, 0, 1}, 4.0f, 1} // back  z=-3
-    };
-    _planeCount = static_cast<uint32_t>(plns.size());
+
+    _planeCount = static_cast<uint32_t>(_scene.planes.size());
     _planeBuffer = _device->newBuffer(
-        plns.data(),
-        plns.size() * sizeof(Pln),
+        _scene.planes.data(),
+        _scene.planes.size() * sizeof(ScenePlane),
         MTL::ResourceStorageModeShared
     );
 
-    std::vector<BVHNode> bvhNodes;
-    bvhNodes.reserve(triangles.size() * 2); // safe upper bound
-    std::vector<int> triIndices(triangles.size());
-    std::iota(triIndices.begin(), triIndices.end(), 0);
+    _sphereCount = static_cast<uint32_t>(_scene.spheres.size());
+    if (_sphereCount > 0) {
+        _sphereBuffer = _device->newBuffer(
+            _scene.spheres.data(),
+            _scene.spheres.size() * sizeof(SceneSphere),
+            MTL::ResourceStorageModeShared
+        );
+    }
 
-    BvhBuilder::buildBVH(0, (int) triangles.size(), triangles, bvhNodes, triIndices);
+    uploadBlas();
 
-    struct SceneTriangle {
-        simd::float3 v0, v1, v2;
-        uint matIndex;
-    };
-    std::vector<SceneTriangle> sceneTris;
-    sceneTris.reserve(triangles.size());
-    for (int triIndex: triIndices) {
-        const auto &T = triangles[triIndex];
-        sceneTris.emplace_back(T.v0, T.v1, T.v2, T.matIndex);
-    }
+    // sized for the worst case so moving objects never reallocates
+    const size_t maxInstances = std::max<size_t>(objects.size(), 1);
+    _instanceBuffer = _device->newBuffer(maxInstances * sizeof(SceneInstance), MTL::ResourceStorageModeShared);
+    _tlasNodeBuffer = _device->newBuffer((2 * maxInstances - 1) * sizeof(BVHNode), MTL::ResourceStorageModeShared);
+    uploadTlas();
+}
 
+void Renderer::uploadBlas() {
+    PROFILE_SCOPE("Buffer upload");
+    if (_vertexBuffer) _vertexBuffer->release();
+    _vertexBuffer = _device->newBuffer(
+        _scene.vertices.data(),
+        _scene.vertices.size() * sizeof(SceneVertex),
+        MTL::ResourceStorageModeShared
+    );
+
+    if (_triangleBuffer) _triangleBuffer->release();
     _triangleBuffer = _device->newBuffer(
-        sceneTris.data(),
-        sceneTris.size() * sizeof(SceneTriangle),
+        _scene.triangles.data(),
+        _scene.triangles.size() * sizeof(SceneTriangle),
         MTL::ResourceStorageModeShared
     );
-    _triangleCount = static_cast<uint32_t>(sceneTris.size());
+    _triangleCount = static_cast<uint32_t>(_scene.triangles.size());
 
+    if (_bvhNodeBuffer) _bvhNodeBuffer->release();
     _bvhNodeBuffer = _device->newBuffer(
-        bvhNodes.data(),
-        bvhNodes.size() * sizeof(BVHNode),
+        _scene.bvhNodes.data(),
+        _scene.bvhNodes.size() * sizeof(BVHNode),
         MTL::ResourceStorageModeShared
     );
-    _bvhNodeCount = static_cast<uint32_t>(bvhNodes.size());
+    _bvhNodeCount = static_cast<uint32_t>(_scene.bvhNodes.size());
+}
+
+void Renderer::uploadTlas() {
+    PROFILE_SCOPE("Buffer upload");
+    _instanceCount = static_cast<uint32_t>(_scene.instances.size());
+    memcpy(_instanceBuffer->contents(), _scene.instances.data(), _scene.instances.size() * sizeof(SceneInstance));
+    _tlasNodeCount = static_cast<uint32_t>(_scene.tlasNodes.size());
+    memcpy(_tlasNodeBuffer->contents(), _scene.tlasNodes.data(), _scene.tlasNodes.size() * sizeof(BVHNode));
+    // the light list is rebuilt with the TLAS; deforming a mesh can change how many
+    // of its emissive triangles are non-degenerate
+    const size_t lightBytes = std::max<size_t>(_scene.lights.size(), 1) * sizeof(SceneLight);
+    if (!_lightBuffer || _lightBuffer->length() < lightBytes) {
+        if (_lightBuffer) _lightBuffer->release();
+        _lightBuffer = _device->newBuffer(lightBytes, MTL::ResourceStorageModeShared);
+    }
+    _lightCount = static_cast<uint32_t>(_scene.lights.size());
+    memcpy(_lightBuffer->contents(), _scene.lights.data(), _scene.lights.size() * sizeof(SceneLight));
+}
+
+void Renderer::setObjectTransform(size_t index, const simd::float4x4 &transform) {
+    objects[index].transform = transform;
+    _scene.buildTlas();
+    uploadTlas();
+    clearAccumulation();
+}
+
+
+BvhUpdateResult Renderer::updateMesh(uint32_t mesh, const std::vector<uint32_t> &changedTriangles) {
+    const BvhUpdateResult result = _scene.updateMesh(mesh, changedTriangles);
+    if (_scene.bvhNodes.size() != _bvhNodeCount || _scene.triangles.size() != _triangleCount) {
+        // the mesh was re-laid out from scratch
+        uploadBlas();
+    } else {
+        const SceneMesh &m = _scene.meshes[mesh];
+        memcpy(static_cast<SceneVertex *>(_vertexBuffer->contents()) + m.firstVertex,
+               _scene.vertices.data() + m.firstVertex, m.vertexCount * sizeof(SceneVertex));
+        memcpy(static_cast<SceneTriangle *>(_triangleBuffer->contents()) + m.firstSlot,
+               _scene.triangles.data() + m.firstSlot, m.slotCount * sizeof(SceneTriangle));
+        memcpy(static_cast<BVHNode *>(_bvhNodeBuffer->contents()) + m.rootNode,
+               _scene.bvhNodes.data() + m.rootNode, m.nodeCount * sizeof(BVHNode));
+    }
+    uploadTlas();
+    clearAccumulation();
+    return result;
 }
 
 
 void Renderer::clearAccumulation() {
     // reset our sample counter
     _frameIndex = 0;
+    _history = false;
+}
+
+void Renderer::startReprojection() {
+    // path_trace fills the live set from scratch, then reproject merges the history in;
+    // _frameIndex keeps counting so the samples stay independent
+    std::swap(_outputTexture, _historyTextures[0]);
+    std::swap(_albedoTexture, _historyTextures[1]);
+    std::swap(_normalDepthTexture, _historyTextures[2]);
+    _history = false;
 }
@@ -1,10 +1,45 @@
 #pragma once
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <Metal/Metal.hpp>
 #include <QuartzCore/QuartzCore.hpp>
-#include <simd/vector_types.h>
+#include "Math/Simd.h"
 
+#include "Camera.h"
 #include "MovementHandler.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "Cpu/Denoiser.h"
+#include "Cpu/Sampler.h"
+
+// Queue lengths and indirect dispatch arguments of the wavefront kernels; matches
+// WavefrontControl in shaders/wavefront.metal.
+struct WavefrontControl {
+    uint32_t count[5];
+    uint32_t args[5][3];
+};
+
+// Arguments of the reproject kernel; matches Reprojection in shaders/types.metal.
+struct Reprojection {
+    Camera current;
+    Camera previous;
+    uint32_t maxHistory = 32; // samples a pixel may carry over, so old lighting fades
+    float depthTolerance = 0.05f; // relative
+    float normalTolerance = 0.8f; // minimum cosine
+};
+
+// Stages of a frame that run as command buffers of their own, so each gets GPU
+// start and end times.
+enum class GpuStage : uint32_t { PathTrace, Denoise, Display, Count };
+
+// GPU time of the most recently completed command buffer of each stage, written by
+// completion handlers; shared so handlers that run after the renderer is gone are harmless.
+struct GpuTimes {
+    std::atomic<float> ms[static_cast<size_t>(GpuStage::Count)]{};
+    std::atomic<uint64_t> completed[static_cast<size_t>(GpuStage::Count)]{};
+};
 
 class Renderer {
 public:
@@ -14,17 +49,44 @@ public:
 
     void resetCamera();
 
+    // Move `objects[index]`; only the top-level BVH is rebuilt and re-uploaded.
+    void setObjectTransform(size_t index, const simd::float4x4 &transform);
+
+    // Re-read moved vertices of `changedTriangles` (global triangle indices) in
+    // `_scene.meshes[mesh]`. The BLAS is refitted or partially rebuilt and only the
+    // mesh's triangle and node ranges are re-uploaded.
+    BvhUpdateResult updateMesh(uint32_t mesh, const std::vector<uint32_t> &changedTriangles);
+
     MovementHandler &movement() { return _move; }
 
 private:
     MTL::Device *_device;
     MTL::CommandQueue *_cmdQueue;
     MTL::Texture *_outputTexture{};
+    MTL::Texture *_albedoTexture{}; // first-hit AOVs accumulated by path_trace
+    MTL::Texture *_normalDepthTexture{};
+    MTL::Texture *_denoiseTextures[2]{}; // ping-pong targets of the filter passes
+    // accumulation, albedo and normal/depth of the last camera, swapped with the
+    // live ones whenever it moves
+    MTL::Texture *_historyTextures[3]{};
     MTL::ComputePipelineState *_computePipeline{};
+    MTL::ComputePipelineState *_denoisePreparePipeline{};
+    MTL::ComputePipelineState *_denoisePipeline{};
+    MTL::ComputePipelineState *_reprojectPipeline{};
+    MTL::ComputePipelineState *_wavefrontGenerate{};
+    MTL::ComputePipelineState *_wavefrontQueueArgs{};
+    MTL::ComputePipelineState *_wavefrontExtend{};
+    MTL::ComputePipelineState *_wavefrontClassify{};
+    MTL::ComputePipelineState *_wavefrontShadeDielectric{};
+    MTL::ComputePipelineState *_wavefrontShadeSurface{};
+    MTL::ComputePipelineState *_wavefrontConnect{};
+    MTL::ComputePipelineState *_wavefrontNextBounce{};
+    MTL::ComputePipelineState *_wavefrontAccumulate{};
     MTL::RenderPipelineState *_quadPipeline{};
     MTL::SamplerState *_quadSampler{};
 
 
+    MTL::Buffer *_vertexBuffer{};
     MTL::Buffer *_triangleBuffer{};
     uint32_t _triangleCount{};
     MTL::Buffer *_planeBuffer{};
@@ -35,6 +97,31 @@ private:
     uint32_t _materialCount{};
     MTL::Buffer *_bvhNodeBuffer{};
     uint32_t _bvhNodeCount{};
+    MTL::Buffer *_instanceBuffer{};
+    uint32_t _instanceCount{};
+    MTL::Buffer *_tlasNodeBuffer{};
+    uint32_t _tlasNodeCount{};
+    MTL::Buffer *_lightBuffer{};
+    uint32_t _lightCount{};
+    SamplerType _samplerType = SamplerType::Sobol; // bound as a uint, see shaders/sampler.metal
+    bool _denoise = false; // filters only what is displayed, never the accumulation
+    bool _wavefront = false; // stage kernels instead of path_trace, same image
+    // wavefront path state, queues and WavefrontControl, allocated on first use
+    MTL::Buffer *_wavefrontPaths{};
+    MTL::Buffer *_wavefrontQueues{};
+    MTL::Buffer *_wavefrontControl{};
+    DenoiseSettings _denoiseSettings;
+    bool _reproject = true; // carry samples across camera moves instead of restarting
+    Reprojection _reprojection;
+    Camera _camera{}; // of the last frame drawn
+    bool _history = false; // whether the textures hold samples for _camera
+#ifdef PATHTRACER_TRAVERSAL_STATS
+    MTL::Buffer *_rayStatsBuffer{}; // RayStats per pixel
+    bool _saveRayStats = false;
+#endif
+
+    ThreadPool _pool;
+    Scene _scene;
 
     std::vector<MTL::Texture *> _textures;
 
@@ -46,10 +133,30 @@ private:
 
     void setupOutputTexture();
 
+    // Encode one sample per pixel through the wavefront kernels, on an encoder that
+    // already has path_trace's bindings.
+    void encodeWavefront(MTL::ComputeCommandEncoder *encoder);
+
+    // Encode the denoise passes; returns the texture holding the result.
+    MTL::Texture *encodeDenoise(MTL::CommandBuffer *cmdBuf);
+
     void setupScene();
 
+    void uploadTlas();
+
+    void uploadBlas();
+
     void clearAccumulation();
 
+    // Record `cmdBuf`'s execution on the GPU track once it has completed.
+    void timeOnGpu(MTL::CommandBuffer *cmdBuf, const char *name, GpuStage stage);
+
+    // The "Profiler" window.
+    void drawProfiler();
+
+    // Swap the live textures into history before drawing from a moved camera.
+    void startReprojection();
+
     simd::float3 _camPos = {0, 1, 3};
     float _yaw = 0.0f; // in radians
     float _pitch = 0.0f;
@@ -61,4 +168,11 @@ private:
 
     std::chrono::high_resolution_clock::time_point _lastFpsTime;
     uint32_t _framesSinceLastFps = 0;
+
+    uint32_t _gpuTrack = 0; // Profiler track of the command buffers
+    std::shared_ptr<GpuTimes> _gpuTimes = std::make_shared<GpuTimes>();
+    uint64_t _gpuFramesSeen = 0; // path trace buffers already in _gpuFrameTimes
+    uint64_t _lastFrameStart = 0; // Profiler::now() when the previous draw began
+    RollingStats _frameTimes; // ms between draws
+    RollingStats _gpuFrameTimes; // ms of the path trace command buffer
 };
@@ -0,0 +1,439 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+#include "Object.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "SceneCache.h"
+#include "Bvh/BvhRefit.h"
+#include "Math/Transform.h"
+
+namespace {
+    // Corners of a global triangle by value, as the BVH builders take them.
+    Triangle expand(const SceneTriangle &T) {
+        return {vertices[T.v0], vertices[T.v1], vertices[T.v2], T.matIndex};
+    }
+}
+
+void Scene::setupDefault() {
+    setupRoom();
+
+    // Load teapot with blue material and center it on the floor
+    const simd::float3 bbMin = {-3.0f, 0.0f, -2.0f};
+    const simd::float3 bbMax = {3.43400002f, 3.1500001f, 2.0f};
+    const simd::float3 translation = {
+        -(bbMin.x + bbMax.x) * 0.5f,
+        -bbMin.y,
+        -(bbMin.z + bbMax.z) * 0.5f
+    };
+    const std::vector<MeshSource> sources = {
+        {"assets/teapot.obj", 4, makeTranslation(translation)},
+        // {"assets/cube.obj", 0},
+    };
+    loadMeshes(sources);
+}
+
+const AABB Scene::kSubjectBounds = {{-2.0f, 0.0f, -2.0f}, {2.0f, 3.0f, 1.5f}};
+
+bool Scene::setupObj(const std::string &path, uint32_t materialIndex) {
+    ObjData data;
+    if (!ObjLoader::parseObj(path, data) || data.positions.empty()) return false;
+    AABB b;
+    for (const simd::float3 &p: data.positions) b.grow(p);
+    const simd::float3 e = b.extent(), room = kSubjectBounds.extent();
+    const float s = std::min({room.x / e.x, room.y / e.y, room.z / e.z});
+    const simd::float3 c = kSubjectBounds.center();
+    const simd::float3 offset = {c.x - b.center().x * s, kSubjectBounds.bmin.y - b.bmin.y * s,
+                                 c.z - b.center().z * s};
+
+    setupRoom();
+    loadMeshes({{path, materialIndex, simd_mul(makeTranslation(offset), makeScale(s))}});
+    return true;
+}
+
+void Scene::setupRoom() {
+    objects.clear();
+    ::vertices.clear();
+    ::triangles.clear();
+    //
+    //  1) MATERIALS
+    //
+    //  idx 0: emissive “light panel”
+    //  idx 1: white diffuse (walls, floor, back)
+    //  idx 2: red diffuse
+    //  idx 3: green diffuse
+    //  idx 4: mirror
+    //  idx 5: glass (ior=1.5)
+    materials = {
+        // albedo         emission        reflectivity  ior
+        {{0, 0, 0}, {15, 15, 15}, 0.0f, 1.0f}, // 0 light
+        {{0.8f, 0.8f, 0.8f}, {0, 0, 0}, 0.0f, 1.0f}, // 1 white
+        {{0.8f, 0.2f, 0.2f}, {0, 0, 0}, 0.0f, 1.0f}, // 2 red
+        {{0.2f, 0.8f, 0.2f}, {0, 0, 0}, 0.0f, 1.0f}, // 3 green
+        {{0.9f, 0.9f, 0.9f}, {0, 0, 0}, 1.0f, 1.0f}, // 4 mirror
+        {{1.0f, 1.0f, 1.0f}, {0, 0, 0}, 0.0f, 1.5f}, // 5 glass
+        {{0.2f, 0.2f, 0.8f}, {0, 0, 0}, 0.0f, 1.0f} // 6 blue
+    };
+
+    //
+    //  2) GEOMETRY
+    //
+    //  a) Ceiling “light panel” as two triangles (mat 0)
+    constexpr float yL = 4.99f; // just below the ceiling
+    constexpr float x0 = -2.0f;
+    constexpr float x1 = 2.0f;
+    constexpr float z0 = -2.0f;
+    constexpr float z1 = -1.0f;
+    Object light;
+    light.firstTriangle = static_cast<uint32_t>(::triangles.size());
+    light.triCount = 2;
+    light.materialIndex = 0;
+    const uint32_t v = static_cast<uint32_t>(::vertices.size());
+    ::vertices.insert(::vertices.end(), {{x0, yL, z0}, {x1, yL, z0}, {x1, yL, z1}, {x0, yL, z1}});
+    ::triangles.push_back({v, v + 1, v + 2, 0});
+    ::triangles.push_back({v + 2, v + 3, v, 0});
+    objects.push_back(light);
+
+    //  b) Spheres (mat 2:red, 4:mirror, 5:glass, 3:green)
+    // spheres = {
+    //     {{-0.6f, 0.25f, -0.1f}, 0.25f, 2}, // small red
+    //     {{0.0f, 0.25f, -0.2f}, 0.25f, 4}, // mirror
+    //     {{0.6f, 0.25f, -0.3f}, 0.25f, 5}, // glass
+    //     {{0.0f, 0.9f, -0.2f}, 0.25f, 3} // green
+    // };
+
+    //  c) Walls & floor & back (infinite planes, mat 1)
+    planes = {
+        // normal         d        matIndex
+        {{0, 1, 0}, 0.0f, 2}, // floor y=0
+        {{0, -1, 0}, 5.0f, 1}, // ceiling y=2
+        {{1, 0, 0}, 5.0f, 1}, // left  x=-2
+        {{-1, 0, 0}, 5.0f, 1}, // right x= 2
+        {{0, 0, 1}, 4.0f, 1} // back  z=-3
+    };
+}
+
+void Scene::loadMeshes(const std::vector<MeshSource> &sources) {
+    PROFILE_SCOPE("Scene load");
+    const uint64_t hash = cachePath.empty() ? 0 : SceneCache::contentHash(*this, sources);
+    if (!cachePath.empty() && SceneCache::load(cachePath, hash, *this)) return;
+
+    for (const MeshSource &src: sources) {
+        ObjLoader::loadObj(src.path, src.materialIndex, src.transform, pool);
+    }
+    buildAccel();
+
+    if (!cachePath.empty()) SceneCache::save(cachePath, hash, *this);
+}
+
+void Scene::buildAccel() {
+    PROFILE_SCOPE("BVH build");
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // one mesh per distinct triangle range
+    meshes.clear();
+    _objectMesh.clear();
+    for (const Object &obj: objects) {
+        uint32_t mesh = 0;
+        while (mesh < meshes.size() &&
+               (meshes[mesh].firstTriangle != obj.firstTriangle || meshes[mesh].triCount != obj.triCount)) {
+            ++mesh;
+        }
+        if (mesh == meshes.size()) {
+            meshes.push_back({obj.firstTriangle, obj.triCount, 0, 0, 0, 0, 0, 0, 0.0f});
+        }
+        _objectMesh.push_back(mesh);
+    }
+
+    vertices.resize(::vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) vertices[i] = SceneVertex::of(::vertices[i]);
+
+    std::vector<std::vector<BVHNode>> meshNodes(meshes.size());
+    std::vector<std::vector<int>> leafOrder(meshes.size());
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        SceneMesh &mesh = meshes[m];
+        std::vector<Triangle> meshTris(mesh.triCount);
+        uint32_t lo = UINT32_MAX, hi = 0;
+        for (uint32_t i = 0; i < mesh.triCount; ++i) {
+            const SceneTriangle &T = ::triangles[mesh.firstTriangle + i];
+            meshTris[i] = expand(T);
+            lo = std::min({lo, T.v0, T.v1, T.v2});
+            hi = std::max({hi, T.v0, T.v1, T.v2});
+        }
+        mesh.firstVertex = mesh.triCount > 0 ? lo : 0;
+        mesh.vertexCount = mesh.triCount > 0 ? hi - lo + 1 : 0;
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<BVHNode> &nodes = meshNodes[m];
+        std::vector<int> &triIndices = leafOrder[m];
+        BvhBuilder::build(bvhMode, meshTris, nodes, triIndices, pool, sbvh);
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        mesh.builtSahCost = BvhBuilder::sahCost(nodes);
+        std::cout << "Built BLAS " << m << " (" << bvhBuildModeName(bvhMode) << ", "
+                << (pool ? pool->size() : 1) << " threads): "
+                << nodes.size() << " nodes, depth " << BvhBuilder::depth(nodes)
+                << ", SAH cost " << mesh.builtSahCost;
+        if (triIndices.size() > mesh.triCount) {
+            std::cout << ", " << triIndices.size() - mesh.triCount << " duplicated references";
+        }
+        std::cout << " in " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+
+        if (bvhOptimize.enabled) {
+            PROFILE_SCOPE("BVH optimise");
+            const BvhOptimizeStats stats = BvhOptimizer::optimize(nodes, triIndices, bvhOptimize, pool);
+            mesh.builtSahCost = stats.costAfter;
+            std::cout << "Optimised BLAS " << m << ": SAH cost " << stats.costBefore << " -> " << stats.costAfter
+                    << " in " << stats.passes << " passes, " << stats.ms << " ms\n";
+        }
+        if (const int collapsed = BvhBuilder::limitDepth(nodes, kMaxBvhDepth)) {
+            mesh.builtSahCost = BvhBuilder::sahCost(nodes);
+            std::cout << "Collapsed " << collapsed << " subtrees of BLAS " << m << " at depth " << kMaxBvhDepth
+                    << "\n";
+        }
+    }
+
+    // lay the slots out in global triangle order, each mesh's references in leaf
+    // order where its range starts; triangles outside every mesh keep one slot each
+    std::vector<int> meshAt(::triangles.size(), -1);
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        if (meshes[m].triCount > 0) meshAt[meshes[m].firstTriangle] = static_cast<int>(m);
+    }
+    triangles.clear();
+    _slotTriangle.clear();
+    for (uint32_t g = 0; g < ::triangles.size();) {
+        if (meshAt[g] < 0) {
+            triangles.push_back(::triangles[g]);
+            _slotTriangle.push_back(g++);
+            continue;
+        }
+        SceneMesh &mesh = meshes[meshAt[g]];
+        const std::vector<int> &order = leafOrder[meshAt[g]];
+        mesh.firstSlot = static_cast<uint32_t>(triangles.size());
+        mesh.slotCount = static_cast<uint32_t>(order.size());
+        for (const int i: order) {
+            triangles.push_back(::triangles[mesh.firstTriangle + i]);
+            _slotTriangle.push_back(mesh.firstTriangle + i);
+        }
+        g += mesh.triCount;
+    }
+
+    // make node indices absolute
+    bvhNodes.clear();
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        SceneMesh &mesh = meshes[m];
+        std::vector<BVHNode> &nodes = meshNodes[m];
+        mesh.rootNode = static_cast<uint32_t>(bvhNodes.size());
+        mesh.nodeCount = static_cast<uint32_t>(nodes.size());
+        for (BVHNode &n: nodes) {
+            if (n.count > 0) {
+                n.leftFirst += mesh.firstSlot;
+            } else {
+                n.leftFirst += mesh.rootNode;
+                n.rightFirst += mesh.rootNode;
+            }
+        }
+        bvhNodes.insert(bvhNodes.end(), nodes.begin(), nodes.end());
+    }
+
+    buildUpdateTables();
+    buildTlas();
+    buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Scene::buildUpdateTables() {
+    _triangleSlot.assign(::triangles.size(), 0);
+    for (uint32_t slot = 0; slot < _slotTriangle.size(); ++slot) _triangleSlot[_slotTriangle[slot]] = slot;
+
+    _bvhParents.assign(bvhNodes.size(), -1);
+    _slotLeaf.assign(triangles.size(), 0);
+    for (const SceneMesh &mesh: meshes) {
+        if (mesh.nodeCount == 0) continue;
+        BvhRefit::computeParents(bvhNodes, mesh.rootNode, _bvhParents);
+        BvhRefit::computeTriangleLeaves(bvhNodes, mesh.rootNode, _slotLeaf);
+    }
+}
+
+void Scene::buildTlas() {
+    PROFILE_SCOPE("TLAS build");
+    instances.clear();
+    tlasNodes.clear();
+
+    std::vector<SahBuilder::PrimRef> refs;
+    std::vector<SceneInstance> unordered;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const SceneMesh &mesh = meshes[_objectMesh[i]];
+        if (mesh.nodeCount == 0) continue;
+        const BVHNode &root = bvhNodes[mesh.rootNode];
+        SahBuilder::PrimRef ref;
+        ref.bounds = AABB{root.bboxMin, root.bboxMax}.transformed(objects[i].transform);
+        ref.centroid = ref.bounds.center();
+        refs.push_back(ref);
+        unordered.push_back({simd_inverse(objects[i].transform), mesh.rootNode});
+    }
+
+    std::vector<int> order(refs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    SahSettings settings;
+    settings.maxLeafSize = 2;
+    SahBuilder::build(refs, tlasNodes, order, settings, pool);
+    BvhBuilder::limitDepth(tlasNodes, kMaxBvhDepth);
+
+    for (int i: order) instances.push_back(unordered[i]);
+    buildLights();
+}
+
+void Scene::buildLights() {
+    lights.clear();
+    std::vector<float> power;
+    for (const Object &obj: objects) {
+        for (uint32_t i = 0; i < obj.triCount; ++i) {
+            const SceneTriangle &T = ::triangles[obj.firstTriangle + i];
+            const float emitted = luminance(materials[T.matIndex].emission);
+            if (emitted <= 0.0f) continue;
+            const simd::float3 v0 = transformPoint(obj.transform, ::vertices[T.v0]);
+            const simd::float3 e1 = transformPoint(obj.transform, ::vertices[T.v1]) - v0;
+            const simd::float3 e2 = transformPoint(obj.transform, ::vertices[T.v2]) - v0;
+            const float area = 0.5f * simd::length(simd::cross(e1, e2));
+            if (area <= 0.0f) continue;
+            lights.push_back({SceneVertex::of(v0), SceneVertex::of(e1), SceneVertex::of(e2), T.matIndex, 1.0f, 0});
+            power.push_back(area * emitted);
+        }
+    }
+    lightPower = std::accumulate(power.begin(), power.end(), 0.0f);
+    if (lights.empty()) return;
+
+    // Vose's alias method: scale to a mean of 1, then pair every under-full entry
+    // with an over-full one that tops it up
+    const float scale = static_cast<float>(lights.size()) / lightPower;
+    std::vector<uint32_t> small, large;
+    for (uint32_t i = 0; i < lights.size(); ++i) {
+        power[i] *= scale;
+        (power[i] < 1.0f ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        const uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+        lights[s].prob = power[s];
+        lights[s].alias = l;
+        power[l] -= 1.0f - power[s];
+        if (power[l] < 1.0f) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // whatever is left is full up to rounding
+    for (const uint32_t i: small) lights[i].prob = 1.0f;
+    for (const uint32_t i: large) lights[i].prob = 1.0f;
+}
+
+BvhUpdateResult Scene::updateMesh(uint32_t mesh, const std::vector<uint32_t> &changedTriangles) {
+    PROFILE_SCOPE("BVH update");
+    const SceneMesh &m = meshes[mesh];
+
+    // 1) copy the moved triangles and their vertices and refit the dirty paths
+    std::vector<uint32_t> dirtyLeaves;
+    dirtyLeaves.reserve(changedTriangles.size());
+    const auto refresh = [&](uint32_t slot) {
+        triangles[slot] = ::triangles[_slotTriangle[slot]];
+        dirtyLeaves.push_back(_slotLeaf[slot]);
+    };
+    const bool duplicated = m.slotCount != m.triCount;
+    for (uint32_t g: changedTriangles) {
+        const SceneTriangle &T = ::triangles[g];
+        for (uint32_t v: {T.v0, T.v1, T.v2}) vertices[v] = SceneVertex::of(::vertices[v]);
+        if (!duplicated) refresh(_triangleSlot[g]);
+    }
+    if (duplicated) {
+        // an SBVH references some triangles from several leaves
+        std::vector<uint8_t> changed(m.triCount, 0);
+        for (uint32_t g: changedTriangles) changed[g - m.firstTriangle] = 1;
+        for (uint32_t slot = m.firstSlot; slot < m.firstSlot + m.slotCount; ++slot) {
+            if (changed[_slotTriangle[slot] - m.firstTriangle]) refresh(slot);
+        }
+    }
+    std::vector<uint8_t> marked(bvhNodes.size(), 0);
+    BvhRefit::refit(bvhNodes, triangles, vertices, BvhRefit::collectDirty(_bvhParents, dirtyLeaves, marked));
+
+    // 2) quality monitor: refitted boxes overlap more and more as geometry deforms
+    const float limit = m.builtSahCost * refitRebuildThreshold;
+    if (BvhBuilder::sahCost(bvhNodes, m.rootNode) <= limit) {
+        buildTlas();
+        return BvhUpdateResult::Refit;
+    }
+
+    // 3) rebuild just the subtree that holds every change, if that is enough
+    const uint32_t dirtyRoot = BvhRefit::dirtyRoot(bvhNodes, marked, m.rootNode);
+    if (dirtyRoot != m.rootNode && rebuildSubtree(dirtyRoot) &&
+        BvhBuilder::sahCost(bvhNodes, m.rootNode) <= limit) {
+        buildTlas();
+        return BvhUpdateResult::PartialRebuild;
+    }
+
+    // 4) whole mesh, in place when the new tree fits, otherwise re-lay out everything;
+    // an SBVH always starts over, since its duplicates need fresh slots
+    if (bvhMode != BvhBuildMode::Sbvh && rebuildSubtree(m.rootNode)) {
+        meshes[mesh].builtSahCost = BvhBuilder::sahCost(bvhNodes, m.rootNode);
+        buildTlas();
+    } else {
+        buildAccel();
+    }
+    return BvhUpdateResult::FullRebuild;
+}
+
+bool Scene::rebuildSubtree(uint32_t root) {
+    uint32_t first, count, span;
+    BvhRefit::subtreeExtent(bvhNodes, root, first, count, span);
+
+    std::vector<Triangle> subTris(count);
+    for (uint32_t i = 0; i < count; ++i) subTris[i] = expand(::triangles[_slotTriangle[first + i]]);
+
+    // the slots are fixed, so an SBVH's subtrees are rebuilt with object splits only
+    std::vector<BVHNode> nodes;
+    std::vector<int> triIndices;
+    BvhBuilder::build(bvhMode == BvhBuildMode::Sbvh ? BvhBuildMode::BinnedSah : bvhMode, subTris, nodes, triIndices,
+                      pool);
+    if (bvhOptimize.enabled) BvhOptimizer::optimize(nodes, triIndices, bvhOptimize, pool);
+    // the whole BLAS must stay within kMaxBvhDepth
+    int level = 1;
+    for (int p = _bvhParents[root]; p >= 0; p = _bvhParents[p]) ++level;
+    BvhBuilder::limitDepth(nodes, kMaxBvhDepth - level + 1);
+    if (nodes.size() > span) return false;
+
+    // reorder the slots to the new leaf order
+    const std::vector<uint32_t> oldSlots(_slotTriangle.begin() + first, _slotTriangle.begin() + first + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t g = oldSlots[triIndices[i]];
+        triangles[first + i] = ::triangles[g];
+        _slotTriangle[first + i] = g;
+        _triangleSlot[g] = first + i;
+    }
+
+    // the subtree keeps its root slot, so the parent link stays valid; unused
+    // trailing slots of the old span become unreachable
+    for (BVHNode &n: nodes) {
+        if (n.count > 0) {
+            n.leftFirst += first;
+        } else {
+            n.leftFirst += root;
+            n.rightFirst += root;
+        }
+    }
+    std::copy(nodes.begin(), nodes.end(), bvhNodes.begin() + root);
+    const int parent = _bvhParents[root];
+    BvhRefit::computeParents(bvhNodes, root, _bvhParents);
+    _bvhParents[root] = parent;
+    BvhRefit::computeTriangleLeaves(bvhNodes, root, _slotLeaf);
+
+    // the new root box may differ from the refitted one; propagate it upwards
+    if (parent >= 0) {
+        std::vector<uint8_t> marked(bvhNodes.size(), 0);
+        BvhRefit::refit(bvhNodes, triangles, vertices,
+                        BvhRefit::collectDirty(_bvhParents, {static_cast<uint32_t>(parent)}, marked));
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Material.h"
+#include "Bvh/BvhBuilder.h"
+#include "Bvh/BvhNode.h"
+#include "ThreadPool.h"
+#include "Primitives/Primitives.h"
+
+// A bottom-level BVH: one triangle range and the nodes built over it.
+struct SceneMesh {
+    uint32_t firstTriangle; // into the global `triangles`
+    uint32_t triCount;
+    uint32_t firstSlot; // into Scene::triangles, where its leaves' references start
+    uint32_t slotCount; // triCount, plus the references an SBVH duplicated
+    uint32_t firstVertex; // into Scene::vertices, the range its triangles index
+    uint32_t vertexCount;
+    uint32_t rootNode; // into Scene::bvhNodes
+    uint32_t nodeCount;
+    float builtSahCost; // SAH cost right after the last (re)build, the refit baseline
+};
+
+// An OBJ file placed in the scene.
+struct MeshSource {
+    std::string path;
+    uint32_t materialIndex;
+    simd::float4x4 transform = matrix_identity_float4x4;
+};
+
+// What Scene::updateMesh had to do to keep a mesh's BLAS valid.
+enum class BvhUpdateResult {
+    Refit, // boxes updated in place, topology kept
+    PartialRebuild, // the subtree over the changed triangles was rebuilt in place
+    FullRebuild // the whole BLAS was rebuilt; node count may have changed
+};
+
+// Everything path_trace reads, in the layout it reads it. Filled on the CPU and then
+// either uploaded to Metal buffers (Renderer) or traced directly (CpuRenderer).
+//
+// Geometry is two-level: every distinct triangle range referenced by `objects` gets
+// one BLAS in `bvhNodes` (child and leaf indices are absolute), and a TLAS over the
+// objects' world bounds selects which instances a ray visits.
+struct Scene {
+    std::vector<Material> materials;
+    std::vector<SceneVertex> vertices; // the global `vertices`, packed; shared by all triangles
+    // Leaf references: each mesh's triangles in its BLAS leaf order, at the mesh's
+    // slots. Meshes follow the global triangle order; with an SBVH a triangle may
+    // have several slots, which costs only the 16-byte reference, never vertices.
+    std::vector<SceneTriangle> triangles;
+    std::vector<ScenePlane> planes;
+    std::vector<SceneSphere> spheres;
+    std::vector<BVHNode> bvhNodes; // all BLAS
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneInstance> instances; // in TLAS leaf order
+    std::vector<BVHNode> tlasNodes;
+    std::vector<SceneLight> lights; // every instance's emissive triangles
+    float lightPower = 0.0f; // sum of area * luminance(emission) over `lights`
+
+    BvhBuildMode bvhMode = BvhBuildMode::BinnedSah;
+    SbvhSettings sbvh; // when bvhMode is Sbvh
+    BvhOptimizeSettings bvhOptimize; // run after every BLAS build when enabled
+    ThreadPool *pool = nullptr; // BVH builds run here when set
+    // refit until the SAH cost grows past this factor of builtSahCost, then rebuild
+    float refitRebuildThreshold = 1.5f;
+    // binary cache of the loaded meshes and built BVHs (see SceneCache); off when empty
+    std::string cachePath;
+    // wall time of the last buildAccel, in milliseconds
+    double buildMs = 0.0;
+
+    // Where meshes other than the teapot are placed: on the floor, inside the room.
+    static const AABB kSubjectBounds;
+
+    // Cornell-style box with a ceiling light and the teapot on the floor.
+    void setupDefault();
+
+    // The box, its materials and the ceiling light, without any meshes. Follow with
+    // loadMeshes (or buildAccel once other geometry has been added).
+    void setupRoom();
+
+    // The room with the OBJ at `path` scaled to stand on the floor inside
+    // kSubjectBounds. False if the file has no geometry.
+    bool setupObj(const std::string &path, uint32_t materialIndex);
+
+    // Load `sources` into the global `objects`/`vertices`/`triangles` and build the BVHs, or
+    // take all of it from `cachePath` when that was written for the same inputs.
+    void loadMeshes(const std::vector<MeshSource> &sources);
+
+    // Build one BLAS per distinct mesh in the global `objects`, then the TLAS.
+    void buildAccel();
+
+    // Rebuild only the TLAS and the light list, e.g. after an object's transform changed.
+    void buildTlas();
+
+    // Collect the emissive triangles of all objects into `lights`, in world space.
+    void buildLights();
+
+    // Pick up moved vertices of `changedTriangles` (indices into the global
+    // `triangles`, all inside `meshes[mesh]`). Vertices are shared, so the list must
+    // hold every triangle that uses a moved vertex. The BLAS is refitted bottom-up along
+    // the changed leaves only; when that degrades its SAH cost past
+    // refitRebuildThreshold, the smallest subtree covering the changes is rebuilt,
+    // and failing that the whole mesh. The TLAS is rebuilt afterwards.
+    BvhUpdateResult updateMesh(uint32_t mesh, const std::vector<uint32_t> &changedTriangles);
+
+private:
+    friend class SceneCache;
+
+    // Derive the lookup tables updateMesh needs from `bvhNodes` and `meshes`.
+    void buildUpdateTables();
+
+    // Rebuild the BLAS subtree under `root` in place. False if the new tree needs
+    // more nodes than the old one occupied.
+    bool rebuildSubtree(uint32_t root);
+
+    std::vector<uint32_t> _objectMesh; // mesh index of every entry in `objects`
+    std::vector<uint32_t> _triangleSlot; // global triangle -> index into `triangles` (one of them, for SBVH meshes)
+    std::vector<uint32_t> _slotTriangle; // global triangle of every entry in `triangles`
+    std::vector<uint32_t> _slotLeaf; // leaf node holding each entry of `triangles`
+    std::vector<int> _bvhParents; // parent of every node in `bvhNodes`, -1 for roots
+};
+
+
+#endif //SCENE_H
@@ -0,0 +1,366 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "Object.h"
+#include "Profiler.h"
+
+namespace {
+    constexpr char kMagic[8] = {'P', 'T', 'S', 'C', 'A', 'C', 'H', 'E'};
+
+    enum SectionId : uint32_t {
+        kMaterials = 1,
+        kTriangles, // Scene::triangles, leaf order
+        kTriangleOrder, // global triangle index of every Scene::triangles entry
+        kPlanes,
+        kSpheres,
+        kBvhNodes,
+        kMeshes,
+        kObjects,
+        kObjectSources, // NUL-terminated Object::source strings, one per object
+        kInstances,
+        kTlasNodes,
+        kVertices, // Scene::vertices, load order
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t contentHash;
+    };
+
+    struct Section {
+        uint32_t id;
+        uint32_t elementSize; // guards against struct layout changes
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    // Object without the std::string, plus the mesh it resolved to.
+    struct ObjectRecord {
+        simd::float4x4 transform;
+        uint32_t firstTriangle, triCount, materialIndex, mesh;
+    };
+
+    // 64-bit hash over words; for change detection, not security.
+    class Hasher {
+    public:
+        void bytes(const void *data, size_t size) {
+            const auto *p = static_cast<const unsigned char *>(data);
+            for (; size >= 8; p += 8, size -= 8) {
+                uint64_t w;
+                std::memcpy(&w, p, 8);
+                mix(w);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, p, size);
+            mix(tail ^ static_cast<uint64_t>(size) << 56);
+        }
+
+        void u32(uint32_t v) { mix(v); }
+        void f(float v) { mix(std::bit_cast<uint32_t>(v)); }
+
+        void f3(const simd::float3 &v) {
+            f(v.x);
+            f(v.y);
+            f(v.z);
+        }
+
+        void mat(const simd::float4x4 &m) {
+            for (const auto &c: m.columns) {
+                for (int r = 0; r < 4; ++r) f(c[r]);
+            }
+        }
+
+        void str(const std::string &s) { bytes(s.data(), s.size()); }
+
+        uint64_t value() const {
+            // splitmix64 finaliser
+            uint64_t z = _h;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+    private:
+        void mix(uint64_t w) { _h = std::rotl(_h ^ w, 27) * 0x9e3779b97f4a7c15ull + 0x632be59bd9b4e019ull; }
+
+        uint64_t _h = 0x243f6a8885a308d3ull;
+    };
+
+    size_t alignUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+    template<typename T>
+    bool readSection(const MappedFile &file, const Section *sections, uint32_t sectionCount, uint32_t id,
+                     std::vector<T> &out) {
+        for (uint32_t i = 0; i < sectionCount; ++i) {
+            const Section &s = sections[i];
+            if (s.id != id) continue;
+            if (s.elementSize != sizeof(T) || s.offset > file.size() ||
+                s.count > (file.size() - s.offset) / sizeof(T)) {
+                return false;
+            }
+            out.resize(s.count);
+            if (s.count > 0) std::memcpy(out.data(), file.data() + s.offset, s.count * sizeof(T));
+            return true;
+        }
+        return false;
+    }
+}
+
+uint64_t SceneCache::contentHash(const Scene &scene, const std::vector<MeshSource> &sources) {
+    Hasher h;
+    h.u32(kVersion);
+    h.u32(sizeof(SceneVertex));
+    h.u32(sizeof(SceneTriangle));
+    h.u32(sizeof(BVHNode));
+    h.u32(sizeof(SceneInstance));
+    h.u32(static_cast<uint32_t>(scene.bvhMode));
+    if (scene.bvhMode == BvhBuildMode::Sbvh) {
+        const SbvhSettings &s = scene.sbvh;
+        h.u32(static_cast<uint32_t>(s.sah.binCount));
+        h.f(s.sah.traversalCost);
+        h.f(s.sah.intersectionCost);
+        h.u32(static_cast<uint32_t>(s.sah.maxLeafSize));
+        h.u32(static_cast<uint32_t>(s.spatialBinCount));
+        h.f(s.overlapThreshold);
+        h.f(s.duplicationBudget);
+    }
+    if (scene.bvhOptimize.enabled) {
+        const BvhOptimizeSettings &o = scene.bvhOptimize;
+        h.u32(static_cast<uint32_t>(o.treeletLeaves));
+        h.f(o.traversalCost);
+        h.f(o.intersectionCost);
+        h.f(o.minImprovement);
+        h.f(o.timeBudgetMs);
+        h.u32(static_cast<uint32_t>(o.maxPasses));
+    }
+
+    for (const Material &m: scene.materials) {
+        h.f3(m.albedo);
+        h.f3(m.emission);
+        h.f(m.reflectivity);
+        h.f(m.ior);
+    }
+    for (const ScenePlane &p: scene.planes) {
+        h.f3(p.normal);
+        h.f(p.d);
+        h.u32(p.matIndex);
+    }
+    for (const SceneSphere &s: scene.spheres) {
+        h.f3(s.center);
+        h.f(s.radius);
+        h.u32(s.matIndex);
+    }
+    // geometry placed before the meshes (e.g. the light panel)
+    for (const simd::float3 &v: vertices) h.f3(v);
+    for (const SceneTriangle &t: triangles) {
+        h.u32(t.v0);
+        h.u32(t.v1);
+        h.u32(t.v2);
+        h.u32(t.matIndex);
+    }
+    for (const Object &o: objects) {
+        h.u32(o.firstTriangle);
+        h.u32(o.triCount);
+        h.u32(o.materialIndex);
+        h.mat(o.transform);
+        h.str(o.source);
+    }
+    for (const MeshSource &src: sources) {
+        h.str(src.path);
+        h.u32(src.materialIndex);
+        h.mat(src.transform);
+        const MappedFile file(src.path);
+        if (file.valid()) {
+            h.bytes(file.data(), file.size());
+        } else {
+            h.u32(0xdeadbeef); // never matches a cache written while the file existed
+        }
+    }
+    return h.value();
+}
+
+bool SceneCache::save(const std::string &path, uint64_t hash, const Scene &scene) {
+    PROFILE_SCOPE("Scene cache save");
+    std::vector<ObjectRecord> records;
+    std::vector<char> sourceNames;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const Object &o = objects[i];
+        records.push_back({o.transform, o.firstTriangle, o.triCount, o.materialIndex, scene._objectMesh[i]});
+        sourceNames.insert(sourceNames.end(), o.source.begin(), o.source.end());
+        sourceNames.push_back('\0');
+    }
+
+    struct Blob {
+        uint32_t id, elementSize;
+        const void *data;
+        size_t count;
+    };
+    const auto blob = [](uint32_t id, const auto &v) {
+        return Blob{id, static_cast<uint32_t>(sizeof(v[0])), v.data(), v.size()};
+    };
+    const Blob blobs[] = {
+        blob(kMaterials, scene.materials),
+        blob(kTriangles, scene.triangles),
+        blob(kTriangleOrder, scene._slotTriangle),
+        blob(kPlanes, scene.planes),
+        blob(kSpheres, scene.spheres),
+        blob(kBvhNodes, scene.bvhNodes),
+        blob(kMeshes, scene.meshes),
+        blob(kObjects, records),
+        blob(kObjectSources, sourceNames),
+        blob(kInstances, scene.instances),
+        blob(kTlasNodes, scene.tlasNodes),
+        blob(kVertices, scene.vertices),
+    };
+    constexpr uint32_t sectionCount = std::size(blobs);
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.sectionCount = sectionCount;
+    header.contentHash = hash;
+
+    Section sections[sectionCount];
+    size_t offset = sizeof(Header) + sizeof(sections);
+    for (uint32_t i = 0; i < sectionCount; ++i) {
+        offset = alignUp(offset, kSectionAlignment);
+        sections[i] = {blobs[i].id, blobs[i].elementSize, offset, blobs[i].count};
+        offset += blobs[i].count * blobs[i].elementSize;
+    }
+
+    // write next to the target and rename, so a crash never leaves a torn cache
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to write scene cache: " << path << "\n";
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(sections), sizeof(sections));
+        for (uint32_t i = 0; i < sectionCount; ++i) {
+            const std::vector<char> padding(sections[i].offset - static_cast<size_t>(out.tellp()), 0);
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            out.write(static_cast<const char *>(blobs[i].data),
+                      static_cast<std::streamsize>(blobs[i].count * blobs[i].elementSize));
+        }
+        if (!out) {
+            std::cerr << "Failed to write scene cache: " << path << "\n";
+            return false;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write scene cache: " << path << "\n";
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::cout << "Wrote scene cache: " << path << " (" << offset / 1024 << " KiB)\n";
+    return true;
+}
+
+bool SceneCache::load(const std::string &path, uint64_t hash, Scene &scene) {
+    PROFILE_SCOPE("Scene cache load");
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    const MappedFile file(path);
+    if (!file.valid()) return false; // no cache yet
+
+    Header header{};
+    if (file.size() < sizeof(Header)) return false;
+    std::memcpy(&header, file.data(), sizeof(Header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+        std::cout << "Scene cache " << path << " has an unknown format, rebuilding\n";
+        return false;
+    }
+    if (header.contentHash != hash) {
+        std::cout << "Scene cache " << path << " is stale, rebuilding\n";
+        return false;
+    }
+    if (header.sectionCount > (file.size() - sizeof(Header)) / sizeof(Section)) {
+        std::cout << "Scene cache " << path << " is damaged, rebuilding\n";
+        return false;
+    }
+    std::vector<Section> sections(header.sectionCount);
+    std::memcpy(sections.data(), file.data() + sizeof(Header), sections.size() * sizeof(Section));
+
+    // read everything before touching the scene, so a bad file leaves it intact
+    Scene loaded;
+    std::vector<ObjectRecord> records;
+    std::vector<char> sourceNames;
+    const Section *s = sections.data();
+    const uint32_t n = header.sectionCount;
+    const bool ok = readSection(file, s, n, kMaterials, loaded.materials) &&
+                    readSection(file, s, n, kTriangles, loaded.triangles) &&
+                    readSection(file, s, n, kTriangleOrder, loaded._slotTriangle) &&
+                    readSection(file, s, n, kPlanes, loaded.planes) &&
+                    readSection(file, s, n, kSpheres, loaded.spheres) &&
+                    readSection(file, s, n, kBvhNodes, loaded.bvhNodes) &&
+                    readSection(file, s, n, kMeshes, loaded.meshes) &&
+                    readSection(file, s, n, kObjects, records) &&
+                    readSection(file, s, n, kObjectSources, sourceNames) &&
+                    readSection(file, s, n, kInstances, loaded.instances) &&
+                    readSection(file, s, n, kTlasNodes, loaded.tlasNodes) &&
+                    readSection(file, s, n, kVertices, loaded.vertices) &&
+                    loaded._slotTriangle.size() == loaded.triangles.size();
+    if (!ok) {
+        std::cout << "Scene cache " << path << " is damaged, rebuilding\n";
+        return false;
+    }
+
+    scene.materials = std::move(loaded.materials);
+    scene.vertices = std::move(loaded.vertices);
+    scene.triangles = std::move(loaded.triangles);
+    scene.planes = std::move(loaded.planes);
+    scene.spheres = std::move(loaded.spheres);
+    scene.bvhNodes = std::move(loaded.bvhNodes);
+    scene.meshes = std::move(loaded.meshes);
+    scene.instances = std::move(loaded.instances);
+    scene.tlasNodes = std::move(loaded.tlasNodes);
+    scene._slotTriangle = std::move(loaded._slotTriangle);
+
+    // the global load-order arrays, for later rebuilds and updates
+    objects.clear();
+    scene._objectMesh.clear();
+    const char *name = sourceNames.data();
+    const char *namesEnd = sourceNames.data() + sourceNames.size();
+    for (const ObjectRecord &r: records) {
+        Object obj;
+        obj.firstTriangle = r.firstTriangle;
+        obj.triCount = r.triCount;
+        obj.materialIndex = r.materialIndex;
+        obj.transform = r.transform;
+        if (name < namesEnd) {
+            obj.source = name;
+            name += obj.source.size() + 1;
+        }
+        objects.push_back(obj);
+        scene._objectMesh.push_back(r.mesh);
+    }
+    vertices.resize(scene.vertices.size());
+    for (size_t i = 0; i < scene.vertices.size(); ++i) vertices[i] = scene.vertices[i].position();
+    // every global triangle has at least one slot, duplicates just repeat it
+    triangles.resize(scene._slotTriangle.empty()
+                         ? 0
+                         : *std::max_element(scene._slotTriangle.begin(), scene._slotTriangle.end()) + 1);
+    for (size_t slot = 0; slot < scene.triangles.size(); ++slot) {
+        triangles[scene._slotTriangle[slot]] = scene.triangles[slot];
+    }
+    scene.buildUpdateTables();
+    scene.buildLights();
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded scene cache: " << path << " (" << scene.triangles.size() << " triangles, "
+            << scene.vertices.size() << " vertices, "
+            << scene.bvhNodes.size() << " BVH nodes) in "
+            << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+    return true;
+}
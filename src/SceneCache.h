@@ -0,0 +1,39 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+
+// Binary snapshot of a loaded scene: the vertices, the leaf-ordered triangles,
+// every BVH, the materials and the object table, so a later run maps the file and
+// copies the arrays instead of parsing OBJs and building BVHs.
+//
+// Layout: a header (magic, format version, content hash), a section table, then
+// one raw array per section, each aligned to kSectionAlignment so it could also be
+// wrapped as a no-copy GPU buffer. The content hash covers the source files, the
+// rest of the scene description and the build settings; any mismatch (or a
+// different struct layout) makes load() fail and the caller rebuild.
+class SceneCache {
+public:
+    static constexpr uint32_t kVersion = 3;
+    static constexpr size_t kSectionAlignment = 16384; // a page on every platform we run on
+
+    // Hash of everything the cached arrays are derived from: `sources` (including
+    // their file contents), what the scene and the global `objects`/`vertices`/
+    // `triangles` already hold, and the BVH settings.
+    static uint64_t contentHash(const Scene &scene, const std::vector<MeshSource> &sources);
+
+    // Replace the scene's meshes, BVHs and the global `objects`/`vertices`/`triangles`
+    // with the cache at `path`. False (scene untouched) if it is missing, stale or malformed.
+    static bool load(const std::string &path, uint64_t hash, Scene &scene);
+
+    static bool save(const std::string &path, uint64_t hash, const Scene &scene);
+};
+
+
+#endif //SCENECACHE_H
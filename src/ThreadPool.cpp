@@ -0,0 +1,137 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace {
+    // which pool (if any) the current thread works for, and its queue slot
+    thread_local const ThreadPool *tlsPool = nullptr;
+    thread_local unsigned tlsIndex = 0;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) threadCount = 1;
+    _queues.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    _workers.reserve(threadCount - 1);
+    for (unsigned i = 1; i < threadCount; ++i) {
+        _workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lg(_sleepMtx);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &t: _workers) t.join();
+}
+
+int ThreadPool::queueIndexForThisThread() const {
+    return tlsPool == this ? static_cast<int>(tlsIndex) : 0;
+}
+
+void ThreadPool::push(Task *task) {
+    Queue &q = *_queues[queueIndexForThisThread()];
+    {
+        std::lock_guard lg(q.mtx);
+        q.tasks.push_back(task);
+    }
+    _queued.fetch_add(1, std::memory_order_release);
+    {
+        // a worker may be between checking _queued and going to sleep
+        std::lock_guard lg(_sleepMtx);
+    }
+    _wake.notify_one();
+}
+
+ThreadPool::Task *ThreadPool::pop() {
+    const size_t self = static_cast<size_t>(queueIndexForThisThread());
+    const size_t n = _queues.size();
+
+    // own queue first, newest task (depth-first)
+    {
+        Queue &q = *_queues[self];
+        std::lock_guard lg(q.mtx);
+        if (!q.tasks.empty()) {
+            Task *t = q.tasks.back();
+            q.tasks.pop_back();
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            return t;
+        }
+    }
+
+    // then steal the oldest (largest) task from someone else
+    for (size_t k = 1; k < n; ++k) {
+        Queue &q = *_queues[(self + k) % n];
+        std::lock_guard lg(q.mtx);
+        if (!q.tasks.empty()) {
+            Task *t = q.tasks.front();
+            q.tasks.pop_front();
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::execute(Task *task) {
+    TaskGroup *group = task->group;
+    task->fn();
+    delete task;
+    // last touch of the group: the waiter may destroy it right after this
+    group->_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    tlsPool = this;
+    tlsIndex = index;
+    while (true) {
+        if (Task *t = pop()) {
+            execute(t);
+            continue;
+        }
+        std::unique_lock lk(_sleepMtx);
+        _wake.wait(lk, [this] { return _stop || _queued.load(std::memory_order_acquire) > 0; });
+        if (_stop && _queued.load(std::memory_order_acquire) == 0) return;
+    }
+}
+
+void ThreadPool::TaskGroup::run(std::function<void()> fn) {
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    _pool.push(new Task{std::move(fn), this});
+}
+
+void ThreadPool::TaskGroup::wait() {
+    while (_pending.load(std::memory_order_acquire) > 0) {
+        if (Task *t = _pool.pop()) {
+            _pool.execute(t);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    if (count == 0) return;
+    if (_workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto body = [&] {
+        for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+             i = next.fetch_add(1, std::memory_order_relaxed)) {
+            fn(i);
+        }
+    };
+
+    TaskGroup group(*this);
+    const size_t helpers = std::min<size_t>(size(), count) - 1;
+    for (size_t t = 0; t < helpers; ++t) group.run(body);
+    body();
+    group.wait();
+}
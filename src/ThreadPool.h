@@ -0,0 +1,89 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool. Every worker owns a deque: it pushes and pops its own tasks at
+// the back (depth-first, cache-warm) and steals from the front of the others' deques
+// when it runs dry. Threads outside the pool submit through a shared queue, and a
+// thread waiting on a TaskGroup keeps executing tasks instead of blocking, so nested
+// fork/join (e.g. recursive BVH builds) cannot deadlock.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of threads that execute work, including the caller.
+    unsigned size() const { return static_cast<unsigned>(_workers.size()) + 1; }
+
+    // A set of tasks that can be waited on together.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool &pool) : _pool(pool) {
+        }
+
+        ~TaskGroup() { wait(); }
+
+        void run(std::function<void()> fn);
+
+        // Help execute pending tasks until every task of this group has finished.
+        void wait();
+
+    private:
+        friend class ThreadPool;
+        ThreadPool &_pool;
+        std::atomic<int> _pending{0};
+    };
+
+    // Call fn(i) for every i in [0, count), handing out indices dynamically.
+    // Blocks until all indices have been processed.
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup *group;
+    };
+
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Task *> tasks;
+    };
+
+    void workerLoop(unsigned index);
+
+    void push(Task *task);
+
+    Task *pop();
+
+    void execute(Task *task);
+
+    int queueIndexForThisThread() const;
+
+    std::vector<std::thread> _workers;
+    // slot 0 is shared by threads outside the pool, slot i by worker i
+    std::vector<std::unique_ptr<Queue> > _queues;
+
+    std::mutex _sleepMtx;
+    std::condition_variable _wake;
+    std::atomic<int> _queued{0};
+    bool _stop = false;
+};
+
+
+#endif //THREADPOOL_H
@@ -0,0 +1,107 @@
+#include "TraversalStats.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+    struct Counter {
+        const char *name;
+        uint32_t RayStats::*field;
+        bool perPath; // divided by the pixel's path count
+    };
+
+    constexpr std::array<Counter, 7> kCounters = {
+        {
+            {"bounces", &RayStats::bounces, true},
+            {"nodes", &RayStats::nodes, true},
+            {"aabb_tests", &RayStats::aabbTests, true},
+            {"triangle_tests", &RayStats::triangleTests, true},
+            {"primitive_tests", &RayStats::primitiveTests, true},
+            {"stack_high_water", &RayStats::stackHighWater, false},
+            {"stack_overflows", &RayStats::stackOverflows, true},
+        }
+    };
+
+    float pixelValue(const RayStats &s, const Counter &c) {
+        const float v = static_cast<float>(s.*c.field);
+        return c.perPath ? v / static_cast<float>(std::max(s.paths, 1u)) : v;
+    }
+
+    // black -> blue -> red -> yellow -> white
+    void heatColour(float x, uint8_t *rgb) {
+        constexpr float stops[5][3] = {{0, 0, 0}, {0, 0, 1}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}};
+        const float s = std::clamp(x, 0.0f, 1.0f) * 4.0f;
+        const int i = std::min(static_cast<int>(s), 3);
+        const float f = s - static_cast<float>(i);
+        for (int c = 0; c < 3; ++c) {
+            rgb[c] = static_cast<uint8_t>(std::lround((stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f) * 255.0f));
+        }
+    }
+}
+
+bool writeTraversalHeatmaps(const std::string &prefix, const RayStats *pixels, uint32_t width, uint32_t height) {
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<float> values(count);
+    std::vector<uint8_t> rgb(count * 3);
+    for (const Counter &c: kCounters) {
+        for (size_t i = 0; i < count; ++i) values[i] = pixelValue(pixels[i], c);
+
+        std::vector<float> sorted = values;
+        const size_t p99 = count > 0 ? (count - 1) * 99 / 100 : 0;
+        std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(p99), sorted.end());
+        const float scale = count > 0 && sorted[p99] > 0.0f ? 1.0f / sorted[p99] : 0.0f;
+        for (size_t i = 0; i < count; ++i) heatColour(values[i] * scale, &rgb[i * 3]);
+
+        const std::string path = prefix + "." + c.name + ".ppm";
+        std::ofstream out(path, std::ios::binary);
+        out << "P6\n" << width << " " << height << "\n255\n";
+        out.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        if (!out) {
+            std::cerr << "Failed to write heatmap: " << path << "\n";
+            return false;
+        }
+    }
+    std::cout << "Wrote traversal heatmaps: " << prefix << ".*.ppm\n";
+    return true;
+}
+
+void printTraversalHistograms(const RayStats *pixels, size_t count, uint32_t stackCapacity) {
+    constexpr int kBuckets = 24; // [0,1), [1,2), [2,4) ... [2^22, inf)
+    uint64_t paths = 0;
+    for (size_t i = 0; i < count; ++i) paths += pixels[i].paths;
+    std::cout << "Traversal stats over " << count << " pixels, " << paths << " paths\n";
+
+    for (const Counter &c: kCounters) {
+        std::array<uint64_t, kBuckets> histogram{};
+        double sum = 0.0;
+        float maxValue = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            const float v = pixelValue(pixels[i], c);
+            sum += v;
+            maxValue = std::max(maxValue, v);
+            const int b = v < 1.0f ? 0 : static_cast<int>(std::bit_width(static_cast<uint32_t>(v)));
+            histogram[std::min(b, kBuckets - 1)]++;
+        }
+
+        std::cout << c.name << (c.perPath ? " per path" : " per pixel") << ": mean "
+                << (count > 0 ? sum / static_cast<double>(count) : 0.0) << ", max " << maxValue;
+        if (c.field == &RayStats::stackHighWater) std::cout << " of " << stackCapacity;
+        std::cout << "\n";
+
+        int first = 0, last = kBuckets - 1;
+        while (last > 0 && histogram[last] == 0) --last;
+        while (first < last && histogram[first] == 0) ++first;
+        for (int b = first; b <= last; ++b) {
+            const uint32_t lo = b == 0 ? 0 : 1u << (b - 1), hi = 1u << b;
+            const double share = count > 0 ? static_cast<double>(histogram[b]) / static_cast<double>(count) : 0.0;
+            char line[64];
+            std::snprintf(line, sizeof(line), "  [%7u, %7u) %6.2f%% ", lo, hi, share * 100.0);
+            std::cout << line << std::string(static_cast<size_t>(std::lround(share * 50.0)), '#') << "\n";
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef TRAVERSALSTATS_H
+#define TRAVERSALSTATS_H
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Traversal counters of one path, or summed over all paths of a pixel (the stack
+// high-water mark is the maximum instead). Layout matches shaders/types.metal.
+struct RayStats {
+    uint32_t paths; // 1 for a single path
+    uint32_t bounces; // rays traced along the path
+    uint32_t nodes; // TLAS and BLAS nodes popped
+    uint32_t aabbTests; // child boxes tested, W per wide node
+    uint32_t triangleTests; // triangle intersections, W per TriPacket
+    uint32_t primitiveTests; // brute-force plane and sphere tests
+    uint32_t stackHighWater; // deepest traversal stack
+    uint32_t stackOverflows; // subtrees skipped because the stack was full
+
+    void noteStack(int depth) { stackHighWater = std::max(stackHighWater, static_cast<uint32_t>(depth)); }
+
+    void add(const RayStats &s) {
+        paths += s.paths;
+        bounces += s.bounces;
+        nodes += s.nodes;
+        aabbTests += s.aabbTests;
+        triangleTests += s.triangleTests;
+        primitiveTests += s.primitiveTests;
+        stackHighWater = std::max(stackHighWater, s.stackHighWater);
+        stackOverflows += s.stackOverflows;
+    }
+};
+
+// The instrumentation is only compiled in with -DPATHTRACER_TRAVERSAL_STATS=ON;
+// otherwise TRAVERSAL_STAT expands to nothing and traversal is unchanged.
+#ifdef PATHTRACER_TRAVERSAL_STATS
+inline thread_local RayStats tRayStats{}; // the path being traced on this thread
+#define TRAVERSAL_STAT(statement) (tRayStats.statement)
+#else
+#define TRAVERSAL_STAT(statement) ((void) 0)
+#endif
+
+// One false-colour PPM per counter, `<prefix>.<counter>.ppm`, showing each pixel's
+// mean per path (high-water mark: its maximum). Black is zero, white the 99th
+// percentile of the image.
+bool writeTraversalHeatmaps(const std::string &prefix, const RayStats *pixels, uint32_t width, uint32_t height);
+
+// Log2 histogram of the per-pixel values of every counter, on stdout.
+// `stackCapacity` is the traversal stack size the high-water mark is measured against.
+void printTraversalHistograms(const RayStats *pixels, size_t count, uint32_t stackCapacity);
+
+
+#endif //TRAVERSALSTATS_H